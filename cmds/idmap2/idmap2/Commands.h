@@ -20,6 +20,9 @@
 #include <string>
 #include <vector>
 
+#include "androidfw/ApkAssets.h"
+#include "idmap2/Idmap.h"
+#include "idmap2/Policies.h"
 #include "idmap2/Result.h"
 
 android::idmap2::Result<android::idmap2::Unit> Create(const std::vector<std::string>& args);
@@ -28,4 +31,14 @@ android::idmap2::Result<android::idmap2::Unit> Lookup(const std::vector<std::str
 android::idmap2::Result<android::idmap2::Unit> Scan(const std::vector<std::string>& args);
 android::idmap2::Result<android::idmap2::Unit> Verify(const std::vector<std::string>& args);
 
+// Writes the idmap of overlay_apk_path against a target apk the caller has already loaded, so
+// that scan can load the target once for all of its overlays. target_index, if not null, must
+// have been built from target_apk. Safe to call from several threads with the same target_apk
+// and target_index. The caller is responsible for the umask of the idmap file.
+android::idmap2::Result<android::idmap2::Unit> CreateIdmapFile(
+    const std::string& target_apk_path, const android::ApkAssets& target_apk,
+    const android::idmap2::TargetResourceIndex* target_index, const std::string& overlay_apk_path,
+    const std::string& idmap_path,
+    android::idmap2::PolicyBitmask fulfilled_policies, bool enforce_overlayable);
+
 #endif  // IDMAP2_IDMAP2_COMMANDS_H_
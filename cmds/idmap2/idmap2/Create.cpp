@@ -24,6 +24,7 @@
 #include <string>
 #include <vector>
 
+#include "Commands.h"
 #include "idmap2/BinaryStreamVisitor.h"
 #include "idmap2/CommandLineOptions.h"
 #include "idmap2/FileUtils.h"
@@ -40,6 +41,7 @@ using android::idmap2::PoliciesToBitmask;
 using android::idmap2::PolicyBitmask;
 using android::idmap2::PolicyFlags;
 using android::idmap2::Result;
+using android::idmap2::TargetResourceIndex;
 using android::idmap2::Unit;
 using android::idmap2::utils::kIdmapFilePermissionMask;
 using android::idmap2::utils::UidHasWriteAccessToPath;
@@ -94,18 +96,31 @@ Result<Unit> Create(const std::vector<std::string>& args) {
     return Error("failed to load apk %s", target_apk_path.c_str());
   }
 
+  umask(kIdmapFilePermissionMask);
+  return CreateIdmapFile(target_apk_path, *target_apk, /* target_index */ nullptr,
+                         overlay_apk_path, idmap_path, fulfilled_policies, !ignore_overlayable);
+}
+
+Result<Unit> CreateIdmapFile(const std::string& target_apk_path, const ApkAssets& target_apk,
+                             const TargetResourceIndex* target_index,
+                             const std::string& overlay_apk_path, const std::string& idmap_path,
+                             PolicyBitmask fulfilled_policies, bool enforce_overlayable) {
+  SYSTRACE << "CreateIdmapFile " << overlay_apk_path;
   const std::unique_ptr<const ApkAssets> overlay_apk = ApkAssets::Load(overlay_apk_path);
   if (!overlay_apk) {
     return Error("failed to load apk %s", overlay_apk_path.c_str());
   }
 
-  const auto idmap = Idmap::FromApkAssets(target_apk_path, *target_apk, overlay_apk_path,
-                                          *overlay_apk, fulfilled_policies, !ignore_overlayable);
+  const auto idmap =
+      target_index != nullptr
+          ? Idmap::FromApkAssets(target_apk_path, target_apk, *target_index, overlay_apk_path,
+                                 *overlay_apk, fulfilled_policies, enforce_overlayable)
+          : Idmap::FromApkAssets(target_apk_path, target_apk, overlay_apk_path, *overlay_apk,
+                                 fulfilled_policies, enforce_overlayable);
   if (!idmap) {
     return Error(idmap.GetError(), "failed to create idmap");
   }
 
-  umask(kIdmapFilePermissionMask);
   std::ofstream fout(idmap_path);
   if (fout.fail()) {
     return Error("failed to open idmap path %s", idmap_path.c_str());
@@ -15,13 +15,21 @@
  */
 
 #include <dirent.h>
+#include <sys/stat.h>   // umask
+#include <sys/types.h>  // umask
+#include <unistd.h>     // getuid
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <set>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -30,28 +38,37 @@
 #include "idmap2/CommandLineOptions.h"
 #include "idmap2/FileUtils.h"
 #include "idmap2/Idmap.h"
+#include "idmap2/Policies.h"
 #include "idmap2/ResourceUtils.h"
 #include "idmap2/Result.h"
 #include "idmap2/SysTrace.h"
 #include "idmap2/Xml.h"
 #include "idmap2/ZipFile.h"
 
+using android::ApkAssets;
+using android::idmap2::ApkCrcCache;
 using android::idmap2::CommandLineOptions;
 using android::idmap2::Error;
 using android::idmap2::Idmap;
+using android::idmap2::IdmapView;
 using android::idmap2::kPolicyOdm;
 using android::idmap2::kPolicyOem;
 using android::idmap2::kPolicyProduct;
 using android::idmap2::kPolicyPublic;
 using android::idmap2::kPolicySystem;
 using android::idmap2::kPolicyVendor;
+using android::idmap2::PoliciesToBitmask;
 using android::idmap2::PolicyBitmask;
 using android::idmap2::PolicyFlags;
 using android::idmap2::Result;
+using android::idmap2::TargetResourceIndex;
 using android::idmap2::Unit;
 using android::idmap2::utils::ExtractOverlayManifestInfo;
 using android::idmap2::utils::FindFiles;
+using android::idmap2::utils::kApkCrcCacheFileName;
+using android::idmap2::utils::kIdmapFilePermissionMask;
 using android::idmap2::utils::OverlayManifestInfo;
+using android::idmap2::utils::UidHasWriteAccessToPath;
 
 namespace {
 
@@ -117,6 +134,48 @@ std::vector<std::string> PoliciesForPath(const std::string& apk_path) {
   return fulfilled_policies;
 }
 
+// Calls fn(i) for every i in [0, count), spread over as many threads as there are cores. fn
+// must be safe to call concurrently for different values of i.
+void ForEachInParallel(size_t count, const std::function<void(size_t)>& fn) {
+  const size_t thread_count =
+      std::min<size_t>(count, std::max(1U, std::thread::hardware_concurrency()));
+  std::atomic<size_t> next(0);
+  const auto worker = [&]() {
+    for (size_t i = next++; i < count; i = next++) {
+      fn(i);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < thread_count; i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+Result<Unit> CreateIdmap(const std::string& target_apk_path, const ApkAssets& target_apk,
+                         const TargetResourceIndex* target_index, const InputOverlay& overlay) {
+  const uid_t uid = getuid();
+  if (!UidHasWriteAccessToPath(uid, overlay.idmap_path)) {
+    return Error("uid %d does not have write access to %s", uid, overlay.idmap_path.c_str());
+  }
+
+  const auto policies = PoliciesToBitmask(overlay.policies);
+  if (!policies) {
+    return policies.GetError();
+  }
+  PolicyBitmask fulfilled_policies = *policies;
+  if (fulfilled_policies == 0) {
+    fulfilled_policies |= PolicyFlags::POLICY_PUBLIC;
+  }
+
+  return CreateIdmapFile(target_apk_path, target_apk, target_index, overlay.apk_path,
+                         overlay.idmap_path, fulfilled_policies, !overlay.ignore_overlayable);
+}
+
 }  // namespace
 
 Result<Unit> Scan(const std::vector<std::string>& args) {
@@ -154,10 +213,18 @@ Result<Unit> Scan(const std::vector<std::string>& args) {
     return Error(apk_paths.GetError(), "failed to find apk files");
   }
 
+  // Parsing the manifests is most of the work when there are many overlays and their idmaps
+  // are up to date, so read them all at once.
+  const std::vector<std::string>& paths = **apk_paths;
+  std::vector<std::optional<Result<OverlayManifestInfo>>> overlay_infos(paths.size());
+  ForEachInParallel(paths.size(), [&](size_t i) {
+    overlay_infos[i] = ExtractOverlayManifestInfo(paths[i], /* assert_overlay */ false);
+  });
+
   std::vector<InputOverlay> interesting_apks;
-  for (const std::string& path : **apk_paths) {
-    Result<OverlayManifestInfo> overlay_info =
-        ExtractOverlayManifestInfo(path, /* assert_overlay */ false);
+  for (size_t i = 0; i < paths.size(); i++) {
+    const std::string& path = paths[i];
+    const Result<OverlayManifestInfo>& overlay_info = *overlay_infos[i];
     if (!overlay_info) {
       return overlay_info.GetError();
     }
@@ -201,30 +268,65 @@ Result<Unit> Scan(const std::vector<std::string>& args) {
         std::lower_bound(interesting_apks.begin(), interesting_apks.end(), input), input);
   }
 
-  std::stringstream stream;
-  for (const auto& overlay : interesting_apks) {
-    if (!Verify(std::vector<std::string>({"--idmap-path", overlay.idmap_path}))) {
-      std::vector<std::string> create_args = {"--target-apk-path",  target_apk_path,
-                                              "--overlay-apk-path", overlay.apk_path,
-                                              "--idmap-path",       overlay.idmap_path};
-      if (overlay.ignore_overlayable) {
-        create_args.emplace_back("--ignore-overlayable");
-      }
+  // Only the overlays whose idmap is out of date need the target apk, which is then loaded once
+  // and shared by all of them.
+  // All overlays share the target, and most of them didn't change since the last scan, so keep
+  // their CRCs instead of reading the zips again.
+  ApkCrcCache crc_cache;
+  const std::string crc_cache_path = output_directory + "/" + kApkCrcCacheFileName;
+  crc_cache.Load(crc_cache_path, android::base::GetProperty("ro.build.fingerprint", ""));
 
-      for (const std::string& policy : overlay.policies) {
-        create_args.emplace_back("--policy");
-        create_args.emplace_back(policy);
-      }
+  std::vector<char> up_to_date(interesting_apks.size());
+  ForEachInParallel(interesting_apks.size(), [&](size_t i) {
+    const auto idmap = IdmapView::FromFile(interesting_apks[i].idmap_path);
+    up_to_date[i] = idmap && (*idmap)->IsUpToDate(&crc_cache);
+  });
+
+  std::vector<char> created(interesting_apks.size());
+  if (std::find(up_to_date.begin(), up_to_date.end(), false) != up_to_date.end()) {
+    const std::unique_ptr<const ApkAssets> target_apk = ApkAssets::Load(target_apk_path);
+    if (!target_apk) {
+      LOG(WARNING) << "failed to load target apk \"" << target_apk_path << "\"";
+    } else {
+      umask(kIdmapFilePermissionMask);
 
-      const auto create_ok = Create(create_args);
-      if (!create_ok) {
-        LOG(WARNING) << "failed to create idmap for overlay apk path \"" << overlay.apk_path
-                     << "\": " << create_ok.GetError().GetMessage();
-        continue;
+      // the index of the target is kept in the output directory with the idmaps, and reused by
+      // later scans until the target changes
+      const auto target_index = TargetResourceIndex::FromCache(
+          TargetResourceIndex::CanonicalIndexPathFor(output_directory, target_apk_path),
+          target_apk_path, *target_apk);
+      if (!target_index) {
+        LOG(WARNING) << "failed to index target apk \"" << target_apk_path
+                     << "\": " << target_index.GetErrorMessage();
       }
+
+      ForEachInParallel(interesting_apks.size(), [&](size_t i) {
+        if (up_to_date[i]) {
+          return;
+        }
+        const InputOverlay& overlay = interesting_apks[i];
+        const auto create_ok = CreateIdmap(target_apk_path, *target_apk,
+                                           target_index ? target_index->get() : nullptr, overlay);
+        if (!create_ok) {
+          LOG(WARNING) << "failed to create idmap for overlay apk path \"" << overlay.apk_path
+                       << "\": " << create_ok.GetError().GetMessage();
+          return;
+        }
+        created[i] = true;
+      });
     }
+  }
+
+  const auto save_ok = crc_cache.Save(crc_cache_path);
+  if (!save_ok) {
+    LOG(WARNING) << save_ok.GetErrorMessage();
+  }
 
-    stream << overlay.idmap_path << std::endl;
+  std::stringstream stream;
+  for (size_t i = 0; i < interesting_apks.size(); i++) {
+    if (up_to_date[i] || created[i]) {
+      stream << interesting_apks[i].idmap_path << std::endl;
+    }
   }
 
   std::cout << stream.str();
@@ -14,7 +14,6 @@
  * limitations under the License.
  */
 
-#include <fstream>
 #include <memory>
 #include <string>
 #include <vector>
@@ -26,7 +25,7 @@
 
 using android::idmap2::CommandLineOptions;
 using android::idmap2::Error;
-using android::idmap2::IdmapHeader;
+using android::idmap2::IdmapView;
 using android::idmap2::Result;
 using android::idmap2::Unit;
 
@@ -43,14 +42,12 @@ Result<Unit> Verify(const std::vector<std::string>& args) {
     return opts_ok.GetError();
   }
 
-  std::ifstream fin(idmap_path);
-  const std::unique_ptr<const IdmapHeader> header = IdmapHeader::FromBinaryStream(fin);
-  fin.close();
-  if (!header) {
-    return Error("failed to parse idmap header");
+  const auto idmap = IdmapView::FromFile(idmap_path);
+  if (!idmap) {
+    return Error(idmap.GetError(), "failed to parse idmap header");
   }
 
-  const auto header_ok = header->IsUpToDate();
+  const auto header_ok = (*idmap)->IsUpToDate();
   if (!header_ok) {
     return Error(header_ok.GetError(), "idmap not up to date");
   }
@@ -28,6 +28,7 @@
 #include <string>
 
 #include "android-base/macros.h"
+#include "android-base/properties.h"
 #include "android-base/stringprintf.h"
 #include "binder/IPCThreadState.h"
 #include "idmap2/BinaryStreamVisitor.h"
@@ -41,8 +42,11 @@ using android::IPCThreadState;
 using android::binder::Status;
 using android::idmap2::BinaryStreamVisitor;
 using android::idmap2::Idmap;
-using android::idmap2::IdmapHeader;
+using android::idmap2::IdmapView;
 using android::idmap2::PolicyBitmask;
+using android::idmap2::TargetResourceIndex;
+using android::idmap2::ApkCrcCache;
+using android::idmap2::utils::kApkCrcCacheFileName;
 using android::idmap2::utils::kIdmapCacheDir;
 using android::idmap2::utils::kIdmapFilePermissionMask;
 using android::idmap2::utils::UidHasWriteAccessToPath;
@@ -100,16 +104,29 @@ Status Idmap2Service::verifyIdmap(const std::string& overlay_apk_path,
   SYSTRACE << "Idmap2Service::verifyIdmap " << overlay_apk_path;
   assert(_aidl_return);
   const std::string idmap_path = Idmap::CanonicalIdmapPathFor(kIdmapCacheDir, overlay_apk_path);
-  std::ifstream fin(idmap_path);
-  const std::unique_ptr<const IdmapHeader> header = IdmapHeader::FromBinaryStream(fin);
-  fin.close();
-  *_aidl_return = header && header->IsUpToDate();
+  const auto idmap = IdmapView::FromFile(idmap_path);
+  *_aidl_return = idmap && (*idmap)->IsUpToDate(GetApkCrcCache());
+
+  const auto save_ok =
+      apk_crc_cache_.Save(base::StringPrintf("%s/%s", kIdmapCacheDir, kApkCrcCacheFileName));
+  if (!save_ok) {
+    LOG(WARNING) << save_ok.GetErrorMessage();
+  }
 
   // TODO(b/119328308): Check that the set of fulfilled policies of the overlay has not changed
 
   return ok();
 }
 
+ApkCrcCache* Idmap2Service::GetApkCrcCache() {
+  std::call_once(apk_crc_cache_loaded_, [this]() {
+    // a new build may come with new apks that have the same stat data as the old ones
+    apk_crc_cache_.Load(base::StringPrintf("%s/%s", kIdmapCacheDir, kApkCrcCacheFileName),
+                        base::GetProperty("ro.build.fingerprint", ""));
+  });
+  return &apk_crc_cache_;
+}
+
 Status Idmap2Service::createIdmap(const std::string& target_apk_path,
                                   const std::string& overlay_apk_path, int32_t fulfilled_policies,
                                   bool enforce_overlayable, int32_t user_id ATTRIBUTE_UNUSED,
@@ -137,13 +154,28 @@ Status Idmap2Service::createIdmap(const std::string& target_apk_path,
     return error("failed to load apk " + overlay_apk_path);
   }
 
-  const auto idmap = Idmap::FromApkAssets(target_apk_path, *target_apk, overlay_apk_path,
-                                          *overlay_apk, policy_bitmask, enforce_overlayable);
+  umask(kIdmapFilePermissionMask);
+
+  // Most overlays target the framework, so the index of the target is worth keeping: it makes
+  // creating each idmap depend on the size of the overlay rather than on the size of the target.
+  const auto target_index = TargetResourceIndex::FromCache(
+      TargetResourceIndex::CanonicalIndexPathFor(kIdmapCacheDir, target_apk_path),
+      target_apk_path, *target_apk);
+  if (!target_index) {
+    LOG(WARNING) << "failed to index target apk " << target_apk_path << ": "
+                 << target_index.GetErrorMessage();
+  }
+
+  const auto idmap =
+      target_index
+          ? Idmap::FromApkAssets(target_apk_path, *target_apk, **target_index, overlay_apk_path,
+                                 *overlay_apk, policy_bitmask, enforce_overlayable)
+          : Idmap::FromApkAssets(target_apk_path, *target_apk, overlay_apk_path, *overlay_apk,
+                                 policy_bitmask, enforce_overlayable);
   if (!idmap) {
     return error(idmap.GetErrorMessage());
   }
 
-  umask(kIdmapFilePermissionMask);
   std::ofstream fout(idmap_path);
   if (fout.fail()) {
     return error("failed to open idmap path " + idmap_path);
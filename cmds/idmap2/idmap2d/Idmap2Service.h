@@ -21,9 +21,11 @@
 #include <binder/BinderService.h>
 
 #include <memory>
+#include <mutex>
 #include <string>
 
 #include "android/os/BnIdmap2.h"
+#include "idmap2/Idmap.h"
 
 namespace android::os {
 
@@ -46,6 +48,13 @@ class Idmap2Service : public BinderService<Idmap2Service>, public BnIdmap2 {
                              const std::string& overlay_apk_path, int32_t fulfilled_policies,
                              bool enforce_overlayable, int32_t user_id,
                              std::unique_ptr<std::string>* _aidl_return);
+
+ private:
+  // CRCs of the targets and overlays of the idmaps, kept across boots
+  idmap2::ApkCrcCache* GetApkCrcCache();
+
+  std::once_flag apk_crc_cache_loaded_;
+  idmap2::ApkCrcCache apk_crc_cache_;
 };
 
 }  // namespace android::os
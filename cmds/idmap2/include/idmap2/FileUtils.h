@@ -27,6 +27,7 @@
 namespace android::idmap2::utils {
 
 constexpr const char* kIdmapCacheDir = "/data/resource-cache";
+constexpr const char* kApkCrcCacheFileName = "apk-crc-cache";  // in the idmap directory
 constexpr const mode_t kIdmapFilePermissionMask = 0133;  // u=rw,g=r,o=r
 
 typedef std::function<bool(unsigned char type /* DT_* from dirent.h */, const std::string& path)>
@@ -38,6 +39,11 @@ std::unique_ptr<std::string> ReadFile(int fd);
 
 std::unique_ptr<std::string> ReadFile(const std::string& path);
 
+// Writes content to a temporary file in the directory of path, then renames it to path, so that
+// readers of path never see a partially written file. The file is readable by everybody, like
+// the idmaps.
+bool WriteFileAtomically(const std::string& path, const std::string& content);
+
 bool UidHasWriteAccessToPath(uid_t uid, const std::string& path);
 
 }  // namespace android::idmap2::utils
@@ -38,6 +38,19 @@
  * version           := <uint32_t>
  *
  *
+ * # target resource index file format
+ *
+ * index             := index_magic index_version target_crc package_name resource_count resource*
+ * resource          := resid name
+ * index_magic       := <uint32_t>
+ * index_version     := <uint32_t>
+ * name              := name_length <uint8_t>[name_length]
+ * name_length       := <uint16_t>
+ * package_name      := name
+ * resid             := <uint32_t>
+ * resource_count    := <uint32_t>
+ *
+ *
  * # idmap file format changelog
  * ## v1
  * - Identical to idmap v1.
@@ -46,9 +59,12 @@
 #ifndef IDMAP2_INCLUDE_IDMAP2_IDMAP_H_
 #define IDMAP2_INCLUDE_IDMAP2_IDMAP_H_
 
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "android-base/macros.h"
@@ -82,6 +98,41 @@ static constexpr const uint32_t kIdmapCurrentVersion = android::kIdmapCurrentVer
 // terminating null)
 static constexpr const size_t kIdmapStringLength = 256;
 
+// The CRCs of apks, as stored in idmap headers, by apk path. An entry is only used while the
+// apk's stat data (device, inode, size, mtime and ctime) is unchanged, so that checking whether an
+// idmap is up to date doesn't have to open and read the target and overlay zips again. The cache
+// can be saved and loaded again, e.g. on the next boot; the generation it was saved with (e.g. the
+// build fingerprint) must then match, because read-only partitions may be replaced by files with
+// the same stat data. Safe to use from several threads.
+class ApkCrcCache {
+ public:
+  Result<uint32_t> GetCrc(const std::string& apk_path);
+
+  // Replaces the entries of the cache with those in file path, unless it was saved with a different
+  // generation. A missing or corrupt file leaves the cache empty.
+  void Load(const std::string& path, const std::string& generation);
+
+  // Writes the cache to file path, if anything changed since it was loaded or last saved.
+  Result<Unit> Save(const std::string& path);
+
+  size_t GetSize() const;
+
+ private:
+  struct Entry {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t size;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+    uint32_t crc;
+  };
+
+  mutable std::mutex lock_;
+  std::string generation_;
+  std::unordered_map<std::string, Entry> entries_;
+  bool dirty_ = false;
+};
+
 class IdmapHeader {
  public:
   static std::unique_ptr<const IdmapHeader> FromBinaryStream(std::istream& stream);
@@ -221,6 +272,91 @@ class IdmapData {
   DISALLOW_COPY_AND_ASSIGN(IdmapData);
 };
 
+// The ids of all resources in the target package, by "<type>/<entry>" name. Creating an idmap
+// looks up the name of every overlay resource in the target; with an index, that is a hash lookup
+// instead of a search of the target's string pools, and the target's AssetManager2 need not be
+// set up again for each overlay. Building the index walks the whole target package, so it only
+// pays off when many overlays target the same apk, as framework-res. It is then saved next to the
+// idmaps, and reused for as long as the CRC of the target stays the same.
+class TargetResourceIndex {
+ public:
+  static std::string CanonicalIndexPathFor(const std::string& absolute_dir,
+                                           const std::string& absolute_apk_path);
+
+  static Result<std::unique_ptr<const TargetResourceIndex>> FromBinaryStream(std::istream& stream);
+
+  static Result<std::unique_ptr<const TargetResourceIndex>> FromApkAssets(
+      const std::string& target_apk_path, const ApkAssets& target_apk_assets);
+
+  // Reads the index from index_path if it belongs to the target apk as it is now; otherwise
+  // builds it, and replaces index_path with it. Failing to write the index is not an error.
+  static Result<std::unique_ptr<const TargetResourceIndex>> FromCache(
+      const std::string& index_path, const std::string& target_apk_path,
+      const ApkAssets& target_apk_assets);
+
+  inline uint32_t GetTargetCrc() const {
+    return target_crc_;
+  }
+
+  inline const std::string& GetPackageName() const {
+    return package_name_;
+  }
+
+  inline size_t GetResourceCount() const {
+    return resids_.size();
+  }
+
+  // Returns 0 if the target package has no resource with the given "<type>/<entry>" name.
+  ResourceId FindResource(const std::string& type_entry_name) const;
+
+  Result<Unit> WriteBinaryStream(std::ostream& stream) const;
+
+ private:
+  TargetResourceIndex() {
+  }
+
+  uint32_t target_crc_;
+  std::string package_name_;
+  std::unordered_map<std::string, ResourceId> resids_;
+
+  DISALLOW_COPY_AND_ASSIGN(TargetResourceIndex);
+};
+
+// A read-only view of an idmap file that is mapped into memory instead of being read into
+// IdmapHeader and IdmapData objects. The whole file is validated in place when it is mapped, so
+// the getters don't need to check anything.
+class IdmapView {
+ public:
+  static Result<std::unique_ptr<const IdmapView>> FromFile(const std::string& idmap_path);
+
+  ~IdmapView();
+
+  uint32_t GetMagic() const;
+  uint32_t GetVersion() const;
+  uint32_t GetTargetCrc() const;
+  uint32_t GetOverlayCrc() const;
+  StringPiece GetTargetPath() const;
+  StringPiece GetOverlayPath() const;
+  PackageId GetTargetPackageId() const;
+  uint16_t GetTypeCount() const;
+
+  // Same as IdmapHeader::IsUpToDate. With a crc_cache, the target and overlay zips are only
+  // read if they changed since their CRCs were cached.
+  Result<Unit> IsUpToDate(ApkCrcCache* crc_cache = nullptr) const;
+
+ private:
+  IdmapView(const uint8_t* data, size_t size) : data_(data), size_(size) {
+  }
+
+  uint32_t Read32At(size_t offset) const;
+  uint16_t Read16At(size_t offset) const;
+
+  const uint8_t* data_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(IdmapView);
+};
+
 class Idmap {
  public:
   static std::string CanonicalIdmapPathFor(const std::string& absolute_dir,
@@ -239,6 +375,14 @@ class Idmap {
                                                             const PolicyBitmask& fulfilled_policies,
                                                             bool enforce_overlayable);
 
+  // Same as above, but looks up the overlay resources in an index of the target instead of in
+  // the target itself. target_index must have been built from target_apk_assets.
+  static Result<std::unique_ptr<const Idmap>> FromApkAssets(
+      const std::string& target_apk_path, const ApkAssets& target_apk_assets,
+      const TargetResourceIndex& target_index, const std::string& overlay_apk_path,
+      const ApkAssets& overlay_apk_assets, const PolicyBitmask& fulfilled_policies,
+      bool enforce_overlayable);
+
   inline const std::unique_ptr<const IdmapHeader>& GetHeader() const {
     return header_;
   }
@@ -253,6 +397,12 @@ class Idmap {
   Idmap() {
   }
 
+  static Result<std::unique_ptr<const Idmap>> FromApkAssets(
+      const std::string& target_apk_path, const ApkAssets& target_apk_assets,
+      uint32_t target_crc, const std::function<ResourceId(const std::string&)>& find_target_resid,
+      const std::string& overlay_apk_path, const ApkAssets& overlay_apk_assets,
+      const PolicyBitmask& fulfilled_policies, bool enforce_overlayable);
+
   std::unique_ptr<const IdmapHeader> header_;
   std::vector<std::unique_ptr<const IdmapData>> data_;
 
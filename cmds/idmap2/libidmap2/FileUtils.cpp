@@ -17,11 +17,13 @@
 #include "idmap2/FileUtils.h"
 
 #include <dirent.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <cerrno>
 #include <climits>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
@@ -85,6 +87,20 @@ std::unique_ptr<std::string> ReadFile(int fd) {
   return r == 0 ? std::move(str) : nullptr;
 }
 
+bool WriteFileAtomically(const std::string& path, const std::string& content) {
+  std::string temp_path = path + ".XXXXXX";
+  const int fd = mkstemp(temp_path.data());
+  if (fd == -1) {
+    return false;
+  }
+  const bool written = fchmod(fd, 0644) == 0 && base::WriteStringToFd(content, fd);
+  if (close(fd) != 0 || !written || rename(temp_path.c_str(), path.c_str()) != 0) {
+    unlink(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
 #ifdef __ANDROID__
 bool UidHasWriteAccessToPath(uid_t uid, const std::string& path) {
   // resolve symlinks and relative paths; the directories must exist
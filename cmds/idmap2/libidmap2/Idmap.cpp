@@ -16,13 +16,23 @@
 
 #include "idmap2/Idmap.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <iterator>
 #include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
@@ -30,6 +40,7 @@
 #include "android-base/macros.h"
 #include "android-base/stringprintf.h"
 #include "androidfw/AssetManager2.h"
+#include "idmap2/FileUtils.h"
 #include "idmap2/ResourceUtils.h"
 #include "idmap2/Result.h"
 #include "idmap2/SysTrace.h"
@@ -83,6 +94,35 @@ bool WARN_UNUSED Read32(std::istream& stream, uint32_t* out) {
   return false;
 }
 
+void Write16(std::ostream& stream, uint16_t value) {
+  uint16_t x = htodl(value);
+  stream.write(reinterpret_cast<char*>(&x), sizeof(uint16_t));
+}
+
+void Write32(std::ostream& stream, uint32_t value) {
+  uint32_t x = htodl(value);
+  stream.write(reinterpret_cast<char*>(&x), sizeof(uint32_t));
+}
+
+// a name in the target resource index is encoded as its uint16_t length followed by its chars
+bool WARN_UNUSED ReadName(std::istream& stream, std::string* out) {
+  uint16_t length;
+  if (!Read16(stream, &length)) {
+    return false;
+  }
+  out->resize(length);
+  return static_cast<bool>(stream.read(out->data(), length));
+}
+
+bool WARN_UNUSED WriteName(std::ostream& stream, const std::string& name) {
+  if (name.size() > std::numeric_limits<uint16_t>::max()) {
+    return false;
+  }
+  Write16(stream, name.size());
+  stream.write(name.data(), name.size());
+  return true;
+}
+
 // a string is encoded as a kIdmapStringLength char array; the array is always null-terminated
 bool WARN_UNUSED ReadString(std::istream& stream, char out[kIdmapStringLength]) {
   char buf[kIdmapStringLength];
@@ -127,63 +167,116 @@ Result<uint32_t> GetCrc(const ZipFile& zip) {
              : Error("failed to get CRC for \"%s\"", a ? "AndroidManifest.xml" : "resources.arsc");
 }
 
-}  // namespace
-
-std::unique_ptr<const IdmapHeader> IdmapHeader::FromBinaryStream(std::istream& stream) {
-  std::unique_ptr<IdmapHeader> idmap_header(new IdmapHeader());
+Result<uint32_t> GetTargetCrc(const std::string& target_apk_path) {
+  const std::unique_ptr<const ZipFile> target_zip = ZipFile::Open(target_apk_path);
+  if (!target_zip) {
+    return Error("failed to open target as zip");
+  }
 
-  if (!Read32(stream, &idmap_header->magic_) || !Read32(stream, &idmap_header->version_) ||
-      !Read32(stream, &idmap_header->target_crc_) || !Read32(stream, &idmap_header->overlay_crc_) ||
-      !ReadString(stream, idmap_header->target_path_) ||
-      !ReadString(stream, idmap_header->overlay_path_)) {
-    return nullptr;
+  const Result<uint32_t> crc = GetCrc(*target_zip);
+  if (!crc) {
+    return Error(crc.GetError(), "failed to get zip CRC for target");
   }
+  return crc;
+}
 
-  return std::move(idmap_header);
+std::string CanonicalPathFor(const std::string& absolute_dir, const std::string& absolute_apk_path,
+                             const std::string& suffix) {
+  assert(absolute_dir.size() > 0 && absolute_dir[0] == "/");
+  assert(absolute_apk_path.size() > 0 && absolute_apk_path[0] == "/");
+  std::string copy(++absolute_apk_path.cbegin(), absolute_apk_path.cend());
+  replace(copy.begin(), copy.end(), '/', '@');
+  return absolute_dir + "/" + copy + suffix;
 }
 
-Result<Unit> IdmapHeader::IsUpToDate() const {
-  if (magic_ != kIdmapMagic) {
-    return Error("bad magic: actual 0x%08x, expected 0x%08x", magic_, kIdmapMagic);
+// "INDX"
+constexpr const uint32_t kTargetResourceIndexMagic = 0x58444e49;
+
+// must be incremented when the format of the target resource index is changed
+constexpr const uint32_t kTargetResourceIndexVersion = 0x01;
+
+// magic, version, target crc, overlay crc, target path, overlay path
+constexpr const size_t kIdmapHeaderSize = 4 * sizeof(uint32_t) + 2 * kIdmapStringLength;
+
+// target package id, type count
+constexpr const size_t kIdmapDataHeaderSize = 2 * sizeof(uint16_t);
+
+// target type, overlay type, entry count, entry offset
+constexpr const size_t kIdmapTypeEntryHeaderSize = 4 * sizeof(uint16_t);
+
+Result<uint32_t> GetApkCrc(const std::string& apk_path, ApkCrcCache* crc_cache) {
+  if (crc_cache != nullptr) {
+    return crc_cache->GetCrc(apk_path);
   }
 
-  if (version_ != kIdmapCurrentVersion) {
-    return Error("bad version: actual 0x%08x, expected 0x%08x", version_, kIdmapCurrentVersion);
+  const std::unique_ptr<const ZipFile> zip = ZipFile::Open(apk_path);
+  if (!zip) {
+    return Error("failed to open %s", apk_path.c_str());
   }
+  return GetCrc(*zip);
+}
 
-  const std::unique_ptr<const ZipFile> target_zip = ZipFile::Open(target_path_);
-  if (!target_zip) {
-    return Error("failed to open target %s", GetTargetPath().to_string().c_str());
+Result<Unit> IsUpToDate(uint32_t magic, uint32_t version, uint32_t target_crc,
+                        const std::string& target_path, uint32_t overlay_crc,
+                        const std::string& overlay_path, ApkCrcCache* crc_cache) {
+  if (magic != kIdmapMagic) {
+    return Error("bad magic: actual 0x%08x, expected 0x%08x", magic, kIdmapMagic);
   }
 
-  Result<uint32_t> target_crc = GetCrc(*target_zip);
-  if (!target_crc) {
-    return Error("failed to get target crc");
+  if (version != kIdmapCurrentVersion) {
+    return Error("bad version: actual 0x%08x, expected 0x%08x", version, kIdmapCurrentVersion);
   }
 
-  if (target_crc_ != *target_crc) {
-    return Error("bad target crc: idmap version 0x%08x, file system version 0x%08x", target_crc_,
-                 *target_crc);
+  const Result<uint32_t> actual_target_crc = GetApkCrc(target_path, crc_cache);
+  if (!actual_target_crc) {
+    return Error(actual_target_crc.GetError(), "failed to get target crc");
   }
 
-  const std::unique_ptr<const ZipFile> overlay_zip = ZipFile::Open(overlay_path_);
-  if (!overlay_zip) {
-    return Error("failed to open overlay %s", GetOverlayPath().to_string().c_str());
+  if (target_crc != *actual_target_crc) {
+    return Error("bad target crc: idmap version 0x%08x, file system version 0x%08x", target_crc,
+                 *actual_target_crc);
   }
 
-  Result<uint32_t> overlay_crc = GetCrc(*overlay_zip);
-  if (!overlay_crc) {
-    return Error("failed to get overlay crc");
+  const Result<uint32_t> actual_overlay_crc = GetApkCrc(overlay_path, crc_cache);
+  if (!actual_overlay_crc) {
+    return Error(actual_overlay_crc.GetError(), "failed to get overlay crc");
   }
 
-  if (overlay_crc_ != *overlay_crc) {
-    return Error("bad overlay crc: idmap version 0x%08x, file system version 0x%08x", overlay_crc_,
-                 *overlay_crc);
+  if (overlay_crc != *actual_overlay_crc) {
+    return Error("bad overlay crc: idmap version 0x%08x, file system version 0x%08x", overlay_crc,
+                 *actual_overlay_crc);
   }
 
   return Unit{};
 }
 
+int64_t ToNs(const struct timespec& time) {
+  return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+// first line of a saved ApkCrcCache; must be changed when the format is changed
+constexpr const char* kApkCrcCacheHeader = "apk crc cache v1";
+
+}  // namespace
+
+std::unique_ptr<const IdmapHeader> IdmapHeader::FromBinaryStream(std::istream& stream) {
+  std::unique_ptr<IdmapHeader> idmap_header(new IdmapHeader());
+
+  if (!Read32(stream, &idmap_header->magic_) || !Read32(stream, &idmap_header->version_) ||
+      !Read32(stream, &idmap_header->target_crc_) || !Read32(stream, &idmap_header->overlay_crc_) ||
+      !ReadString(stream, idmap_header->target_path_) ||
+      !ReadString(stream, idmap_header->overlay_path_)) {
+    return nullptr;
+  }
+
+  return std::move(idmap_header);
+}
+
+Result<Unit> IdmapHeader::IsUpToDate() const {
+  return idmap2::IsUpToDate(magic_, version_, target_crc_, target_path_, overlay_crc_,
+                            overlay_path_, nullptr);
+}
+
 std::unique_ptr<const IdmapData::Header> IdmapData::Header::FromBinaryStream(std::istream& stream) {
   std::unique_ptr<IdmapData::Header> idmap_data_header(new IdmapData::Header());
 
@@ -237,11 +330,7 @@ std::unique_ptr<const IdmapData> IdmapData::FromBinaryStream(std::istream& strea
 
 std::string Idmap::CanonicalIdmapPathFor(const std::string& absolute_dir,
                                          const std::string& absolute_apk_path) {
-  assert(absolute_dir.size() > 0 && absolute_dir[0] == "/");
-  assert(absolute_apk_path.size() > 0 && absolute_apk_path[0] == "/");
-  std::string copy(++absolute_apk_path.cbegin(), absolute_apk_path.cend());
-  replace(copy.begin(), copy.end(), '/', '@');
-  return absolute_dir + "/" + copy + "@idmap";
+  return CanonicalPathFor(absolute_dir, absolute_apk_path, "@idmap");
 }
 
 Result<std::unique_ptr<const Idmap>> Idmap::FromBinaryStream(std::istream& stream) {
@@ -319,6 +408,359 @@ Result<Unit> CheckOverlayable(const LoadedPackage& target_package,
   return Result<Unit>({});
 }
 
+Result<uint32_t> ApkCrcCache::GetCrc(const std::string& apk_path) {
+  struct stat st;
+  if (stat(apk_path.c_str(), &st) != 0) {
+    return Error("failed to stat %s: %s", apk_path.c_str(), strerror(errno));
+  }
+  Entry entry{static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino), st.st_size,
+              ToNs(st.st_mtim), ToNs(st.st_ctim), 0};
+
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    const auto iter = entries_.find(apk_path);
+    if (iter != entries_.end() && iter->second.dev == entry.dev &&
+        iter->second.ino == entry.ino && iter->second.size == entry.size &&
+        iter->second.mtime_ns == entry.mtime_ns && iter->second.ctime_ns == entry.ctime_ns) {
+      return iter->second.crc;
+    }
+  }
+
+  // the apk is read after it was stat'ed, so if it changes in between, its new CRC is cached
+  // with its old stat data, and is computed again the next time
+  const std::unique_ptr<const ZipFile> zip = ZipFile::Open(apk_path);
+  if (!zip) {
+    return Error("failed to open %s", apk_path.c_str());
+  }
+  const Result<uint32_t> crc = idmap2::GetCrc(*zip);
+  if (!crc) {
+    return crc;
+  }
+  entry.crc = *crc;
+
+  std::lock_guard<std::mutex> lock(lock_);
+  entries_[apk_path] = entry;
+  dirty_ = true;
+  return crc;
+}
+
+void ApkCrcCache::Load(const std::string& path, const std::string& generation) {
+  SYSTRACE << "ApkCrcCache::Load " << path;
+  std::unordered_map<std::string, Entry> entries;
+  std::ifstream fin(path);
+  std::string line;
+  if (std::getline(fin, line) && line == kApkCrcCacheHeader && std::getline(fin, line) &&
+      line == generation) {
+    while (std::getline(fin, line)) {
+      std::istringstream fields(line);
+      Entry entry;
+      std::string apk_path;
+      if (!(fields >> entry.crc >> entry.dev >> entry.ino >> entry.size >> entry.mtime_ns >>
+            entry.ctime_ns) ||
+          !std::getline(fields >> std::ws, apk_path) || apk_path.empty()) {
+        LOG(WARNING) << "ignoring corrupt apk crc cache " << path;
+        entries.clear();
+        break;
+      }
+      entries[apk_path] = entry;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(lock_);
+  generation_ = generation;
+  entries_ = std::move(entries);
+  dirty_ = false;
+}
+
+Result<Unit> ApkCrcCache::Save(const std::string& path) {
+  SYSTRACE << "ApkCrcCache::Save " << path;
+  std::stringstream stream;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!dirty_) {
+      return Unit{};
+    }
+    stream << kApkCrcCacheHeader << std::endl << generation_ << std::endl;
+    for (const auto& [apk_path, entry] : entries_) {
+      stream << entry.crc << " " << entry.dev << " " << entry.ino << " " << entry.size << " "
+             << entry.mtime_ns << " " << entry.ctime_ns << " " << apk_path << std::endl;
+    }
+    dirty_ = false;
+  }
+
+  if (!utils::WriteFileAtomically(path, stream.str())) {
+    std::lock_guard<std::mutex> lock(lock_);
+    dirty_ = true;
+    return Error("failed to write apk crc cache %s", path.c_str());
+  }
+  return Unit{};
+}
+
+size_t ApkCrcCache::GetSize() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return entries_.size();
+}
+
+Result<std::unique_ptr<const IdmapView>> IdmapView::FromFile(const std::string& idmap_path) {
+  SYSTRACE << "IdmapView::FromFile " << idmap_path;
+  const int fd = open(idmap_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return Error("failed to open %s: %s", idmap_path.c_str(), strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return Error("failed to stat %s: %s", idmap_path.c_str(), strerror(errno));
+  }
+  const size_t size = st.st_size;
+  if (size < kIdmapHeaderSize + kIdmapDataHeaderSize) {
+    close(fd);
+    return Error("idmap %s too small: %zu bytes", idmap_path.c_str(), size);
+  }
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return Error("failed to map %s: %s", idmap_path.c_str(), strerror(errno));
+  }
+
+  // the view unmaps the file, whether it turns out to be valid or not
+  std::unique_ptr<IdmapView> view(new IdmapView(static_cast<const uint8_t*>(data), size));
+
+  // the strings in the header must be null-terminated
+  const size_t target_path_offset = 4 * sizeof(uint32_t);
+  const size_t overlay_path_offset = target_path_offset + kIdmapStringLength;
+  if (view->data_[target_path_offset + kIdmapStringLength - 1] != '\0' ||
+      view->data_[overlay_path_offset + kIdmapStringLength - 1] != '\0') {
+    return Error("failed to parse idmap header");
+  }
+
+  // idmap version 0x01 does not specify the number of data blocks that follow the idmap header;
+  // as in Idmap::FromBinaryStream, assume exactly one data block
+  size_t offset = kIdmapHeaderSize + kIdmapDataHeaderSize;
+  for (uint16_t i = 0; i < view->GetTypeCount(); i++) {
+    if (size - offset < kIdmapTypeEntryHeaderSize) {
+      return Error("failed to parse data block 0");
+    }
+    const size_t entries_size = view->Read16At(offset + 2 * sizeof(uint16_t)) * sizeof(uint32_t);
+    offset += kIdmapTypeEntryHeaderSize;
+    if (size - offset < entries_size) {
+      return Error("failed to parse data block 0");
+    }
+    offset += entries_size;
+  }
+
+  return {std::move(view)};
+}
+
+IdmapView::~IdmapView() {
+  munmap(const_cast<uint8_t*>(data_), size_);
+}
+
+uint32_t IdmapView::Read32At(size_t offset) const {
+  uint32_t value;
+  memcpy(&value, data_ + offset, sizeof(value));
+  return dtohl(value);
+}
+
+uint16_t IdmapView::Read16At(size_t offset) const {
+  uint16_t value;
+  memcpy(&value, data_ + offset, sizeof(value));
+  return dtohs(value);
+}
+
+uint32_t IdmapView::GetMagic() const {
+  return Read32At(0);
+}
+
+uint32_t IdmapView::GetVersion() const {
+  return Read32At(sizeof(uint32_t));
+}
+
+uint32_t IdmapView::GetTargetCrc() const {
+  return Read32At(2 * sizeof(uint32_t));
+}
+
+uint32_t IdmapView::GetOverlayCrc() const {
+  return Read32At(3 * sizeof(uint32_t));
+}
+
+StringPiece IdmapView::GetTargetPath() const {
+  return StringPiece(reinterpret_cast<const char*>(data_ + 4 * sizeof(uint32_t)));
+}
+
+StringPiece IdmapView::GetOverlayPath() const {
+  return StringPiece(
+      reinterpret_cast<const char*>(data_ + 4 * sizeof(uint32_t) + kIdmapStringLength));
+}
+
+PackageId IdmapView::GetTargetPackageId() const {
+  return Read16At(kIdmapHeaderSize);
+}
+
+uint16_t IdmapView::GetTypeCount() const {
+  return Read16At(kIdmapHeaderSize + sizeof(uint16_t));
+}
+
+Result<Unit> IdmapView::IsUpToDate(ApkCrcCache* crc_cache) const {
+  return idmap2::IsUpToDate(GetMagic(), GetVersion(), GetTargetCrc(),
+                            GetTargetPath().to_string(), GetOverlayCrc(),
+                            GetOverlayPath().to_string(), crc_cache);
+}
+
+std::string TargetResourceIndex::CanonicalIndexPathFor(const std::string& absolute_dir,
+                                                       const std::string& absolute_apk_path) {
+  return CanonicalPathFor(absolute_dir, absolute_apk_path, "@index");
+}
+
+Result<std::unique_ptr<const TargetResourceIndex>> TargetResourceIndex::FromBinaryStream(
+    std::istream& stream) {
+  SYSTRACE << "TargetResourceIndex::FromBinaryStream";
+  std::unique_ptr<TargetResourceIndex> index(new TargetResourceIndex());
+
+  uint32_t magic;
+  uint32_t version;
+  if (!Read32(stream, &magic) || !Read32(stream, &version)) {
+    return Error("failed to read target resource index header");
+  }
+  if (magic != kTargetResourceIndexMagic) {
+    return Error("bad magic: actual 0x%08x, expected 0x%08x", magic, kTargetResourceIndexMagic);
+  }
+  if (version != kTargetResourceIndexVersion) {
+    return Error("bad version: actual 0x%08x, expected 0x%08x", version,
+                 kTargetResourceIndexVersion);
+  }
+
+  uint32_t resource_count;
+  if (!Read32(stream, &index->target_crc_) || !ReadName(stream, &index->package_name_) ||
+      !Read32(stream, &resource_count)) {
+    return Error("failed to read target resource index header");
+  }
+
+  std::string name;
+  for (uint32_t i = 0; i < resource_count; i++) {
+    ResourceId resid;
+    if (!Read32(stream, &resid) || !ReadName(stream, &name)) {
+      return Error("failed to read target resource index entry %u", i);
+    }
+    index->resids_.emplace(name, resid);
+  }
+
+  return {std::move(index)};
+}
+
+Result<std::unique_ptr<const TargetResourceIndex>> TargetResourceIndex::FromApkAssets(
+    const std::string& target_apk_path, const ApkAssets& target_apk_assets) {
+  SYSTRACE << "TargetResourceIndex::FromApkAssets";
+  AssetManager2 target_asset_manager;
+  if (!target_asset_manager.SetApkAssets({&target_apk_assets}, true, false)) {
+    return Error("failed to create target asset manager");
+  }
+
+  const LoadedArsc* target_arsc = target_apk_assets.GetLoadedArsc();
+  if (target_arsc == nullptr) {
+    return Error("failed to load target resources.arsc");
+  }
+
+  const LoadedPackage* target_pkg = GetPackageAtIndex0(*target_arsc);
+  if (target_pkg == nullptr) {
+    return Error("failed to load target package from resources.arsc");
+  }
+
+  const Result<uint32_t> crc = GetTargetCrc(target_apk_path);
+  if (!crc) {
+    return crc.GetError();
+  }
+
+  std::unique_ptr<TargetResourceIndex> index(new TargetResourceIndex());
+  index->target_crc_ = *crc;
+  index->package_name_ = target_pkg->GetPackageName();
+  const auto end = target_pkg->end();
+  for (auto iter = target_pkg->begin(); iter != end; ++iter) {
+    const ResourceId resid = *iter;
+    Result<std::string> name = utils::ResToTypeEntryName(target_asset_manager, resid);
+    if (!name) {
+      continue;
+    }
+    // as in AssetManager2::GetResourceId, the resource with the lowest id wins if several share
+    // a name
+    index->resids_.emplace(std::move(*name), resid);
+  }
+
+  return {std::move(index)};
+}
+
+Result<std::unique_ptr<const TargetResourceIndex>> TargetResourceIndex::FromCache(
+    const std::string& index_path, const std::string& target_apk_path,
+    const ApkAssets& target_apk_assets) {
+  SYSTRACE << "TargetResourceIndex::FromCache " << index_path;
+  const Result<uint32_t> crc = GetTargetCrc(target_apk_path);
+  if (!crc) {
+    return crc.GetError();
+  }
+
+  std::ifstream fin(index_path);
+  if (fin.good()) {
+    auto cached_index = FromBinaryStream(fin);
+    if (cached_index && (*cached_index)->GetTargetCrc() == *crc) {
+      return cached_index;
+    }
+  }
+  fin.close();
+
+  auto index = FromApkAssets(target_apk_path, target_apk_assets);
+  if (!index) {
+    return index;
+  }
+
+  std::stringstream stream;
+  if (!(*index)->WriteBinaryStream(stream) ||
+      !utils::WriteFileAtomically(index_path, stream.str())) {
+    LOG(WARNING) << "failed to write target resource index " << index_path;
+  }
+
+  return index;
+}
+
+ResourceId TargetResourceIndex::FindResource(const std::string& type_entry_name) const {
+  auto iter = resids_.find(type_entry_name);
+  if (iter != resids_.end()) {
+    return iter->second;
+  }
+
+  // like AssetManager2::GetResourceId, also look for private attributes, which libraries such as
+  // the framework sometimes encode under the type '^attr-private'
+  static constexpr const char kAttrType[] = "attr/";
+  static constexpr size_t kAttrTypeLength = sizeof(kAttrType) - 1;
+  if (type_entry_name.compare(0, kAttrTypeLength, kAttrType) == 0) {
+    iter = resids_.find("^attr-private/" + type_entry_name.substr(kAttrTypeLength));
+    if (iter != resids_.end()) {
+      return iter->second;
+    }
+  }
+
+  return 0;
+}
+
+Result<Unit> TargetResourceIndex::WriteBinaryStream(std::ostream& stream) const {
+  Write32(stream, kTargetResourceIndexMagic);
+  Write32(stream, kTargetResourceIndexVersion);
+  Write32(stream, target_crc_);
+  if (!WriteName(stream, package_name_)) {
+    return Error("package name \"%s\" too long", package_name_.c_str());
+  }
+  Write32(stream, resids_.size());
+  for (const auto& [name, resid] : resids_) {
+    Write32(stream, resid);
+    if (!WriteName(stream, name)) {
+      return Error("resource name \"%s\" too long", name.c_str());
+    }
+  }
+  if (stream.fail()) {
+    return Error("failed to write target resource index");
+  }
+  return Unit{};
+}
+
 Result<std::unique_ptr<const Idmap>> Idmap::FromApkAssets(const std::string& target_apk_path,
                                                           const ApkAssets& target_apk_assets,
                                                           const std::string& overlay_apk_path,
@@ -331,6 +773,51 @@ Result<std::unique_ptr<const Idmap>> Idmap::FromApkAssets(const std::string& tar
     return Error("failed to create target asset manager");
   }
 
+  const LoadedArsc* target_arsc = target_apk_assets.GetLoadedArsc();
+  if (target_arsc == nullptr) {
+    return Error("failed to load target resources.arsc");
+  }
+
+  const LoadedPackage* target_pkg = GetPackageAtIndex0(*target_arsc);
+  if (target_pkg == nullptr) {
+    return Error("failed to load target package from resources.arsc");
+  }
+
+  const Result<uint32_t> crc = GetTargetCrc(target_apk_path);
+  if (!crc) {
+    return crc.GetError();
+  }
+
+  const auto find_target_resid = [&](const std::string& name) -> ResourceId {
+    // prepend "<package>:" to turn name into "<package>:<type>/<name>"
+    const std::string full_name =
+        base::StringPrintf("%s:%s", target_pkg->GetPackageName().c_str(), name.c_str());
+    return NameToResid(target_asset_manager, full_name);
+  };
+  return FromApkAssets(target_apk_path, target_apk_assets, *crc, find_target_resid,
+                       overlay_apk_path, overlay_apk_assets, fulfilled_policies,
+                       enforce_overlayable);
+}
+
+Result<std::unique_ptr<const Idmap>> Idmap::FromApkAssets(
+    const std::string& target_apk_path, const ApkAssets& target_apk_assets,
+    const TargetResourceIndex& target_index, const std::string& overlay_apk_path,
+    const ApkAssets& overlay_apk_assets, const PolicyBitmask& fulfilled_policies,
+    bool enforce_overlayable) {
+  SYSTRACE << "Idmap::FromApkAssets with index";
+  const auto find_target_resid = [&](const std::string& name) -> ResourceId {
+    return target_index.FindResource(name);
+  };
+  return FromApkAssets(target_apk_path, target_apk_assets, target_index.GetTargetCrc(),
+                       find_target_resid, overlay_apk_path, overlay_apk_assets,
+                       fulfilled_policies, enforce_overlayable);
+}
+
+Result<std::unique_ptr<const Idmap>> Idmap::FromApkAssets(
+    const std::string& target_apk_path, const ApkAssets& target_apk_assets, uint32_t target_crc,
+    const std::function<ResourceId(const std::string&)>& find_target_resid,
+    const std::string& overlay_apk_path, const ApkAssets& overlay_apk_assets,
+    const PolicyBitmask& fulfilled_policies, bool enforce_overlayable) {
   AssetManager2 overlay_asset_manager;
   if (!overlay_asset_manager.SetApkAssets({&overlay_apk_assets}, true, false)) {
     return Error("failed to create overlay asset manager");
@@ -356,11 +843,6 @@ Result<std::unique_ptr<const Idmap>> Idmap::FromApkAssets(const std::string& tar
     return Error("failed to load overlay package from resources.arsc");
   }
 
-  const std::unique_ptr<const ZipFile> target_zip = ZipFile::Open(target_apk_path);
-  if (!target_zip) {
-    return Error("failed to open target as zip");
-  }
-
   const std::unique_ptr<const ZipFile> overlay_zip = ZipFile::Open(overlay_apk_path);
   if (!overlay_zip) {
     return Error("failed to open overlay as zip");
@@ -374,14 +856,9 @@ Result<std::unique_ptr<const Idmap>> Idmap::FromApkAssets(const std::string& tar
   std::unique_ptr<IdmapHeader> header(new IdmapHeader());
   header->magic_ = kIdmapMagic;
   header->version_ = kIdmapCurrentVersion;
+  header->target_crc_ = target_crc;
 
-  Result<uint32_t> crc = GetCrc(*target_zip);
-  if (!crc) {
-    return Error(crc.GetError(), "failed to get zip CRC for target");
-  }
-  header->target_crc_ = *crc;
-
-  crc = GetCrc(*overlay_zip);
+  const Result<uint32_t> crc = GetCrc(*overlay_zip);
   if (!crc) {
     return Error(crc.GetError(), "failed to get zip CRC for overlay");
   }
@@ -413,10 +890,7 @@ Result<std::unique_ptr<const Idmap>> Idmap::FromApkAssets(const std::string& tar
     if (!name) {
       continue;
     }
-    // prepend "<package>:" to turn name into "<package>:<type>/<name>"
-    const std::string full_name =
-        base::StringPrintf("%s:%s", target_pkg->GetPackageName().c_str(), name->c_str());
-    const ResourceId target_resid = NameToResid(target_asset_manager, full_name);
+    const ResourceId target_resid = find_target_resid(*name);
     if (target_resid == 0) {
       continue;
     }
@@ -426,8 +900,8 @@ Result<std::unique_ptr<const Idmap>> Idmap::FromApkAssets(const std::string& tar
           CheckOverlayable(*target_pkg, *overlay_info, fulfilled_policies, target_resid);
       if (!success) {
         LOG(WARNING) << "overlay \"" << overlay_apk_path
-                     << "\" is not allowed to overlay resource \"" << full_name
-                     << "\": " << success.GetErrorMessage();
+                     << "\" is not allowed to overlay resource \"" << target_pkg->GetPackageName()
+                     << ":" << *name << "\": " << success.GetErrorMessage();
         continue;
       }
     }
@@ -15,7 +15,10 @@
  */
 
 #include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <cstdlib>
 #include <set>
 #include <string>
 
@@ -80,6 +83,33 @@ TEST(FileUtilsTests, ReadFile) {
   close(pipefd[0]);
 }
 
+TEST(FileUtilsTests, WriteFileAtomically) {
+  char dir[] = "/tmp/idmap2-tests-XXXXXX";
+  ASSERT_THAT(mkdtemp(dir), NotNull());
+  const std::string path = std::string(dir) + "/file";
+
+  ASSERT_TRUE(WriteFileAtomically(path, "foo"));
+  ASSERT_EQ(*ReadFile(path), "foo");
+  ASSERT_TRUE(WriteFileAtomically(path, "foobar"));
+  ASSERT_EQ(*ReadFile(path), "foobar");
+
+  struct stat st;
+  ASSERT_EQ(stat(path.c_str(), &st), 0);
+  ASSERT_EQ(st.st_mode & 0777, 0644U);
+
+  // no temporary files left behind
+  auto files = FindFiles(dir, false, [](unsigned char type, const std::string&) -> bool {
+    return type == DT_REG;
+  });
+  ASSERT_THAT(files, NotNull());
+  ASSERT_EQ(files->size(), 1U);
+
+  ASSERT_FALSE(WriteFileAtomically(std::string(dir) + "/no-such-dir/file", "foo"));
+
+  unlink(path.c_str());
+  rmdir(dir);
+}
+
 #ifdef __ANDROID__
 TEST(FileUtilsTests, UidHasWriteAccessToPath) {
   constexpr const char* tmp_path = "/data/local/tmp/test@idmap";
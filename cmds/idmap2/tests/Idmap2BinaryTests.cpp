@@ -26,6 +26,8 @@
 #include <unistd.h>
 
 #include <cerrno>
+#include <chrono>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>  // strerror
 #include <fstream>
@@ -62,6 +64,12 @@ void AssertIdmap(const Idmap& idmap, const std::string& target_apk_path,
   ASSERT_EQ(idmap.GetData().size(), 1U);
 }
 
+// scan keeps an index of the target and the CRCs of the apks next to the idmaps
+void RemoveScanCaches(const std::string& output_dir, const std::string& target_apk_path) {
+  unlink(TargetResourceIndex::CanonicalIndexPathFor(output_dir, target_apk_path).c_str());
+  unlink((output_dir + "/" + utils::kApkCrcCacheFileName).c_str());
+}
+
 #define ASSERT_IDMAP(idmap_ref, target_apk_path, overlay_apk_path)                      \
   do {                                                                                  \
     ASSERT_NO_FATAL_FAILURE(AssertIdmap(idmap_ref, target_apk_path, overlay_apk_path)); \
@@ -279,6 +287,80 @@ TEST_F(Idmap2BinaryTests, Scan) {
   unlink(idmap_static_no_name_path.c_str());
   unlink(idmap_static_2_path.c_str());
   unlink(idmap_static_1_path.c_str());
+  RemoveScanCaches(GetTempDirPath(), GetTargetApkPath());
+}
+
+TEST_F(Idmap2BinaryTests, ScanManyOverlays) {
+  SKIP_TEST_IF_CANT_EXEC_IDMAP2;
+
+  // 50 copies of the same static overlay, under different names
+  constexpr int kOverlayCount = 50;
+  const std::string overlay_dir = GetTempDirPath() + "/overlays";
+  ASSERT_EQ(mkdir(overlay_dir.c_str(), 0755), 0) << strerror(errno);
+  const auto overlay_data = utils::ReadFile(GetTestDataPath() + "/overlay/overlay-static-1.apk");
+  ASSERT_THAT(overlay_data, NotNull());
+  std::vector<std::string> overlay_apk_paths;
+  std::stringstream expected;
+  for (int i = 0; i < kOverlayCount; i++) {
+    char name[32];
+    snprintf(name, sizeof(name), "/overlay-%02d.apk", i);
+    overlay_apk_paths.push_back(overlay_dir + name);
+    std::ofstream fout(overlay_apk_paths.back());
+    fout << *overlay_data;
+    fout.close();
+    ASSERT_FALSE(fout.fail());
+    expected << Idmap::CanonicalIdmapPathFor(GetTempDirPath(), overlay_apk_paths.back())
+             << std::endl;
+  }
+
+  const auto scan = [&]() {
+    // clang-format off
+    return ExecuteBinary({"idmap2",
+                          "scan",
+                          "--input-directory", overlay_dir,
+                          "--target-package-name", "test.target",
+                          "--target-apk-path", GetTargetApkPath(),
+                          "--output-directory", GetTempDirPath(),
+                          "--override-policy", "public"});
+    // clang-format on
+  };
+
+  // no idmaps yet: all of them are created
+  auto start = std::chrono::steady_clock::now();
+  auto result = scan();
+  const auto create_time = std::chrono::steady_clock::now() - start;
+  ASSERT_THAT(result, NotNull());
+  ASSERT_EQ(result->status, EXIT_SUCCESS) << result->stderr;
+  ASSERT_EQ(result->stdout, expected.str());
+
+  for (const auto& overlay_apk_path : overlay_apk_paths) {
+    const std::string idmap_path = Idmap::CanonicalIdmapPathFor(GetTempDirPath(), overlay_apk_path);
+    auto idmap_raw_string = utils::ReadFile(idmap_path);
+    auto idmap_raw_stream = std::istringstream(*idmap_raw_string);
+    auto idmap = Idmap::FromBinaryStream(idmap_raw_stream);
+    ASSERT_TRUE(idmap);
+    ASSERT_IDMAP(**idmap, GetTargetApkPath(), overlay_apk_path);
+  }
+
+  // all idmaps up to date: only verified
+  start = std::chrono::steady_clock::now();
+  result = scan();
+  const auto verify_time = std::chrono::steady_clock::now() - start;
+  ASSERT_THAT(result, NotNull());
+  ASSERT_EQ(result->status, EXIT_SUCCESS) << result->stderr;
+  ASSERT_EQ(result->stdout, expected.str());
+
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
+  RecordProperty("create_ms", duration_cast<milliseconds>(create_time).count());
+  RecordProperty("verify_ms", duration_cast<milliseconds>(verify_time).count());
+
+  for (const auto& overlay_apk_path : overlay_apk_paths) {
+    unlink(Idmap::CanonicalIdmapPathFor(GetTempDirPath(), overlay_apk_path).c_str());
+    unlink(overlay_apk_path.c_str());
+  }
+  rmdir(overlay_dir.c_str());
+  RemoveScanCaches(GetTempDirPath(), GetTargetApkPath());
 }
 
 TEST_F(Idmap2BinaryTests, Lookup) {
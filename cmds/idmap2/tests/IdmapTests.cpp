@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <unistd.h>  // rmdir, unlink
+
 #include <cstdio>  // fclose
 #include <fstream>
 #include <memory>
@@ -29,7 +31,9 @@
 #include "gtest/gtest.h"
 #include "idmap2/BinaryStreamVisitor.h"
 #include "idmap2/CommandLineOptions.h"
+#include "idmap2/FileUtils.h"
 #include "idmap2/Idmap.h"
+#include "idmap2/ResourceUtils.h"
 
 using ::testing::IsNull;
 using ::testing::NotNull;
@@ -584,6 +588,281 @@ TEST(IdmapTests, IdmapHeaderIsUpToDate) {
   ASSERT_FALSE(bad_overlay_path_header->IsUpToDate());
 }
 
+TEST(IdmapTests, TestCanonicalIndexPathFor) {
+  ASSERT_EQ(TargetResourceIndex::CanonicalIndexPathFor("/foo", "/system/framework/bar.apk"),
+            "/foo/system@framework@bar.apk@index");
+}
+
+TEST(IdmapTests, CreateTargetResourceIndexFromApkAssets) {
+  const std::string target_apk_path(GetTestDataPath() + "/target/target.apk");
+  std::unique_ptr<const ApkAssets> target_apk = ApkAssets::Load(target_apk_path);
+  ASSERT_THAT(target_apk, NotNull());
+
+  const std::string overlay_apk_path(GetTestDataPath() + "/overlay/overlay.apk");
+  std::unique_ptr<const ApkAssets> overlay_apk = ApkAssets::Load(overlay_apk_path);
+  ASSERT_THAT(overlay_apk, NotNull());
+
+  const auto index = TargetResourceIndex::FromApkAssets(target_apk_path, *target_apk);
+  ASSERT_TRUE(index);
+  ASSERT_EQ((*index)->GetTargetCrc(), 0x76a20829);
+  ASSERT_EQ((*index)->GetPackageName(), "test.target");
+  ASSERT_GT((*index)->GetResourceCount(), 0U);
+  ASSERT_EQ((*index)->FindResource("string/no-such-resource"), 0U);
+
+  // the index finds the same target resources as the target asset manager
+  AssetManager2 target_am;
+  ASSERT_TRUE(target_am.SetApkAssets({target_apk.get()}, true, false));
+  AssetManager2 overlay_am;
+  ASSERT_TRUE(overlay_am.SetApkAssets({overlay_apk.get()}, true, false));
+  const LoadedPackage* overlay_pkg = overlay_apk->GetLoadedArsc()->GetPackages()[0].get();
+  for (auto iter = overlay_pkg->begin(); iter != overlay_pkg->end(); ++iter) {
+    const auto name = utils::ResToTypeEntryName(overlay_am, *iter);
+    ASSERT_TRUE(name);
+    ASSERT_EQ((*index)->FindResource(*name), target_am.GetResourceId("test.target:" + *name))
+        << *name;
+  }
+}
+
+TEST(IdmapTests, CreateTargetResourceIndexFromBinaryStream) {
+  const std::string target_apk_path(GetTestDataPath() + "/target/target.apk");
+  std::unique_ptr<const ApkAssets> target_apk = ApkAssets::Load(target_apk_path);
+  ASSERT_THAT(target_apk, NotNull());
+
+  const auto index = TargetResourceIndex::FromApkAssets(target_apk_path, *target_apk);
+  ASSERT_TRUE(index);
+
+  std::stringstream stream;
+  ASSERT_TRUE((*index)->WriteBinaryStream(stream));
+  const auto read_index = TargetResourceIndex::FromBinaryStream(stream);
+  ASSERT_TRUE(read_index);
+  ASSERT_EQ((*read_index)->GetTargetCrc(), (*index)->GetTargetCrc());
+  ASSERT_EQ((*read_index)->GetPackageName(), (*index)->GetPackageName());
+  ASSERT_EQ((*read_index)->GetResourceCount(), (*index)->GetResourceCount());
+  ASSERT_EQ((*read_index)->FindResource("integer/int1"), (*index)->FindResource("integer/int1"));
+  ASSERT_NE((*read_index)->FindResource("integer/int1"), 0U);
+
+  // truncated
+  std::string truncated(stream.str());
+  truncated.resize(truncated.size() - 1);
+  std::istringstream truncated_stream(truncated);
+  ASSERT_FALSE(TargetResourceIndex::FromBinaryStream(truncated_stream));
+
+  // bad magic
+  std::string bad_magic(stream.str());
+  bad_magic[0x0] = '.';
+  std::istringstream bad_magic_stream(bad_magic);
+  ASSERT_FALSE(TargetResourceIndex::FromBinaryStream(bad_magic_stream));
+}
+
+TEST(IdmapTests, CreateTargetResourceIndexFromCache) {
+  char dir[] = "/tmp/idmap2-tests-XXXXXX";
+  ASSERT_THAT(mkdtemp(dir), NotNull());
+  const std::string index_path = std::string(dir) + "/target.index";
+
+  const std::string target_apk_path(GetTestDataPath() + "/target/target.apk");
+  std::unique_ptr<const ApkAssets> target_apk = ApkAssets::Load(target_apk_path);
+  ASSERT_THAT(target_apk, NotNull());
+
+  // no index yet: built and written
+  auto index = TargetResourceIndex::FromCache(index_path, target_apk_path, *target_apk);
+  ASSERT_TRUE(index);
+  auto written = utils::ReadFile(index_path);
+  ASSERT_THAT(written, NotNull());
+  std::istringstream written_stream(*written);
+  auto written_index = TargetResourceIndex::FromBinaryStream(written_stream);
+  ASSERT_TRUE(written_index);
+  ASSERT_EQ((*written_index)->GetTargetCrc(), (*index)->GetTargetCrc());
+
+  // index of another version of the target: rebuilt
+  // target crc: bytes (0x8, 0xb)
+  std::string stale(*written);
+  stale[0x8] = static_cast<char>(stale[0x8] ^ 0xff);
+  std::ofstream(index_path) << stale;
+  index = TargetResourceIndex::FromCache(index_path, target_apk_path, *target_apk);
+  ASSERT_TRUE(index);
+  ASSERT_EQ((*index)->GetTargetCrc(), 0x76a20829);
+  ASSERT_EQ(*utils::ReadFile(index_path), *written);
+
+  // corrupt index: rebuilt
+  std::ofstream(index_path) << "garbage";
+  index = TargetResourceIndex::FromCache(index_path, target_apk_path, *target_apk);
+  ASSERT_TRUE(index);
+  ASSERT_EQ((*index)->GetResourceCount(), (*written_index)->GetResourceCount());
+
+  unlink(index_path.c_str());
+  rmdir(dir);
+}
+
+TEST(IdmapTests, CreateIdmapFromApkAssetsWithTargetResourceIndex) {
+  const std::string target_apk_path(GetTestDataPath() + "/target/target.apk");
+  std::unique_ptr<const ApkAssets> target_apk = ApkAssets::Load(target_apk_path);
+  ASSERT_THAT(target_apk, NotNull());
+
+  const auto index = TargetResourceIndex::FromApkAssets(target_apk_path, *target_apk);
+  ASSERT_TRUE(index);
+
+  for (const char* overlay : {"/overlay/overlay.apk", "/system-overlay/system-overlay.apk",
+                              "/system-overlay-invalid/system-overlay-invalid.apk"}) {
+    const std::string overlay_apk_path(GetTestDataPath() + overlay);
+    std::unique_ptr<const ApkAssets> overlay_apk = ApkAssets::Load(overlay_apk_path);
+    ASSERT_THAT(overlay_apk, NotNull());
+
+    const auto expected =
+        Idmap::FromApkAssets(target_apk_path, *target_apk, overlay_apk_path, *overlay_apk,
+                             PolicyFlags::POLICY_PUBLIC | PolicyFlags::POLICY_SYSTEM_PARTITION,
+                             /* enforce_overlayable */ true);
+    ASSERT_TRUE(expected);
+    const auto actual =
+        Idmap::FromApkAssets(target_apk_path, *target_apk, **index, overlay_apk_path,
+                             *overlay_apk,
+                             PolicyFlags::POLICY_PUBLIC | PolicyFlags::POLICY_SYSTEM_PARTITION,
+                             /* enforce_overlayable */ true);
+    ASSERT_TRUE(actual);
+
+    std::stringstream expected_stream;
+    BinaryStreamVisitor expected_visitor(expected_stream);
+    (*expected)->accept(&expected_visitor);
+    std::stringstream actual_stream;
+    BinaryStreamVisitor actual_visitor(actual_stream);
+    (*actual)->accept(&actual_visitor);
+    ASSERT_EQ(actual_stream.str(), expected_stream.str()) << overlay;
+  }
+}
+
+TEST(IdmapTests, CreateIdmapViewFromFile) {
+  char path[] = "/tmp/idmap2-tests-XXXXXX";
+  const int fd = mkstemp(path);
+  ASSERT_NE(fd, -1);
+  ASSERT_EQ(write(fd, idmap_raw_data, sizeof(idmap_raw_data)),
+            static_cast<ssize_t>(sizeof(idmap_raw_data)));
+  close(fd);
+
+  const auto view = IdmapView::FromFile(path);
+  ASSERT_TRUE(view);
+  ASSERT_EQ((*view)->GetMagic(), 0x504d4449U);
+  ASSERT_EQ((*view)->GetVersion(), 0x01U);
+  ASSERT_EQ((*view)->GetTargetCrc(), 0x1234U);
+  ASSERT_EQ((*view)->GetOverlayCrc(), 0x5678U);
+  ASSERT_EQ((*view)->GetTargetPath().to_string(), "target.apk");
+  ASSERT_EQ((*view)->GetOverlayPath().to_string(), "overlay.apk");
+  ASSERT_EQ((*view)->GetTargetPackageId(), 0x7fU);
+  ASSERT_EQ((*view)->GetTypeCount(), 2U);
+
+  // truncated in the last type entry
+  ASSERT_EQ(truncate(path, sizeof(idmap_raw_data) - 1), 0);
+  ASSERT_FALSE(IdmapView::FromFile(path));
+
+  // truncated in the header
+  ASSERT_EQ(truncate(path, 0x10), 0);
+  ASSERT_FALSE(IdmapView::FromFile(path));
+
+  unlink(path);
+  ASSERT_FALSE(IdmapView::FromFile(path));
+}
+
+TEST(IdmapTests, FailToCreateIdmapViewFromFileIfPathNotTerminated) {
+  std::string raw(reinterpret_cast<const char*>(idmap_raw_data), idmap_raw_data_len);
+  // overwrite the overlay path string, including the terminating null, with '.'
+  for (size_t i = 0x110; i < 0x210; i++) {
+    raw[i] = '.';
+  }
+
+  char path[] = "/tmp/idmap2-tests-XXXXXX";
+  const int fd = mkstemp(path);
+  ASSERT_NE(fd, -1);
+  ASSERT_EQ(write(fd, raw.data(), raw.size()), static_cast<ssize_t>(raw.size()));
+  close(fd);
+
+  ASSERT_FALSE(IdmapView::FromFile(path));
+  unlink(path);
+}
+
+TEST(IdmapTests, IdmapViewIsUpToDate) {
+  const std::string target_apk_path(GetTestDataPath() + "/target/target.apk");
+  std::unique_ptr<const ApkAssets> target_apk = ApkAssets::Load(target_apk_path);
+  ASSERT_THAT(target_apk, NotNull());
+
+  const std::string overlay_apk_path(GetTestDataPath() + "/overlay/overlay.apk");
+  std::unique_ptr<const ApkAssets> overlay_apk = ApkAssets::Load(overlay_apk_path);
+  ASSERT_THAT(overlay_apk, NotNull());
+
+  auto result = Idmap::FromApkAssets(target_apk_path, *target_apk, overlay_apk_path, *overlay_apk,
+                                     PolicyFlags::POLICY_PUBLIC,
+                                     /* enforce_overlayable */ true);
+  ASSERT_TRUE(result);
+
+  std::stringstream stream;
+  BinaryStreamVisitor visitor(stream);
+  (*result)->accept(&visitor);
+
+  char path[] = "/tmp/idmap2-tests-XXXXXX";
+  const int fd = mkstemp(path);
+  ASSERT_NE(fd, -1);
+  close(fd);
+  std::ofstream(path) << stream.str();
+
+  const auto view = IdmapView::FromFile(path);
+  ASSERT_TRUE(view);
+  ASSERT_TRUE((*view)->IsUpToDate());
+
+  ApkCrcCache crc_cache;
+  ASSERT_TRUE((*view)->IsUpToDate(&crc_cache));
+  ASSERT_EQ(crc_cache.GetSize(), 2U);
+  ASSERT_TRUE((*view)->IsUpToDate(&crc_cache));
+  ASSERT_EQ(crc_cache.GetSize(), 2U);
+
+  // target crc: bytes (0x8, 0xb)
+  std::string bad_target_crc(stream.str());
+  bad_target_crc[0x8] = static_cast<char>(bad_target_crc[0x8] ^ 0xff);
+  std::ofstream(path) << bad_target_crc;
+  const auto bad_target_crc_view = IdmapView::FromFile(path);
+  ASSERT_TRUE(bad_target_crc_view);
+  ASSERT_FALSE((*bad_target_crc_view)->IsUpToDate());
+  ASSERT_FALSE((*bad_target_crc_view)->IsUpToDate(&crc_cache));
+
+  unlink(path);
+}
+
+TEST(IdmapTests, ApkCrcCache) {
+  char dir[] = "/tmp/idmap2-tests-XXXXXX";
+  ASSERT_THAT(mkdtemp(dir), NotNull());
+  const std::string apk_path = std::string(dir) + "/overlay.apk";
+  const std::string cache_path = std::string(dir) + "/apk-crc-cache";
+  const auto overlay_data = utils::ReadFile(GetTestDataPath() + "/overlay/overlay.apk");
+  ASSERT_THAT(overlay_data, NotNull());
+  std::ofstream(apk_path) << *overlay_data;
+
+  ApkCrcCache crc_cache;
+  const auto crc = crc_cache.GetCrc(apk_path);
+  ASSERT_TRUE(crc);
+  ASSERT_EQ(*crc, 0x8635c2ed);
+  ASSERT_FALSE(crc_cache.GetCrc(std::string(dir) + "/no-such.apk"));
+
+  // saved and loaded again
+  ASSERT_TRUE(crc_cache.Save(cache_path));
+  ApkCrcCache loaded_cache;
+  loaded_cache.Load(cache_path, "");
+  ASSERT_EQ(loaded_cache.GetSize(), 1U);
+  ASSERT_EQ(*loaded_cache.GetCrc(apk_path), 0x8635c2ed);
+
+  // the cache is dropped when the generation changes
+  loaded_cache.Load(cache_path, "another build");
+  ASSERT_EQ(loaded_cache.GetSize(), 0U);
+
+  // a changed apk is read again
+  std::ofstream(apk_path) << *utils::ReadFile(GetTestDataPath() + "/target/target.apk");
+  ASSERT_EQ(*crc_cache.GetCrc(apk_path), 0x76a20829);
+
+  // corrupt cache
+  std::ofstream(cache_path) << "apk crc cache v1\n\n12 garbage\n";
+  loaded_cache.Load(cache_path, "");
+  ASSERT_EQ(loaded_cache.GetSize(), 0U);
+
+  unlink(cache_path.c_str());
+  unlink(apk_path.c_str());
+  rmdir(dir);
+}
+
 class TestVisitor : public Visitor {
  public:
   explicit TestVisitor(std::ostream& stream) : stream_(stream) {
@@ -19,6 +19,8 @@
 #include "ih_util.h"
 
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <sstream>
 #include <unistd.h>
 
@@ -38,58 +40,92 @@ std::string trim(const std::string& s, const std::string& charset) {
     return s.substr(head, tail - head + 1);
 }
 
+static inline std::string_view trimView(std::string_view s, std::string_view charset) {
+    const auto head = s.find_first_not_of(charset);
+    if (head == std::string_view::npos) return std::string_view();
+
+    const auto tail = s.find_last_not_of(charset);
+    return s.substr(head, tail - head + 1);
+}
+
 static inline std::string toLowerStr(const std::string& s) {
     std::string res(s);
     std::transform(res.begin(), res.end(), res.begin(), ::tolower);
     return res;
 }
 
-static inline std::string trimDefault(const std::string& s) {
-    return trim(s, DEFAULT_WHITESPACE);
+static inline bool equalsLowerStr(std::string_view s, std::string_view lower) {
+    return s.size() == lower.size() && std::equal(s.begin(), s.end(), lower.begin(),
+            [](char a, char b) { return ::tolower((unsigned char)a) == b; });
 }
 
-static inline std::string trimHeader(const std::string& s) {
-    return toLowerStr(trimDefault(s));
+// DEFAULT_WHITESPACE without the charset scan, as every word of every record is trimmed by it.
+static inline std::string_view trimDefault(std::string_view s) {
+    size_t head = 0;
+    size_t tail = s.size();
+    while (head < tail && (s[head] == ' ' || s[head] == '\t')) head++;
+    while (tail > head && (s[tail - 1] == ' ' || s[tail - 1] == '\t')) tail--;
+    return s.substr(head, tail - head);
 }
 
-static inline bool isNumber(const std::string& s) {
-    std::string::const_iterator it = s.begin();
+// Membership table of a delimiter charset, so splitting tests each character once instead of
+// scanning the charset for it.
+class DelimiterSet {
+public:
+    explicit DelimiterSet(std::string_view delimiters) : mIsDelimiter() {
+        for (char c : delimiters) mIsDelimiter[(uint8_t)c] = true;
+    }
+    bool contains(char c) const { return mIsDelimiter[(uint8_t)c]; }
+private:
+    bool mIsDelimiter[256];
+};
+
+static inline bool isNumber(std::string_view s) {
+    std::string_view::const_iterator it = s.begin();
     while (it != s.end() && std::isdigit(*it)) ++it;
     return !s.empty() && it == s.end();
 }
 
-// This is similiar to Split in android-base/file.h, but it won't add empty string
-static void split(const std::string& line, std::vector<std::string>& words,
-        const trans_func& func, const std::string& delimiters) {
-    words.clear();  // clear the buffer before split
+// This is similiar to Split in android-base/file.h, but it won't add empty string, and the
+// words are trimmed views into line.
+static void split(std::string_view line, record_view_t* words, std::string_view delimiters) {
+    words->clear();  // clear the buffer before split
 
+    const DelimiterSet isDelimiter(delimiters);
+    const size_t size = line.size();
     size_t base = 0;
-    size_t found;
     while (true) {
-        found = line.find_first_of(delimiters, base);
+        size_t found = base;
+        while (found < size && !isDelimiter.contains(line[found])) found++;
         if (found != base) {
-            std::string word = (*func) (line.substr(base, found - base));
+            std::string_view word = trimDefault(line.substr(base, found - base));
             if (!word.empty()) {
-                words.push_back(word);
+                words->push_back(word);
             }
         }
-        if (found == line.npos) break;
+        if (found == size) break;
         base = found + 1;
     }
 }
 
 header_t parseHeader(const std::string& line, const std::string& delimiters) {
+    record_view_t words;
+    split(line, &words, delimiters);
     header_t header;
-    trans_func f = &trimHeader;
-    split(line, header, f, delimiters);
+    for (std::string_view word : words) {
+        header.push_back(toLowerStr(std::string(word)));
+    }
     return header;
 }
 
 record_t parseRecord(const std::string& line, const std::string& delimiters) {
-    record_t record;
-    trans_func f = &trimDefault;
-    split(line, record, f, delimiters);
-    return record;
+    record_view_t words;
+    split(line, &words, delimiters);
+    return record_t(words.begin(), words.end());
+}
+
+void parseRecord(std::string_view line, record_view_t* record, std::string_view delimiters) {
+    split(line, record, delimiters);
 }
 
 bool getColumnIndices(std::vector<int>& indices, const char** headerNames, const std::string& line) {
@@ -113,7 +149,15 @@ bool getColumnIndices(std::vector<int>& indices, const char** headerNames, const
 }
 
 record_t parseRecordByColumns(const std::string& line, const std::vector<int>& indices, const std::string& delimiters) {
-    record_t record;
+    record_view_t columns;
+    parseRecordByColumns(line, indices, &columns, delimiters);
+    return record_t(columns.begin(), columns.end());
+}
+
+void parseRecordByColumns(std::string_view line, const std::vector<int>& indices,
+        record_view_t* record, std::string_view delimiters) {
+    record->clear();
+    const DelimiterSet isDelimiter(delimiters);
     int lastIndex = 0;
     int lastBeginning = 0;
     int lineSize = (int)line.size();
@@ -132,25 +176,24 @@ record_t parseRecordByColumns(const std::string& line, const std::vector<int>& i
             }
             // If we're past the end of the line AND we've already saved everything up to the end.
             fprintf(stderr, "index wrong: lastIndex: %d, idx: %d, lineSize: %d\n", lastIndex, idx, lineSize);
-            record.clear(); // The indices are wrong, return empty.
-            return record;
+            record->clear(); // The indices are wrong, return empty.
+            return;
         }
-        while (idx < lineSize && delimiters.find(line[idx++]) == std::string::npos);
-        record.push_back(trimDefault(line.substr(lastIndex, idx - lastIndex)));
+        while (idx < lineSize && !isDelimiter.contains(line[idx++]));
+        record->push_back(trimDefault(line.substr(lastIndex, idx - lastIndex)));
         lastBeginning = lastIndex;
         lastIndex = idx;
     }
     if (lineSize - lastIndex > 0) {
         int beginning = lastIndex;
-        if (record.size() == indices.size() && !record.empty()) {
+        if (record->size() == indices.size() && !record->empty()) {
             // We've already encountered all of the columns...put whatever is
             // left in the last column.
-            record.pop_back();
+            record->pop_back();
             beginning = lastBeginning;
         }
-        record.push_back(trimDefault(line.substr(beginning, lineSize - beginning)));
+        record->push_back(trimDefault(line.substr(beginning, lineSize - beginning)));
     }
-    return record;
 }
 
 void printRecord(const record_t& record) {
@@ -166,9 +209,36 @@ void printRecord(const record_t& record) {
     fprintf(stderr, "\" }\n");
 }
 
+void printRecord(const record_view_t& record) {
+    fprintf(stderr, "Record: { ");
+    if (record.size() == 0) {
+        fprintf(stderr, "}\n");
+        return;
+    }
+    for(size_t i = 0; i < record.size(); ++i) {
+        if(i != 0) fprintf(stderr, "\", ");
+        fprintf(stderr, "\"%.*s", (int)record[i].size(), record[i].data());
+    }
+    fprintf(stderr, "\" }\n");
+}
+
 bool stripPrefix(std::string* line, const char* key, bool endAtDelimiter) {
+    std::string_view rest(*line);
+    if (!stripPrefix(&rest, key, endAtDelimiter)) return false;
+    line->assign(std::string(rest));
+    return true;
+}
+
+bool stripSuffix(std::string* line, const char* key, bool endAtDelimiter) {
+    std::string_view rest(*line);
+    if (!stripSuffix(&rest, key, endAtDelimiter)) return false;
+    line->assign(std::string(rest));
+    return true;
+}
+
+bool stripPrefix(std::string_view* line, const char* key, bool endAtDelimiter) {
     const auto head = line->find_first_not_of(DEFAULT_WHITESPACE);
-    if (head == std::string::npos) return false;
+    if (head == std::string_view::npos) return false;
     int len = (int)line->length();
     int i = 0;
     int j = head;
@@ -183,13 +253,13 @@ bool stripPrefix(std::string* line, const char* key, bool endAtDelimiter) {
         if (j == len || isValidChar(line->at(j))) return false;
     }
 
-    line->assign(trimDefault(line->substr(j)));
+    *line = trimDefault(line->substr(j));
     return true;
 }
 
-bool stripSuffix(std::string* line, const char* key, bool endAtDelimiter) {
+bool stripSuffix(std::string_view* line, const char* key, bool endAtDelimiter) {
     const auto tail = line->find_last_not_of(DEFAULT_WHITESPACE);
-    if (tail == std::string::npos) return false;
+    if (tail == std::string_view::npos) return false;
     int i = 0;
     while (key[++i] != '\0'); // compute the size of the key
     int j = tail;
@@ -204,7 +274,7 @@ bool stripSuffix(std::string* line, const char* key, bool endAtDelimiter) {
         if (j < 0 || isValidChar(line->at(j))) return false;
     }
 
-    line->assign(trimDefault(line->substr(0, j+1)));
+    *line = trimDefault(line->substr(0, j+1));
     return true;
 }
 
@@ -221,20 +291,35 @@ std::string behead(std::string* line, const char cut) {
     return head;
 }
 
-int toInt(const std::string& s) {
-    return atoi(s.c_str());
+// The conversions need a terminated string. Numbers are short, so they are copied to the stack
+// instead of into a std::string.
+template <typename T>
+static T parseNumber(std::string_view s, T (*parse)(const char*)) {
+    char buf[32];
+    if (s.size() < sizeof(buf)) {
+        memcpy(buf, s.data(), s.size());
+        buf[s.size()] = '\0';
+        return parse(buf);
+    }
+    return parse(std::string(s).c_str());
 }
 
-long long toLongLong(const std::string& s) {
-    return atoll(s.c_str());
+int toInt(std::string_view s) {
+    return parseNumber(s, atoi);
 }
 
-double toDouble(const std::string& s) {
-    return atof(s.c_str());
+long long toLongLong(std::string_view s) {
+    return parseNumber(s, atoll);
+}
+
+double toDouble(std::string_view s) {
+    return parseNumber(s, atof);
 }
 
 // ==============================================================================
 Reader::Reader(const int fd)
+        :mBuffer(nullptr),
+         mBufferSize(0)
 {
     mFile = fdopen(fd, "r");
     mStatus = mFile == nullptr ? "Invalid fd " + std::to_string(fd) : "";
@@ -243,21 +328,26 @@ Reader::Reader(const int fd)
 Reader::~Reader()
 {
     if (mFile != nullptr) fclose(mFile);
+    free(mBuffer);
 }
 
 bool Reader::readLine(std::string* line) {
+    std::string_view view;
+    if (!readLine(&view)) return false;
+    line->assign(view.data(), view.size());
+    return true;
+}
+
+bool Reader::readLine(std::string_view* line) {
     if (mFile == nullptr) return false;
 
-    char* buf = nullptr;
-    size_t len = 0;
-    ssize_t read = getline(&buf, &len, mFile);
+    ssize_t read = getline(&mBuffer, &mBufferSize, mFile);
     if (read != -1) {
-        std::string s(buf);
-        line->assign(trim(s, DEFAULT_NEWLINE));
+        // The line ends at the first NUL, as it did when it was copied into a std::string.
+        *line = trimView(std::string_view(mBuffer, strlen(mBuffer)), DEFAULT_NEWLINE);
     } else if (errno == EINVAL) {
         mStatus = "Bad Argument";
     }
-    free(buf);
     return read != -1;
 }
 
@@ -271,11 +361,9 @@ Table::Table(const char* names[], const uint64_t ids[], const int count)
         :mEnums(),
          mEnumValuesByName()
 {
-    std::map<std::string, uint64_t> fields;
     for (int i = 0; i < count; i++) {
-        fields[names[i]] = ids[i];
+        mFields[names[i]] = ids[i];
     }
-    mFields = fields;
 }
 
 Table::~Table()
@@ -290,7 +378,7 @@ Table::addEnumTypeMap(const char* field, const char* enumNames[], const int enum
         return;
     }
 
-    std::map<std::string, int> enu;
+    std::map<std::string, int, std::less<>> enu;
     for (int i = 0; i < enumSize; i++) {
         enu[enumNames[i]] = enumValues[i];
     }
@@ -304,12 +392,13 @@ Table::addEnumNameToValue(const char* enumName, const int enumValue)
 }
 
 bool
-Table::insertField(ProtoOutputStream* proto, const std::string& name, const std::string& value)
+Table::insertField(ProtoOutputStream* proto, std::string_view name, std::string_view value)
 {
-    if (mFields.find(name) == mFields.end()) return false;
+    auto field = mFields.find(name);
+    if (field == mFields.end()) return false;
 
-    uint64_t found = mFields[name];
-    record_t repeats; // used for repeated fields
+    uint64_t found = field->second;
+    record_view_t repeats; // used for repeated fields
     switch ((found & FIELD_COUNT_MASK) | (found & FIELD_TYPE_MASK)) {
         case FIELD_COUNT_SINGLE | FIELD_TYPE_DOUBLE:
         case FIELD_COUNT_SINGLE | FIELD_TYPE_FLOAT:
@@ -317,7 +406,7 @@ Table::insertField(ProtoOutputStream* proto, const std::string& name, const std:
             break;
         case FIELD_COUNT_SINGLE | FIELD_TYPE_STRING:
         case FIELD_COUNT_SINGLE | FIELD_TYPE_BYTES:
-            proto->write(found, value);
+            proto->write(found, value.data(), value.size());
             break;
         case FIELD_COUNT_SINGLE | FIELD_TYPE_INT64:
         case FIELD_COUNT_SINGLE | FIELD_TYPE_SINT64:
@@ -327,31 +416,37 @@ Table::insertField(ProtoOutputStream* proto, const std::string& name, const std:
             proto->write(found, toLongLong(value));
             break;
         case FIELD_COUNT_SINGLE | FIELD_TYPE_BOOL:
-            if (strcmp(toLowerStr(value).c_str(), "true") == 0 || strcmp(value.c_str(), "1") == 0) {
+            if (equalsLowerStr(value, "true") || value == "1") {
                 proto->write(found, true);
                 break;
             }
-            if (strcmp(toLowerStr(value).c_str(), "false") == 0 || strcmp(value.c_str(), "0") == 0) {
+            if (equalsLowerStr(value, "false") || value == "0") {
                 proto->write(found, false);
                 break;
             }
             return false;
-        case FIELD_COUNT_SINGLE | FIELD_TYPE_ENUM:
+        case FIELD_COUNT_SINGLE | FIELD_TYPE_ENUM: {
             // if the field has its own enum mapping, use this, otherwise use general name to value mapping.
-            if (mEnums.find(name) != mEnums.end()) {
-                if (mEnums[name].find(value) != mEnums[name].end()) {
-                    proto->write(found, mEnums[name][value]);
+            auto enums = mEnums.find(name);
+            if (enums != mEnums.end()) {
+                auto enumValue = enums->second.find(value);
+                if (enumValue != enums->second.end()) {
+                    proto->write(found, enumValue->second);
                 } else {
                     proto->write(found, 0); // TODO: should get the default enum value (Unknown)
                 }
-            } else if (mEnumValuesByName.find(value) != mEnumValuesByName.end()) {
-                proto->write(found, mEnumValuesByName[value]);
+                break;
+            }
+            auto enumValue = mEnumValuesByName.find(value);
+            if (enumValue != mEnumValuesByName.end()) {
+                proto->write(found, enumValue->second);
             } else if (isNumber(value)) {
                 proto->write(found, toInt(value));
             } else {
                 return false;
             }
             break;
+        }
         case FIELD_COUNT_SINGLE | FIELD_TYPE_INT32:
         case FIELD_COUNT_SINGLE | FIELD_TYPE_SINT32:
         case FIELD_COUNT_SINGLE | FIELD_TYPE_UINT32:
@@ -361,15 +456,15 @@ Table::insertField(ProtoOutputStream* proto, const std::string& name, const std:
             break;
         // REPEATED TYPE below:
         case FIELD_COUNT_REPEATED | FIELD_TYPE_INT32:
-            repeats = parseRecord(value, COMMA_DELIMITER);
+            parseRecord(value, &repeats, COMMA_DELIMITER);
             for (size_t i=0; i<repeats.size(); i++) {
                 proto->write(found, toInt(repeats[i]));
             }
             break;
         case FIELD_COUNT_REPEATED | FIELD_TYPE_STRING:
-            repeats = parseRecord(value, COMMA_DELIMITER);
+            parseRecord(value, &repeats, COMMA_DELIMITER);
             for (size_t i=0; i<repeats.size(); i++) {
-                proto->write(found, repeats[i]);
+                proto->write(found, repeats[i].data(), repeats[i].size());
             }
             break;
         default:
@@ -20,6 +20,7 @@
 #include <map>
 #include <stack>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <android/util/ProtoOutputStream.h>
@@ -28,7 +29,7 @@ using namespace android::util;
 
 typedef std::vector<std::string> header_t;
 typedef std::vector<std::string> record_t;
-typedef std::string (*trans_func) (const std::string&);
+typedef std::vector<std::string_view> record_view_t;
 
 const std::string DEFAULT_WHITESPACE = " \t";
 const std::string DEFAULT_NEWLINE = "\r\n";
@@ -57,6 +58,13 @@ std::string trim(const std::string& s, const std::string& charset);
 header_t parseHeader(const std::string& line, const std::string& delimiters = DEFAULT_WHITESPACE);
 record_t parseRecord(const std::string& line, const std::string& delimiters = DEFAULT_WHITESPACE);
 
+/**
+ * Same as parseRecord, but the words are views into line, so nothing is copied. The record is
+ * cleared and refilled, so parsers can reuse one for every line of a large output.
+ */
+void parseRecord(std::string_view line, record_view_t* record,
+        std::string_view delimiters = DEFAULT_WHITESPACE);
+
 /**
  * Gets the list of end indices of each word in the line and places it in the given vector,
  * clearing out the vector beforehand. These indices can be used with parseRecordByColumns.
@@ -72,8 +80,15 @@ bool getColumnIndices(std::vector<int>& indices, const char* headerNames[], cons
  */
 record_t parseRecordByColumns(const std::string& line, const std::vector<int>& indices, const std::string& delimiters = DEFAULT_WHITESPACE);
 
+/**
+ * Same as parseRecordByColumns, but the columns are views into line, see parseRecord above.
+ */
+void parseRecordByColumns(std::string_view line, const std::vector<int>& indices,
+        record_view_t* record, std::string_view delimiters = DEFAULT_WHITESPACE);
+
 /** Prints record_t to stderr */
 void printRecord(const record_t& record);
+void printRecord(const record_view_t& record);
 
 /**
  * When the line starts/ends with the given key, the function returns true
@@ -89,6 +104,8 @@ void printRecord(const record_t& record);
  */
 bool stripPrefix(std::string* line, const char* key, bool endAtDelimiter = false);
 bool stripSuffix(std::string* line, const char* key, bool endAtDelimiter = false);
+bool stripPrefix(std::string_view* line, const char* key, bool endAtDelimiter = false);
+bool stripSuffix(std::string_view* line, const char* key, bool endAtDelimiter = false);
 
 /**
  * behead the given line by the cut, return the head and reassign the line to be the rest.
@@ -98,9 +115,9 @@ std::string behead(std::string* line, const char cut);
 /**
  * Converts string to the desired type
  */
-int toInt(const std::string& s);
-long long toLongLong(const std::string& s);
-double toDouble(const std::string& s);
+int toInt(std::string_view s);
+long long toLongLong(std::string_view s);
+double toDouble(std::string_view s);
 
 /**
  * Reader class reads data from given fd in streaming fashion.
@@ -113,11 +130,17 @@ public:
     ~Reader();
 
     bool readLine(std::string* line);
+    // Same as above, but line points into the reader's buffer and is only valid until the
+    // next call.
+    bool readLine(std::string_view* line);
     bool ok(std::string* error);
 
 private:
     FILE* mFile;
     std::string mStatus;
+    // Reused by every getline call.
+    char* mBuffer;
+    size_t mBufferSize;
 };
 
 /**
@@ -148,11 +171,12 @@ public:
 
     // Based on given name, find the right field id, parse the text value and insert to proto.
     // Return false if the given name can't be found.
-    bool insertField(ProtoOutputStream* proto, const std::string& name, const std::string& value);
+    bool insertField(ProtoOutputStream* proto, std::string_view name, std::string_view value);
 private:
-    std::map<std::string, uint64_t> mFields;
-    std::map<std::string, std::map<std::string, int>> mEnums;
-    std::map<std::string, int> mEnumValuesByName;
+    // Transparent comparators, so names and values can be looked up without copying them.
+    std::map<std::string, uint64_t, std::less<>> mFields;
+    std::map<std::string, std::map<std::string, int, std::less<>>, std::less<>> mEnums;
+    std::map<std::string, int, std::less<>> mEnumValuesByName;
 };
 
 /**
@@ -24,10 +24,11 @@
 using namespace android::os;
 
 static void writeSuffixLine(ProtoOutputStream* proto, uint64_t fieldId,
-        const string& line, const string& delimiter,
+        string_view line, const string& delimiter,
         const int count, const char* names[], const uint64_t ids[])
 {
-    record_t record = parseRecord(line, delimiter);
+    record_view_t record;
+    parseRecord(line, &record, delimiter);
     uint64_t token = proto->start(fieldId);
     for (int i=0; i<(int)record.size(); i++) {
         for (int j=0; j<count; j++) {
@@ -44,10 +45,11 @@ status_t
 CpuInfoParser::Parse(const int in, const int out) const
 {
     Reader reader(in);
-    string line;
+    string_view line;  // valid until the next readLine
+    string error;
     header_t header;
     vector<int> columnIndices; // task table can't be split by purely delimiter, needs column positions.
-    record_t record;
+    record_view_t record;  // reused for every task
     int nline = 0;
     int diff = 0;
     bool nextToSwap = false;
@@ -106,12 +108,13 @@ CpuInfoParser::Parse(const int in, const int out) const
             // PID   TID USER         PR  NI[%CPU]S VIRT  RES PCY CMD             NAME
             // After parsing, header = { PID, TID, USER, PR, NI, CPU, S, VIRT, RES, PCY, CMD, NAME }
             // And columnIndices will contain end index of each word.
-            header = parseHeader(line, "[ %]");
+            const string headerLine(line);
+            header = parseHeader(headerLine, "[ %]");
             nextToUsage = false;
 
             // NAME is not in the list since we need to modify the end of the CMD index.
             const char* headerNames[] = { "PID", "TID", "USER", "PR", "NI", "CPU", "S", "VIRT", "RES", "PCY", "CMD", nullptr };
-            if (!getColumnIndices(columnIndices, headerNames, line)) {
+            if (!getColumnIndices(columnIndices, headerNames, headerLine)) {
                 return -1;
             }
             // Need to remove the end index of CMD and use the start index of NAME because CMD values contain spaces.
@@ -121,20 +124,22 @@ CpuInfoParser::Parse(const int in, const int out) const
             // If use start index of NAME, parsed result = { "Jit thread pool", "com.google.android.gms.feedback" }
             int endCMD = columnIndices.back();
             columnIndices.pop_back();
-            columnIndices.push_back(line.find("NAME", endCMD) - 1);
+            columnIndices.push_back(headerLine.find("NAME", endCMD) - 1);
             // Add NAME index to complete the column list.
             columnIndices.push_back(columnIndices.back() + 4);
             continue;
         }
 
-        record = parseRecordByColumns(line, columnIndices);
+        parseRecordByColumns(line, columnIndices, &record);
         diff = record.size() - header.size();
         if (diff < 0) {
-            fprintf(stderr, "[%s]Line %d has %d missing fields\n%s\n", this->name.string(), nline, -diff, line.c_str());
+            fprintf(stderr, "[%s]Line %d has %d missing fields\n%.*s\n", this->name.string(), nline, -diff,
+                    (int)line.size(), line.data());
             printRecord(record);
             continue;
         } else if (diff > 0) {
-            fprintf(stderr, "[%s]Line %d has %d extra fields\n%s\n", this->name.string(), nline, diff, line.c_str());
+            fprintf(stderr, "[%s]Line %d has %d extra fields\n%.*s\n", this->name.string(), nline, diff,
+                    (int)line.size(), line.data());
             printRecord(record);
             continue;
         }
@@ -142,15 +147,16 @@ CpuInfoParser::Parse(const int in, const int out) const
         uint64_t token = proto.start(CpuInfoProto::TASKS);
         for (int i=0; i<(int)record.size(); i++) {
             if (!table.insertField(&proto, header[i], record[i])) {
-                fprintf(stderr, "[%s]Line %d fails to insert field %s with value %s\n",
-                        this->name.string(), nline, header[i].c_str(), record[i].c_str());
+                fprintf(stderr, "[%s]Line %d fails to insert field %s with value %.*s\n",
+                        this->name.string(), nline, header[i].c_str(),
+                        (int)record[i].size(), record[i].data());
             }
         }
         proto.end(token);
     }
 
-    if (!reader.ok(&line)) {
-        fprintf(stderr, "Bad read from fd %d: %s\n", in, line.c_str());
+    if (!reader.ok(&error)) {
+        fprintf(stderr, "Bad read from fd %d: %s\n", in, error.c_str());
         return -1;
     }
 
@@ -27,9 +27,10 @@ status_t
 ProcrankParser::Parse(const int in, const int out) const
 {
     Reader reader(in);
-    string line;
+    string_view line;  // valid until the next readLine
+    string error;
     header_t header;  // the header of /d/wakeup_sources
-    record_t record;  // retain each record
+    record_view_t record;  // retain each record, reused for every line
     int nline = 0;
 
     ProtoOutputStream proto;
@@ -42,26 +43,26 @@ ProcrankParser::Parse(const int in, const int out) const
 
         // parse head line
         if (nline++ == 0) {
-            header = parseHeader(line);
+            header = parseHeader(string(line));
             continue;
         }
 
         if (stripPrefix(&line, "ZRAM:")) {
-            zram = line;
+            zram = string(line);
             continue;
         }
         if (stripPrefix(&line, "RAM:")) {
-            ram = line;
+            ram = string(line);
             continue;
         }
 
-        record = parseRecord(line);
+        parseRecord(line, &record);
         if (record.size() != header.size()) {
             if (record[record.size() - 1] == "TOTAL") { // TOTAL record
-                total = line;
+                total = string(line);
             } else {
-                fprintf(stderr, "[%s]Line %d has missing fields\n%s\n", this->name.string(), nline,
-                    line.c_str());
+                fprintf(stderr, "[%s]Line %d has missing fields\n%.*s\n", this->name.string(), nline,
+                    (int)line.size(), line.data());
             }
             continue;
         }
@@ -69,8 +70,9 @@ ProcrankParser::Parse(const int in, const int out) const
         uint64_t token = proto.start(ProcrankProto::PROCESSES);
         for (int i=0; i<(int)record.size(); i++) {
             if (!table.insertField(&proto, header[i], record[i])) {
-                fprintf(stderr, "[%s]Line %d has bad value %s of %s\n",
-                        this->name.string(), nline, header[i].c_str(), record[i].c_str());
+                fprintf(stderr, "[%s]Line %d has bad value %s of %.*s\n",
+                        this->name.string(), nline, header[i].c_str(),
+                        (int)record[i].size(), record[i].data());
             }
         }
         proto.end(token);
@@ -79,10 +81,10 @@ ProcrankParser::Parse(const int in, const int out) const
     // add summary
     uint64_t token = proto.start(ProcrankProto::SUMMARY);
     if (!total.empty()) {
-        record = parseRecord(total);
+        parseRecord(total, &record);
         uint64_t token = proto.start(ProcrankProto::Summary::TOTAL);
         for (int i=(int)record.size(); i>0; i--) {
-            table.insertField(&proto, header[header.size() - i].c_str(), record[record.size() - i].c_str());
+            table.insertField(&proto, header[header.size() - i], record[record.size() - i]);
         }
         proto.end(token);
     }
@@ -98,8 +100,8 @@ ProcrankParser::Parse(const int in, const int out) const
     }
     proto.end(token);
 
-    if (!reader.ok(&line)) {
-        fprintf(stderr, "Bad read from fd %d: %s\n", in, line.c_str());
+    if (!reader.ok(&error)) {
+        fprintf(stderr, "Bad read from fd %d: %s\n", in, error.c_str());
         return -1;
     }
 
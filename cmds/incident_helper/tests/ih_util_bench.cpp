@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ih_util.h"
+
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static const char* PS_HEADER =
+        "LABEL                          USER     PID   TID  PPID     VSZ    RSS WCHAN            ADDR S PRI  NI RTPRIO SCH PCY TIME CMD";
+
+static vector<int> psColumns() {
+    static const char* names[] = {
+        "LABEL", "USER", "PID", "TID", "PPID", "VSZ", "RSS", "WCHAN", "ADDR", "S", "PRI", "NI",
+        "RTPRIO", "SCH", "PCY", "TIME", "CMD", nullptr
+    };
+    vector<int> indices;
+    getColumnIndices(indices, names, PS_HEADER);
+    return indices;
+}
+
+// A ps -A -T like output, as large as the one of a device running a few thousand threads. Every
+// value is right aligned to the end of its header, and the command runs past the last one.
+static vector<string> makePsLines(int count) {
+    const vector<int> indices = psColumns();
+    vector<string> lines;
+    lines.reserve(count);
+    for (int i = 0; i < count; i++) {
+        const string values[] = {
+            "u:r:priv_app:s0:c512,c768", "u0_a" + to_string(i % 1000), to_string(1000 + i / 8),
+            to_string(1000 + i), "600", to_string(1000000 + i), to_string(50000 + i),
+            "SyS_epoll_wait", "0", "S", "19", "0", "-", "0", "fg", "00:00:" + to_string(10 + i % 50),
+            "com.example.app" + to_string(i),
+        };
+        string line;
+        for (size_t c = 0; c < indices.size(); c++) {
+            if (c > 0) line += ' ';
+            if (c + 1 < indices.size() && line.size() + values[c].size() < (size_t)indices[c]) {
+                line.append(indices[c] - line.size() - values[c].size(), ' ');
+            }
+            line += values[c];
+        }
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+// A top -b like output, split on whitespace rather than by columns.
+static vector<string> makeTopLines(int count) {
+    vector<string> lines;
+    lines.reserve(count);
+    char line[256];
+    for (int i = 0; i < count; i++) {
+        snprintf(line, sizeof(line),
+                "%5d u0_a%-4d  20   0  %3dG %4dM %4dM S %4.1f  %3.1f %2d:%02d.%02d com.example.app%d",
+                1000 + i, i % 1000, 1 + i % 8, 100 + i % 900, 50 + i % 400, (i % 100) / 10.0,
+                (i % 50) / 10.0, i % 60, i % 60, i % 100, i);
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+static void BM_ParseRecordByColumnsCopy(benchmark::State& state) {
+    const vector<string> lines = makePsLines(state.range(0));
+    const vector<int> indices = psColumns();
+    size_t bytes = 0;
+    for (const string& line : lines) bytes += line.size();
+
+    for (auto _ : state) {
+        for (const string& line : lines) {
+            record_t record = parseRecordByColumns(line, indices);
+            benchmark::DoNotOptimize(record.data());
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_ParseRecordByColumnsCopy)->Arg(10000);
+
+static void BM_ParseRecordByColumnsView(benchmark::State& state) {
+    const vector<string> lines = makePsLines(state.range(0));
+    const vector<int> indices = psColumns();
+    size_t bytes = 0;
+    for (const string& line : lines) bytes += line.size();
+
+    record_view_t record;
+    for (auto _ : state) {
+        for (const string& line : lines) {
+            parseRecordByColumns(line, indices, &record);
+            benchmark::DoNotOptimize(record.data());
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_ParseRecordByColumnsView)->Arg(10000);
+
+static void BM_ParseRecordCopy(benchmark::State& state) {
+    const vector<string> lines = makeTopLines(state.range(0));
+    size_t bytes = 0;
+    for (const string& line : lines) bytes += line.size();
+
+    for (auto _ : state) {
+        for (const string& line : lines) {
+            record_t record = parseRecord(line);
+            benchmark::DoNotOptimize(record.data());
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_ParseRecordCopy)->Arg(10000);
+
+static void BM_ParseRecordView(benchmark::State& state) {
+    const vector<string> lines = makeTopLines(state.range(0));
+    size_t bytes = 0;
+    for (const string& line : lines) bytes += line.size();
+
+    record_view_t record;
+    for (auto _ : state) {
+        for (const string& line : lines) {
+            parseRecord(line, &record);
+            benchmark::DoNotOptimize(record.data());
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_ParseRecordView)->Arg(10000);
+
+// The whole ps path: columns written into the proto by name, as PsParser does.
+static void BM_PsToProto(benchmark::State& state) {
+    static const char* names[] = { "pid", "tid", "ppid", "vsz", "rss", "pri", "ni", "cmd" };
+    static const uint64_t ids[] = {
+        FIELD_TYPE_INT32 | FIELD_COUNT_SINGLE | 1, FIELD_TYPE_INT32 | FIELD_COUNT_SINGLE | 2,
+        FIELD_TYPE_INT32 | FIELD_COUNT_SINGLE | 3, FIELD_TYPE_INT32 | FIELD_COUNT_SINGLE | 4,
+        FIELD_TYPE_INT32 | FIELD_COUNT_SINGLE | 5, FIELD_TYPE_INT32 | FIELD_COUNT_SINGLE | 6,
+        FIELD_TYPE_INT32 | FIELD_COUNT_SINGLE | 7, FIELD_TYPE_STRING | FIELD_COUNT_SINGLE | 8,
+    };
+    static const int columns[] = { 2, 3, 4, 5, 6, 10, 11, 16 };
+    Table table(names, ids, sizeof(ids) / sizeof(ids[0]));
+    const vector<string> lines = makePsLines(state.range(0));
+    const vector<int> indices = psColumns();
+    size_t bytes = 0;
+    for (const string& line : lines) bytes += line.size();
+
+    record_view_t record;
+    for (auto _ : state) {
+        ProtoOutputStream proto;
+        for (const string& line : lines) {
+            parseRecordByColumns(line, indices, &record);
+            if (record.size() != indices.size()) {
+                state.SkipWithError("ps line was not split into every column");
+                return;
+            }
+            uint64_t token = proto.start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | 1);
+            for (size_t i = 0; i < sizeof(columns) / sizeof(columns[0]); i++) {
+                if (!table.insertField(&proto, names[i], record[columns[i]])) {
+                    state.SkipWithError("ps column was not written into the proto");
+                    return;
+                }
+            }
+            proto.end(token);
+        }
+        benchmark::DoNotOptimize(proto.size());
+    }
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_PsToProto)->Arg(10000);
+
+BENCHMARK_MAIN();
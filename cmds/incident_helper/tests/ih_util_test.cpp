@@ -99,6 +99,39 @@ TEST(IhUtilTest, ParseRecordByColumns) {
     EXPECT_EQ(expected, result);
 }
 
+TEST(IhUtilTest, ParseRecordView) {
+    record_view_t result;
+    parseRecord(" \t \t\t ", &result);
+    EXPECT_TRUE(result.empty());
+
+    parseRecord(" \t 100 00\toooh \t wqrw", &result);
+    EXPECT_THAT(result, ::testing::ElementsAre("100", "00", "oooh", "wqrw"));
+
+    // The record is refilled, not appended to.
+    parseRecord(" \t 100 00\toooh \t wqrw", &result, "\t");
+    EXPECT_THAT(result, ::testing::ElementsAre("100 00", "oooh", "wqrw"));
+}
+
+TEST(IhUtilTest, ParseRecordByColumnsView) {
+    std::vector<int> indices = { 3, 10 };
+    const char* lines[] = {
+        "12345",
+        "abc \t2345  6789 ",
+        "abc \t23456789 bob",
+        "abc \t         bob",
+        "abcdefgt\t6789 bob",
+        "abcdefgt\t     bob",
+    };
+
+    // Must match the copying version on every input.
+    record_view_t view;
+    for (const char* line : lines) {
+        parseRecordByColumns(line, indices, &view);
+        record_t expected = parseRecordByColumns(string(line), indices);
+        EXPECT_EQ(record_t(view.begin(), view.end()), expected) << line;
+    }
+}
+
 TEST(IhUtilTest, stripPrefix) {
     string data1 = "Swap: abc ";
     EXPECT_TRUE(stripPrefix(&data1, "Swap:"));
@@ -135,6 +168,20 @@ TEST(IhUtilTest, stripSuffix) {
     EXPECT_THAT(data4, StrEq(" 243%abc"));
 }
 
+TEST(IhUtilTest, stripPrefixView) {
+    std::string_view data1 = "Swap: abc ";
+    EXPECT_TRUE(stripPrefix(&data1, "Swap:"));
+    EXPECT_EQ(data1, "abc");
+
+    std::string_view data2 = "Swap: abc ";
+    EXPECT_FALSE(stripPrefix(&data2, "Swa", true));
+    EXPECT_EQ(data2, "Swap: abc ");
+
+    std::string_view data3 = " 243%abc";
+    EXPECT_TRUE(stripSuffix(&data3, "bc"));
+    EXPECT_EQ(data3, "243%a");
+}
+
 TEST(IhUtilTest, behead) {
     string testcase1 = "81002 dropbox_file_copy (a)(b)";
     EXPECT_THAT(behead(&testcase1, ' '), StrEq("81002"));
@@ -168,6 +215,22 @@ TEST(IhUtilTest, Reader) {
     ASSERT_TRUE(r.ok(&line));
 }
 
+TEST(IhUtilTest, ReaderStringView) {
+    TemporaryFile tf;
+    ASSERT_NE(tf.fd, -1);
+    ASSERT_TRUE(WriteStringToFile("test string\r\nsecond\n", tf.path));
+
+    Reader r(tf.fd);
+    std::string_view line;
+    ASSERT_TRUE(r.readLine(&line));
+    EXPECT_EQ(line, "test string");
+    ASSERT_TRUE(r.readLine(&line));
+    EXPECT_EQ(line, "second");
+    ASSERT_FALSE(r.readLine(&line));
+    string error;
+    ASSERT_TRUE(r.ok(&error));
+}
+
 TEST(IhUtilTest, ReaderEmpty) {
     TemporaryFile tf;
     ASSERT_NE(tf.fd, -1);
@@ -17,6 +17,7 @@
 #include "Log.h"
 
 #include "FdBuffer.h"
+#include "PrivacyFilter.h"
 
 #include <log/log.h>
 #include <utils/SystemClock.h>
@@ -25,6 +26,9 @@
 #include <poll.h>
 #include <unistd.h>
 #include <wait.h>
+#include <zlib.h>
+
+#include <vector>
 
 namespace android {
 namespace os {
@@ -35,6 +39,8 @@ const ssize_t MAX_BUFFER_COUNT = 6144;   // 96 MB max
 
 FdBuffer::FdBuffer()
         :mBuffer(new EncodedBuffer(BUFFER_SIZE)),
+         mStripper(),
+         mStrippedSize(0),
          mStartTime(-1),
          mFinishTime(-1),
          mTimedOut(false),
@@ -51,7 +57,7 @@ status_t FdBuffer::read(int fd, int64_t timeout) {
     fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
 
     while (true) {
-        if (mBuffer->size() >= MAX_BUFFER_COUNT * BUFFER_SIZE) {
+        if (size() >= MAX_BUFFER_COUNT * BUFFER_SIZE) {
             mTruncated = true;
             VLOG("Truncating data");
             break;
@@ -94,7 +100,7 @@ status_t FdBuffer::read(int fd, int64_t timeout) {
                     VLOG("Reached EOF of fd=%d", fd);
                     break;
                 }
-                mBuffer->wp()->move(amt);
+                onRead(amt);
             }
         }
     }
@@ -106,7 +112,7 @@ status_t FdBuffer::readFully(int fd) {
     mStartTime = uptimeMillis();
 
     while (true) {
-        if (mBuffer->size() >= MAX_BUFFER_COUNT * BUFFER_SIZE) {
+        if (size() >= MAX_BUFFER_COUNT * BUFFER_SIZE) {
             // Don't let it get too big.
             mTruncated = true;
             VLOG("Truncating data");
@@ -123,11 +129,11 @@ status_t FdBuffer::readFully(int fd) {
             VLOG("Fail to read %d: %s", fd, strerror(errno));
             return -errno;
         } else if (amt == 0) {
-            VLOG("Done reading %zu bytes", mBuffer->size());
+            VLOG("Done reading %zu bytes", size());
             // We're done.
             break;
         }
-        mBuffer->wp()->move(amt);
+        onRead(amt);
     }
 
     mFinishTime = uptimeMillis();
@@ -156,7 +162,7 @@ status_t FdBuffer::readProcessedDataInStream(int fd, unique_fd toFd, unique_fd f
 
     // This is the buffer used to store processed data
     while (true) {
-        if (mBuffer->size() >= MAX_BUFFER_COUNT * BUFFER_SIZE) {
+        if (size() >= MAX_BUFFER_COUNT * BUFFER_SIZE) {
             VLOG("Truncating data");
             mTruncated = true;
             break;
@@ -264,7 +270,7 @@ status_t FdBuffer::readProcessedDataInStream(int fd, unique_fd toFd, unique_fd f
             VLOG("Reached EOF of fromFd %d", fromFd.get());
             break;
         } else {
-            mBuffer->wp()->move(amt);
+            onRead(amt);
         }
     }
 
@@ -272,6 +278,86 @@ status_t FdBuffer::readProcessedDataInStream(int fd, unique_fd toFd, unique_fd f
     return NO_ERROR;
 }
 
+status_t FdBuffer::readCompressed(int fd, int64_t timeoutMs) {
+    mStartTime = uptimeMillis();
+
+    // windowBits above 15 writes a gzip header and trailer instead of a zlib one.
+    z_stream stream = {};
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NO_MEMORY;
+    }
+
+    std::vector<uint8_t> in(BUFFER_SIZE);
+    status_t err = NO_ERROR;
+    int flush = Z_NO_FLUSH;
+    while (flush != Z_FINISH) {
+        if (size() >= MAX_BUFFER_COUNT * BUFFER_SIZE) {
+            // Finish the stream, so what was read can still be uncompressed.
+            mTruncated = true;
+            VLOG("Truncating data");
+            flush = Z_FINISH;
+        } else if (uptimeMillis() - mStartTime >= timeoutMs) {
+            VLOG("timed out due to long read");
+            mTimedOut = true;
+            break;
+        } else {
+            ssize_t amt = TEMP_FAILURE_RETRY(::read(fd, in.data(), in.size()));
+            if (amt < 0) {
+                VLOG("Fail to read %d: %s", fd, strerror(errno));
+                err = -errno;
+                break;
+            } else if (amt == 0) {
+                VLOG("Reached EOF of fd=%d", fd);
+                flush = Z_FINISH;
+            }
+            stream.next_in = in.data();
+            stream.avail_in = amt;
+        }
+
+        // Compress straight into the chunks of the buffer, until all of the input is taken.
+        do {
+            uint8_t* out = mBuffer->writeBuffer();
+            if (out == NULL) {
+                VLOG("No memory");
+                err = NO_MEMORY;
+                break;
+            }
+            stream.next_out = out;
+            stream.avail_out = mBuffer->currentToWrite();
+            deflate(&stream, flush);
+            mBuffer->wp()->move(stream.next_out - out);
+        } while (stream.avail_out == 0);
+        if (err != NO_ERROR) {
+            break;
+        }
+    }
+    deflateEnd(&stream);
+
+    mFinishTime = uptimeMillis();
+    return err;
+}
+
+void FdBuffer::setStripper(const sp<StreamingFieldStripper>& stripper) {
+    mStripper = stripper;
+}
+
+void FdBuffer::onRead(size_t amt) {
+    if (mStripper == nullptr) {
+        mBuffer->wp()->move(amt);
+        return;
+    }
+    // An error means the data can't be stripped, which writing the section handles. Keep
+    // reading, so the source doesn't block and the stats are right.
+    mStripper->write(mBuffer->writeBuffer(), amt);
+    if (mStripper->needsUnfilteredData()) {
+        mBuffer->wp()->move(amt);
+    } else {
+        // Leave the write pointer, so the next read reuses the same chunk.
+        mStrippedSize += amt;
+    }
+}
+
 status_t FdBuffer::write(uint8_t const* buf, size_t size) {
     return mBuffer->writeRaw(buf, size);
 }
@@ -285,7 +371,7 @@ status_t FdBuffer::write(const sp<ProtoReader>& reader, size_t size) {
 }
 
 size_t FdBuffer::size() const {
-    return mBuffer->size();
+    return mBuffer->size() + mStrippedSize;
 }
 
 sp<EncodedBuffer> FdBuffer::data() const {
@@ -29,6 +29,8 @@ namespace incidentd {
 using namespace android::base;
 using namespace android::util;
 
+class StreamingFieldStripper;
+
 /**
  * Reads data from fd into a buffer, fd must be closed explicitly.
  */
@@ -63,6 +65,26 @@ public:
     status_t readProcessedDataInStream(int fd, unique_fd toFd, unique_fd fromFd, int64_t timeoutMs,
                                        const bool isSysfs = false);
 
+    /**
+     * Read the data until eof and store it gzip compressed, with zlib in this process.
+     * Stops at the timeout, or finishes the compressed data early if it gets too big.  The
+     * timeout is only checked between reads, so fd should be a file that doesn't block.
+     * Returns NO_ERROR if there were no errors or if we timed out.
+     */
+    status_t readCompressed(int fd, int64_t timeoutMs);
+
+    /**
+     * Hand the data to stripper as it is read from the fd, instead of keeping all of it.
+     * The data is only kept in the buffer if the stripper needs the unfiltered data.
+     * Data written by hand with write() is kept and is not given to the stripper.
+     */
+    void setStripper(const sp<StreamingFieldStripper>& stripper);
+
+    /**
+     * The stripper the data was handed to, if any.
+     */
+    sp<StreamingFieldStripper> stripper() const { return mStripper; }
+
     /**
      * Write by hand into the buffer.
      */
@@ -110,10 +132,15 @@ public:
 
 private:
     sp<EncodedBuffer> mBuffer;
+    sp<StreamingFieldStripper> mStripper;
+    // Bytes that were given to mStripper and not kept in mBuffer.
+    size_t mStrippedSize;
     int64_t mStartTime;
     int64_t mFinishTime;
     bool mTimedOut;
     bool mTruncated;
+
+    void onRead(size_t amt);
 };
 
 }  // namespace incidentd
@@ -24,6 +24,7 @@
 #include "incidentd_util.h"
 #include "section_list.h"
 
+#include <android-base/properties.h>
 #include <android/os/IncidentReportArgs.h>
 #include <binder/IPCThreadState.h>
 #include <binder/IResultReceiver.h>
@@ -46,6 +47,12 @@ enum {
 #define DEFAULT_BYTES_SIZE_LIMIT (96 * 1024 * 1024)        // 96MB
 #define DEFAULT_REFACTORY_PERIOD_MS (24 * 60 * 60 * 1000)  // 1 Day
 
+// How long the sections of earlier reports took, to schedule the next ones.
+#define SECTION_HISTORY_FILE "/data/misc/incidents/section_history"
+// How long a whole report may take.  0, the default, lets every section take its own
+// timeout.
+#define REPORT_TIMEOUT_PROPERTY "persist.incidentd.report_timeout_ms"
+
 // Skip these sections for dumpstate only. Dumpstate allows 10s max for each service to dump.
 // Skip logs (1100 - 1108) and traces (1200 - 1202) because they are already in the bug report.
 // Skip 3018 because it takes too long.
@@ -125,13 +132,14 @@ static string build_uri(const string& pkg, const string& cls, const string& id)
 // ================================================================================
 ReportHandler::ReportHandler(const sp<WorkDirectory>& workDirectory,
             const sp<Broadcaster>& broadcaster, const sp<Looper>& handlerLooper,
-            const sp<Throttler>& throttler)
+            const sp<Throttler>& throttler, const sp<SectionScheduler>& scheduler)
         :mLock(),
          mWorkDirectory(workDirectory),
          mBroadcaster(broadcaster),
          mHandlerLooper(handlerLooper),
          mBacklogDelay(DEFAULT_DELAY_NS),
          mThrottler(throttler),
+         mScheduler(scheduler),
          mBatch(new ReportBatch()) {
 }
 
@@ -186,7 +194,7 @@ void ReportHandler::take_report() {
         return;
     }
 
-    sp<Reporter> reporter = new Reporter(mWorkDirectory, batch);
+    sp<Reporter> reporter = new Reporter(mWorkDirectory, batch, mScheduler);
 
     // Take the report, which might take a while. More requests might queue
     // up while we're doing this, and we'll handle them in their next batch.
@@ -236,9 +244,11 @@ void ReportHandler::send_broadcasts() {
 IncidentService::IncidentService(const sp<Looper>& handlerLooper) {
     mThrottler = new Throttler(DEFAULT_BYTES_SIZE_LIMIT, DEFAULT_REFACTORY_PERIOD_MS);
     mWorkDirectory = new WorkDirectory();
+    mScheduler = new SectionScheduler(SECTION_HISTORY_FILE,
+            android::base::GetIntProperty(REPORT_TIMEOUT_PROPERTY, (int64_t)0));
     mBroadcaster = new Broadcaster(mWorkDirectory);
     mHandler = new ReportHandler(mWorkDirectory, mBroadcaster, handlerLooper,
-            mThrottler);
+            mThrottler, mScheduler);
     mBroadcaster->setHandler(mHandler);
 }
 
@@ -471,6 +481,10 @@ status_t IncidentService::command(FILE* in, FILE* out, FILE* err, Vector<String8
             mThrottler->dump(out);
             return NO_ERROR;
         }
+        if (!args[0].compare(String8("scheduler"))) {
+            mScheduler->dump(out);
+            return NO_ERROR;
+        }
         if (!args[0].compare(String8("section"))) {
             int id = atoi(args[1]);
             int idx = 0;
@@ -495,7 +509,9 @@ status_t IncidentService::cmd_help(FILE* out) {
     fprintf(out, "usage: adb shell cmd incident section <section_id>\n");
     fprintf(out, "    Prints section id and its name.\n\n");
     fprintf(out, "usage: adb shell cmd incident throttler\n");
-    fprintf(out, "    Prints the current throttler state\n");
+    fprintf(out, "    Prints the current throttler state\n\n");
+    fprintf(out, "usage: adb shell cmd incident scheduler\n");
+    fprintf(out, "    Prints how long sections took in earlier reports\n");
     return NO_ERROR;
 }
 
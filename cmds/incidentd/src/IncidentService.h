@@ -21,6 +21,7 @@
 #include "Reporter.h"
 
 #include "Broadcaster.h"
+#include "SectionScheduler.h"
 #include "Throttler.h"
 #include "WorkDirectory.h"
 
@@ -45,7 +46,7 @@ class ReportHandler : public MessageHandler {
 public:
     ReportHandler(const sp<WorkDirectory>& workDirectory,
             const sp<Broadcaster>& broadcaster, const sp<Looper>& handlerLooper,
-            const sp<Throttler>& throttler);
+            const sp<Throttler>& throttler, const sp<SectionScheduler>& scheduler);
     virtual ~ReportHandler();
 
     virtual void handleMessage(const Message& message);
@@ -78,6 +79,7 @@ private:
     sp<Looper> mHandlerLooper;
     nsecs_t mBacklogDelay;
     sp<Throttler> mThrottler;
+    sp<SectionScheduler> mScheduler;
 
     sp<ReportBatch> mBatch;
 
@@ -147,6 +149,7 @@ private:
     sp<Broadcaster> mBroadcaster;
     sp<ReportHandler> mHandler;
     sp<Throttler> mThrottler;
+    sp<SectionScheduler> mScheduler;
 
     /**
      * Commands print out help.
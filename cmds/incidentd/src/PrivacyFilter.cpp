@@ -29,6 +29,8 @@
 #include <android/util/ProtoFileReader.h>
 #include <log/log.h>
 
+#include <algorithm>
+
 namespace android {
 namespace os {
 namespace incidentd {
@@ -80,158 +82,233 @@ void write_field_or_skip(ProtoOutputStream* out, const sp<ProtoReader>& in,
     }
 }
 
-/**
- * Strip next field based on its private policy and request spec, then stores data in buf.
- * Return NO_ERROR if succeeds, otherwise BAD_VALUE is returned to indicate bad data in
- * FdBuffer.
- *
- * The iterator must point to the head of a protobuf formatted field for successful operation.
- * After exit with NO_ERROR, iterator points to the next protobuf field's head.
- *
- * depth is the depth of recursion, for debugging.
- */
-status_t strip_field(ProtoOutputStream* out, const sp<ProtoReader>& in,
-        const Privacy* parentPolicy, const PrivacySpec& spec, int depth) {
-    if (!in->hasNext() || parentPolicy == NULL) {
-        return BAD_VALUE;
-    }
-    uint32_t fieldTag = in->readRawVarint();
-    uint32_t fieldId = read_field_id(fieldTag);
-    const Privacy* policy = lookup(parentPolicy, fieldId);
-
-    if (policy == NULL || policy->children == NULL) {
-        bool skip = !spec.CheckPremission(policy, parentPolicy->policy);
-        // iterator will point to head of next field
-        size_t currentAt = in->bytesRead();
-        write_field_or_skip(out, in, fieldTag, skip);
-        return NO_ERROR;
-    }
-    // current field is message type and its sub-fields have extra privacy policies
-    uint32_t msgSize = in->readRawVarint();
-    size_t start = in->bytesRead();
-    uint64_t token = out->start(encode_field_id(policy));
-    while (in->bytesRead() - start != msgSize) {
-        status_t err = strip_field(out, in, policy, spec, depth + 1);
-        if (err != NO_ERROR) {
-            ALOGW("Bad value when stripping id %d, wiretype %d, tag %#x, depth %d, size %d, "
-                    "relative pos %zu, ", fieldId, read_wire_type(fieldTag), fieldTag, depth,
-                    msgSize, in->bytesRead() - start);
-            return err;
+// ================================================================================
+StreamingFieldStripper::StrippedLevel::StrippedLevel(uint8_t privacyPolicy)
+        :privacyPolicy(privacyPolicy),
+         spec(privacyPolicy),
+         proto(new ProtoOutputStream(ProtoOutputStream::NestedEncoding::SINGLE_PASS)),
+         keepField(false) {
+}
+
+StreamingFieldStripper::StreamingFieldStripper(const Privacy* restrictions,
+            const vector<uint8_t>& privacyPolicies, uint8_t bufferLevel)
+        :mRestrictions(restrictions),
+         mNeedsUnfilteredData(false),
+         mLevels(),
+         mUnfilteredPolicies(),
+         mState(STATE_TAG),
+         mVarint(0),
+         mVarintShift(0),
+         mFieldTag(0),
+         mFieldPolicy(NULL),
+         mBytesRemaining(0),
+         mBytesRead(0),
+         mOpenMessages(),
+         mError(NO_ERROR) {
+    for (uint8_t privacyPolicy: privacyPolicies) {
+        if (hasPolicy(privacyPolicy)) {
+            continue;
+        }
+        // Same as the levels that FieldStripper used to skip re-filtering for.
+        if (privacyPolicy <= bufferLevel || mRestrictions == NULL
+                || PrivacySpec(privacyPolicy).RequireAll()) {
+            mUnfilteredPolicies.push_back(privacyPolicy);
+            mNeedsUnfilteredData = true;
+        } else {
+            mLevels.emplace_back(privacyPolicy);
         }
     }
-    out->end(token);
-    return NO_ERROR;
 }
 
-// ================================================================================
-class FieldStripper {
-public:
-    FieldStripper(const Privacy* restrictions, const sp<ProtoReader>& data,
-            uint8_t bufferLevel);
-
-    /**
-     * Take the data that we have, and filter it down so that no fields
-     * are more sensitive than the given privacy policy.
-     */
-    status_t strip(uint8_t privacyPolicy);
-
-    /**
-     * At the current filter level, how many bytes of data there is.
-     */
-    ssize_t dataSize() const { return mSize; }
-
-    /**
-     * Write the data from the current filter level to the file descriptor.
-     */
-    status_t writeData(int fd);
+StreamingFieldStripper::~StreamingFieldStripper() {
+}
 
-private:
-    /**
-     * The global set of field --> required privacy level mapping.
-     */
-    const Privacy* mRestrictions;
-
-    /**
-     * The current buffer.
-     */
-    sp<ProtoReader> mData;
-
-    /**
-     * The current size of the buffer inside mData.
-     */
-    ssize_t mSize;
-
-    /**
-     * The current privacy policy that the data is filtered to, as an optimization
-     * so we don't always re-filter data that has already been filtered.
-     */
-    uint8_t mCurrentLevel;
+bool StreamingFieldStripper::hasPolicy(uint8_t privacyPolicy) const {
+    if (keepsUnfilteredData(privacyPolicy)) {
+        return true;
+    }
+    for (const StrippedLevel& level: mLevels) {
+        if (level.privacyPolicy == privacyPolicy) {
+            return true;
+        }
+    }
+    return false;
+}
 
-};
+bool StreamingFieldStripper::keepsUnfilteredData(uint8_t privacyPolicy) const {
+    return std::find(mUnfilteredPolicies.begin(), mUnfilteredPolicies.end(), privacyPolicy)
+            != mUnfilteredPolicies.end();
+}
 
-FieldStripper::FieldStripper(const Privacy* restrictions, const sp<ProtoReader>& data,
-            uint8_t bufferLevel)
-        :mRestrictions(restrictions),
-         mData(data),
-         mSize(data->size()),
-         mCurrentLevel(bufferLevel) {
-    if (mSize < 0) {
-        ALOGW("FieldStripper constructed with a ProtoReader that doesn't support size."
-                " Data will be missing.");
+ProtoOutputStream* StreamingFieldStripper::getStrippedData(uint8_t privacyPolicy) const {
+    if (mError != NO_ERROR) {
+        return NULL;
+    }
+    for (const StrippedLevel& level: mLevels) {
+        if (level.privacyPolicy == privacyPolicy) {
+            return level.proto.get();
+        }
     }
+    return NULL;
 }
 
-status_t FieldStripper::strip(const uint8_t privacyPolicy) {
-    // If the current strip level is less (fewer fields retained) than what's already in the
-    // buffer, then we can skip it.
-    if (mCurrentLevel < privacyPolicy) {
-        PrivacySpec spec(privacyPolicy);
-        ProtoOutputStream proto;
-
-        // Optimization when no strip happens.
-        if (mRestrictions == NULL || spec.RequireAll()) {
-            if (spec.CheckPremission(mRestrictions)) {
-                mSize = mData->size();
+status_t StreamingFieldStripper::write(uint8_t const* buf, size_t size) {
+    if (mError != NO_ERROR || mLevels.empty()) {
+        return mError;
+    }
+    uint8_t const* end = buf + size;
+    while (buf < end) {
+        if (mState == STATE_BYTES) {
+            // Copy as much of the field as we have, without looking at it.
+            size_t count = std::min(mBytesRemaining, (size_t)(end - buf));
+            for (StrippedLevel& level: mLevels) {
+                if (level.keepField) {
+                    level.proto->writeRaw(buf, count);
+                }
             }
-            return NO_ERROR;
+            buf += count;
+            mBytesRead += count;
+            mBytesRemaining -= count;
+            if (mBytesRemaining == 0) {
+                status_t err = onFieldEnd();
+                if (err != NO_ERROR) {
+                    return err;
+                }
+            }
+            continue;
         }
 
-        while (mData->hasNext()) {
-            status_t err = strip_field(&proto, mData, mRestrictions, spec, 0);
+        // All of the other states read a varint, which may be split across writes.
+        uint8_t b = *buf++;
+        mBytesRead++;
+        if (mVarintShift >= 64) {
+            return fail("varint too long");
+        }
+        mVarint |= (uint64_t)(b & 0x7f) << mVarintShift;
+        mVarintShift += 7;
+        if ((b & 0x80) == 0) {
+            status_t err = onVarint();
             if (err != NO_ERROR) {
-                return err; // Error logged in strip_field.
+                return err;
             }
         }
+    }
+    return NO_ERROR;
+}
 
-        if (mData->bytesRead() != mData->size()) {
-            ALOGW("Buffer corrupted: expect %zu bytes, read %zu bytes", mData->size(),
-                    mData->bytesRead());
-            return BAD_VALUE;
+status_t StreamingFieldStripper::onVarint() {
+    uint64_t varint = mVarint;
+    mVarint = 0;
+    mVarintShift = 0;
+
+    switch (mState) {
+        case STATE_TAG: {
+            const Privacy* parentPolicy = mOpenMessages.empty()
+                    ? mRestrictions : mOpenMessages.back().policy;
+            mFieldTag = (uint32_t)varint;
+            mFieldPolicy = lookup(parentPolicy, read_field_id(mFieldTag));
+            if (mFieldPolicy != NULL && mFieldPolicy->children != NULL) {
+                // The field is a message and its fields have their own policies.
+                mState = STATE_MESSAGE_SIZE;
+                return NO_ERROR;
+            }
+            for (StrippedLevel& level: mLevels) {
+                level.keepField = level.spec.CheckPremission(mFieldPolicy, parentPolicy->policy);
+            }
+            switch (read_wire_type(mFieldTag)) {
+                case WIRE_TYPE_VARINT:
+                    mState = STATE_VARINT_VALUE;
+                    return NO_ERROR;
+                case WIRE_TYPE_LENGTH_DELIMITED:
+                    mState = STATE_LENGTH;
+                    return NO_ERROR;
+                case WIRE_TYPE_FIXED64:
+                case WIRE_TYPE_FIXED32:
+                    for (StrippedLevel& level: mLevels) {
+                        if (level.keepField) {
+                            level.proto->writeRawVarint(mFieldTag);
+                        }
+                    }
+                    mBytesRemaining = read_wire_type(mFieldTag) == WIRE_TYPE_FIXED64 ? 8 : 4;
+                    mState = STATE_BYTES;
+                    return NO_ERROR;
+                default:
+                    // Nothing but the tag to drop, like write_field_or_skip does.
+                    return onFieldEnd();
+            }
         }
+        case STATE_MESSAGE_SIZE: {
+            OpenMessage message;
+            message.policy = mFieldPolicy;
+            message.end = mBytesRead + (uint32_t)varint;
+            for (StrippedLevel& level: mLevels) {
+                message.tokens.push_back(level.proto->start(encode_field_id(mFieldPolicy)));
+            }
+            mOpenMessages.push_back(std::move(message));
+            return onFieldEnd();
+        }
+        case STATE_VARINT_VALUE:
+            for (StrippedLevel& level: mLevels) {
+                if (level.keepField) {
+                    level.proto->writeRawVarint(mFieldTag);
+                    level.proto->writeRawVarint(varint);
+                }
+            }
+            return onFieldEnd();
+        case STATE_LENGTH:
+            for (StrippedLevel& level: mLevels) {
+                if (level.keepField) {
+                    level.proto->writeLengthDelimitedHeader(read_field_id(mFieldTag), varint);
+                }
+            }
+            mBytesRemaining = varint;
+            if (mBytesRemaining == 0) {
+                return onFieldEnd();
+            }
+            mState = STATE_BYTES;
+            return NO_ERROR;
+        default:
+            return fail("unexpected state");
+    }
+}
 
-        mData = proto.data();
-        mSize = proto.size();
-        mCurrentLevel = privacyPolicy;
+status_t StreamingFieldStripper::onFieldEnd() {
+    mState = STATE_TAG;
+    // Close the messages that this field was the last one of.
+    while (!mOpenMessages.empty() && mBytesRead >= mOpenMessages.back().end) {
+        if (mBytesRead > mOpenMessages.back().end) {
+            return fail("field overruns its message");
+        }
+        const OpenMessage& message = mOpenMessages.back();
+        for (size_t i = 0; i < mLevels.size(); i++) {
+            mLevels[i].proto->end(message.tokens[i]);
+        }
+        mOpenMessages.pop_back();
     }
     return NO_ERROR;
 }
 
-status_t FieldStripper::writeData(int fd) {
-    status_t err = NO_ERROR;
-    sp<ProtoReader> reader = mData;
-    if (mData == nullptr) {
-        // There had been an error processing the data. We won't write anything,
-        // but we also won't return an error, because errors are fatal.
-        return NO_ERROR;
+status_t StreamingFieldStripper::finish() {
+    if (mError != NO_ERROR || mLevels.empty()) {
+        return mError;
     }
-    while (reader->readBuffer() != NULL) {
-        err = WriteFully(fd, reader->readBuffer(), reader->currentToRead()) ? NO_ERROR : -errno;
-        reader->move(reader->currentToRead());
-        if (err != NO_ERROR) return err;
+    if (mState != STATE_TAG || mVarintShift != 0 || !mOpenMessages.empty()) {
+        return fail("data ends in the middle of a field");
     }
     return NO_ERROR;
 }
 
+status_t StreamingFieldStripper::fail(const char* reason) {
+    ALOGW("Bad value when stripping tag %#x at %zu, depth %zu: %s", mFieldTag, mBytesRead,
+            mOpenMessages.size(), reason);
+    mError = BAD_VALUE;
+    // Free what was stripped so far, it won't be written.
+    for (StrippedLevel& level: mLevels) {
+        level.proto.reset();
+    }
+    mOpenMessages.clear();
+    return mError;
+}
 
 // ================================================================================
 FilterFd::FilterFd(uint8_t privacyPolicy, int fd)
@@ -256,37 +333,77 @@ void PrivacyFilter::addFd(const sp<FilterFd>& output) {
     mOutputs.push_back(output);
 }
 
+sp<StreamingFieldStripper> PrivacyFilter::newStripper(uint8_t bufferLevel) const {
+    vector<uint8_t> privacyPolicies;
+    for (const sp<FilterFd>& output: mOutputs) {
+        privacyPolicies.push_back(output->getPrivacyPolicy());
+    }
+    return new StreamingFieldStripper(mRestrictions, privacyPolicies, bufferLevel);
+}
+
 status_t PrivacyFilter::writeData(const FdBuffer& buffer, uint8_t bufferLevel,
         size_t* maxSize) {
+    return writeData(buffer.data(), buffer.stripper(), bufferLevel, maxSize);
+}
+
+/**
+ * Write everything left in the reader to the file descriptor.
+ */
+static status_t write_reader(int fd, const sp<ProtoReader>& reader) {
+    status_t err = NO_ERROR;
+    while (reader->readBuffer() != NULL) {
+        err = WriteFully(fd, reader->readBuffer(), reader->currentToRead()) ? NO_ERROR : -errno;
+        reader->move(reader->currentToRead());
+        if (err != NO_ERROR) return err;
+    }
+    return NO_ERROR;
+}
+
+status_t PrivacyFilter::writeData(const sp<EncodedBuffer>& data,
+        const sp<StreamingFieldStripper>& streamedStripper, uint8_t bufferLevel,
+        size_t* maxSize) {
     status_t err;
 
     if (maxSize != NULL) {
         *maxSize = 0;
     }
 
-    // Order the writes by privacy filter, with increasing levels of filtration,k
-    // so we can do the filter once, and then write many times.
-    sort(mOutputs.begin(), mOutputs.end(),
-        [](const sp<FilterFd>& a, const sp<FilterFd>& b) -> bool { 
-            return a->getPrivacyPolicy() < b->getPrivacyPolicy();
-        });
+    sp<StreamingFieldStripper> stripper = streamedStripper;
+    if (stripper == nullptr) {
+        // Strip to every policy in one pass over the data.
+        stripper = newStripper(bufferLevel);
+        sp<ProtoReader> reader = data->read();
+        while (reader->readBuffer() != NULL) {
+            stripper->write(reader->readBuffer(), reader->currentToRead());
+            reader->move(reader->currentToRead());
+        }
+    }
+    stripper->finish();
 
-    uint8_t privacyPolicy = PRIVACY_POLICY_LOCAL; // a.k.a. no filtering
-    FieldStripper fieldStripper(mRestrictions, buffer.data()->read(), bufferLevel);
     for (const sp<FilterFd>& output: mOutputs) {
-        // Do another level of filtering if necessary
-        if (privacyPolicy != output->getPrivacyPolicy()) {
-            privacyPolicy = output->getPrivacyPolicy();
-            err = fieldStripper.strip(privacyPolicy);
-            if (err != NO_ERROR) {
-                // We can't successfully strip this data.  We will skip
-                // the rest of this section.
-                return NO_ERROR;
+        const uint8_t privacyPolicy = output->getPrivacyPolicy();
+        sp<ProtoReader> reader;
+        ssize_t dataSize;
+        if (stripper->keepsUnfilteredData(privacyPolicy)) {
+            reader = data->read();
+            dataSize = data->size();
+        } else {
+            ProtoOutputStream* proto = stripper->getStrippedData(privacyPolicy);
+            if (proto == NULL) {
+                // We can't successfully strip this data, or the data was stripped as it
+                // was read before this output was added.  We will skip this section
+                // for it.
+                if (stripper->getError() == NO_ERROR) {
+                    ALOGW("Section %d was not stripped to privacy policy %d", mSectionId,
+                            privacyPolicy);
+                }
+                continue;
             }
+            dataSize = proto->size();
+            reader = proto->data();
         }
 
         // Write the resultant buffer to the fd, along with the header.
-        ssize_t dataSize = fieldStripper.dataSize();
         if (dataSize > 0) {
             err = write_section_header(output->getFd(), mSectionId, dataSize);
             if (err != NO_ERROR) {
@@ -294,7 +411,7 @@ status_t PrivacyFilter::writeData(const FdBuffer& buffer, uint8_t bufferLevel,
                 continue;
             }
 
-            err = fieldStripper.writeData(output->getFd());
+            err = write_reader(output->getFd(), reader);
             if (err != NO_ERROR) {
                 output->onWriteError(err);
                 continue;
@@ -333,21 +450,60 @@ void ReadbackFilterFd::onWriteError(status_t err) {
 }
 
 // ================================================================================
+status_t filter_and_write_section(int to, int sectionId, const FdBuffer& sectionData,
+        uint8_t bufferLevel, const IncidentReportArgs& args) {
+    // We need this section, but we need to strip it to the level provided in args.
+    PrivacyFilter filter(sectionId, get_privacy_of_section(sectionId));
+    filter.addFd(new ReadbackFilterFd(args.getPrivacyPolicy(), to));
+
+    // Do the filter and write.
+    status_t err = filter.writeData(sectionData, bufferLevel, nullptr);
+    if (err != NO_ERROR) {
+        ALOGW("filter_and_write_section filter.writeData had an error: %s", strerror(-err));
+        return err;
+    }
+    return NO_ERROR;
+}
+
 status_t filter_and_write_report(int to, int from, uint8_t bufferLevel,
         const IncidentReportArgs& args) {
     status_t err;
     sp<ProtoFileReader> reader = new ProtoFileReader(from);
 
+    // With the index of the report, go straight to the requested sections.
+    const std::vector<ProtoFieldPosition>* index = reader->fieldIndex();
+    if (index != NULL) {
+        for (const ProtoFieldPosition& field : *index) {
+            uint32_t fieldId = read_field_id(field.tag);
+            if (read_wire_type(field.tag) != WIRE_TYPE_LENGTH_DELIMITED
+                    || !args.containsSection(fieldId, section_requires_specific_mention(fieldId))) {
+                continue;
+            }
+            FdBuffer sectionData;
+            err = reader->seek(field.offset);
+            if (err == NO_ERROR) {
+                err = sectionData.write(reader, field.size);
+            }
+            if (err != NO_ERROR) {
+                ALOGW("filter_and_write_report reading section %d failed: %s", fieldId,
+                        strerror(-err));
+                return err;
+            }
+
+            err = filter_and_write_section(to, fieldId, sectionData, bufferLevel, args);
+            if (err != NO_ERROR) {
+                return err;
+            }
+        }
+        return reader->getError();
+    }
+
     while (reader->hasNext()) {
         uint64_t fieldTag = reader->readRawVarint();
         uint32_t fieldId = read_field_id(fieldTag);
         uint8_t wireType = read_wire_type(fieldTag);
         if (wireType == WIRE_TYPE_LENGTH_DELIMITED
                 && args.containsSection(fieldId, section_requires_specific_mention(fieldId))) {
-            // We need this field, but we need to strip it to the level provided in args.
-            PrivacyFilter filter(fieldId, get_privacy_of_section(fieldId));
-            filter.addFd(new ReadbackFilterFd(args.getPrivacyPolicy(), to));
-
             // Read this section from the reader into an FdBuffer
             size_t sectionSize = reader->readRawVarint();
             FdBuffer sectionData;
@@ -358,10 +514,8 @@ status_t filter_and_write_report(int to, int from, uint8_t bufferLevel,
                 return err;
             }
 
-            // Do the filter and write.
-            err = filter.writeData(sectionData, bufferLevel, nullptr);
+            err = filter_and_write_section(to, fieldId, sectionData, bufferLevel, args);
             if (err != NO_ERROR) {
-                ALOGW("filter_and_write_report filter.writeData had an error: %s", strerror(-err));
                 return err;
             }
         } else {
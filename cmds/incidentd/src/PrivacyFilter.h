@@ -27,6 +27,9 @@
 #include <stdint.h>
 #include <utils/Errors.h>
 
+#include <memory>
+#include <vector>
+
 namespace android {
 namespace os {
 namespace incidentd {
@@ -53,6 +56,115 @@ private:
     int mFd;
 };
 
+/**
+ * Strips the data of a section to several privacy policies in a single pass, as the data
+ * arrives, so the unfiltered data doesn't need to be kept around.  Policies that keep all
+ * of the data (those at or below the level the data is already filtered to, or that don't
+ * restrict anything) aren't parsed for; their output is the unfiltered data itself.
+ */
+class StreamingFieldStripper : public virtual RefBase {
+public:
+    /**
+     * Strips to each of privacyPolicies. The data is assumed to have already been filtered
+     * to bufferLevel.
+     */
+    StreamingFieldStripper(const Privacy* restrictions, const vector<uint8_t>& privacyPolicies,
+            uint8_t bufferLevel);
+    virtual ~StreamingFieldStripper();
+
+    /**
+     * Whether the stripper can produce the data for privacyPolicy.
+     */
+    bool hasPolicy(uint8_t privacyPolicy) const;
+
+    /**
+     * Whether privacyPolicy keeps all of the data, so the unfiltered data is written for it.
+     */
+    bool keepsUnfilteredData(uint8_t privacyPolicy) const;
+
+    /**
+     * Whether any of the policies keeps all of the data, so the caller must hold on to the
+     * unfiltered data too.
+     */
+    bool needsUnfilteredData() const { return mNeedsUnfilteredData; }
+
+    /**
+     * Parse the next size bytes of the data, which may end anywhere in a field. Once it
+     * returns an error, the stripped data is unusable and the rest of the data is ignored.
+     */
+    status_t write(uint8_t const* buf, size_t size);
+
+    /**
+     * Called after the last write. Returns BAD_VALUE if the data ended in the middle of
+     * a field.
+     */
+    status_t finish();
+
+    /**
+     * The first error hit while stripping, NO_ERROR if there was none.
+     */
+    status_t getError() const { return mError; }
+
+    /**
+     * The data stripped to privacyPolicy.  NULL if the policy keeps the unfiltered data,
+     * if the policy wasn't given, or if there was an error.
+     */
+    ProtoOutputStream* getStrippedData(uint8_t privacyPolicy) const;
+
+private:
+    enum State {
+        // The bytes are the tag of the next field.
+        STATE_TAG,
+        // The bytes are the size of a message whose fields have their own policies.
+        STATE_MESSAGE_SIZE,
+        // The bytes are the value of a varint field.
+        STATE_VARINT_VALUE,
+        // The bytes are the size of a length delimited field.
+        STATE_LENGTH,
+        // The bytes are copied as they are to the policies keeping the field.
+        STATE_BYTES,
+    };
+
+    struct StrippedLevel {
+        StrippedLevel(uint8_t privacyPolicy);
+
+        uint8_t privacyPolicy;
+        PrivacySpec spec;
+        std::unique_ptr<ProtoOutputStream> proto;
+
+        // Whether the policy keeps the field being parsed.
+        bool keepField;
+    };
+
+    // A message being parsed whose fields have their own policies.
+    struct OpenMessage {
+        const Privacy* policy;
+        // Position in the data where the message ends.
+        size_t end;
+        // The token of the message in the proto of each StrippedLevel.
+        vector<uint64_t> tokens;
+    };
+
+    const Privacy* mRestrictions;
+    bool mNeedsUnfilteredData;
+    vector<StrippedLevel> mLevels;
+    vector<uint8_t> mUnfilteredPolicies;
+
+    State mState;
+    uint64_t mVarint;
+    int mVarintShift;
+    uint32_t mFieldTag;
+    const Privacy* mFieldPolicy;
+    size_t mBytesRemaining;
+    size_t mBytesRead;
+    vector<OpenMessage> mOpenMessages;
+    status_t mError;
+
+    status_t onVarint();
+    status_t onFieldEnd();
+    status_t fail(const char* reason);
+};
+
 /**
  * PrivacyFilter holds the original protobuf data and strips PII-sensitive fields
  * for several requests, streaming them to a set of corresponding file descriptors.
@@ -72,6 +184,12 @@ public:
      */
     void addFd(const sp<FilterFd>& output);
 
+    /**
+     * A stripper for the privacy policies of the file descriptors added so far, to strip
+     * the data while it is read.  The data is assumed to be filtered to bufferLevel.
+     */
+    sp<StreamingFieldStripper> newStripper(uint8_t bufferLevel) const;
+
     /**
      * Write the data, filtered according to the privacy specs, to each of the
      * file descriptors.  Any non-NO_ERROR return codes are fatal to the whole
@@ -85,12 +203,27 @@ public:
      */
     status_t writeData(const FdBuffer& buffer, uint8_t bufferLevel, size_t* maxSize);
 
+    /**
+     * Same as above, for data that outlived its FdBuffer.  If the data was stripped while
+     * it was read, stripper holds the stripped data and data holds the unfiltered data, if
+     * the stripper needed it.
+     */
+    status_t writeData(const sp<EncodedBuffer>& data, const sp<StreamingFieldStripper>& stripper,
+            uint8_t bufferLevel, size_t* maxSize);
+
 private:
     int mSectionId;
     const Privacy* mRestrictions;
     vector<sp<FilterFd>> mOutputs;
 };
 
+/**
+ * Write one section of a persisted report, which has already been filtered to bufferLevel,
+ * to the fd, filtered to the privacy policy in args.
+ */
+status_t filter_and_write_section(int to, int sectionId, const FdBuffer& sectionData,
+        uint8_t bufferLevel, const IncidentReportArgs& args);
+
 status_t filter_and_write_report(int to, int from, uint8_t bufferLevel,
         const IncidentReportArgs& args);
 
@@ -24,6 +24,7 @@
 #include "proto_util.h"
 #include "report_directory.h"
 #include "section_list.h"
+#include "SectionScheduler.h"
 
 #include <android-base/file.h>
 #include <android/os/DropBoxManager.h>
@@ -37,7 +38,9 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <memory>
 #include <string>
+#include <thread>
 #include <time.h>
 
 namespace android {
@@ -338,7 +341,12 @@ void ReportBatch::removeRequest(const sp<ReportRequest>& request) {
 ReportWriter::ReportWriter(const sp<ReportBatch>& batch)
         :mBatch(batch),
          mPersistedFile(),
-         mMaxPersistedPrivacyPolicy(PRIVACY_POLICY_UNSET) {
+         mMaxPersistedPrivacyPolicy(PRIVACY_POLICY_UNSET),
+         mSectionTimeoutMs(-1),
+         mDeferWrites(false),
+         mDeferredData(),
+         mDeferredStripper(),
+         mSectionStripper() {
 }
 
 ReportWriter::~ReportWriter() {
@@ -355,6 +363,7 @@ void ReportWriter::setMaxPersistedPrivacyPolicy(uint8_t privacyPolicy) {
 void ReportWriter::startSection(int sectionId) {
     mCurrentSectionId = sectionId;
     mSectionStartTimeMs = uptimeMillis();
+    mSectionTimeoutMs = -1;
 
     mSectionStatsCalledForSectionId = -1;
     mDumpSizeBytes = 0;
@@ -364,7 +373,9 @@ void ReportWriter::startSection(int sectionId) {
     mSectionBufferSuccess = false;
     mHadError = false;
     mSectionErrors.clear();
-    
+    mMaxSectionDataFilteredSize = 0;
+    mDeferredData = nullptr;
+    mDeferredStripper = nullptr;
 }
 
 void ReportWriter::setSectionStats(const FdBuffer& buffer) {
@@ -376,6 +387,33 @@ void ReportWriter::setSectionStats(const FdBuffer& buffer) {
     mSectionBufferSuccess = !buffer.timedOut() && !buffer.truncated();
 }
 
+void ReportWriter::setSectionTimeoutMs(int64_t timeoutMs) {
+    mSectionTimeoutMs = timeoutMs;
+}
+
+int64_t ReportWriter::getSectionTimeoutMs(const Section* section) const {
+    if (mSectionTimeoutMs >= 0 && mSectionTimeoutMs < section->timeoutMs) {
+        return mSectionTimeoutMs;
+    }
+    return section->timeoutMs;
+}
+
+sp<StreamingFieldStripper> ReportWriter::newSectionStripper(int sectionId) {
+    PrivacyFilter filter(sectionId, get_privacy_of_section(sectionId));
+    addSectionFds(&filter, sectionId);
+    return filter.newStripper(PRIVACY_POLICY_LOCAL);
+}
+
+void ReportWriter::setSectionStripper(const sp<StreamingFieldStripper>& stripper) {
+    mSectionStripper = stripper;
+}
+
+void ReportWriter::stripWhileReading(FdBuffer* buffer) {
+    if (mSectionStripper != nullptr) {
+        buffer->setStripper(mSectionStripper);
+    }
+}
+
 void ReportWriter::endSection(IncidentMetadata::SectionStats* sectionMetadata) {
     long endTime = uptimeMillis();
 
@@ -447,33 +485,126 @@ void ReportWriter::vflog(const Section* section, status_t err, int level, const
 
 // Reads data from FdBuffer and writes it to the requests file descriptor.
 status_t ReportWriter::writeSection(const FdBuffer& buffer) {
-    PrivacyFilter filter(mCurrentSectionId, get_privacy_of_section(mCurrentSectionId));
+    if (mDeferWrites) {
+        // The EncodedBuffer stays alive after the section's FdBuffer is gone.
+        mDeferredData = buffer.data();
+        mDeferredStripper = buffer.stripper();
+        return NO_ERROR;
+    }
+    return writeSectionData(mCurrentSectionId, buffer.data(), buffer.stripper(),
+            &mMaxSectionDataFilteredSize);
+}
 
+void ReportWriter::setDeferWrites(bool deferWrites) {
+    mDeferWrites = deferWrites;
+}
+
+status_t ReportWriter::writeDeferredSection(const ReportWriter& sectionWriter,
+        IncidentMetadata::SectionStats* sectionStats) {
+    if (sectionWriter.mDeferredData == nullptr) {
+        // The section had nothing to write.
+        return NO_ERROR;
+    }
+    size_t maxSize = 0;
+    status_t err = writeSectionData(sectionWriter.mCurrentSectionId, sectionWriter.mDeferredData,
+            sectionWriter.mDeferredStripper, &maxSize);
+    sectionStats->set_report_size_bytes(maxSize);
+    return err;
+}
+
+void ReportWriter::addSectionFds(PrivacyFilter* filter, int sectionId) {
     // Add the fd for the persisted requests
     if (mPersistedFile != nullptr) {
-        filter.addFd(new PersistedFilterFd(mMaxPersistedPrivacyPolicy,
+        filter->addFd(new PersistedFilterFd(mMaxPersistedPrivacyPolicy,
                     mPersistedFile->getDataFileFd(), mPersistedFile));
     }
 
     // Add the fds for the streamed requests
-    mBatch->forEachStreamingRequest([&filter, this](const sp<ReportRequest>& request) {
+    mBatch->forEachStreamingRequest([filter, sectionId](const sp<ReportRequest>& request) {
         if (request->ok()
-                && request->args.containsSection(mCurrentSectionId,
-                    section_requires_specific_mention(mCurrentSectionId))) {
-            filter.addFd(new StreamingFilterFd(request->args.getPrivacyPolicy(),
+                && request->args.containsSection(sectionId,
+                    section_requires_specific_mention(sectionId))) {
+            filter->addFd(new StreamingFilterFd(request->args.getPrivacyPolicy(),
                         request->getFd(), request));
         }
     });
+}
 
-    return filter.writeData(buffer, PRIVACY_POLICY_LOCAL, &mMaxSectionDataFilteredSize);
+status_t ReportWriter::writeSectionData(int sectionId, const sp<EncodedBuffer>& data,
+        const sp<StreamingFieldStripper>& stripper, size_t* maxSize) {
+    PrivacyFilter filter(sectionId, get_privacy_of_section(sectionId));
+    addSectionFds(&filter, sectionId);
+    return filter.writeData(data, stripper, PRIVACY_POLICY_LOCAL, maxSize);
 }
 
 
 // ================================================================================
-Reporter::Reporter(const sp<WorkDirectory>& workDirectory, const sp<ReportBatch>& batch)
+// Sections execute on their own threads, at most this many at a time.  The data of a
+// section is kept until the sections before it are written, so this also bounds how
+// many section buffers are held at once.
+const size_t MAX_CONCURRENT_SECTIONS = 4;
+
+/**
+ * A section executing on its own thread, into a ReportWriter that keeps its data.
+ */
+struct SectionTask {
+    const Section* section;
+    ReportWriter writer;
+    IncidentMetadata::SectionStats stats;
+    status_t err;
+    bool executed;
+    std::thread worker;
+
+    // A timeout of 0 means there was no time left for the section, so it doesn't execute.
+    SectionTask(const Section* section, int64_t timeoutMs, const sp<ReportBatch>& batch,
+            const sp<StreamingFieldStripper>& stripper);
+    ~SectionTask();
+
+    // Waits for the section to finish executing.
+    void join();
+};
+
+SectionTask::SectionTask(const Section* s, int64_t timeoutMs, const sp<ReportBatch>& batch,
+            const sp<StreamingFieldStripper>& stripper)
+        :section(s),
+         writer(batch),
+         stats(),
+         err(NO_ERROR),
+         executed(timeoutMs > 0) {
+    if (!executed) {
+        stats.set_id(section->id);
+        stats.set_success(false);
+        stats.set_timed_out(true);
+        stats.set_error_msg("Skipped, the report timed out");
+        return;
+    }
+    writer.setDeferWrites(true);
+    writer.setSectionStripper(stripper);
+    worker = std::thread([this, timeoutMs]() {
+        writer.startSection(section->id);
+        writer.setSectionTimeoutMs(timeoutMs);
+        err = section->Execute(&writer);
+        writer.endSection(&stats);
+    });
+}
+
+SectionTask::~SectionTask() {
+    join();
+}
+
+void SectionTask::join() {
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+// ================================================================================
+Reporter::Reporter(const sp<WorkDirectory>& workDirectory, const sp<ReportBatch>& batch,
+            const sp<SectionScheduler>& scheduler)
         :mWorkDirectory(workDirectory),
          mWriter(batch),
-         mBatch(batch) {
+         mBatch(batch),
+         mScheduler(scheduler) {
 }
 
 Reporter::~Reporter() {
@@ -484,6 +615,8 @@ void Reporter::runReport(size_t* reportByteSize) {
 
     IncidentMetadata metadata;
     int persistedPrivacyPolicy = PRIVACY_POLICY_UNSET;
+    vector<const Section*> sections;
+    vector<unique_ptr<SectionTask>> tasks;
 
     (*reportByteSize) = 0;
 
@@ -577,33 +710,70 @@ void Reporter::runReport(size_t* reportByteSize) {
     // sections for it.
     cancel_and_remove_failed_requests();
 
-    // For each of the report fields, see if we need it, and if so, execute the command
-    // and report to those that care that we're doing it.
+    // For each of the report fields, see if we need it.
     for (const Section** section = SECTION_LIST; *section; section++) {
-        const int sectionId = (*section)->id;
-
         // If nobody wants this section, skip it.
-        if (!mBatch->containsSection(sectionId)) {
-            continue;
+        if (mBatch->containsSection((*section)->id)) {
+            sections.push_back(*section);
         }
+    }
 
-        ALOGD("Start incident report section %d '%s'", sectionId, (*section)->name.string());
-        IncidentMetadata::SectionStats* sectionMetadata = metadata.add_sections();
+    // With a report timeout, the scheduler orders the sections so the quickest go first.
+    const int64_t reportStartMs = uptimeMillis();
+    if (mScheduler != nullptr) {
+        mScheduler->schedule(&sections);
+    }
 
-        // Notify listener of starting
-        mBatch->forEachListener(sectionId, [sectionId](const auto& listener) {
-            listener->onReportSectionStatus(
-                    sectionId, IIncidentReportStatusListener::STATUS_STARTING);
-        });
+    // Execute the commands and report to those that care that we're doing it.  Sections
+    // execute concurrently, each one into its own buffer, and are written out in the
+    // order they were started once they and all the sections before them are done.
+    // Every section still enforces its own timeout, cut to what is left of the report
+    // timeout.
+    for (size_t i = 0; i < sections.size(); i++) {
+        while (tasks.size() < sections.size() && tasks.size() < i + MAX_CONCURRENT_SECTIONS) {
+            const Section* section = sections[tasks.size()];
+            const int sectionId = section->id;
+            ALOGD("Start incident report section %d '%s'", sectionId, section->name.string());
+
+            // Notify listener of starting
+            mBatch->forEachListener(sectionId, [sectionId](const auto& listener) {
+                listener->onReportSectionStatus(
+                        sectionId, IIncidentReportStatusListener::STATUS_STARTING);
+            });
+
+            int64_t timeoutMs = section->timeoutMs;
+            if (mScheduler != nullptr) {
+                timeoutMs = mScheduler->getTimeoutMs(section, reportStartMs, uptimeMillis());
+            }
+            if (timeoutMs <= 0) {
+                ALOGW("Skipping incident report section %d '%s', the report timed out",
+                        sectionId, section->name.string());
+            }
+
+            // Go get the data.  The policies to strip to are decided here, because the
+            // batch can only be looked at from this thread.
+            tasks.push_back(std::make_unique<SectionTask>(section, timeoutMs, mBatch,
+                        mWriter.newSectionStripper(sectionId)));
+        }
 
-        // Go get the data and write it into the file descriptors.
-        mWriter.startSection(sectionId);
-        err = (*section)->Execute(&mWriter);
-        mWriter.endSection(sectionMetadata);
+        SectionTask* task = tasks[i].get();
+        const int sectionId = task->section->id;
+        task->join();
+
+        // Write the data into the file descriptors.
+        err = task->err;
+        if (err == NO_ERROR) {
+            err = mWriter.writeDeferredSection(task->writer, &task->stats);
+        }
+        IncidentMetadata::SectionStats* sectionMetadata = metadata.add_sections();
+        *sectionMetadata = task->stats;
+        if (mScheduler != nullptr && mScheduler->hasReportTimeout() && task->executed) {
+            mScheduler->record(task->section, task->stats);
+        }
 
         // Sections returning errors are fatal. Most errors should not be fatal.
         if (err != NO_ERROR) {
-            mWriter.error((*section), err, "Section failed. Stopping report.");
+            mWriter.error(task->section, err, "Section failed. Stopping report.");
             goto DONE;
         }
 
@@ -623,10 +793,19 @@ void Reporter::runReport(size_t* reportByteSize) {
                         sectionId, IIncidentReportStatusListener::STATUS_FINISHED);
         });
 
-        ALOGD("Finish incident report section %d '%s'", sectionId, (*section)->name.string());
+        ALOGD("Finish incident report section %d '%s'", sectionId,
+                task->section->name.string());
+        tasks[i].reset();
     }
 
 DONE:
+    // Wait for the sections still executing after a fatal error.  Their data is dropped.
+    tasks.clear();
+
+    if (mScheduler != nullptr && mScheduler->hasReportTimeout()) {
+        mScheduler->save();
+    }
+
     // Finish up the persisted file.
     if (mPersistedFile != nullptr) {
         mPersistedFile->closeDataFile();
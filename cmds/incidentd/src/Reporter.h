@@ -39,7 +39,10 @@ using namespace std;
 using namespace android::content;
 using namespace android::os;
 
+class PrivacyFilter;
 class Section;
+class SectionScheduler;
+class StreamingFieldStripper;
 
 // ================================================================================
 class ReportRequest : public virtual RefBase {
@@ -195,11 +198,53 @@ public:
 
     void setSectionStats(const FdBuffer& buffer);
 
+    /**
+     * Set how long the current section may take, when it is less than its own timeout,
+     * because the report is running out of time.
+     */
+    void setSectionTimeoutMs(int64_t timeoutMs);
+
+    /**
+     * How long section may take.  Sections use this instead of their own timeout.
+     */
+    int64_t getSectionTimeoutMs(const Section* section) const;
+
+    /**
+     * A stripper for the privacy policies that the requests want sectionId filtered to,
+     * so a section can be stripped as it is read.
+     */
+    sp<StreamingFieldStripper> newSectionStripper(int sectionId);
+
+    /**
+     * Set the stripper that stripWhileReading hands to the buffer of the section.
+     */
+    void setSectionStripper(const sp<StreamingFieldStripper>& stripper);
+
+    /**
+     * Called by sections before reading into buffer, so the data is stripped as it is
+     * read instead of being kept whole.  Does nothing without a section stripper.
+     */
+    void stripWhileReading(FdBuffer* buffer);
+
     void warning(const Section* section, status_t err, const char* format, ...);
     void error(const Section* section, status_t err, const char* format, ...);
 
     status_t writeSection(const FdBuffer& buffer);
 
+    /**
+     * When set, writeSection keeps the data of the section instead of writing it, so the
+     * section can execute on another thread.  The ReportWriter that owns the outputs then
+     * writes it with writeDeferredSection, in section order.
+     */
+    void setDeferWrites(bool deferWrites);
+
+    /**
+     * Writes the data that sectionWriter kept for its current section and records the
+     * filtered size in sectionStats, which sectionWriter's endSection filled in.
+     */
+    status_t writeDeferredSection(const ReportWriter& sectionWriter,
+            IncidentMetadata::SectionStats* sectionStats);
+
 private:
     // Data about all requests
     sp<ReportBatch> mBatch;
@@ -225,6 +270,11 @@ private:
      */
     int64_t mSectionStartTimeMs;
 
+    /**
+     * How long the current section may take, or -1 for its own timeout.
+     */
+    int64_t mSectionTimeoutMs;
+
     /**
      * The last section that setSectionStats was called for, so if someone misses
      * it we can log that.
@@ -244,6 +294,22 @@ private:
     string mSectionErrors;
     size_t mMaxSectionDataFilteredSize;
 
+    /**
+     * Whether writeSection keeps the data in mDeferredData.
+     */
+    bool mDeferWrites;
+    sp<EncodedBuffer> mDeferredData;
+    sp<StreamingFieldStripper> mDeferredStripper;
+
+    /**
+     * The stripper for the current section, set by setSectionStripper.
+     */
+    sp<StreamingFieldStripper> mSectionStripper;
+
+    void addSectionFds(PrivacyFilter* filter, int sectionId);
+    status_t writeSectionData(int sectionId, const sp<EncodedBuffer>& data,
+            const sp<StreamingFieldStripper>& stripper, size_t* maxSize);
+
     void vflog(const Section* section, status_t err, int level, const char* levelText,
         const char* format, va_list args);
 };
@@ -251,7 +317,8 @@ private:
 // ================================================================================
 class Reporter : public virtual RefBase {
 public:
-    Reporter(const sp<WorkDirectory>& workDirectory, const sp<ReportBatch>& batch);
+    Reporter(const sp<WorkDirectory>& workDirectory, const sp<ReportBatch>& batch,
+            const sp<SectionScheduler>& scheduler = nullptr);
 
     virtual ~Reporter();
 
@@ -263,6 +330,7 @@ private:
     ReportWriter mWriter;
     sp<ReportBatch> mBatch;
     sp<ReportFile> mPersistedFile;
+    sp<SectionScheduler> mScheduler;
 
     void cancel_and_remove_failed_requests();
 };
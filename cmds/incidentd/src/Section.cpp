@@ -56,7 +56,6 @@ const int FIELD_ID_INCIDENT_METADATA = 2;
 
 // incident section parameters
 const char INCIDENT_HELPER[] = "/system/bin/incident_helper";
-const char* GZIP[] = {"/system/bin/gzip", NULL};
 
 static pid_t fork_execute_incident_helper(const int id, Fpipe* p2cPipe, Fpipe* c2pPipe) {
     const char* ihArgs[]{INCIDENT_HELPER, "-s", String8::format("%d", id).string(), NULL};
@@ -121,9 +120,11 @@ status_t FileSection::Execute(ReportWriter* writer) const {
     }
 
     // parent process
+    writer->stripWhileReading(&buffer);
     status_t readStatus = buffer.readProcessedDataInStream(fd.get(), std::move(p2cPipe.writeFd()),
                                                            std::move(c2pPipe.readFd()),
-                                                           this->timeoutMs, mIsSysfs);
+                                                           writer->getSectionTimeoutMs(this),
+                                                           mIsSysfs);
     writer->setSectionStats(buffer);
     if (readStatus != NO_ERROR || buffer.timedOut()) {
         ALOGW("[%s] failed to read data from incident helper: %s, timedout: %s",
@@ -172,20 +173,6 @@ status_t GZipSection::Execute(ReportWriter* writer) const {
         return NO_ERROR;  // e.g. LAST_KMSG will reach here in user build.
     }
     FdBuffer buffer;
-    Fpipe p2cPipe;
-    Fpipe c2pPipe;
-    // initiate pipes to pass data to/from gzip
-    if (!p2cPipe.init() || !c2pPipe.init()) {
-        ALOGW("[%s] failed to setup pipes", this->name.string());
-        return -errno;
-    }
-
-    pid_t pid = fork_execute_cmd((char* const*)GZIP, &p2cPipe, &c2pPipe);
-    if (pid == -1) {
-        ALOGW("[%s] failed to fork", this->name.string());
-        return -errno;
-    }
-    // parent process
 
     // construct Fdbuffer to output GZippedfileProto, the reason to do this instead of using
     // ProtoOutputStream is to avoid allocation of another buffer inside ProtoOutputStream.
@@ -203,22 +190,15 @@ status_t GZipSection::Execute(ReportWriter* writer) const {
     size_t dataBeginAt = internalBuffer->wp()->pos();
     VLOG("[%s] editPos=%zu, dataBeginAt=%zu", this->name.string(), editPos, dataBeginAt);
 
-    status_t readStatus = buffer.readProcessedDataInStream(
-            fd.get(), std::move(p2cPipe.writeFd()), std::move(c2pPipe.readFd()), this->timeoutMs,
-            isSysfs(mFilenames[index]));
+    // Compressed in this process, straight into the buffer, instead of piped through gzip.
+    status_t readStatus = buffer.readCompressed(fd.get(), writer->getSectionTimeoutMs(this));
     writer->setSectionStats(buffer);
     if (readStatus != NO_ERROR || buffer.timedOut()) {
-        ALOGW("[%s] failed to read data from gzip: %s, timedout: %s", this->name.string(),
+        ALOGW("[%s] failed to gzip data: %s, timedout: %s", this->name.string(),
               strerror(-readStatus), buffer.timedOut() ? "true" : "false");
-        kill_child(pid);
         return readStatus;
     }
 
-    status_t gzipStatus = wait_child(pid);
-    if (gzipStatus != NO_ERROR) {
-        ALOGW("[%s] abnormal child process: %s", this->name.string(), strerror(-gzipStatus));
-        return gzipStatus;
-    }
     // Revisit the actual size from gzip result and edit the internal buffer accordingly.
     size_t dataSize = buffer.size() - dataBeginAt;
     internalBuffer->wp()->rewind()->move(editPos);
@@ -320,7 +300,8 @@ status_t WorkerThreadSection::Execute(ReportWriter* writer) const {
     }
 
     // Loop reading until either the timeout or the worker side is done (i.e. eof).
-    err = buffer.read(data->pipe.readFd().get(), this->timeoutMs);
+    writer->stripWhileReading(&buffer);
+    err = buffer.read(data->pipe.readFd().get(), writer->getSectionTimeoutMs(this));
     if (err != NO_ERROR) {
         ALOGE("[%s] reader failed with error '%s'", this->name.string(), strerror(-err));
     }
@@ -412,7 +393,8 @@ status_t CommandSection::Execute(ReportWriter* writer) const {
     }
 
     cmdPipe.writeFd().reset();
-    status_t readStatus = buffer.read(ihPipe.readFd().get(), this->timeoutMs);
+    writer->stripWhileReading(&buffer);
+    status_t readStatus = buffer.read(ihPipe.readFd().get(), writer->getSectionTimeoutMs(this));
     writer->setSectionStats(buffer);
     if (readStatus != NO_ERROR || buffer.timedOut()) {
         ALOGW("[%s] failed to read data from incident helper: %s, timedout: %s",
@@ -476,6 +458,9 @@ status_t DumpsysSection::BlockingCall(int pipeWriteFd) const {
 // initialization only once in Section.cpp.
 map<log_id_t, log_time> LogSection::gLastLogsRetrieved;
 
+// Sections of a report execute concurrently, so the log sections share the map under a lock.
+static mutex gLastLogsRetrievedLock;
+
 LogSection::LogSection(int id, log_id_t logID) : WorkerThreadSection(id), mLogID(logID) {
     name = "logcat ";
     name += android_log_id_to_name(logID);
@@ -509,12 +494,23 @@ static inline int32_t get4LE(uint8_t const* src) {
 }
 
 status_t LogSection::BlockingCall(int pipeWriteFd) const {
+    bool retrievedBefore;
+    log_time lastRetrieved(0);
+    {
+        lock_guard<mutex> lock(gLastLogsRetrievedLock);
+        auto found = gLastLogsRetrieved.find(mLogID);
+        retrievedBefore = found != gLastLogsRetrieved.end();
+        if (retrievedBefore) {
+            lastRetrieved = found->second;
+        }
+    }
+
     // Open log buffer and getting logs since last retrieved time if any.
     unique_ptr<logger_list, void (*)(logger_list*)> loggers(
-            gLastLogsRetrieved.find(mLogID) == gLastLogsRetrieved.end()
+            !retrievedBefore
                     ? android_logger_list_alloc(ANDROID_LOG_RDONLY | ANDROID_LOG_NONBLOCK, 0, 0)
                     : android_logger_list_alloc_time(ANDROID_LOG_RDONLY | ANDROID_LOG_NONBLOCK,
-                                                     gLastLogsRetrieved[mLogID], 0),
+                                                     lastRetrieved, 0),
             android_logger_list_free);
 
     if (android_logger_open(loggers.get(), mLogID) == NULL) {
@@ -625,7 +621,10 @@ status_t LogSection::BlockingCall(int pipeWriteFd) const {
             proto.end(token);
         }
     }
-    gLastLogsRetrieved[mLogID] = lastTimestamp;
+    {
+        lock_guard<mutex> lock(gLastLogsRetrievedLock);
+        gLastLogsRetrieved[mLogID] = lastTimestamp;
+    }
     if (!proto.flush(pipeWriteFd) && errno == EPIPE) {
         ALOGE("[%s] wrote to a broken pipe\n", this->name.string());
         return EPIPE;
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define DEBUG false
+#include "Log.h"
+
+#include "SectionScheduler.h"
+
+#include <android-base/file.h>
+
+#include <algorithm>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
+
+namespace android {
+namespace os {
+namespace incidentd {
+
+using android::base::ReadFileToString;
+using android::base::WriteStringToFile;
+using std::unique_lock;
+
+/**
+ * How much a new duration counts in the moving average, as 1 / AVERAGE_WEIGHT.
+ */
+const int64_t AVERAGE_WEIGHT = 4;
+
+SectionScheduler::SectionScheduler(const string& historyFileName, int64_t reportTimeoutMs)
+        :mHistoryFileName(historyFileName),
+         mReportTimeoutMs(reportTimeoutMs),
+         mLock(),
+         mHistory(),
+         mChanged(false) {
+    load();
+}
+
+SectionScheduler::~SectionScheduler() {
+}
+
+bool SectionScheduler::hasReportTimeout() const {
+    return mReportTimeoutMs > 0;
+}
+
+void SectionScheduler::schedule(vector<const Section*>* sections) {
+    unique_lock<mutex> lock(mLock);
+    if (mReportTimeoutMs <= 0) {
+        // Every section gets all of its time anyway, so keep the order of SECTION_LIST.
+        return;
+    }
+    std::stable_sort(sections->begin(), sections->end(),
+            [this](const Section* a, const Section* b) {
+                return get_expected_duration_ms_locked(a->id)
+                        < get_expected_duration_ms_locked(b->id);
+            });
+}
+
+int64_t SectionScheduler::getTimeoutMs(const Section* section, int64_t reportStartMs,
+        int64_t nowMs) const {
+    if (mReportTimeoutMs <= 0) {
+        return section->timeoutMs;
+    }
+    const int64_t remainingMs = reportStartMs + mReportTimeoutMs - nowMs;
+    return std::max((int64_t)0, std::min(section->timeoutMs, remainingMs));
+}
+
+int64_t SectionScheduler::getExpectedDurationMs(int sectionId) {
+    unique_lock<mutex> lock(mLock);
+    return get_expected_duration_ms_locked(sectionId);
+}
+
+void SectionScheduler::record(const Section* section,
+        const IncidentMetadata::SectionStats& stats) {
+    unique_lock<mutex> lock(mLock);
+    SectionHistoryProto::Section& history = mHistory[section->id];
+    int64_t durationMs = stats.exec_duration_ms();
+    if (stats.timed_out()) {
+        // When the report timeout cut the section short, it would have taken longer, so
+        // don't let that make it look quicker.
+        if (history.runs() > 0) {
+            durationMs = std::max(durationMs, history.average_duration_ms());
+        }
+        history.set_timeouts(history.timeouts() + 1);
+    }
+    if (history.runs() == 0) {
+        history.set_average_duration_ms(durationMs);
+    } else {
+        history.set_average_duration_ms(history.average_duration_ms()
+                + (durationMs - history.average_duration_ms()) / AVERAGE_WEIGHT);
+    }
+    history.set_id(section->id);
+    history.set_runs(history.runs() + 1);
+    mChanged = true;
+}
+
+status_t SectionScheduler::save() {
+    string content;
+    {
+        unique_lock<mutex> lock(mLock);
+        if (!mChanged) {
+            return NO_ERROR;
+        }
+        SectionHistoryProto proto;
+        for (const auto& entry : mHistory) {
+            *proto.add_section() = entry.second;
+        }
+        if (!proto.SerializeToString(&content)) {
+            return BAD_VALUE;
+        }
+        mChanged = false;
+    }
+
+    // Written under another name, so that a partly written file is never read.
+    const string tempFileName = mHistoryFileName + ".tmp";
+    if (!WriteStringToFile(content, tempFileName)
+            || rename(tempFileName.c_str(), mHistoryFileName.c_str()) != 0) {
+        status_t err = -errno;
+        ALOGW("Couldn't write the section history to %s: %s", mHistoryFileName.c_str(),
+                strerror(-err));
+        unlink(tempFileName.c_str());
+        return err;
+    }
+    return NO_ERROR;
+}
+
+void SectionScheduler::dump(FILE* out) {
+    unique_lock<mutex> lock(mLock);
+    fprintf(out, "mReportTimeoutMs=%" PRIi64 "\n", mReportTimeoutMs);
+    for (const auto& entry : mHistory) {
+        const SectionHistoryProto::Section& history = entry.second;
+        fprintf(out, "section %d: average %" PRIi64 " ms, %d runs, %d timeouts\n",
+                history.id(), history.average_duration_ms(), history.runs(),
+                history.timeouts());
+    }
+}
+
+void SectionScheduler::load() {
+    string content;
+    if (!ReadFileToString(mHistoryFileName, &content)) {
+        // There's no history yet.
+        return;
+    }
+    SectionHistoryProto proto;
+    if (!proto.ParseFromString(content)) {
+        ALOGW("Couldn't parse the section history in %s", mHistoryFileName.c_str());
+        return;
+    }
+    for (const SectionHistoryProto::Section& history : proto.section()) {
+        mHistory[history.id()] = history;
+    }
+}
+
+int64_t SectionScheduler::get_expected_duration_ms_locked(int sectionId) const {
+    map<int, SectionHistoryProto::Section>::const_iterator it = mHistory.find(sectionId);
+    if (it == mHistory.end()) {
+        return -1;
+    }
+    return it->second.average_duration_ms();
+}
+
+}  // namespace incidentd
+}  // namespace os
+}  // namespace android
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "Section.h"
+
+#include <frameworks/base/core/proto/android/os/metadata.pb.h>
+#include <frameworks/base/cmds/incidentd/src/report_file.pb.h>
+
+#include <utils/RefBase.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace os {
+namespace incidentd {
+
+using std::map;
+using std::mutex;
+using std::string;
+using std::vector;
+
+/**
+ * Decides the order that the sections of a report execute in, and how long each of them
+ * may take, from how long they took in earlier reports.  The history is kept in a file,
+ * so it is there after incidentd restarts.
+ *
+ * With a report timeout, the quickest sections execute first, so that the most sections
+ * finish in time, and no section may take longer than what is left of the report timeout.
+ */
+class SectionScheduler : public virtual android::RefBase {
+public:
+    /**
+     * reportTimeoutMs of 0 means reports can take as long as their sections do.
+     */
+    SectionScheduler(const string& historyFileName, int64_t reportTimeoutMs);
+    ~SectionScheduler();
+
+    /**
+     * Whether reports have a timeout.  Without one, the history is never used, so the
+     * reporter doesn't record or save it.
+     */
+    bool hasReportTimeout() const;
+
+    /**
+     * Order sections by how long they are expected to take, quickest first.  Sections
+     * without history keep their order, ahead of the others.
+     */
+    void schedule(vector<const Section*>* sections);
+
+    /**
+     * How long section may take if it starts at nowMs, in a report that started at
+     * reportStartMs.  Returns 0 if there is no time left for it.
+     */
+    int64_t getTimeoutMs(const Section* section, int64_t reportStartMs, int64_t nowMs) const;
+
+    /**
+     * How long the section is expected to take, or -1 if it never executed.
+     */
+    int64_t getExpectedDurationMs(int sectionId);
+
+    /**
+     * Record how long section took in a report.
+     */
+    void record(const Section* section, const IncidentMetadata::SectionStats& stats);
+
+    /**
+     * Write the history to its file, if anything was recorded.
+     */
+    status_t save();
+
+    void dump(FILE* out);
+
+private:
+    const string mHistoryFileName;
+    const int64_t mReportTimeoutMs;
+
+    // Protects the fields below, for dump.
+    mutex mLock;
+    map<int, SectionHistoryProto::Section> mHistory;
+    bool mChanged;
+
+    void load();
+    int64_t get_expected_duration_ms_locked(int sectionId) const;
+};
+
+}  // namespace incidentd
+}  // namespace os
+}  // namespace android
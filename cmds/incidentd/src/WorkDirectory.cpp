@@ -18,14 +18,23 @@
 
 #include "WorkDirectory.h"
 
+#include "FdBuffer.h"
 #include "proto_util.h"
 #include "PrivacyFilter.h"
+#include "Section.h"
 
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+#include <android/util/protobuf.h>
+#include <android/util/ProtoFileReader.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <openssl/sha.h>
 #include <private/android_filesystem_config.h>
+#include <zlib.h>
 
 #include <iomanip>
 #include <map>
+#include <set>
 #include <sstream>
 #include <thread>
 #include <vector>
@@ -40,6 +49,12 @@ namespace os {
 namespace incidentd {
 
 using std::thread;
+using android::base::unique_fd;
+using android::base::WriteFully;
+using android::util::ProtoFileReader;
+using android::util::read_field_id;
+using android::util::read_wire_type;
+using android::util::WIRE_TYPE_LENGTH_DELIMITED;
 using google::protobuf::MessageLite;
 using google::protobuf::RepeatedPtrField;
 using google::protobuf::io::FileInputStream;
@@ -60,6 +75,16 @@ static const string EXTENSION_ENVELOPE(".envelope");
  */
 static const string EXTENSION_DATA(".data");
 
+/**
+ * File extension for the files of the section store.
+ */
+static const string EXTENSION_SECTION(".section");
+
+/**
+ * File extension for files that are being written, before they are renamed.
+ */
+static const string EXTENSION_TEMP(".tmp");
+
 /**
  * Send these reports to dropbox.
  */
@@ -88,23 +113,148 @@ static status_t read_proto(MessageLite* msg, const string& filename) {
 }
 
 /**
- * Write a protobuf to disk.
+ * Write a protobuf to disk.  It is written to a temporary file that is renamed once it is
+ * complete, so that cleaning up the section store never reads an envelope half written.
  */
 static status_t write_proto(const MessageLite& msg, const string& filename) {
-    int fd = open(filename.c_str(), O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0660);
+    const string tempFileName = filename + EXTENSION_TEMP;
+    int fd = open(tempFileName.c_str(), O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0660);
     if (fd < 0) {
         return -errno;
     }
 
     FileOutputStream stream(fd);
-    stream.SetCloseOnDelete(fd);
 
     if (!msg.SerializeToZeroCopyStream(&stream)) {
         ALOGW("write_proto: error writing to %s", filename.c_str());
+        stream.Close();
+        unlink(tempFileName.c_str());
         return BAD_VALUE;
     }
 
-    return stream.GetErrno();
+    if (!stream.Close()) {
+        status_t err = -stream.GetErrno();
+        unlink(tempFileName.c_str());
+        return err;
+    }
+
+    if (rename(tempFileName.c_str(), filename.c_str()) != 0) {
+        status_t err = -errno;
+        unlink(tempFileName.c_str());
+        return err;
+    }
+
+    return NO_ERROR;
+}
+
+/**
+ * The name of a section in the section store: the hex SHA-256 of its data.
+ */
+static string make_section_blob_name(uint8_t const* data, size_t size) {
+    static const char HEX[] = "0123456789abcdef";
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    SHA256(data, size, digest);
+
+    string result;
+    result.reserve(2 * SHA256_DIGEST_LENGTH + EXTENSION_SECTION.size());
+    for (uint8_t b: digest) {
+        result += HEX[b >> 4];
+        result += HEX[b & 0xf];
+    }
+    return result + EXTENSION_SECTION;
+}
+
+/**
+ * Write data to fd, compressed with zlib.
+ */
+static status_t write_compressed(int fd, uint8_t const* data, size_t size) {
+    uLongf compressedSize = compressBound(size);
+    vector<uint8_t> compressed(compressedSize);
+    if (compress2(compressed.data(), &compressedSize, data, size,
+                Z_DEFAULT_COMPRESSION) != Z_OK) {
+        return NO_MEMORY;
+    }
+    return WriteFully(fd, compressed.data(), compressedSize) ? NO_ERROR : -errno;
+}
+
+/**
+ * Copy the next size bytes of reader into data.
+ */
+static bool copy_section(const sp<ProtoFileReader>& reader, size_t size, vector<uint8_t>* data) {
+    data->resize(size);
+    size_t pos = 0;
+    while (pos < size && reader->readBuffer() != NULL) {
+        const size_t chunk = min(reader->currentToRead(), size - pos);
+        memcpy(data->data() + pos, reader->readBuffer(), chunk);
+        reader->move(chunk);
+        pos += chunk;
+    }
+    return pos == size;
+}
+
+/**
+ * Make stagedFileName hold the section that is stored in filename once it is published.  An
+ * existing section is linked, so that it is kept even if it is collected before then.
+ * Otherwise the data is compressed into it.
+ */
+static status_t stage_section(const string& filename, const string& stagedFileName,
+        uint8_t const* data, size_t size) {
+    unlink(stagedFileName.c_str());
+    if (link(filename.c_str(), stagedFileName.c_str()) == 0) {
+        return NO_ERROR;
+    }
+
+    int fd = open(stagedFileName.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0660);
+    if (fd < 0) {
+        return -errno;
+    }
+    status_t err = write_compressed(fd, data, size);
+    close(fd);
+    if (err != NO_ERROR) {
+        unlink(stagedFileName.c_str());
+    }
+    return err;
+}
+
+/**
+ * Read the zlib compressed data in fd into buffer.  There must be exactly size bytes once
+ * it is uncompressed.
+ */
+static status_t read_compressed(int fd, int64_t size, FdBuffer* buffer) {
+    z_stream stream = {};
+    if (inflateInit(&stream) != Z_OK) {
+        return NO_MEMORY;
+    }
+
+    vector<uint8_t> in(16 * 1024);
+    vector<uint8_t> out(64 * 1024);
+    status_t err = NO_ERROR;
+    int result = Z_OK;
+    while (err == NO_ERROR && result != Z_STREAM_END) {
+        ssize_t amt = TEMP_FAILURE_RETRY(read(fd, in.data(), in.size()));
+        if (amt <= 0) {
+            err = amt < 0 ? -errno : NOT_ENOUGH_DATA;
+            break;
+        }
+        stream.next_in = in.data();
+        stream.avail_in = amt;
+        while (err == NO_ERROR && stream.avail_in > 0 && result != Z_STREAM_END) {
+            stream.next_out = out.data();
+            stream.avail_out = out.size();
+            result = inflate(&stream, Z_NO_FLUSH);
+            if (result != Z_OK && result != Z_STREAM_END) {
+                err = BAD_VALUE;
+                break;
+            }
+            err = buffer->write(out.data(), out.size() - stream.avail_out);
+        }
+    }
+    inflateEnd(&stream);
+
+    if (err == NO_ERROR && (int64_t)buffer->size() != size) {
+        err = BAD_VALUE;
+    }
+    return err;
 }
 
 static string strip_extension(const string& filename) {
@@ -224,6 +374,8 @@ struct WorkDirectoryEntry {
     string data;
     int64_t timestampNs;
     off_t size;
+    // Files of the section store that the envelope refers to, see load_sections.
+    vector<string> sections;
 };
 
 WorkDirectoryEntry::WorkDirectoryEntry()
@@ -235,12 +387,29 @@ WorkDirectoryEntry::WorkDirectoryEntry()
 WorkDirectoryEntry::WorkDirectoryEntry(const WorkDirectoryEntry& that)
         :envelope(that.envelope),
          data(that.data),
-         size(that.size) {
+         size(that.size),
+         sections(that.sections) {
 }
 
 WorkDirectoryEntry::~WorkDirectoryEntry() {
 }
 
+/**
+ * Read the sections that the envelope of the entry refers to.  Returns false if the envelope
+ * can't be read.
+ */
+static bool load_sections(WorkDirectoryEntry* entry) {
+    ReportFileProto envelope;
+    if (read_proto(&envelope, entry->envelope) != NO_ERROR) {
+        return false;
+    }
+    entry->sections.clear();
+    for (const auto& section: envelope.stored_section()) {
+        entry->sections.push_back(section.blob());
+    }
+    return true;
+}
+
 // ================================================================================
 ReportFile::ReportFile(const sp<WorkDirectory>& workDirectory, int64_t timestampNs,
             const string& envelopeFileName, const string& dataFileName)
@@ -385,40 +554,72 @@ status_t ReportFile::startWritingDataFile() {
 void ReportFile::closeDataFile() {
     if (mDataFd >= 0) {
         mEnvelope.set_data_file_size(lseek(mDataFd, 0, SEEK_END));
+        if (mError == NO_ERROR) {
+            // If this fails, the data file is kept and read back as it is.
+            mWorkDirectory->storeSections(this);
+        }
         close(mDataFd);
         mDataFd = -1;
     }
 }
 
 status_t ReportFile::startFilteringData(int writeFd, const IncidentReportArgs& args) {
-    // Open data file.
-    int dataFd = open(mDataFileName.c_str(), O_RDONLY | O_CLOEXEC);
-    if (dataFd < 0) {
-        ALOGW("Error opening incident report '%s' %s", getDataFileName().c_str(), strerror(-errno));
-        close(writeFd);
-        return -errno;
-    }
+    status_t err;
+    int dataFd = -1;
+    vector<pair<const ReportFileProto_StoredSection*, unique_fd>> sections;
+
+    if (mEnvelope.has_data_file()) {
+        // Open data file.
+        dataFd = open(mDataFileName.c_str(), O_RDONLY | O_CLOEXEC);
+        if (dataFd < 0) {
+            ALOGW("Error opening incident report '%s' %s", getDataFileName().c_str(),
+                    strerror(-errno));
+            close(writeFd);
+            return -errno;
+        }
 
-    // Check that the size on disk is what we thought we wrote.
-    struct stat st;
-    if (fstat(dataFd, &st) != 0) {
-        ALOGW("Error running fstat incident report '%s' %s", getDataFileName().c_str(),
-              strerror(-errno));
-        close(writeFd);
-        return -errno;
-    }
-    if (st.st_size != mEnvelope.data_file_size()) {
-        ALOGW("File size mismatch. Envelope says %" PRIi64 " bytes but data file is %" PRIi64
-              " bytes: %s",
-              (int64_t)mEnvelope.data_file_size(), st.st_size, mDataFileName.c_str());
-        ALOGW("Removing incident report");
-        mWorkDirectory->remove(this);
-        close(writeFd);
-        return BAD_VALUE;
+        // Check that the size on disk is what we thought we wrote.
+        struct stat st;
+        if (fstat(dataFd, &st) != 0) {
+            ALOGW("Error running fstat incident report '%s' %s", getDataFileName().c_str(),
+                  strerror(-errno));
+            close(dataFd);
+            close(writeFd);
+            return -errno;
+        }
+        if (st.st_size != mEnvelope.data_file_size()) {
+            ALOGW("File size mismatch. Envelope says %" PRIi64 " bytes but data file is %" PRIi64
+                  " bytes: %s",
+                  (int64_t)mEnvelope.data_file_size(), st.st_size, mDataFileName.c_str());
+            ALOGW("Removing incident report");
+            mWorkDirectory->remove(this);
+            close(dataFd);
+            close(writeFd);
+            return BAD_VALUE;
+        }
+    } else {
+        // The sections are in the section store.  Open the ones we need before writing
+        // anything, so that they are all there even if the report is committed meanwhile.
+        for (const auto& section : mEnvelope.stored_section()) {
+            if (!args.containsSection(section.id(),
+                        section_requires_specific_mention(section.id()))) {
+                continue;
+            }
+            const string filename = mWorkDirectory->getSectionFileName(section.blob());
+            unique_fd fd(open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+            if (fd < 0) {
+                err = -errno;
+                ALOGW("Error opening section %d of incident report %s: %s %s", section.id(),
+                        getId().c_str(), filename.c_str(), strerror(-err));
+                ALOGW("Removing incident report");
+                mWorkDirectory->remove(this);
+                close(writeFd);
+                return err;
+            }
+            sections.emplace_back(&section, std::move(fd));
+        }
     }
 
-    status_t err;
-
     for (const auto& report : mEnvelope.report()) {
         for (const auto& header : report.header()) {
            write_header_section(writeFd,
@@ -430,7 +631,26 @@ status_t ReportFile::startFilteringData(int writeFd, const IncidentReportArgs& a
         write_section(writeFd, FIELD_ID_INCIDENT_METADATA, mEnvelope.metadata());
     }
 
-    err = filter_and_write_report(writeFd, dataFd, mEnvelope.privacy_policy(), args);
+    if (dataFd >= 0) {
+        err = filter_and_write_report(writeFd, dataFd, mEnvelope.privacy_policy(), args);
+        close(dataFd);
+    } else {
+        err = NO_ERROR;
+        for (auto& section : sections) {
+            FdBuffer sectionData;
+            err = read_compressed(section.second.get(), section.first->size(), &sectionData);
+            if (err != NO_ERROR) {
+                ALOGW("Error reading section %d of incident report %s: %s",
+                        section.first->id(), getId().c_str(), strerror(-err));
+                break;
+            }
+            err = filter_and_write_section(writeFd, section.first->id(), sectionData,
+                    mEnvelope.privacy_policy(), args);
+            if (err != NO_ERROR) {
+                break;
+            }
+        }
+    }
     if (err != NO_ERROR) {
         ALOGW("Error writing incident report '%s' to dropbox: %s", getDataFileName().c_str(),
                 strerror(-err));
@@ -501,6 +721,7 @@ WorkDirectory::WorkDirectory()
          mMaxDiskUsageBytes(100 * 1024 * 1024) {  // Incident reports can take up to 100MB on disk.
                                                  // TODO: Should be a flag.
     create_directory(mDirectory.c_str());
+    remove_temp_files();
 }
 
 WorkDirectory::WorkDirectory(const string& dir, int maxFileCount, long maxDiskUsageBytes)
@@ -508,6 +729,7 @@ WorkDirectory::WorkDirectory(const string& dir, int maxFileCount, long maxDiskUs
          mMaxFileCount(maxFileCount),
          mMaxDiskUsageBytes(maxDiskUsageBytes) {
     create_directory(mDirectory.c_str());
+    remove_temp_files();
 }
 
 sp<ReportFile> WorkDirectory::createReportFile() {
@@ -610,7 +832,9 @@ void WorkDirectory::commit(const sp<ReportFile>& report, const string& pkg, cons
 
     report->removeReport(pkg, cls);
 
-    delete_files_for_report_if_necessary(report);
+    if (delete_files_for_report_if_necessary(report)) {
+        collect_sections_locked();
+    }
 }
 
 void WorkDirectory::commitAll(const string& pkg) {
@@ -622,6 +846,7 @@ void WorkDirectory::commitAll(const string& pkg) {
     map<string,WorkDirectoryEntry> files;
     get_directory_contents_locked(&files, 0);
     
+    bool deleted = false;
     for (map<string,WorkDirectoryEntry>::iterator it = files.begin();
             it != files.end(); it++) {
         sp<ReportFile> reportFile = new ReportFile(this, it->second.timestampNs,
@@ -634,7 +859,11 @@ void WorkDirectory::commitAll(const string& pkg) {
 
         reportFile->removeReports(pkg);
 
-        delete_files_for_report_if_necessary(reportFile);
+        deleted |= delete_files_for_report_if_necessary(reportFile);
+    }
+
+    if (deleted) {
+        collect_sections_locked();
     }
 }
 
@@ -645,6 +874,105 @@ void WorkDirectory::remove(const sp<ReportFile>& report) {
         unlink(report->getDataFileName().c_str());
         unlink(report->getEnvelopeFileName().c_str());
     }
+    collect_sections_locked();
+}
+
+string WorkDirectory::getSectionFileName(const string& blob) const {
+    return mDirectory + '/' + blob;
+}
+
+status_t WorkDirectory::storeSections(const sp<ReportFile>& report) {
+    status_t err = NO_ERROR;
+
+    if (lseek(report->mDataFd, 0, SEEK_SET) < 0) {
+        return -errno;
+    }
+
+    // The sections are hashed and compressed without the lock, each into a staged file of
+    // this report.  The data file is a list of sections, as filter_and_write_report reads it.
+    RepeatedPtrField<ReportFileProto_StoredSection> sections;
+    map<string,string> staged;
+    sp<ProtoFileReader> reader = new ProtoFileReader(report->mDataFd);
+    vector<uint8_t> data;
+    while (err == NO_ERROR && reader->hasNext()) {
+        uint64_t fieldTag = reader->readRawVarint();
+        if (read_wire_type(fieldTag) != WIRE_TYPE_LENGTH_DELIMITED) {
+            err = BAD_VALUE;
+            break;
+        }
+        const size_t size = reader->readRawVarint();
+        uint8_t const* sectionData = reader->readBuffer();
+        if (sectionData != NULL && reader->currentToRead() >= size) {
+            // The section is all in the mapped data file, it doesn't need to be copied.
+            reader->move(size);
+        } else if (copy_section(reader, size, &data)) {
+            sectionData = data.data();
+        } else {
+            err = NOT_ENOUGH_DATA;
+            break;
+        }
+
+        ReportFileProto_StoredSection* section = sections.Add();
+        section->set_id(read_field_id(fieldTag));
+        section->set_size(size);
+        section->set_blob(make_section_blob_name(sectionData, size));
+        if (staged.find(section->blob()) == staged.end()) {
+            const string stagedFileName = make_filename(report->mTimestampNs,
+                    '-' + section->blob() + EXTENSION_TEMP);
+            staged[section->blob()] = stagedFileName;
+            err = stage_section(getSectionFileName(section->blob()), stagedFileName,
+                    sectionData, size);
+        }
+    }
+    if (err == NO_ERROR) {
+        err = reader->getError();
+    }
+    if (err != NO_ERROR) {
+        ALOGW("Error storing the sections of %s, keeping the data file: %s",
+                report->getDataFileName().c_str(), strerror(-err));
+        for (map<string,string>::const_iterator it = staged.begin(); it != staged.end(); it++) {
+            unlink(it->second.c_str());
+        }
+        return err;
+    }
+
+    // The lock is only held to publish the sections and the envelope that refers to them, so
+    // that no section is collected in between.
+    unique_lock<mutex> lock(mLock);
+    for (map<string,string>::const_iterator it = staged.begin(); it != staged.end(); it++) {
+        const string filename = getSectionFileName(it->first);
+        struct stat st;
+        if (err == NO_ERROR && stat(filename.c_str(), &st) != 0
+                && rename(it->second.c_str(), filename.c_str()) != 0) {
+            err = -errno;
+        }
+        // Left if another report has the same section, or if publishing failed.
+        unlink(it->second.c_str());
+    }
+    if (err != NO_ERROR) {
+        // The sections that were stored are cleaned up with the next report that is removed.
+        ALOGW("Error storing the sections of %s, keeping the data file: %s",
+                report->getDataFileName().c_str(), strerror(-err));
+        return err;
+    }
+
+    // The envelope must refer to the sections before the data file is removed.
+    ReportFileProto& envelope = report->mEnvelope;
+    envelope.mutable_stored_section()->Swap(&sections);
+    envelope.clear_data_file();
+    err = report->trySaveEnvelope();
+    if (err != NO_ERROR) {
+        envelope.mutable_stored_section()->Swap(&sections);
+        envelope.set_data_file(report->mDataFileName);
+        ALOGW("Error saving the envelope of %s, keeping the data file: %s",
+                report->getDataFileName().c_str(), strerror(-err));
+        return err;
+    }
+
+    if (DO_UNLINK) {
+        unlink(report->mDataFileName.c_str());
+    }
+    return NO_ERROR;
 }
 
 int64_t WorkDirectory::make_timestamp_ns_locked() {
@@ -766,11 +1094,83 @@ off_t WorkDirectory::get_directory_contents_locked(map<string,WorkDirectoryEntry
     return totalSize;
 }
 
-void WorkDirectory::clean_directory_locked() {
+void WorkDirectory::remove_temp_files() {
     DIR* dir;
     struct dirent* entry;
-    struct stat st;
 
+    if ((dir = opendir(mDirectory.c_str())) == NULL) {
+        ALOGE("Couldn't open incident directory: %s", mDirectory.c_str());
+        return;
+    }
+
+    string dirbase(mDirectory);
+    if (mDirectory[dirbase.size() - 1] != '/') dirbase += "/";
+
+    // No report is open yet, so any envelope or data file still under its temporary name
+    // was left by an incidentd that died before renaming it.  Nothing else would ever
+    // match it, count it or remove it.
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        const string entryname = entry->d_name;
+        if (ends_with(entryname, EXTENSION_ENVELOPE + EXTENSION_TEMP)
+                || ends_with(entryname, EXTENSION_DATA + EXTENSION_TEMP)) {
+            ALOGW("Removing unfinished incident file %s", entryname.c_str());
+            if (DO_UNLINK) {
+                unlink((dirbase + entryname).c_str());
+            }
+        }
+    }
+
+    closedir(dir);
+}
+
+off_t WorkDirectory::get_sections_locked(map<string,off_t>* sections) {
+    DIR* dir;
+    struct dirent* entry;
+
+    if ((dir = opendir(mDirectory.c_str())) == NULL) {
+        ALOGE("Couldn't open incident directory: %s", mDirectory.c_str());
+        return -1;
+    }
+
+    off_t totalSize = 0;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        const string entryname = entry->d_name;
+        const string filename = getSectionFileName(entryname);
+
+        if (ends_with(entryname, EXTENSION_SECTION + EXTENSION_TEMP)) {
+            // Sections are staged while the data file of their report is stored, see
+            // storeSections.  Without the data file, this one was never published.
+            struct stat st;
+            const string dataFileName = mDirectory + '/'
+                    + entryname.substr(0, entryname.find('-')) + EXTENSION_DATA;
+            if (DO_UNLINK && stat(dataFileName.c_str(), &st) != 0) {
+                unlink(filename.c_str());
+            }
+            continue;
+        }
+        if (!ends_with(entryname, EXTENSION_SECTION)) {
+            continue;
+        }
+
+        struct stat st;
+        if (stat(filename.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        (*sections)[entryname] = st.st_size;
+        totalSize += st.st_size;
+    }
+
+    closedir(dir);
+    return totalSize;
+}
+
+void WorkDirectory::clean_directory_locked() {
     // Map of filename without extension to the entries about it.  Conveniently,
     // this also keeps the list sorted by filename, which is a timestamp.
     map<string,WorkDirectoryEntry> files;
@@ -778,6 +1178,11 @@ void WorkDirectory::clean_directory_locked() {
     if (totalSize < 0) {
         return;
     }
+    map<string,off_t> sections;
+    off_t sectionsSize = get_sections_locked(&sections);
+    if (sectionsSize > 0) {
+        totalSize += sectionsSize;
+    }
     int totalCount = files.size();
 
     // Count or size is less than max, then we're done.
@@ -785,8 +1190,30 @@ void WorkDirectory::clean_directory_locked() {
         return;
     }
 
+    // How many reports refer to each section.  A section is removed with the last report
+    // that refers to it.
+    // If an envelope can't be read, we can't tell which sections its report needs, so no
+    // section is removed, as in collect_sections_locked.
+    map<string,int> references;
+    bool referencesKnown = true;
+    for (map<string,WorkDirectoryEntry>::iterator it = files.begin(); it != files.end(); it++) {
+        if (!load_sections(&it->second)) {
+            referencesKnown = false;
+        }
+        for (const string& blob: it->second.sections) {
+            references[blob]++;
+        }
+    }
+
     // Remove files until we're under our limits.
     if (DO_UNLINK) {
+        for (map<string,off_t>::const_iterator it = sections.begin();
+                referencesKnown && it != sections.end(); it++) {
+            if (references.find(it->first) == references.end()) {
+                unlink(getSectionFileName(it->first).c_str());
+                totalSize -= it->second;
+            }
+        }
         for (map<string, WorkDirectoryEntry>::const_iterator it = files.begin();
                 it != files.end() && (totalSize >= mMaxDiskUsageBytes
                     || totalCount >= mMaxFileCount);
@@ -795,18 +1222,58 @@ void WorkDirectory::clean_directory_locked() {
             unlink(it->second.data.c_str());
             totalSize -= it->second.size;
             totalCount--;
+            for (const string& blob: it->second.sections) {
+                if (--references[blob] == 0 && referencesKnown) {
+                    unlink(getSectionFileName(blob).c_str());
+                    map<string,off_t>::const_iterator section = sections.find(blob);
+                    if (section != sections.end()) {
+                        totalSize -= section->second;
+                    }
+                }
+            }
         }
     }
 }
 
-void WorkDirectory::delete_files_for_report_if_necessary(const sp<ReportFile>& report) {
+/**
+ * Remove the sections that no envelope refers to anymore.
+ */
+void WorkDirectory::collect_sections_locked() {
+    map<string,off_t> sections;
+    if (get_sections_locked(&sections) < 0 || sections.empty()) {
+        return;
+    }
+
+    map<string,WorkDirectoryEntry> files;
+    get_directory_contents_locked(&files, 0);
+    for (map<string,WorkDirectoryEntry>::iterator it = files.begin(); it != files.end(); it++) {
+        if (!load_sections(&it->second)) {
+            // We can't tell which sections this report needs, so keep all of them.
+            return;
+        }
+        for (const string& blob: it->second.sections) {
+            sections.erase(blob);
+        }
+    }
+
+    if (DO_UNLINK) {
+        for (map<string,off_t>::const_iterator it = sections.begin(); it != sections.end();
+                it++) {
+            unlink(getSectionFileName(it->first).c_str());
+        }
+    }
+}
+
+bool WorkDirectory::delete_files_for_report_if_necessary(const sp<ReportFile>& report) {
     if (report->getEnvelope().report_size() == 0) {
         ALOGI("Report %s is finished. Deleting from storage.", report->getId().c_str());
         if (DO_UNLINK) {
             unlink(report->getDataFileName().c_str());
             unlink(report->getEnvelopeFileName().c_str());
         }
+        return true;
     }
+    return false;
 }
 
 // ================================================================================
@@ -23,8 +23,10 @@
 
 #include <utils/RefBase.h>
 
+#include <map>
 #include <mutex>
 #include <string>
+#include <vector>
 
 namespace android {
 namespace os {
@@ -130,7 +132,8 @@ public:
     status_t startWritingDataFile();
 
     /**
-     * Close the data file.
+     * Close the data file.  Unless there was an error writing it, its sections are moved
+     * into the work directory's section store, and the data file is removed.
      */
     void closeDataFile();
 
@@ -176,6 +179,8 @@ public:
     string getId();
 
 private:
+    friend class WorkDirectory;
+
     sp<WorkDirectory> mWorkDirectory;
     int64_t mTimestampNs;
     string mEnvelopeFileName;
@@ -250,7 +255,21 @@ public:
      * more pending readers or broadcasts, for example in response to an error.
      */
     void remove(const sp<ReportFile>& report);
-    
+
+    /**
+     * Move the sections in the data file of the report into the section store and save the
+     * envelope, which then refers to them instead of the data file.  Each section is kept
+     * compressed, once, however many reports contain it.  The sections are compressed without
+     * the lock, which is only held to publish them.  If there is an error, the data file is
+     * left as it is.
+     */
+    status_t storeSections(const sp<ReportFile>& report);
+
+    /**
+     * Get the name on disk of a file of the section store.
+     */
+    string getSectionFileName(const string& blob) const;
+
 private:
     string mDirectory;
     int mMaxFileCount;
@@ -263,8 +282,11 @@ private:
     int64_t make_timestamp_ns_locked();
     bool file_exists_locked(int64_t timestampNs);    
     off_t get_directory_contents_locked(map<string,WorkDirectoryEntry>* files, int64_t after);
+    off_t get_sections_locked(map<string,off_t>* sections);
     void clean_directory_locked();
-    void delete_files_for_report_if_necessary(const sp<ReportFile>& report);
+    void remove_temp_files();
+    void collect_sections_locked();
+    bool delete_files_for_report_if_necessary(const sp<ReportFile>& report);
 
     string make_filename(int64_t timestampNs, const string& extension);
 };
@@ -20,6 +20,7 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <string.h>
+#include <zlib.h>
 
 #include <android-base/file.h>
 #include <gtest/gtest.h>
@@ -57,6 +58,31 @@ public:
         EXPECT_EQ(expected[i], '\0');
     }
 
+    std::string Gunzip() {
+        std::string compressed;
+        sp<ProtoReader> reader = buffer.data()->read();
+        while (reader->hasNext()) {
+            compressed.push_back(reader->next());
+        }
+
+        z_stream stream = {};
+        EXPECT_EQ(Z_OK, inflateInit2(&stream, MAX_WBITS + 16));
+        std::string result;
+        char out[BUFFER_SIZE];
+        stream.next_in = (Bytef*)compressed.data();
+        stream.avail_in = compressed.size();
+        int err = Z_OK;
+        while (err == Z_OK) {
+            stream.next_out = (Bytef*)out;
+            stream.avail_out = sizeof(out);
+            err = inflate(&stream, Z_NO_FLUSH);
+            result.append(out, (char*)stream.next_out - out);
+        }
+        EXPECT_EQ(Z_STREAM_END, err);
+        inflateEnd(&stream);
+        return result;
+    }
+
     bool DoDataStream(const unique_fd& rFd, const unique_fd& wFd) {
         char buf[BUFFER_SIZE];
         ssize_t nRead;
@@ -326,3 +352,28 @@ TEST_F(FdBufferTest, ReadInStreamTimeOut) {
         kill(pid, SIGKILL);  // reap the child process
     }
 }
+
+TEST_F(FdBufferTest, ReadCompressed) {
+    std::string testdata;
+    for (int i = 0; i < 10000; i++) {
+        testdata += "<6>[    0.000000] Booting Linux on physical CPU " + std::to_string(i) + "\n";
+    }
+    ASSERT_TRUE(WriteStringToFile(testdata, tf.path));
+    ASSERT_EQ(NO_ERROR, buffer.readCompressed(tf.fd, READ_TIMEOUT));
+    EXPECT_FALSE(buffer.timedOut());
+    EXPECT_FALSE(buffer.truncated());
+    EXPECT_LT(buffer.size(), testdata.size() / 4);
+    EXPECT_EQ(testdata, Gunzip());
+}
+
+TEST_F(FdBufferTest, ReadCompressedEmpty) {
+    ASSERT_EQ(NO_ERROR, buffer.readCompressed(tf.fd, READ_TIMEOUT));
+    EXPECT_GT(buffer.size(), 0u);  // The gzip header and trailer.
+    EXPECT_EQ("", Gunzip());
+}
+
+TEST_F(FdBufferTest, ReadCompressedTimeOut) {
+    // Nothing is ever written to the pipe.
+    ASSERT_EQ(NO_ERROR, buffer.readCompressed(c2pPipe.readFd().get(), 0));
+    EXPECT_TRUE(buffer.timedOut());
+}
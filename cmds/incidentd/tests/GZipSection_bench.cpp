@@ -0,0 +1,99 @@
+// Copyright (C) 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#define DEBUG false
+#include "Log.h"
+
+#include "FdBuffer.h"
+#include "incidentd_util.h"
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+#include <sys/resource.h>
+
+#include <string>
+
+using namespace android;
+using namespace android::base;
+using namespace android::os::incidentd;
+
+const int64_t READ_TIMEOUT_MS = 60 * 1000;
+const char* GZIP[] = {"/system/bin/gzip", NULL};
+const size_t LOG_SIZE = 16 * 1024 * 1024;
+
+// Compresses a large kernel log, written to a file for each benchmark.
+class GZipSectionBench : public benchmark::Fixture {
+public:
+    virtual void SetUp(const benchmark::State&) override {
+        std::string contents;
+        for (int i = 0; contents.size() < LOG_SIZE; i++) {
+            contents += "<6>[" + std::to_string(i / 1000) + "." + std::to_string(i % 1000) +
+                    "] binder: 1234:5678 transaction failed 29189/-22, size 0-0 line " +
+                    std::to_string(i % 3000) + "\n";
+        }
+        WriteStringToFile(contents, file.path);
+    }
+
+protected:
+    TemporaryFile file;
+};
+
+static int64_t cpuTimeUs(int who) {
+    struct rusage usage;
+    getrusage(who, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000LL +
+            usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+// The file piped through a forked gzip, as GZipSection compressed it before.
+BENCHMARK_DEFINE_F(GZipSectionBench, GzipChildProcess)(benchmark::State& state) {
+    int64_t childCpuUs = cpuTimeUs(RUSAGE_CHILDREN);
+    for (auto _ : state) {
+        unique_fd fd(open(file.path, O_RDONLY | O_CLOEXEC));
+        FdBuffer buffer;
+        Fpipe p2cPipe;
+        Fpipe c2pPipe;
+        if (!p2cPipe.init() || !c2pPipe.init()) {
+            state.SkipWithError("failed to setup pipes");
+            return;
+        }
+        pid_t pid = fork_execute_cmd((char* const*)GZIP, &p2cPipe, &c2pPipe);
+        buffer.readProcessedDataInStream(fd.get(), std::move(p2cPipe.writeFd()),
+                                         std::move(c2pPipe.readFd()), READ_TIMEOUT_MS);
+        if (wait_child(pid) != NO_ERROR) {
+            state.SkipWithError("gzip failed");
+            return;
+        }
+        benchmark::DoNotOptimize(buffer.size());
+    }
+    state.SetBytesProcessed(state.iterations() * LOG_SIZE);
+    // The work done by gzip doesn't show in the cpu time of the benchmark itself.
+    state.counters["child_cpu_us"] = benchmark::Counter(
+            cpuTimeUs(RUSAGE_CHILDREN) - childCpuUs, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK_REGISTER_F(GZipSectionBench, GzipChildProcess)->Unit(benchmark::kMillisecond);
+
+// The file compressed with zlib in this process, as GZipSection does now.
+BENCHMARK_DEFINE_F(GZipSectionBench, GzipInProcess)(benchmark::State& state) {
+    for (auto _ : state) {
+        unique_fd fd(open(file.path, O_RDONLY | O_CLOEXEC));
+        FdBuffer buffer;
+        buffer.readCompressed(fd.get(), READ_TIMEOUT_MS);
+        benchmark::DoNotOptimize(buffer.size());
+    }
+    state.SetBytesProcessed(state.iterations() * LOG_SIZE);
+    state.counters["child_cpu_us"] = 0;
+}
+BENCHMARK_REGISTER_F(GZipSectionBench, GzipInProcess)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,148 @@
+// Copyright (C) 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#define DEBUG false
+#include "Log.h"
+
+#include "PrivacyFilter.h"
+
+#include <android/os/IncidentReportArgs.h>
+#include <android/util/ProtoOutputStream.h>
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+using namespace android;
+using namespace android::os;
+using namespace android::os::incidentd;
+
+const uint8_t OTHER_TYPE = 1;
+const uint8_t STRING_TYPE = 9;
+const uint8_t MESSAGE_TYPE = 11;
+
+// Same chunk size as FdBuffer reads with.
+const size_t READ_SIZE = 16 * 1024;
+
+// A section of repeated entries, each with a local id, an automatic tag and an explicit
+// payload, like a large dumpsys section.
+static Privacy ID = {1, OTHER_TYPE, NULL, PRIVACY_POLICY_LOCAL, NULL};
+static Privacy TAG = {2, STRING_TYPE, NULL, PRIVACY_POLICY_AUTOMATIC, NULL};
+static Privacy PAYLOAD = {3, STRING_TYPE, NULL, PRIVACY_POLICY_EXPLICIT, NULL};
+static Privacy* ENTRY_FIELDS[] = {&ID, &TAG, &PAYLOAD, NULL};
+static Privacy ENTRY = {1, MESSAGE_TYPE, ENTRY_FIELDS, PRIVACY_POLICY_UNSET, NULL};
+static Privacy* SECTION_FIELDS[] = {&ENTRY, NULL};
+static Privacy SECTION = {3000, MESSAGE_TYPE, SECTION_FIELDS, PRIVACY_POLICY_UNSET, NULL};
+
+static const vector<uint8_t> POLICIES = {PRIVACY_POLICY_EXPLICIT, PRIVACY_POLICY_AUTOMATIC};
+
+class PrivacyFilterBench : public benchmark::Fixture {
+public:
+    virtual void SetUp(const benchmark::State&) override {
+        const std::string tag(24, 't');
+        const std::string payload(200, 'p');
+        ProtoOutputStream proto;
+        for (long long i = 0; proto.bytesWritten() < 100 * 1024 * 1024; i++) {
+            uint64_t token = proto.start(FIELD_TYPE_MESSAGE | FIELD_COUNT_REPEATED | 1);
+            proto.write(FIELD_TYPE_INT64 | 1, i);
+            proto.write(FIELD_TYPE_STRING | 2, tag);
+            proto.write(FIELD_TYPE_STRING | 3, payload);
+            proto.end(token);
+        }
+        data = new EncodedBuffer(READ_SIZE);
+        data->writeRaw(proto.data());
+    }
+
+    virtual void TearDown(const benchmark::State&) override { data.clear(); }
+
+protected:
+    sp<EncodedBuffer> data;
+};
+
+static void feed(const sp<StreamingFieldStripper>& stripper, const sp<EncodedBuffer>& data) {
+    sp<ProtoReader> reader = data->read();
+    while (reader->readBuffer() != NULL) {
+        stripper->write(reader->readBuffer(), reader->currentToRead());
+        reader->move(reader->currentToRead());
+    }
+    stripper->finish();
+}
+
+static size_t strippedSize(const sp<StreamingFieldStripper>& stripper) {
+    size_t size = 0;
+    for (uint8_t privacyPolicy : POLICIES) {
+        size += stripper->getStrippedData(privacyPolicy)->size();
+    }
+    return size;
+}
+
+// Buffer the whole section, then make one pass over it per privacy policy, as the data
+// used to be filtered.
+BENCHMARK_DEFINE_F(PrivacyFilterBench, StripBufferedPerPolicy)(benchmark::State& state) {
+    size_t held = 0;
+    for (auto _ : state) {
+        held = data->size();
+        for (uint8_t privacyPolicy : POLICIES) {
+            sp<StreamingFieldStripper> stripper = new StreamingFieldStripper(&SECTION,
+                    vector<uint8_t>{privacyPolicy}, PRIVACY_POLICY_LOCAL);
+            feed(stripper, data);
+            held += stripper->getStrippedData(privacyPolicy)->size();
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * data->size());
+    state.counters["held_bytes"] = held;
+}
+BENCHMARK_REGISTER_F(PrivacyFilterBench, StripBufferedPerPolicy)->Unit(benchmark::kMillisecond);
+
+// Buffer the whole section, then strip it to every policy in a single pass.
+BENCHMARK_DEFINE_F(PrivacyFilterBench, StripBufferedOnePass)(benchmark::State& state) {
+    size_t held = 0;
+    for (auto _ : state) {
+        sp<StreamingFieldStripper> stripper =
+                new StreamingFieldStripper(&SECTION, POLICIES, PRIVACY_POLICY_LOCAL);
+        feed(stripper, data);
+        held = data->size() + strippedSize(stripper);
+    }
+    state.SetBytesProcessed(state.iterations() * data->size());
+    state.counters["held_bytes"] = held;
+}
+BENCHMARK_REGISTER_F(PrivacyFilterBench, StripBufferedOnePass)->Unit(benchmark::kMillisecond);
+
+// Strip each chunk as it is read, reusing one read buffer, as FdBuffer does with a
+// stripper. Only the stripped data is held.
+BENCHMARK_DEFINE_F(PrivacyFilterBench, StripWhileReading)(benchmark::State& state) {
+    std::vector<uint8_t> chunk(READ_SIZE);
+    size_t held = 0;
+    for (auto _ : state) {
+        sp<StreamingFieldStripper> stripper =
+                new StreamingFieldStripper(&SECTION, POLICIES, PRIVACY_POLICY_LOCAL);
+        sp<ProtoReader> reader = data->read();
+        while (reader->hasNext()) {
+            size_t size = 0;
+            while (size < chunk.size() && reader->hasNext()) {
+                size_t count = std::min(chunk.size() - size, reader->currentToRead());
+                memcpy(chunk.data() + size, reader->readBuffer(), count);
+                reader->move(count);
+                size += count;
+            }
+            stripper->write(chunk.data(), size);
+        }
+        stripper->finish();
+        held = chunk.size() + strippedSize(stripper);
+    }
+    state.SetBytesProcessed(state.iterations() * data->size());
+    state.counters["held_bytes"] = held;
+}
+BENCHMARK_REGISTER_F(PrivacyFilterBench, StripWhileReading)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -300,3 +300,111 @@ TEST_F(PrivacyFilterTest, AutoMessage) {
 }
 
 #endif
+
+class StreamingFieldStripperTest : public Test {
+public:
+    virtual ~StreamingFieldStripperTest() {
+        while (!privacies.empty()) {
+            delete privacies.back();
+            privacies.pop_back();
+        }
+    }
+
+    Privacy* create_privacy(uint32_t field_id, uint8_t type, uint8_t privacyPolicy) {
+        Privacy* p = new Privacy;
+        privacies.push_back(p);
+        p->field_id = field_id;
+        p->type = type;
+        p->children = NULL;
+        p->policy = privacyPolicy;
+        p->patterns = NULL;
+        return p;
+    }
+
+    Privacy* create_message_privacy(uint32_t field_id, Privacy** children) {
+        Privacy* p = create_privacy(field_id, MESSAGE_TYPE, PRIVACY_POLICY_UNSET);
+        p->children = children;
+        return p;
+    }
+
+    // Feed the data one byte at a time, so every field is split across writes.
+    void writeByBytes(const sp<StreamingFieldStripper>& stripper, const std::string& data) {
+        for (char c : data) {
+            stripper->write((const uint8_t*)&c, 1);
+        }
+    }
+
+    std::string readStripped(const sp<StreamingFieldStripper>& stripper, uint8_t privacyPolicy) {
+        ProtoOutputStream* proto = stripper->getStrippedData(privacyPolicy);
+        EXPECT_NE(proto, nullptr);
+        std::string content;
+        if (proto != nullptr) {
+            sp<ProtoReader> reader = proto->data();
+            while (reader->hasNext()) {
+                content.push_back(reader->next());
+            }
+        }
+        return content;
+    }
+
+private:
+    std::vector<Privacy*> privacies;
+};
+
+TEST_F(StreamingFieldStripperTest, StripsEveryPolicyInOnePass) {
+    Privacy* list[] = {create_privacy(1, OTHER_TYPE, PRIVACY_POLICY_LOCAL), NULL};
+    Privacy* fields[] = {create_privacy(1, OTHER_TYPE, PRIVACY_POLICY_LOCAL),
+                         create_message_privacy(5, list), NULL};
+    vector<uint8_t> policies = {PRIVACY_POLICY_AUTOMATIC, PRIVACY_POLICY_LOCAL,
+                                PRIVACY_POLICY_EXPLICIT};
+    sp<StreamingFieldStripper> stripper = new StreamingFieldStripper(
+            create_message_privacy(300, fields), policies, PRIVACY_POLICY_LOCAL);
+
+    writeByBytes(stripper, STRING_FIELD_0 + VARINT_FIELD_1 + STRING_FIELD_2 + MESSAGE_FIELD_5);
+    ASSERT_EQ(NO_ERROR, stripper->finish());
+
+    EXPECT_TRUE(stripper->needsUnfilteredData());
+    EXPECT_TRUE(stripper->keepsUnfilteredData(PRIVACY_POLICY_LOCAL));
+    EXPECT_EQ(nullptr, stripper->getStrippedData(PRIVACY_POLICY_LOCAL));
+    EXPECT_EQ(STRING_FIELD_0 + STRING_FIELD_2 + "\x2a\xd" + STRING_FIELD_2,
+              readStripped(stripper, PRIVACY_POLICY_EXPLICIT));
+    // Every field of the message is stripped, so the message is dropped too.
+    EXPECT_EQ("", readStripped(stripper, PRIVACY_POLICY_AUTOMATIC));
+}
+
+TEST_F(StreamingFieldStripperTest, OnlyStrippedPolicies) {
+    Privacy* fields[] = {create_privacy(3, OTHER_TYPE, PRIVACY_POLICY_AUTOMATIC), NULL};
+    vector<uint8_t> policies = {PRIVACY_POLICY_AUTOMATIC};
+    sp<StreamingFieldStripper> stripper = new StreamingFieldStripper(
+            create_message_privacy(300, fields), policies, PRIVACY_POLICY_LOCAL);
+
+    writeByBytes(stripper, VARINT_FIELD_1 + FIX64_FIELD_3 + NEGATIVE_VARINT_FIELD_6);
+    ASSERT_EQ(NO_ERROR, stripper->finish());
+
+    EXPECT_FALSE(stripper->needsUnfilteredData());
+    EXPECT_FALSE(stripper->hasPolicy(PRIVACY_POLICY_EXPLICIT));
+    EXPECT_EQ(FIX64_FIELD_3, readStripped(stripper, PRIVACY_POLICY_AUTOMATIC));
+}
+
+TEST_F(StreamingFieldStripperTest, BadData) {
+    Privacy* fields[] = {create_privacy(4, OTHER_TYPE, PRIVACY_POLICY_AUTOMATIC), NULL};
+    vector<uint8_t> policies = {PRIVACY_POLICY_AUTOMATIC};
+    sp<StreamingFieldStripper> stripper = new StreamingFieldStripper(
+            create_message_privacy(300, fields), policies, PRIVACY_POLICY_LOCAL);
+
+    writeByBytes(stripper, "iambaddata");
+    EXPECT_EQ(BAD_VALUE, stripper->finish());
+    EXPECT_EQ(nullptr, stripper->getStrippedData(PRIVACY_POLICY_AUTOMATIC));
+}
+
+TEST_F(StreamingFieldStripperTest, DataEndsInNestedMessage) {
+    Privacy* list[] = {create_privacy(1, OTHER_TYPE, PRIVACY_POLICY_LOCAL), NULL};
+    Privacy* fields[] = {create_message_privacy(5, list), NULL};
+    vector<uint8_t> policies = {PRIVACY_POLICY_EXPLICIT};
+    sp<StreamingFieldStripper> stripper = new StreamingFieldStripper(
+            create_message_privacy(300, fields), policies, PRIVACY_POLICY_LOCAL);
+
+    std::string data = STRING_FIELD_0 + MESSAGE_FIELD_5;
+    writeByBytes(stripper, data.substr(0, data.size() - 3));
+    EXPECT_EQ(BAD_VALUE, stripper->finish());
+}
@@ -98,3 +98,77 @@ TEST(ProtoFileReaderTest, ParseOneLevel) {
     ASSERT_EQ(msg2Size, msg_size[1]);
     close(fd);
 }
+
+TEST(ProtoFileReaderTest, IndexesFields) {
+    TemporaryFile tf;
+    ProtoOutputStream proto;
+    string field2(5 * 1024, 'a');
+    proto.write(FIELD_TYPE_INT32 | 1, 300);
+    proto.write(FIELD_TYPE_MESSAGE | 2, field2.data(), field2.length());
+    proto.write(FIELD_TYPE_FIXED64 | 3, (long long)7);
+    proto.write(FIELD_TYPE_FIXED32 | 4, 7);
+    ASSERT_TRUE(proto.flush(tf.fd));
+    ASSERT_EQ(0, lseek(tf.fd, 0, SEEK_SET));
+
+    sp<ProtoFileReader> reader = new ProtoFileReader(tf.fd);
+    EXPECT_TRUE(reader->isMapped());
+    const std::vector<ProtoFieldPosition>* index = reader->fieldIndex();
+    ASSERT_TRUE(index != nullptr);
+    ASSERT_EQ(4u, index->size());
+
+    EXPECT_EQ(1u, read_field_id((*index)[0].tag));
+    EXPECT_EQ(WIRE_TYPE_VARINT, read_wire_type((*index)[0].tag));
+    EXPECT_EQ(1u, (*index)[0].offset);
+    EXPECT_EQ(2u, (*index)[0].size);
+
+    EXPECT_EQ(2u, read_field_id((*index)[1].tag));
+    EXPECT_EQ(WIRE_TYPE_LENGTH_DELIMITED, read_wire_type((*index)[1].tag));
+    EXPECT_EQ(6u, (*index)[1].offset);
+    EXPECT_EQ(field2.size(), (*index)[1].size);
+
+    EXPECT_EQ(8u, (*index)[2].size);
+    EXPECT_EQ(4u, (*index)[3].size);
+    EXPECT_EQ((size_t)reader->size(), (*index)[3].offset + (*index)[3].size);
+
+    // Building the index doesn't move the reader.
+    EXPECT_EQ(0u, reader->bytesRead());
+
+    // Read the length delimited field in place.
+    ASSERT_EQ(NO_ERROR, reader->seek((*index)[1].offset));
+    ASSERT_GE(reader->currentToRead(), field2.size());
+    EXPECT_EQ(field2, string((char const*)reader->readBuffer(), field2.size()));
+    reader->move(field2.size());
+    EXPECT_EQ((*index)[2].offset - 1, reader->bytesRead());
+}
+
+TEST(ProtoFileReaderTest, NoIndexForTruncatedMessage) {
+    TemporaryFile tf;
+    // Field 2 claims 10 bytes, but only 3 follow.
+    ASSERT_TRUE(WriteStringToFile(string("\x08\x01\x12\x0a" "abc"), tf.path));
+
+    sp<ProtoFileReader> reader = new ProtoFileReader(tf.fd);
+    EXPECT_TRUE(reader->fieldIndex() == nullptr);
+    EXPECT_EQ(NO_ERROR, reader->getError());
+    EXPECT_EQ(0u, reader->bytesRead());
+}
+
+TEST(ProtoFileReaderTest, ReadsPipesWithoutMapping) {
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    const string data("\x08\x01\x12\x03" "abc", 7);
+    ASSERT_TRUE(WriteFully(fds[1], data.data(), data.size()));
+    close(fds[1]);
+
+    sp<ProtoFileReader> reader = new ProtoFileReader(fds[0]);
+    EXPECT_FALSE(reader->isMapped());
+    // A pipe can't be read twice, so it can't be indexed without losing data.
+    EXPECT_TRUE(reader->fieldIndex() == nullptr);
+
+    string content;
+    while (reader->hasNext()) {
+        content.push_back(reader->next());
+    }
+    EXPECT_EQ(data, content);
+    EXPECT_EQ(data.size(), reader->bytesRead());
+    close(fds[0]);
+}
@@ -149,6 +149,38 @@ TEST_F(ReporterTest, IncidentReportArgs) {
     ASSERT_TRUE(args1.containsSection(3, false));
 }
 
+TEST_F(ReporterTest, DeferredSectionWrites) {
+    TemporaryFile tf;
+    IncidentReportArgs args;
+    args.addSection(1);
+    args.setPrivacyPolicy(android::os::PRIVACY_POLICY_LOCAL);
+    sp<ReportBatch> batch = new ReportBatch();
+    batch->addStreamingReport(args, listener, tf.fd);
+
+    ReportWriter sectionWriter(batch);
+    sectionWriter.setDeferWrites(true);
+    sectionWriter.startSection(1);
+    FdBuffer buffer;
+    const uint8_t data[] = {0x08, 0x2a};  // field_1: 42
+    ASSERT_EQ(NO_ERROR, buffer.write(data, sizeof(data)));
+    sectionWriter.setSectionStats(buffer);
+    ASSERT_EQ(NO_ERROR, sectionWriter.writeSection(buffer));
+    IncidentMetadata::SectionStats stats;
+    sectionWriter.endSection(&stats);
+
+    // Nothing is written until the owner of the outputs writes the section.
+    string result;
+    ReadFileToString(tf.path, &result);
+    EXPECT_TRUE(result.empty());
+
+    ReportWriter writer(batch);
+    ASSERT_EQ(NO_ERROR, writer.writeDeferredSection(sectionWriter, &stats));
+    ReadFileToString(tf.path, &result);
+    EXPECT_THAT(result, StrEq("\x0a\x02\x08\x2a"));
+    EXPECT_EQ(1, stats.id());
+    EXPECT_EQ(2, stats.report_size_bytes());
+}
+
 /*
 TEST_F(ReporterTest, RunReportEmpty) {
     vector<sp<ReportRequest>> requests;
@@ -0,0 +1,125 @@
+// Copyright (C) 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#define DEBUG false
+#include "Log.h"
+
+#include "SectionScheduler.h"
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+using namespace android;
+using namespace android::base;
+using namespace android::os;
+using namespace android::os::incidentd;
+using ::testing::Test;
+
+const int64_t REPORT_TIMEOUT_MS = 10 * 1000;
+
+class TestSection : public Section {
+public:
+    TestSection(int id, int64_t timeoutMs) : Section(id, timeoutMs) {}
+    virtual status_t Execute(ReportWriter* /*writer*/) const { return NO_ERROR; }
+};
+
+class SectionSchedulerTest : public Test {
+public:
+    SectionSchedulerTest()
+            :historyFile(string(td.path) + "/section_history"),
+             slow(1, 5000),
+             quick(2, 5000),
+             unknown(3, 5000) {
+    }
+
+    IncidentMetadata::SectionStats stats(int64_t durationMs, bool timedOut) {
+        IncidentMetadata::SectionStats result;
+        result.set_exec_duration_ms(durationMs);
+        result.set_timed_out(timedOut);
+        return result;
+    }
+
+protected:
+    TemporaryDir td;
+    const string historyFile;
+    TestSection slow;
+    TestSection quick;
+    TestSection unknown;
+};
+
+TEST_F(SectionSchedulerTest, SchedulesQuickestFirst) {
+    sp<SectionScheduler> scheduler = new SectionScheduler(historyFile, REPORT_TIMEOUT_MS);
+    scheduler->record(&slow, stats(3000, false));
+    scheduler->record(&quick, stats(100, false));
+
+    vector<const Section*> sections = {&slow, &quick, &unknown};
+    scheduler->schedule(&sections);
+    EXPECT_EQ(&unknown, sections[0]);
+    EXPECT_EQ(&quick, sections[1]);
+    EXPECT_EQ(&slow, sections[2]);
+}
+
+TEST_F(SectionSchedulerTest, KeepsOrderWithoutReportTimeout) {
+    sp<SectionScheduler> scheduler = new SectionScheduler(historyFile, 0);
+    scheduler->record(&slow, stats(3000, false));
+    scheduler->record(&quick, stats(100, false));
+
+    vector<const Section*> sections = {&slow, &quick, &unknown};
+    scheduler->schedule(&sections);
+    EXPECT_EQ(&slow, sections[0]);
+    EXPECT_EQ(&quick, sections[1]);
+    EXPECT_EQ(&unknown, sections[2]);
+    EXPECT_EQ(5000, scheduler->getTimeoutMs(&slow, 0, 60 * 1000));
+    EXPECT_FALSE(scheduler->hasReportTimeout());
+}
+
+TEST_F(SectionSchedulerTest, CutsTimeoutToReportTimeout) {
+    sp<SectionScheduler> scheduler = new SectionScheduler(historyFile, REPORT_TIMEOUT_MS);
+    EXPECT_TRUE(scheduler->hasReportTimeout());
+    EXPECT_EQ(5000, scheduler->getTimeoutMs(&slow, 1000, 1000));
+    EXPECT_EQ(2000, scheduler->getTimeoutMs(&slow, 1000, 9000));
+    EXPECT_EQ(0, scheduler->getTimeoutMs(&slow, 1000, 12000));
+}
+
+TEST_F(SectionSchedulerTest, AveragesDurations) {
+    sp<SectionScheduler> scheduler = new SectionScheduler(historyFile, REPORT_TIMEOUT_MS);
+    EXPECT_EQ(-1, scheduler->getExpectedDurationMs(slow.id));
+    scheduler->record(&slow, stats(1000, false));
+    EXPECT_EQ(1000, scheduler->getExpectedDurationMs(slow.id));
+    scheduler->record(&slow, stats(2000, false));
+    EXPECT_EQ(1250, scheduler->getExpectedDurationMs(slow.id));
+
+    // A section that was cut short doesn't look quicker than it is.
+    scheduler->record(&slow, stats(500, true));
+    EXPECT_EQ(1250, scheduler->getExpectedDurationMs(slow.id));
+}
+
+TEST_F(SectionSchedulerTest, KeepsHistoryAcrossRestarts) {
+    {
+        sp<SectionScheduler> scheduler = new SectionScheduler(historyFile, REPORT_TIMEOUT_MS);
+        scheduler->record(&slow, stats(3000, false));
+        scheduler->record(&quick, stats(100, false));
+        ASSERT_EQ(NO_ERROR, scheduler->save());
+    }
+
+    sp<SectionScheduler> scheduler = new SectionScheduler(historyFile, REPORT_TIMEOUT_MS);
+    EXPECT_EQ(3000, scheduler->getExpectedDurationMs(slow.id));
+    EXPECT_EQ(100, scheduler->getExpectedDurationMs(quick.id));
+    EXPECT_EQ(-1, scheduler->getExpectedDurationMs(unknown.id));
+}
+
+TEST_F(SectionSchedulerTest, IgnoresCorruptHistory) {
+    ASSERT_TRUE(WriteStringToFile("\xff\xff\xff", historyFile));
+    sp<SectionScheduler> scheduler = new SectionScheduler(historyFile, REPORT_TIMEOUT_MS);
+    EXPECT_EQ(-1, scheduler->getExpectedDurationMs(slow.id));
+}
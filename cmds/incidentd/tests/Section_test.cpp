@@ -25,6 +25,7 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <string.h>
+#include <zlib.h>
 
 using namespace android;
 using namespace android::base;
@@ -147,7 +148,6 @@ TEST_F(SectionTest, FileSectionTimeout) {
 
 TEST_F(SectionTest, GZipSection) {
     const std::string testFile = kTestDataPath + "kmsg.txt";
-    const std::string testGzFile = testFile + ".gz";
     GZipSection gs(NOOP_PARSER, "/tmp/nonexist", testFile.c_str(), NULL);
 
     vector<sp<ReportRequest>> requests;
@@ -156,20 +156,42 @@ TEST_F(SectionTest, GZipSection) {
     requestSet.setMainPrivacyPolicy(android::os::PRIVACY_POLICY_LOCAL);
 
     ASSERT_EQ(NO_ERROR, gs.Execute(&requestSet));
-    std::string expected, gzFile, actual;
-    ASSERT_TRUE(ReadFileToString(testGzFile, &gzFile));
+    std::string content, actual;
+    ASSERT_TRUE(ReadFileToString(testFile, &content));
     ASSERT_TRUE(ReadFileToString(tf.path, &actual));
-    // generates the expected protobuf result.
-    size_t fileLen = testFile.size();
-    size_t totalLen = 1 + get_varint_size(fileLen) + fileLen + 3 + gzFile.size();
-    uint8_t header[20];
-    header[0] = '\x2';  // header 0 << 3 + 2
-    uint8_t* ptr = write_raw_varint(header + 1, totalLen);
-    *ptr = '\n';  // header 1 << 3 + 2
-    ptr = write_raw_varint(++ptr, fileLen);
-    expected.assign((const char*)header, ptr - header);
-    expected += testFile + "\x12\x9F\x6" + gzFile;
-    EXPECT_THAT(actual, StrEq(expected));
+    size_t pos = 0;
+    auto readVarint = [&]() {
+        uint64_t val = 0;
+        for (int shift = 0; pos < actual.size(); shift += 7) {
+            uint8_t b = actual[pos++];
+            val |= (uint64_t)(b & 0x7f) << shift;
+            if ((b & 0x80) == 0) break;
+        }
+        return val;
+    };
+    ASSERT_EQ('\x2', actual[pos++]);  // header 0 << 3 + 2
+    EXPECT_EQ(actual.size() - 1 - get_varint_size(actual.size()), readVarint());
+    ASSERT_EQ('\n', actual[pos++]);  // header 1 << 3 + 2
+    ASSERT_EQ(testFile.size(), readVarint());
+    EXPECT_EQ(testFile, actual.substr(pos, testFile.size()));
+    pos += testFile.size();
+    ASSERT_EQ('\x12', actual[pos++]);  // header 2 << 3 + 2
+    size_t gzLen = readVarint();
+    ASSERT_EQ(actual.size() - pos, gzLen);
+
+    // The file is gzipped by zlib in incidentd, which isn't byte for byte what the gzip
+    // tool writes, so compare what it uncompresses to.
+    std::string uncompressed(content.size() + 1, '\0');
+    z_stream stream = {};
+    ASSERT_EQ(Z_OK, inflateInit2(&stream, MAX_WBITS + 16));
+    stream.next_in = (Bytef*)actual.data() + pos;
+    stream.avail_in = gzLen;
+    stream.next_out = (Bytef*)&uncompressed[0];
+    stream.avail_out = uncompressed.size();
+    EXPECT_EQ(Z_STREAM_END, inflate(&stream, Z_FINISH));
+    uncompressed.resize(stream.total_out);
+    inflateEnd(&stream);
+    EXPECT_THAT(uncompressed, StrEq(content));
 }
 
 TEST_F(SectionTest, GZipSectionNoFileFound) {
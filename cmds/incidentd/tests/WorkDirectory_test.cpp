@@ -0,0 +1,215 @@
+// Copyright (C) 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#define DEBUG false
+#include "Log.h"
+
+#include "WorkDirectory.h"
+
+#include "proto_util.h"
+
+#include <dirent.h>
+#include <string.h>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+using namespace android;
+using namespace android::base;
+using namespace android::os;
+using namespace android::os::incidentd;
+using namespace std;
+using ::testing::Test;
+
+// Section 2 of the test section list has no privacy restrictions, so it reads back as written.
+const int SECTION_ID = 2;
+
+class WorkDirectoryTest : public Test {
+public:
+    virtual void SetUp() override {
+        workDirectory = new WorkDirectory(td.path, 100, 100 * 1024 * 1024);
+        args.setReceiverPkg("com.example");
+        args.setReceiverCls("com.example.Receiver");
+        args.addSection(SECTION_ID);
+    }
+
+    // Make a completed report holding one section with the given data.
+    sp<ReportFile> createReport(const string& data) {
+        sp<ReportFile> report = workDirectory->createReportFile();
+        report->addReport(args);
+        EXPECT_EQ(NO_ERROR, report->startWritingDataFile());
+        EXPECT_EQ(NO_ERROR, write_section_header(report->getDataFileFd(), SECTION_ID,
+                data.size()));
+        EXPECT_TRUE(WriteFully(report->getDataFileFd(), data.c_str(), data.size()));
+        report->closeDataFile();
+        report->markCompleted();
+        EXPECT_EQ(NO_ERROR, report->saveEnvelope());
+        return report;
+    }
+
+    // The data of the report, read back the way it is sent to its receiver.
+    string readReport(const sp<ReportFile>& report) {
+        TemporaryFile tf;
+        int fd = dup(tf.fd);
+        EXPECT_EQ(NO_ERROR, report->startFilteringData(fd, args));
+        string content;
+        ReadFileToString(tf.path, &content);
+        return content;
+    }
+
+    vector<string> sectionFiles() {
+        vector<string> result;
+        DIR* dir = opendir(td.path);
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            const string name = entry->d_name;
+            if (name.size() > 8 && name.compare(name.size() - 8, 8, ".section") == 0) {
+                result.push_back(name);
+            }
+        }
+        closedir(dir);
+        return result;
+    }
+
+protected:
+    TemporaryDir td;
+    sp<WorkDirectory> workDirectory;
+    IncidentReportArgs args;
+};
+
+TEST_F(WorkDirectoryTest, StoresSectionsCompressed) {
+    string data;
+    for (int i = 0; i < 1000; i++) {
+        data += "\x0a\x05hello";
+    }
+    sp<ReportFile> report = createReport(data);
+
+    const ReportFileProto& envelope = report->getEnvelope();
+    EXPECT_FALSE(envelope.has_data_file());
+    ASSERT_EQ(1, envelope.stored_section_size());
+    EXPECT_EQ(SECTION_ID, envelope.stored_section(0).id());
+    EXPECT_EQ((int64_t)data.size(), envelope.stored_section(0).size());
+    EXPECT_NE(0, access(report->getDataFileName().c_str(), F_OK));
+
+    struct stat st;
+    const string blob = workDirectory->getSectionFileName(envelope.stored_section(0).blob());
+    ASSERT_EQ(0, stat(blob.c_str(), &st));
+    EXPECT_LT(st.st_size, (off_t)data.size() / 10);
+
+    sp<ReportFile> loaded = workDirectory->getReport(args.receiverPkg(), args.receiverCls(),
+            report->getId(), nullptr);
+    ASSERT_TRUE(loaded != nullptr);
+    string expected;
+    expected += "\x12\xd8\x36";  // Section 2, 7000 bytes.
+    expected += data;
+    EXPECT_EQ(expected, readReport(loaded));
+}
+
+TEST_F(WorkDirectoryTest, SharesSectionsBetweenReports) {
+    const string data = "\x0a\x05hello";
+    sp<ReportFile> report1 = createReport(data);
+    sp<ReportFile> report2 = createReport(data);
+    sp<ReportFile> report3 = createReport("\x0a\x05world");
+    EXPECT_EQ(report1->getEnvelope().stored_section(0).blob(),
+            report2->getEnvelope().stored_section(0).blob());
+    EXPECT_EQ(2u, sectionFiles().size());
+
+    // The section stays as long as a report refers to it.
+    workDirectory->commit(report1, args.receiverPkg(), args.receiverCls());
+    EXPECT_EQ(2u, sectionFiles().size());
+    EXPECT_EQ("\x12\x07" + data, readReport(report2));
+
+    workDirectory->commit(report2, args.receiverPkg(), args.receiverCls());
+    EXPECT_EQ(1u, sectionFiles().size());
+
+    workDirectory->remove(report3);
+    EXPECT_TRUE(sectionFiles().empty());
+}
+
+TEST_F(WorkDirectoryTest, ReadsReportsWithDataFile) {
+    // A report that was persisted before the section store, or whose sections couldn't be
+    // stored, is read from its data file.
+    const string data = "\x0a\x05hello";
+    sp<ReportFile> report = workDirectory->createReportFile();
+    report->addReport(args);
+    ASSERT_EQ(NO_ERROR, report->startWritingDataFile());
+    ASSERT_EQ(NO_ERROR, write_section_header(report->getDataFileFd(), SECTION_ID,
+            data.size()));
+    ASSERT_TRUE(WriteFully(report->getDataFileFd(), data.c_str(), data.size()));
+    report->setWriteError(BAD_VALUE);
+    report->closeDataFile();
+    report->markCompleted();
+    ASSERT_EQ(NO_ERROR, report->saveEnvelope());
+
+    EXPECT_TRUE(report->getEnvelope().has_data_file());
+    EXPECT_EQ(0, report->getEnvelope().stored_section_size());
+    EXPECT_TRUE(sectionFiles().empty());
+    EXPECT_EQ("\x12\x07" + data, readReport(report));
+}
+
+TEST_F(WorkDirectoryTest, CleansSectionsWithTheirReports) {
+    // Keep at most two reports.
+    workDirectory = new WorkDirectory(td.path, 2, 100 * 1024 * 1024);
+    createReport("\x0a\x01" "a");
+    createReport("\x0a\x01" "a");
+    EXPECT_EQ(1u, sectionFiles().size());
+
+    // Removes the first report, but the second one still has its section.
+    createReport("\x0a\x01" "b");
+    EXPECT_EQ(2u, sectionFiles().size());
+
+    // Removes the second report, and the section with it.
+    sp<ReportFile> report = createReport("\x0a\x01" "c");
+    EXPECT_EQ(2u, sectionFiles().size());
+    EXPECT_EQ("\x12\x03\x0a\x01" "c", readReport(report));
+}
+
+TEST_F(WorkDirectoryTest, KeepsSectionsIfAnEnvelopeCannotBeRead) {
+    // Keep at most two reports.
+    workDirectory = new WorkDirectory(td.path, 2, 100 * 1024 * 1024);
+    createReport("\x0a\x01" "a");
+    createReport("\x0a\x01" "b");
+    ASSERT_TRUE(WriteStringToFile("corrupt", string(td.path) + "/99999999999999999999.envelope"));
+
+    // Removes the first two reports, but the corrupt one could refer to their sections.
+    createReport("\x0a\x01" "c");
+    EXPECT_EQ(3u, sectionFiles().size());
+}
+
+TEST_F(WorkDirectoryTest, RemovesOnlyAbandonedStagedSections) {
+    const string dir = td.path;
+    const string abandoned = dir + "/00000000000000000001-0123.section.tmp";
+    const string storing = dir + "/00000000000000000002-0123.section.tmp";
+    ASSERT_TRUE(WriteStringToFile("abandoned", abandoned));
+    ASSERT_TRUE(WriteStringToFile("storing", storing));
+    // The report whose sections are being stored still has its data file.
+    ASSERT_TRUE(WriteStringToFile("", dir + "/00000000000000000002.envelope"));
+    ASSERT_TRUE(WriteStringToFile("", dir + "/00000000000000000002.data"));
+
+    createReport("\x0a\x01" "a");
+    EXPECT_NE(0, access(abandoned.c_str(), F_OK));
+    EXPECT_EQ(0, access(storing.c_str(), F_OK));
+}
+
+TEST_F(WorkDirectoryTest, RemovesUnfinishedEnvelopesWhenOpened) {
+    const string dir = td.path;
+    const string envelope = dir + "/00000000000000000001.envelope.tmp";
+    const string data = dir + "/00000000000000000001.data.tmp";
+    ASSERT_TRUE(WriteStringToFile("envelope", envelope));
+    ASSERT_TRUE(WriteStringToFile("data", data));
+
+    // A restarted incidentd opens the directory again.
+    workDirectory = new WorkDirectory(td.path, 100, 100 * 1024 * 1024);
+    EXPECT_NE(0, access(envelope.c_str(), F_OK));
+    EXPECT_NE(0, access(data.c_str(), F_OK));
+}
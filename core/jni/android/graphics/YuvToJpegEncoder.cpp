@@ -5,9 +5,131 @@
 #include <hardware/hardware.h>
 
 #include "core_jni_helpers.h"
+#include "parallel_utils.h"
 
+#include <android-base/properties.h>
 #include <jni.h>
 
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define USE_NEON_DEINTERLEAVE 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define USE_SSE2_DEINTERLEAVE 1
+#endif
+
+// The marker codes that aren't in jpeglib.h.
+static const uint8_t kJpegSof0 = 0xC0;
+static const uint8_t kJpegSos = 0xDA;
+
+// Both encoders use 2x2 luma sampling, so MCUs are 16 rows high.
+static const int kMcuRows = 16;
+
+// Pictures are only split into strips of at least this many pixels, below which
+// starting a thread costs more than it saves.
+static const int kMinPixelsPerStrip = 1024 * 1024;
+
+// Splits count pairs of bytes into the first and second byte of each pair.
+static void deinterleave_pairs(const uint8_t* src, uint8_t* first, uint8_t* second,
+        int count) {
+    int i = 0;
+#if defined(USE_NEON_DEINTERLEAVE)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x2_t pairs = vld2q_u8(src + 2 * i);
+        vst1q_u8(first + i, pairs.val[0]);
+        vst1q_u8(second + i, pairs.val[1]);
+    }
+#elif defined(USE_SSE2_DEINTERLEAVE)
+    const __m128i lowBytes = _mm_set1_epi16(0xff);
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (src + 2 * i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (src + 2 * i + 16));
+        _mm_storeu_si128((__m128i*) (first + i), _mm_packus_epi16(
+                _mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes)));
+        _mm_storeu_si128((__m128i*) (second + i), _mm_packus_epi16(
+                _mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+#endif
+    for (; i < count; i++) {
+        first[i] = src[2 * i];
+        second[i] = src[2 * i + 1];
+    }
+}
+
+// Splits count groups of Y0 U Y1 V bytes into planes of 2 * count Y bytes and
+// count U and V bytes.
+static void deinterleave_yuyv(const uint8_t* src, uint8_t* y, uint8_t* u, uint8_t* v,
+        int count) {
+    int i = 0;
+#if defined(USE_NEON_DEINTERLEAVE)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x4_t yuyv = vld4q_u8(src + 4 * i);
+        uint8x16x2_t luma;
+        luma.val[0] = yuyv.val[0];
+        luma.val[1] = yuyv.val[2];
+        vst2q_u8(y + 2 * i, luma);
+        vst1q_u8(u + i, yuyv.val[1]);
+        vst1q_u8(v + i, yuyv.val[3]);
+    }
+#elif defined(USE_SSE2_DEINTERLEAVE)
+    const __m128i lowBytes = _mm_set1_epi16(0xff);
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (src + 4 * i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (src + 4 * i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*) (src + 4 * i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*) (src + 4 * i + 48));
+        _mm_storeu_si128((__m128i*) (y + 2 * i), _mm_packus_epi16(
+                _mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes)));
+        _mm_storeu_si128((__m128i*) (y + 2 * i + 16), _mm_packus_epi16(
+                _mm_and_si128(c, lowBytes), _mm_and_si128(d, lowBytes)));
+        __m128i uv0 = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        __m128i uv1 = _mm_packus_epi16(_mm_srli_epi16(c, 8), _mm_srli_epi16(d, 8));
+        _mm_storeu_si128((__m128i*) (u + i), _mm_packus_epi16(
+                _mm_and_si128(uv0, lowBytes), _mm_and_si128(uv1, lowBytes)));
+        _mm_storeu_si128((__m128i*) (v + i), _mm_packus_epi16(
+                _mm_srli_epi16(uv0, 8), _mm_srli_epi16(uv1, 8)));
+    }
+#endif
+    for (; i < count; i++) {
+        y[2 * i] = src[4 * i];
+        u[i] = src[4 * i + 1];
+        y[2 * i + 1] = src[4 * i + 2];
+        v[i] = src[4 * i + 3];
+    }
+}
+
+// Finds the marker segment with the given code in the header of a jpeg. Returns
+// the offset of its 0xFF byte, or -1 if it isn't before the start of the scan.
+static ssize_t find_jpeg_marker(const uint8_t* data, size_t size, uint8_t code) {
+    // Skip SOI.
+    size_t offset = 2;
+    while (offset + 4 <= size && data[offset] == 0xFF) {
+        if (data[offset + 1] == code) {
+            return offset;
+        }
+        if (data[offset + 1] == kJpegSos) {
+            break;
+        }
+        offset += 2 + ((data[offset + 2] << 8) | data[offset + 3]);
+    }
+    return -1;
+}
+
+// Fills rows numRows to totalRows of a buffer of rows of width bytes with the last row that was
+// read into it.  The blocks of the last MCU row of a picture still cover the rows below the
+// picture, which would otherwise hold whatever the buffer held before.
+static void repeat_last_row(uint8_t* rows, int numRows, int totalRows, int width) {
+    for (int row = std::max(numRows, 1); row < totalRows; row++) {
+        memcpy(rows + row * width, rows + (row - 1) * width, width);
+    }
+}
+
 YuvToJpegEncoder* YuvToJpegEncoder::create(int format, int* strides) {
     // Only ImageFormat.NV21 and ImageFormat.YUY2 are supported
     // for now.
@@ -35,7 +157,19 @@ void error_exit(j_common_ptr cinfo) {
 }
 
 bool YuvToJpegEncoder::encode(SkWStream* stream, void* inYuv, int width,
-        int height, int* offsets, int jpegQuality) {
+        int height, int* offsets, int jpegQuality, int maxThreads) {
+    const int numThreads = (int) std::min<int64_t>(
+            std::min<int64_t>(maxThreads, (int64_t) width * height / kMinPixelsPerStrip),
+            (height + kMcuRows - 1) / kMcuRows);
+    if (numThreads > 1) {
+        return encodeStrips(stream, (uint8_t*) inYuv, width, height, offsets, jpegQuality,
+                numThreads);
+    }
+    return encodeRows(stream, (uint8_t*) inYuv, width, height, offsets, jpegQuality, 0);
+}
+
+bool YuvToJpegEncoder::encodeRows(SkWStream* stream, uint8_t* yuv, int width,
+        int height, int* offsets, int jpegQuality, int restartInterval) {
     jpeg_compress_struct    cinfo;
     ErrorMgr                err;
     skjpeg_destination_mgr  sk_wstream(stream);
@@ -52,10 +186,11 @@ bool YuvToJpegEncoder::encode(SkWStream* stream, void* inYuv, int width,
     cinfo.dest = &sk_wstream;
 
     setJpegCompressStruct(&cinfo, width, height, jpegQuality);
+    cinfo.restart_interval = restartInterval;
 
     jpeg_start_compress(&cinfo, TRUE);
 
-    compress(&cinfo, (uint8_t*) inYuv, offsets);
+    compress(&cinfo, yuv, offsets);
 
     jpeg_finish_compress(&cinfo);
 
@@ -64,6 +199,68 @@ bool YuvToJpegEncoder::encode(SkWStream* stream, void* inYuv, int width,
     return true;
 }
 
+bool YuvToJpegEncoder::encodeStrips(SkWStream* stream, uint8_t* yuv, int width,
+        int height, int* offsets, int jpegQuality, int numThreads) {
+    // Each strip is a whole number of MCU rows, and one restart interval, so it
+    // can be encoded on its own. The encoded strips are then the same as what a
+    // single encoder would have written between the restart markers. A restart
+    // interval can't be longer than 65535 MCUs, so very wide pictures have more
+    // strips than threads.
+    const int mcusPerRow = (width + kMcuRows - 1) / kMcuRows;
+    const int mcuRows = (height + kMcuRows - 1) / kMcuRows;
+    const int mcuRowsPerStrip = std::min((mcuRows + numThreads - 1) / numThreads,
+            std::max(1, 65535 / mcusPerRow));
+    const int rowsPerStrip = mcuRowsPerStrip * kMcuRows;
+    const int restartInterval = mcuRowsPerStrip * mcusPerRow;
+    const int numStrips = (height + rowsPerStrip - 1) / rowsPerStrip;
+
+    std::vector<SkDynamicMemoryWStream> strips(numStrips);
+    std::vector<char> encoded(numStrips);
+    android::for_each_in_parallel(numStrips, numThreads, [&](size_t strip) {
+        const int row = strip * rowsPerStrip;
+        int stripOffsets[2] = { offsets[0], fNumPlanes > 1 ? offsets[1] : 0 };
+        offsetRows(stripOffsets, row);
+        encoded[strip] = encodeRows(&strips[strip], yuv, width,
+                std::min(rowsPerStrip, height - row), stripOffsets, jpegQuality,
+                restartInterval);
+    });
+
+    for (int strip = 0; strip < numStrips; strip++) {
+        if (!encoded[strip]) {
+            return false;
+        }
+        sk_sp<SkData> data = strips[strip].detachAsData();
+        uint8_t* bytes = (uint8_t*) data->writable_data();
+        const size_t size = data->size();
+        if (strip == 0) {
+            // The header of the first strip, with the height of the whole picture.
+            const ssize_t sof = find_jpeg_marker(bytes, size, kJpegSof0);
+            const ssize_t sos = find_jpeg_marker(bytes, size, kJpegSos);
+            if (sof < 0 || sos < 0) {
+                return false;
+            }
+            bytes[sof + 5] = (uint8_t) (height >> 8);
+            bytes[sof + 6] = (uint8_t) height;
+            if (!stream->write(bytes, size - 2)) {
+                return false;
+            }
+        } else {
+            const ssize_t sos = find_jpeg_marker(bytes, size, kJpegSos);
+            if (sos < 0) {
+                return false;
+            }
+            const size_t scan = sos + 2 + ((bytes[sos + 2] << 8) | bytes[sos + 3]);
+            const uint8_t restart[] = { 0xFF, (uint8_t) (JPEG_RST0 + (strip - 1) % 8) };
+            if (!stream->write(restart, sizeof(restart))
+                    || !stream->write(bytes + scan, size - 2 - scan)) {
+                return false;
+            }
+        }
+    }
+    const uint8_t eoi[] = { 0xFF, JPEG_EOI };
+    return stream->write(eoi, sizeof(eoi));
+}
+
 void YuvToJpegEncoder::setJpegCompressStruct(jpeg_compress_struct* cinfo,
         int width, int height, int quality) {
     cinfo->image_width = width;
@@ -109,10 +306,11 @@ void Yuv420SpToJpegEncoder::compress(jpeg_compress_struct* cinfo,
         //deitnerleave u and v
         deinterleave(vuPlanar, uRows, vRows, cinfo->next_scanline, width, height);
 
-        // Jpeg library ignores the rows whose indices are greater than height.
+        // The rows below the picture still go into the last blocks, so they repeat the last
+        // row, as jpeg_write_scanlines would pad them.
         for (int i = 0; i < 16; i++) {
             // y row
-            y[i] = yPlanar + (cinfo->next_scanline + i) * fStrides[0];
+            y[i] = yPlanar + std::min<int>(cinfo->next_scanline + i, height - 1) * fStrides[0];
 
             // construct u row and v row
             if ((i & 1) == 0) {
@@ -135,14 +333,16 @@ void Yuv420SpToJpegEncoder::deinterleave(uint8_t* vuPlanar, uint8_t* uRows,
     if (numRows > 8) numRows = 8;
     for (int row = 0; row < numRows; ++row) {
         int offset = ((rowIndex >> 1) + row) * fStrides[1];
-        uint8_t* vu = vuPlanar + offset;
-        for (int i = 0; i < (width >> 1); ++i) {
-            int index = row * (width >> 1) + i;
-            uRows[index] = vu[1];
-            vRows[index] = vu[0];
-            vu += 2;
-        }
+        int index = row * (width >> 1);
+        deinterleave_pairs(vuPlanar + offset, vRows + index, uRows + index, width >> 1);
     }
+    repeat_last_row(uRows, numRows, 8, width >> 1);
+    repeat_last_row(vRows, numRows, 8, width >> 1);
+}
+
+void Yuv420SpToJpegEncoder::offsetRows(int* offsets, int row) {
+    offsets[0] += row * fStrides[0];
+    offsets[1] += (row >> 1) * fStrides[1];
 }
 
 void Yuv420SpToJpegEncoder::configSamplingFactors(jpeg_compress_struct* cinfo) {
@@ -184,7 +384,6 @@ void Yuv422IToJpegEncoder::compress(jpeg_compress_struct* cinfo,
     while (cinfo->next_scanline < cinfo->image_height) {
         deinterleave(yuvOffset, yRows, uRows, vRows, cinfo->next_scanline, width, height);
 
-        // Jpeg library ignores the rows whose indices are greater than height.
         for (int i = 0; i < 16; i++) {
             // y row
             y[i] = yRows + i * width;
@@ -210,16 +409,17 @@ void Yuv422IToJpegEncoder::deinterleave(uint8_t* yuv, uint8_t* yRows, uint8_t* u
     if (numRows > 16) numRows = 16;
     for (int row = 0; row < numRows; ++row) {
         uint8_t* yuvSeg = yuv + (rowIndex + row) * fStrides[0];
-        for (int i = 0; i < (width >> 1); ++i) {
-            int indexY = row * width + (i << 1);
-            int indexU = row * (width >> 1) + i;
-            yRows[indexY] = yuvSeg[0];
-            yRows[indexY + 1] = yuvSeg[2];
-            uRows[indexU] = yuvSeg[1];
-            vRows[indexU] = yuvSeg[3];
-            yuvSeg += 4;
-        }
+        int indexU = row * (width >> 1);
+        deinterleave_yuyv(yuvSeg, yRows + row * width, uRows + indexU, vRows + indexU,
+                width >> 1);
     }
+    repeat_last_row(yRows, numRows, 16, width);
+    repeat_last_row(uRows, numRows, 16, width >> 1);
+    repeat_last_row(vRows, numRows, 16, width >> 1);
+}
+
+void Yuv422IToJpegEncoder::offsetRows(int* offsets, int row) {
+    offsets[0] += row * fStrides[0];
 }
 
 void Yuv422IToJpegEncoder::configSamplingFactors(jpeg_compress_struct* cinfo) {
@@ -245,7 +445,11 @@ static jboolean YuvImage_compressToJpeg(JNIEnv* env, jobject, jbyteArray inYuv,
     YuvToJpegEncoder* encoder = YuvToJpegEncoder::create(format, imgStrides);
     jboolean result = JNI_FALSE;
     if (encoder != NULL) {
-        encoder->encode(strm, yuv, width, height, imgOffsets, jpegQuality);
+        // Strips add restart markers, which change the bytes of the picture, so they are only
+        // used when asked for.
+        const int maxThreads = android::base::GetBoolProperty("debug.yuvimage.jpeg_strips", false)
+                ? std::thread::hardware_concurrency() : 1;
+        encoder->encode(strm, yuv, width, height, imgOffsets, jpegQuality, maxThreads);
         delete encoder;
         result = JNI_TRUE;
     }
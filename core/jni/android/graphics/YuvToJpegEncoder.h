@@ -28,10 +28,12 @@ public:
      *  @param height Height of the Yuv data in terms of pixels.
      *  @param offsets The offsets in each image plane with respect to inYuv.
      *  @param jpegQuality Picture quality in [0, 100].
+     *  @param maxThreads How many threads a large picture may be encoded
+     *         on, in strips separated by restart markers.
      *  @return true if successfully compressed the stream.
      */
     bool encode(SkWStream* stream,  void* inYuv, int width,
-           int height, int* offsets, int jpegQuality);
+           int height, int* offsets, int jpegQuality, int maxThreads = 1);
 
     virtual ~YuvToJpegEncoder() {}
 
@@ -40,9 +42,15 @@ protected:
     int* fStrides;
     void setJpegCompressStruct(jpeg_compress_struct* cinfo, int width,
             int height, int quality);
+    bool encodeRows(SkWStream* stream, uint8_t* yuv, int width, int height,
+            int* offsets, int jpegQuality, int restartInterval);
+    bool encodeStrips(SkWStream* stream, uint8_t* yuv, int width, int height,
+            int* offsets, int jpegQuality, int numThreads);
     virtual void configSamplingFactors(jpeg_compress_struct* cinfo) = 0;
     virtual void compress(jpeg_compress_struct* cinfo,
             uint8_t* yuv, int* offsets) = 0;
+    // Moves offsets from the first row of each plane to the given row of the image.
+    virtual void offsetRows(int* offsets, int row) = 0;
 };
 
 class Yuv420SpToJpegEncoder : public YuvToJpegEncoder {
@@ -57,6 +65,7 @@ private:
     void deinterleave(uint8_t* vuPlanar, uint8_t* uRows, uint8_t* vRows,
             int rowIndex, int width, int height);
     void compress(jpeg_compress_struct* cinfo, uint8_t* yuv, int* offsets);
+    void offsetRows(int* offsets, int row);
 };
 
 class Yuv422IToJpegEncoder : public YuvToJpegEncoder {
@@ -67,6 +76,7 @@ public:
 private:
     void configSamplingFactors(jpeg_compress_struct* cinfo);
     void compress(jpeg_compress_struct* cinfo, uint8_t* yuv, int* offsets);
+    void offsetRows(int* offsets, int row);
     void deinterleave(uint8_t* yuv, uint8_t* yRows, uint8_t* uRows,
             uint8_t* vRows, int rowIndex, int width, int height);
 };
@@ -42,6 +42,7 @@
 #include <img_utils/StripSource.h>
 
 #include "core_jni_helpers.h"
+#include "raw_pixel_writer.h"
 
 #include "android_runtime/AndroidRuntime.h"
 #include "android_runtime/android_hardware_camera2_CameraMetadata.h"
@@ -121,6 +122,8 @@ enum {
     TIFF_IFD_0 = 0,
     TIFF_IFD_SUB1 = 1,
     TIFF_IFD_GPSINFO = 2,
+    // About how many bytes of pixels are read, repacked and written at once.
+    PIXEL_CHUNK_SIZE = 4 * 1024 * 1024,
 };
 
 
@@ -322,7 +325,7 @@ public:
     status_t close();
 private:
     enum {
-        BYTE_ARRAY_LENGTH = 4096
+        BYTE_ARRAY_LENGTH = 64 * 1024
     };
     jobject mOutputStream;
     JNIEnv* mEnv;
@@ -397,7 +400,7 @@ public:
     virtual ~JniInputStream();
 private:
     enum {
-        BYTE_ARRAY_LENGTH = 4096
+        BYTE_ARRAY_LENGTH = 64 * 1024
     };
     jobject mInStream;
     JNIEnv* mEnv;
@@ -484,7 +487,7 @@ public:
     virtual ~JniInputByteBuffer();
 private:
     enum {
-        BYTE_ARRAY_LENGTH = 4096
+        BYTE_ARRAY_LENGTH = 64 * 1024
     };
     jobject mInBuf;
     JNIEnv* mEnv;
@@ -538,6 +541,16 @@ status_t JniInputByteBuffer::close() {
 // End of JniInputByteBuffer
 // ----------------------------------------------------------------------------
 
+/**
+ * Whether rows of width pixels of bytesPerPixel bytes fit in the given strides, without
+ * overlapping.
+ */
+static bool validStrides(uint32_t width, uint32_t pixStride, uint32_t rowStride,
+        uint32_t bytesPerPixel) {
+    return width > 0 && pixStride >= bytesPerPixel
+            && rowStride >= static_cast<uint64_t>(width - 1) * pixStride + bytesPerPixel;
+}
+
 /**
  * StripSource subclass for Input types.
  *
@@ -588,6 +601,13 @@ status_t InputStripSource::writeToStream(Output& stream, uint32_t count) {
         return BAD_VALUE;
     }
 
+    if (!validStrides(mWidth, mPixStride, mRowStride, mBytesPerSample * mSamplesPerPixel)) {
+        ALOGE("%s: Invalid pixel stride %u or row stride %u", __FUNCTION__, mPixStride,
+                mRowStride);
+        jniThrowException(mEnv, "java/lang/IllegalStateException", "Invalid pixel or row stride");
+        return BAD_VALUE;
+    }
+
     // Skip offset
     while (offset > 0) {
         ssize_t skipped = mInput->skip(offset);
@@ -609,24 +629,30 @@ status_t InputStripSource::writeToStream(Output& stream, uint32_t count) {
         offset -= skipped;
     }
 
-    Vector<uint8_t> row;
-    if (row.resize(mRowStride) < 0) {
-        jniThrowException(mEnv, "java/lang/OutOfMemoryError", "Could not allocate row vector.");
+    // Read whole bands of rows, and write each of them once with the padding removed.
+    const uint32_t bytesPerPixel = mBytesPerSample * mSamplesPerPixel;
+    const uint32_t rowsPerBand = std::max<uint32_t>(1, PIXEL_CHUNK_SIZE / mRowStride);
+    Vector<uint8_t> band;
+    if (band.resize(std::min(rowsPerBand, mHeight) * mRowStride) < 0) {
+        jniThrowException(mEnv, "java/lang/OutOfMemoryError", "Could not allocate band vector.");
         return BAD_VALUE;
     }
 
-    uint8_t* rowBytes = row.editArray();
+    uint8_t* bandBytes = band.editArray();
 
-    for (uint32_t i = 0; i < mHeight; ++i) {
-        size_t rowFillAmt = 0;
-        size_t rowSize = mRowStride;
+    for (uint32_t firstRow = 0; firstRow < mHeight; firstRow += rowsPerBand) {
+        const uint32_t numRows = std::min(rowsPerBand, mHeight - firstRow);
+        size_t bandFillAmt = 0;
+        size_t bandSize = numRows * mRowStride;
 
-        while (rowFillAmt < mRowStride) {
-            ssize_t bytesRead = mInput->read(rowBytes, rowFillAmt, rowSize);
+        while (bandFillAmt < numRows * mRowStride) {
+            ssize_t bytesRead = mInput->read(bandBytes, bandFillAmt, bandSize);
             if (bytesRead <= 0) {
                 if (bytesRead == NOT_ENOUGH_DATA || bytesRead == 0) {
                     ALOGE("%s: Early EOF on row %" PRIu32 ", received bytesRead %zd",
-                            __FUNCTION__, i, bytesRead);
+                            __FUNCTION__,
+                            firstRow + static_cast<uint32_t>(bandFillAmt / mRowStride),
+                            bytesRead);
                     jniThrowExceptionFmt(mEnv, "java/io/IOException",
                             "Early EOF encountered, not enough pixel data for image of size %"
                             PRIu32, fullSize);
@@ -639,27 +665,19 @@ status_t InputStripSource::writeToStream(Output& stream, uint32_t count) {
                 }
                 return bytesRead;
             }
-            rowFillAmt += bytesRead;
-            rowSize -= bytesRead;
+            bandFillAmt += bytesRead;
+            bandSize -= bytesRead;
         }
 
-        if (mPixStride == mBytesPerSample * mSamplesPerPixel) {
-            ALOGV("%s: Using stream per-row write for strip.", __FUNCTION__);
-
-            if (stream.write(rowBytes, 0, mBytesPerSample * mSamplesPerPixel * mWidth) != OK ||
-                    mEnv->ExceptionCheck()) {
-                if (!mEnv->ExceptionCheck()) {
-                    jniThrowException(mEnv, "java/io/IOException", "Failed to write pixel data");
-                }
-                return BAD_VALUE;
+        ALOGV("%s: Using stream per-band write for strip.", __FUNCTION__);
+        repack_raw_rows(bandBytes, mWidth, mPixStride, mRowStride, bytesPerPixel, 0, numRows,
+                bandBytes);
+        if (stream.write(bandBytes, 0, numRows * bytesPerPixel * mWidth) != OK ||
+                mEnv->ExceptionCheck()) {
+            if (!mEnv->ExceptionCheck()) {
+                jniThrowException(mEnv, "java/io/IOException", "Failed to write pixel data");
             }
-        } else {
-            ALOGV("%s: Using stream per-pixel write for strip.", __FUNCTION__);
-            jniThrowException(mEnv, "java/lang/IllegalStateException",
-                    "Per-pixel strides are not supported for RAW16 -- pixels must be contiguous");
             return BAD_VALUE;
-
-            // TODO: Add support for non-contiguous pixels if needed.
         }
     }
     return OK;
@@ -696,7 +714,7 @@ protected:
     uint32_t mHeight;
     uint32_t mPixStride;
     uint32_t mRowStride;
-    uint16_t mOffset;
+    uint64_t mOffset;
     JNIEnv* mEnv;
     uint32_t mBytesPerSample;
     uint32_t mSamplesPerPixel;
@@ -721,40 +739,26 @@ status_t DirectStripSource::writeToStream(Output& stream, uint32_t count) {
         return BAD_VALUE;
     }
 
+    if (!validStrides(mWidth, mPixStride, mRowStride, mBytesPerSample * mSamplesPerPixel)) {
+        ALOGE("%s: Invalid pixel stride %u or row stride %u", __FUNCTION__, mPixStride,
+                mRowStride);
+        jniThrowException(mEnv, "java/lang/IllegalStateException", "Invalid pixel or row stride");
+        return BAD_VALUE;
+    }
 
-    if (mPixStride == mBytesPerSample * mSamplesPerPixel
-            && mRowStride == mWidth * mBytesPerSample * mSamplesPerPixel) {
-        ALOGV("%s: Using direct single-pass write for strip.", __FUNCTION__);
-
-        if (stream.write(mPixelBytes, mOffset, fullSize) != OK || mEnv->ExceptionCheck()) {
-            if (!mEnv->ExceptionCheck()) {
-                jniThrowException(mEnv, "java/io/IOException", "Failed to write pixel data");
-            }
-            return BAD_VALUE;
-        }
-    } else if (mPixStride == mBytesPerSample * mSamplesPerPixel) {
-        ALOGV("%s: Using direct per-row write for strip.", __FUNCTION__);
-
-        for (size_t i = 0; i < mHeight; ++i) {
-            if (stream.write(mPixelBytes, mOffset + i * mRowStride, mPixStride * mWidth) != OK ||
-                        mEnv->ExceptionCheck()) {
-                if (!mEnv->ExceptionCheck()) {
-                    jniThrowException(mEnv, "java/io/IOException", "Failed to write pixel data");
-                }
-                return BAD_VALUE;
-            }
+    // Contiguous pixels are written in a single pass, padded ones are repacked in bands.
+    ALOGV("%s: Using direct write for strip.", __FUNCTION__);
+    auto writeChunk = [&](const uint8_t* chunk, size_t size) {
+        return stream.write(chunk, 0, size) == OK && !mEnv->ExceptionCheck();
+    };
+    if (!write_raw_pixels(mPixelBytes + mOffset, mWidth, mHeight, mPixStride, mRowStride,
+            mBytesPerSample * mSamplesPerPixel, PIXEL_CHUNK_SIZE, writeChunk)) {
+        if (!mEnv->ExceptionCheck()) {
+            jniThrowException(mEnv, "java/io/IOException", "Failed to write pixel data");
         }
-    } else {
-        ALOGV("%s: Using direct per-pixel write for strip.", __FUNCTION__);
-
-        jniThrowException(mEnv, "java/lang/IllegalStateException",
-                "Per-pixel strides are not supported for RAW16 -- pixels must be contiguous");
         return BAD_VALUE;
-
-        // TODO: Add support for non-contiguous pixels if needed.
     }
     return OK;
-
 }
 
 uint32_t DirectStripSource::getIfd() const {
@@ -39,6 +39,7 @@
 #include "android_util_Binder.h"
 #include <nativehelper/JNIHelp.h>
 #include "android_os_Debug.h"
+#include "proc_format.h"
 
 #include <dirent.h>
 #include <fcntl.h>
@@ -59,9 +60,6 @@
 using namespace android;
 
 static const bool kDebugPolicy = false;
-static const bool kDebugProc = false;
-// When reading `proc` files, how many bytes to read at a time
-static const int kReadSize = 4096;
 
 #if GUARD_THREAD_PRIORITY
 Mutex gKeyCreateMutex;
@@ -907,39 +905,19 @@ jintArray android_os_Process_getPids(JNIEnv* env, jobject clazz,
     return lastArray;
 }
 
-enum {
-    PROC_TERM_MASK = 0xff,
-    PROC_ZERO_TERM = 0,
-    PROC_SPACE_TERM = ' ',
-    PROC_COMBINE = 0x100,
-    PROC_PARENS = 0x200,
-    PROC_QUOTES = 0x400,
-    PROC_CHAR = 0x800,
-    PROC_OUT_STRING = 0x1000,
-    PROC_OUT_LONG = 0x2000,
-    PROC_OUT_FLOAT = 0x4000,
-};
-
-jboolean android_os_Process_parseProcLineArray(JNIEnv* env, jobject clazz,
-        char* buffer, jint startIndex, jint endIndex, jintArray format,
+static jboolean android_os_Process_parseProcLineArray(JNIEnv* env, jobject clazz,
+        char* buffer, jint startIndex, jint endIndex, const ProcFormat& format,
         jobjectArray outStrings, jlongArray outLongs, jfloatArray outFloats)
 {
-
-    const jsize NF = env->GetArrayLength(format);
     const jsize NS = outStrings ? env->GetArrayLength(outStrings) : 0;
     const jsize NL = outLongs ? env->GetArrayLength(outLongs) : 0;
     const jsize NR = outFloats ? env->GetArrayLength(outFloats) : 0;
 
-    jint* formatData = env->GetIntArrayElements(format, 0);
     jlong* longsData = outLongs ?
         env->GetLongArrayElements(outLongs, 0) : NULL;
     jfloat* floatsData = outFloats ?
         env->GetFloatArrayElements(outFloats, 0) : NULL;
-    if (formatData == NULL || (NL > 0 && longsData == NULL)
-            || (NR > 0 && floatsData == NULL)) {
-        if (formatData != NULL) {
-            env->ReleaseIntArrayElements(format, formatData, 0);
-        }
+    if ((NL > 0 && longsData == NULL) || (NR > 0 && floatsData == NULL)) {
         if (longsData != NULL) {
             env->ReleaseLongArrayElements(outLongs, longsData, 0);
         }
@@ -950,90 +928,16 @@ jboolean android_os_Process_parseProcLineArray(JNIEnv* env, jobject clazz,
         return JNI_FALSE;
     }
 
-    jsize i = startIndex;
-    jsize di = 0;
-
-    jboolean res = JNI_TRUE;
-
-    for (jsize fi=0; fi<NF; fi++) {
-        jint mode = formatData[fi];
-        if ((mode&PROC_PARENS) != 0) {
-            i++;
-        } else if ((mode&PROC_QUOTES) != 0) {
-            if (buffer[i] == '"') {
-                i++;
-            } else {
-                mode &= ~PROC_QUOTES;
-            }
-        }
-        const char term = (char)(mode&PROC_TERM_MASK);
-        const jsize start = i;
-        if (i >= endIndex) {
-            if (kDebugProc) {
-                ALOGW("Ran off end of data @%d", i);
-            }
-            res = JNI_FALSE;
-            break;
+    auto onString = [&](size_t di, const char* value) {
+        if (di < (size_t)NS) {
+            jstring str = env->NewStringUTF(value);
+            env->SetObjectArrayElement(outStrings, di, str);
         }
+    };
+    static_assert(sizeof(jlong) == sizeof(int64_t), "jlong is not int64_t");
+    const bool res = format.parse(buffer, startIndex, endIndex, (int64_t*)longsData, NL,
+            floatsData, NR, NS > 0 ? std::function<void(size_t, const char*)>(onString) : nullptr);
 
-        jsize end = -1;
-        if ((mode&PROC_PARENS) != 0) {
-            while (i < endIndex && buffer[i] != ')') {
-                i++;
-            }
-            end = i;
-            i++;
-        } else if ((mode&PROC_QUOTES) != 0) {
-            while (buffer[i] != '"' && i < endIndex) {
-                i++;
-            }
-            end = i;
-            i++;
-        }
-        while (i < endIndex && buffer[i] != term) {
-            i++;
-        }
-        if (end < 0) {
-            end = i;
-        }
-
-        if (i < endIndex) {
-            i++;
-            if ((mode&PROC_COMBINE) != 0) {
-                while (i < endIndex && buffer[i] == term) {
-                    i++;
-                }
-            }
-        }
-
-        //ALOGI("Field %" PRId32 ": %" PRId32 "-%" PRId32 " dest=%" PRId32 " mode=0x%" PRIx32 "\n", i, start, end, di, mode);
-
-        if ((mode&(PROC_OUT_FLOAT|PROC_OUT_LONG|PROC_OUT_STRING)) != 0) {
-            char c = buffer[end];
-            buffer[end] = 0;
-            if ((mode&PROC_OUT_FLOAT) != 0 && di < NR) {
-                char* end;
-                floatsData[di] = strtof(buffer+start, &end);
-            }
-            if ((mode&PROC_OUT_LONG) != 0 && di < NL) {
-                if ((mode&PROC_CHAR) != 0) {
-                    // Caller wants single first character returned as one long.
-                    longsData[di] = buffer[start];
-                } else {
-                    char* end;
-                    longsData[di] = strtoll(buffer+start, &end, 10);
-                }
-            }
-            if ((mode&PROC_OUT_STRING) != 0 && di < NS) {
-                jstring str = env->NewStringUTF(buffer+start);
-                env->SetObjectArrayElement(outStrings, di, str);
-            }
-            buffer[end] = c;
-            di++;
-        }
-    }
-
-    env->ReleaseIntArrayElements(format, formatData, 0);
     if (longsData != NULL) {
         env->ReleaseLongArrayElements(outLongs, longsData, 0);
     }
@@ -1041,7 +945,19 @@ jboolean android_os_Process_parseProcLineArray(JNIEnv* env, jobject clazz,
         env->ReleaseFloatArrayElements(outFloats, floatsData, 0);
     }
 
-    return res;
+    return res ? JNI_TRUE : JNI_FALSE;
+}
+
+jboolean android_os_Process_parseProcLineArray(JNIEnv* env, jobject clazz,
+        char* buffer, jint startIndex, jint endIndex, jintArray format,
+        jobjectArray outStrings, jlongArray outLongs, jfloatArray outFloats)
+{
+    const jsize NF = env->GetArrayLength(format);
+    std::vector<jint> formatData(NF);
+    env->GetIntArrayRegion(format, 0, NF, formatData.data());
+
+    return android_os_Process_parseProcLineArray(env, clazz, buffer, startIndex, endIndex,
+            ProcFormat(formatData.data(), NF), outStrings, outLongs, outFloats);
 }
 
 jboolean android_os_Process_parseProcLine(JNIEnv* env, jobject clazz,
@@ -1073,43 +989,13 @@ jboolean android_os_Process_readProcFile(JNIEnv* env, jobject clazz,
         jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
         return JNI_FALSE;
     }
-    int fd = open(file8, O_RDONLY | O_CLOEXEC);
-
-    if (fd < 0) {
-        if (kDebugProc) {
-            ALOGW("Unable to open process file: %s\n", file8);
-        }
-        env->ReleaseStringUTFChars(file, file8);
-        return JNI_FALSE;
-    }
+    std::vector<char> fileBuffer;
+    size_t numBytesRead;
+    const bool read = read_proc_file(file8, &fileBuffer, &numBytesRead);
     env->ReleaseStringUTFChars(file, file8);
-
-    std::vector<char> fileBuffer(kReadSize);
-    int numBytesRead = 0;
-    while (true) {
-        // Resize buffer to make space for contents. This might be more than we need, but once we've
-        // read we resize back down
-        fileBuffer.resize(numBytesRead + kReadSize, 0);
-        // Read in contents
-        int len = TEMP_FAILURE_RETRY(read(fd, fileBuffer.data() + numBytesRead, kReadSize));
-        numBytesRead += len;
-        if (len < 0) {
-            // If `len` is negative, an error occurred on read
-            if (kDebugProc) {
-                ALOGW("Unable to open process file: %s fd=%d\n", file8, fd);
-            }
-            close(fd);
-            return JNI_FALSE;
-        } else if (len == 0) {
-            // If nothing read, we're done
-            break;
-        }
+    if (!read) {
+        return JNI_FALSE;
     }
-    // Resize back down to the amount we read
-    fileBuffer.resize(numBytesRead);
-    // Terminate buffer with null byte
-    fileBuffer.push_back('\0');
-    close(fd);
 
     return android_os_Process_parseProcLineArray(env, clazz, fileBuffer.data(), 0, numBytesRead,
             format, outStrings, outLongs, outFloats);
@@ -450,39 +450,92 @@ void FileDescriptorInfo::DetachSocket(fail_fn_t fail_fn) const {
 // static
 FileDescriptorTable* FileDescriptorTable::Create(const std::vector<int>& fds_to_ignore,
                                                  fail_fn_t fail_fn) {
-  DIR* proc_fd_dir = opendir(kFdPath);
-  if (proc_fd_dir == nullptr) {
-    fail_fn(std::string("Unable to open directory ").append(kFdPath));
+  FileDescriptorTable* table = new FileDescriptorTable();
+  ListOpenFds(fds_to_ignore, fail_fn, &table->open_fds_);
+  table->open_fd_table_.reserve(table->open_fds_.size());
+  for (const int fd : table->open_fds_) {
+    table->open_fd_table_.push_back(FileDescriptorInfo::CreateFromFd(fd, fail_fn));
   }
 
-  int dir_fd = dirfd(proc_fd_dir);
-  dirent* dir_entry;
+  return table;
+}
 
-  std::unordered_map<int, FileDescriptorInfo*> open_fd_map;
-  while ((dir_entry = readdir(proc_fd_dir)) != nullptr) {
-    const int fd = ParseFd(dir_entry, dir_fd);
-    if (fd == -1) {
-      continue;
+FileDescriptorTable::~FileDescriptorTable() {
+  for (FileDescriptorInfo* info : open_fd_table_) {
+    delete info;
+  }
+}
+
+void FileDescriptorTable::Restat(const std::vector<int>& fds_to_ignore, fail_fn_t fail_fn) {
+  ListOpenFds(fds_to_ignore, fail_fn, &open_fds_);
+  RestatInternal(open_fds_, fail_fn);
+}
+
+// Reopens all file descriptors that are contained in the table.
+void FileDescriptorTable::ReopenOrDetach(fail_fn_t fail_fn) {
+  for (const FileDescriptorInfo* info : open_fd_table_) {
+    info->ReopenOrDetach(fail_fn);
+  }
+}
+
+FileDescriptorTable::FileDescriptorTable() {
+}
+
+void FileDescriptorTable::RestatInternal(const std::vector<int>& open_fds, fail_fn_t fail_fn) {
+  // Walk the list of file descriptors we've already recorded along with the
+  // list of open file descriptors. Both are sorted, so each recorded
+  // descriptor is either still open, at the same position in both lists,
+  // or it comes first and is no longer open.
+  restat_table_.clear();
+  restat_table_.reserve(open_fds.size());
+  std::vector<FileDescriptorInfo*>::const_iterator it = open_fd_table_.begin();
+  for (const int fd : open_fds) {
+    while (it != open_fd_table_.end() && (*it)->fd < fd) {
+      // The entry from the file descriptor table is no longer in the list
+      // of open files. We remove it from the list of FDs under consideration.
+      //
+      // TODO(narayan): This will be an error in a future android release.
+      // error = true;
+      // ALOGW("Zygote closed file descriptor %d.", (*it)->fd);
+      delete *it;
+      ++it;
     }
 
-    if (std::find(fds_to_ignore.begin(), fds_to_ignore.end(), fd) != fds_to_ignore.end()) {
+    if (it == open_fd_table_.end() || (*it)->fd != fd) {
+      // The zygote has opened a new file descriptor since our last inspection.
+      // We add it to our table.
+      //
+      // TODO(narayan): This will be an error in a future android release.
+      // error = true;
+      // ALOGW("Zygote opened new file descriptor %d.", fd);
+      restat_table_.push_back(FileDescriptorInfo::CreateFromFd(fd, fail_fn));
       continue;
     }
 
-    open_fd_map[fd] = FileDescriptorInfo::CreateFromFd(fd, fail_fn);
+    // The entry from the file descriptor table is still open. Restat it and
+    // check whether it refers to the same file.
+    FileDescriptorInfo* info = *it++;
+    if (!info->RefersToSameFile()) {
+      // The file descriptor refers to a different description. We must
+      // update our entry in the table.
+      delete info;
+      info = FileDescriptorInfo::CreateFromFd(fd, fail_fn);
+    }
+    restat_table_.push_back(info);
   }
 
-  if (closedir(proc_fd_dir) == -1) {
-    fail_fn("Unable to close directory");
+  for (; it != open_fd_table_.end(); ++it) {
+    delete *it;
   }
 
-  return new FileDescriptorTable(open_fd_map);
+  open_fd_table_.swap(restat_table_);
 }
 
-void FileDescriptorTable::Restat(const std::vector<int>& fds_to_ignore, fail_fn_t fail_fn) {
-  std::set<int> open_fds;
+// static
+void FileDescriptorTable::ListOpenFds(const std::vector<int>& fds_to_ignore, fail_fn_t fail_fn,
+                                      std::vector<int>* open_fds) {
+  open_fds->clear();
 
-  // First get the list of open descriptors.
   DIR* proc_fd_dir = opendir(kFdPath);
   if (proc_fd_dir == nullptr) {
     fail_fn(android::base::StringPrintf("Unable to open directory %s: %s",
@@ -502,90 +555,15 @@ void FileDescriptorTable::Restat(const std::vector<int>& fds_to_ignore, fail_fn_
       continue;
     }
 
-    open_fds.insert(fd);
+    open_fds->push_back(fd);
   }
 
   if (closedir(proc_fd_dir) == -1) {
     fail_fn(android::base::StringPrintf("Unable to close directory: %s", strerror(errno)));
   }
 
-  RestatInternal(open_fds, fail_fn);
-}
-
-// Reopens all file descriptors that are contained in the table.
-void FileDescriptorTable::ReopenOrDetach(fail_fn_t fail_fn) {
-  std::unordered_map<int, FileDescriptorInfo*>::const_iterator it;
-  for (it = open_fd_map_.begin(); it != open_fd_map_.end(); ++it) {
-    const FileDescriptorInfo* info = it->second;
-    if (info == nullptr) {
-      return;
-    } else {
-      info->ReopenOrDetach(fail_fn);
-    }
-  }
-}
-
-FileDescriptorTable::FileDescriptorTable(
-    const std::unordered_map<int, FileDescriptorInfo*>& map)
-    : open_fd_map_(map) {
-}
-
-void FileDescriptorTable::RestatInternal(std::set<int>& open_fds, fail_fn_t fail_fn) {
-  // Iterate through the list of file descriptors we've already recorded
-  // and check whether :
-  //
-  // (a) they continue to be open.
-  // (b) they refer to the same file.
-  //
-  // We'll only store the last error message.
-  std::unordered_map<int, FileDescriptorInfo*>::iterator it = open_fd_map_.begin();
-  while (it != open_fd_map_.end()) {
-    std::set<int>::const_iterator element = open_fds.find(it->first);
-    if (element == open_fds.end()) {
-      // The entry from the file descriptor table is no longer in the list
-      // of open files. We warn about this condition and remove it from
-      // the list of FDs under consideration.
-      //
-      // TODO(narayan): This will be an error in a future android release.
-      // error = true;
-      // ALOGW("Zygote closed file descriptor %d.", it->first);
-      it = open_fd_map_.erase(it);
-    } else {
-      // The entry from the file descriptor table is still open. Restat
-      // it and check whether it refers to the same file.
-      if (!it->second->RefersToSameFile()) {
-        // The file descriptor refers to a different description. We must
-        // update our entry in the table.
-        delete it->second;
-        it->second = FileDescriptorInfo::CreateFromFd(*element, fail_fn);
-      } else {
-        // It's the same file. Nothing to do here. Move on to the next open
-        // FD.
-      }
-
-      ++it;
-
-      // Finally, remove the FD from the set of open_fds. We do this last because
-      // |element| will not remain valid after a call to erase.
-      open_fds.erase(element);
-    }
-  }
-
-  if (open_fds.size() > 0) {
-    // The zygote has opened new file descriptors since our last inspection.
-    // We warn about this condition and add them to our table.
-    //
-    // TODO(narayan): This will be an error in a future android release.
-    // error = true;
-    // ALOGW("Zygote opened %zd new file descriptor(s).", open_fds.size());
-
-    // TODO(narayan): This code will be removed in a future android release.
-    std::set<int>::const_iterator it;
-    for (it = open_fds.begin(); it != open_fds.end(); ++it) {
-      const int fd = (*it);
-      open_fd_map_[fd] = FileDescriptorInfo::CreateFromFd(fd, fail_fn);
-    }
-  }
+  // /proc lists the descriptors in increasing order, so this is cheap.
+  std::sort(open_fds->begin(), open_fds->end());
 }
 
 // static
@@ -17,9 +17,8 @@
 #ifndef FRAMEWORKS_BASE_CORE_JNI_FD_UTILS_H_
 #define FRAMEWORKS_BASE_CORE_JNI_FD_UTILS_H_
 
-#include <set>
+#include <functional>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 #include <dirent.h>
@@ -81,6 +80,11 @@ class FileDescriptorTable {
   static FileDescriptorTable* Create(const std::vector<int>& fds_to_ignore,
                                      fail_fn_t fail_fn);
 
+  ~FileDescriptorTable();
+
+  // Brings the table up to date with the open file descriptors. Only the
+  // descriptors that were opened, or that refer to another file than at the
+  // previous call, are looked at again in full.
   void Restat(const std::vector<int>& fds_to_ignore, fail_fn_t fail_fn);
 
   // Reopens all file descriptors that are contained in the table. Returns true
@@ -89,14 +93,23 @@ class FileDescriptorTable {
   void ReopenOrDetach(fail_fn_t fail_fn);
 
  private:
-  explicit FileDescriptorTable(const std::unordered_map<int, FileDescriptorInfo*>& map);
+  FileDescriptorTable();
+
+  void RestatInternal(const std::vector<int>& open_fds, fail_fn_t fail_fn);
 
-  void RestatInternal(std::set<int>& open_fds, fail_fn_t fail_fn);
+  // Lists the open file descriptors, in increasing order, into |open_fds|.
+  static void ListOpenFds(const std::vector<int>& fds_to_ignore, fail_fn_t fail_fn,
+                          std::vector<int>* open_fds);
 
   static int ParseFd(dirent* e, int dir_fd);
 
-  // Invariant: All values in this unordered_map are non-NULL.
-  std::unordered_map<int, FileDescriptorInfo*> open_fd_map_;
+  // Sorted by FD, so that it can be walked along with the sorted list of open
+  // FDs. Invariant: All values in this vector are non-NULL.
+  std::vector<FileDescriptorInfo*> open_fd_table_;
+
+  // Kept between calls to Restat so that it doesn't allocate on every fork.
+  std::vector<int> open_fds_;
+  std::vector<FileDescriptorInfo*> restat_table_;
 
   DISALLOW_COPY_AND_ASSIGN(FileDescriptorTable);
 };
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PARALLEL_UTILS_H_
+#define PARALLEL_UTILS_H_
+
+#include <stddef.h>
+
+#include <functional>
+
+namespace android {
+
+// Calls fn for each index in [0, count), on at most max_threads threads counting the calling one.
+// Each thread takes the next index that no thread has taken yet, so the indices are not handled
+// in order.  Returns once fn has returned for every index.
+void for_each_in_parallel(size_t count, size_t max_threads,
+        const std::function<void(size_t)>& fn);
+
+}  // namespace android
+
+#endif  // PARALLEL_UTILS_H_
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Process"
+
+#include "proc_format.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <android-base/stringprintf.h>
+#include <utils/Log.h>
+
+namespace android {
+
+static const bool kDebugProc = false;
+
+static const size_t kReadSize = 4096;
+
+ProcFormat::ProcFormat(const int32_t* format, size_t count) : mOutputCount(0) {
+    mFields.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        const bool hasOutput = (format[i]&(PROC_OUT_FLOAT|PROC_OUT_LONG|PROC_OUT_STRING)) != 0;
+        mFields.push_back({ format[i], (char)(format[i]&PROC_TERM_MASK), hasOutput });
+        if (hasOutput) {
+            mOutputCount++;
+        }
+    }
+}
+
+bool ProcFormat::parse(char* buffer, size_t startIndex, size_t endIndex, int64_t* longs,
+        size_t longCount, float* floats, size_t floatCount,
+        const std::function<void(size_t, const char*)>& onString) const
+{
+    size_t i = startIndex;
+    size_t di = 0;
+
+    for (const Field& field : mFields) {
+        int32_t mode = field.mode;
+        if ((mode&PROC_PARENS) != 0) {
+            i++;
+        } else if ((mode&PROC_QUOTES) != 0) {
+            if (buffer[i] == '"') {
+                i++;
+            } else {
+                mode &= ~PROC_QUOTES;
+            }
+        }
+        const char term = field.term;
+        const size_t start = i;
+        if (i >= endIndex) {
+            if (kDebugProc) {
+                ALOGW("Ran off end of data @%zu", i);
+            }
+            return false;
+        }
+
+        ssize_t end = -1;
+        if ((mode&PROC_PARENS) != 0) {
+            while (i < endIndex && buffer[i] != ')') {
+                i++;
+            }
+            end = i;
+            i++;
+        } else if ((mode&PROC_QUOTES) != 0) {
+            while (buffer[i] != '"' && i < endIndex) {
+                i++;
+            }
+            end = i;
+            i++;
+        }
+        while (i < endIndex && buffer[i] != term) {
+            i++;
+        }
+        if (end < 0) {
+            end = i;
+        }
+
+        if (i < endIndex) {
+            i++;
+            if ((mode&PROC_COMBINE) != 0) {
+                while (i < endIndex && buffer[i] == term) {
+                    i++;
+                }
+            }
+        }
+
+        if (field.hasOutput) {
+            char c = buffer[end];
+            buffer[end] = 0;
+            if ((mode&PROC_OUT_FLOAT) != 0 && di < floatCount) {
+                char* end;
+                floats[di] = strtof(buffer+start, &end);
+            }
+            if ((mode&PROC_OUT_LONG) != 0 && di < longCount) {
+                if ((mode&PROC_CHAR) != 0) {
+                    // Caller wants single first character returned as one long.
+                    longs[di] = buffer[start];
+                } else {
+                    char* end;
+                    longs[di] = strtoll(buffer+start, &end, 10);
+                }
+            }
+            if ((mode&PROC_OUT_STRING) != 0 && onString) {
+                onString(di, buffer+start);
+            }
+            buffer[end] = c;
+            di++;
+        }
+    }
+
+    return true;
+}
+
+bool read_proc_file(const char* path, std::vector<char>* buffer, size_t* size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (kDebugProc) {
+            ALOGW("Unable to open process file: %s\n", path);
+        }
+        return false;
+    }
+
+    size_t numBytesRead = 0;
+    while (true) {
+        // Make space for another read.  This might be more than we need, but the buffer is
+        // kept for the next file anyway.
+        if (buffer->size() < numBytesRead + kReadSize + 1) {
+            buffer->resize(numBytesRead + kReadSize + 1);
+        }
+        ssize_t len = TEMP_FAILURE_RETRY(read(fd, buffer->data() + numBytesRead, kReadSize));
+        if (len < 0) {
+            if (kDebugProc) {
+                ALOGW("Unable to read process file: %s fd=%d\n", path, fd);
+            }
+            close(fd);
+            return false;
+        } else if (len == 0) {
+            break;
+        }
+        numBytesRead += len;
+    }
+    close(fd);
+
+    (*buffer)[numBytesRead] = '\0';
+    *size = numBytesRead;
+    return true;
+}
+
+void read_proc_files(const ProcFormat& format, const char* dir, const char* name,
+        const int32_t* ids, size_t count, uint8_t* results, int64_t* longs, float* floats)
+{
+    const size_t stride = format.getOutputCount();
+    std::vector<char> buffer;
+    std::string path;
+    for (size_t i = 0; i < count; i++) {
+        path = android::base::StringPrintf("%s/%d/%s", dir, ids[i], name);
+        size_t size;
+        results[i] = read_proc_file(path.c_str(), &buffer, &size)
+                && format.parse(buffer.data(), 0, size,
+                        longs != NULL ? &longs[i * stride] : NULL, longs != NULL ? stride : 0,
+                        floats != NULL ? &floats[i * stride] : NULL, floats != NULL ? stride : 0,
+                        nullptr);
+    }
+}
+
+}  // namespace android
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROC_FORMAT_H_
+#define PROC_FORMAT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+namespace android {
+
+// The flags of the format of each field, as in Process.PROC_*.
+enum {
+    PROC_TERM_MASK = 0xff,
+    PROC_ZERO_TERM = 0,
+    PROC_SPACE_TERM = ' ',
+    PROC_COMBINE = 0x100,
+    PROC_PARENS = 0x200,
+    PROC_QUOTES = 0x400,
+    PROC_CHAR = 0x800,
+    PROC_OUT_STRING = 0x1000,
+    PROC_OUT_LONG = 0x2000,
+    PROC_OUT_FLOAT = 0x4000,
+};
+
+/*
+ * The format of a line of a /proc file, as given to Process.readProcFile, checked once so that
+ * it can parse any number of files.
+ */
+class ProcFormat {
+public:
+    ProcFormat(const int32_t* format, size_t count);
+
+    // How many fields have an output, which is the stride of the outputs of a batch.
+    size_t getOutputCount() const { return mOutputCount; }
+
+    /*
+     * Parses buffer[start, end) into the outputs.  The value of the n-th field with an output
+     * goes to longs[n] and floats[n] if there are that many, and to onString if it is set.
+     * buffer must have a byte at end, and is put back as it was.  Returns false if the data runs
+     * out before the fields do.
+     */
+    bool parse(char* buffer, size_t start, size_t end, int64_t* longs, size_t longCount,
+            float* floats, size_t floatCount,
+            const std::function<void(size_t, const char*)>& onString) const;
+
+private:
+    struct Field {
+        int32_t mode;
+        char term;
+        bool hasOutput;
+    };
+
+    std::vector<Field> mFields;
+    size_t mOutputCount;
+};
+
+/*
+ * Reads the whole file at path into buffer, followed by a zero byte that is not counted in
+ * *size.  buffer is reused, so that reading many files doesn't allocate for each of them.
+ */
+bool read_proc_file(const char* path, std::vector<char>* buffer, size_t* size);
+
+/*
+ * Reads and parses dir/<id>/name for each of the count ids, such as /proc/<pid>/stat.  The
+ * outputs of the i-th file start at longs[i * format.getOutputCount()] and at the same index of
+ * floats, either of which may be null.  results[i] is whether the file could be read and parsed.
+ */
+void read_proc_files(const ProcFormat& format, const char* dir, const char* name,
+        const int32_t* ids, size_t count, uint8_t* results, int64_t* longs, float* floats);
+
+}  // namespace android
+
+#endif  // PROC_FORMAT_H_
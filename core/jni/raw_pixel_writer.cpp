@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "raw_pixel_writer.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+
+void repack_raw_rows(const uint8_t* pixels, uint32_t width, uint32_t pixelStride,
+        uint32_t rowStride, uint32_t bytesPerPixel, uint32_t firstRow, uint32_t numRows,
+        uint8_t* out)
+{
+    const size_t packedRowSize = static_cast<size_t>(width) * bytesPerPixel;
+    for (uint32_t row = 0; row < numRows; row++) {
+        const uint8_t* src = pixels + static_cast<size_t>(firstRow + row) * rowStride;
+        uint8_t* dst = out + row * packedRowSize;
+        if (pixelStride == bytesPerPixel) {
+            // The rows may overlap when repacking in place.
+            memmove(dst, src, packedRowSize);
+            continue;
+        }
+        // Each pixel moves towards the start of the image, so copying forwards never
+        // overwrites a pixel that is still to be copied.
+        for (uint32_t x = 0; x < width; x++) {
+            for (uint32_t b = 0; b < bytesPerPixel; b++) {
+                dst[b] = src[b];
+            }
+            dst += bytesPerPixel;
+            src += pixelStride;
+        }
+    }
+}
+
+bool write_raw_pixels(const uint8_t* pixels, uint32_t width, uint32_t height,
+        uint32_t pixelStride, uint32_t rowStride, uint32_t bytesPerPixel, size_t chunkSize,
+        const std::function<bool(const uint8_t*, size_t)>& write)
+{
+    const size_t packedRowSize = static_cast<size_t>(width) * bytesPerPixel;
+    if (pixelStride == bytesPerPixel && rowStride == packedRowSize) {
+        return write(pixels, packedRowSize * height);
+    }
+    if (height == 0 || packedRowSize == 0) {
+        return true;
+    }
+
+    const uint32_t rowsPerBand = std::max<size_t>(1, chunkSize / packedRowSize);
+    const uint32_t numBands = (height + rowsPerBand - 1) / rowsPerBand;
+    auto bandRows = [&](uint32_t band) {
+        return std::min(rowsPerBand, height - band * rowsPerBand);
+    };
+
+    std::vector<uint8_t> bands[2];
+    bands[0].resize(rowsPerBand * packedRowSize);
+    bands[1].resize(std::min(numBands - 1, 1u) * rowsPerBand * packedRowSize);
+    auto repack = [&](uint32_t band) {
+        repack_raw_rows(pixels, width, pixelStride, rowStride, bytesPerPixel,
+                band * rowsPerBand, bandRows(band), bands[band % 2].data());
+    };
+    auto writeBand = [&](uint32_t band) {
+        return write(bands[band % 2].data(), bandRows(band) * packedRowSize);
+    };
+
+    repack(0);
+    if (numBands == 1) {
+        return writeBand(0);
+    }
+
+    // One worker thread repacks the bands after the first, each into the buffer of the band two
+    // before it, as soon as that band is written.
+    std::mutex lock;
+    std::condition_variable changed;
+    uint32_t numRepacked = 1;
+    uint32_t numWritten = 0;
+    bool stopped = false;
+    std::thread worker([&]() {
+        std::unique_lock<std::mutex> guard(lock);
+        for (uint32_t band = 1; band < numBands; band++) {
+            changed.wait(guard, [&]() { return stopped || numWritten + 1 >= band; });
+            if (stopped) {
+                return;
+            }
+            guard.unlock();
+            repack(band);
+            guard.lock();
+            numRepacked = band + 1;
+            changed.notify_all();
+        }
+    });
+
+    bool written = true;
+    for (uint32_t band = 0; band < numBands && written; band++) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]() { return numRepacked > band; });
+        }
+        written = writeBand(band);
+        std::lock_guard<std::mutex> guard(lock);
+        numWritten = band + 1;
+        changed.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopped = true;
+        changed.notify_all();
+    }
+    worker.join();
+    return written;
+}
+
+}  // namespace android
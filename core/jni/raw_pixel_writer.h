@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RAW_PIXEL_WRITER_H_
+#define RAW_PIXEL_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+
+namespace android {
+
+// Copies numRows rows of an image whose pixels and rows may be padded, starting at firstRow, to
+// out with the padding removed.  out may be the first row itself, to repack rows in place.
+void repack_raw_rows(const uint8_t* pixels, uint32_t width, uint32_t pixelStride,
+        uint32_t rowStride, uint32_t bytesPerPixel, uint32_t firstRow, uint32_t numRows,
+        uint8_t* out);
+
+// Writes height rows of an image whose pixels and rows may be padded through write, as
+// contiguous pixels.  A padded image is repacked in bands of about chunkSize bytes, so that write
+// is called on this thread with large chunks rather than once per row.  One worker thread
+// repacks each band while the one before it is written.  Returns false as soon as write does.
+bool write_raw_pixels(const uint8_t* pixels, uint32_t width, uint32_t height,
+        uint32_t pixelStride, uint32_t rowStride, uint32_t bytesPerPixel, size_t chunkSize,
+        const std::function<bool(const uint8_t*, size_t)>& write);
+
+}  // namespace android
+
+#endif  // RAW_PIXEL_WRITER_H_
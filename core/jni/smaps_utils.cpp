@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "smaps_utils.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include <meminfo/procmeminfo.h>
+
+namespace android {
+
+namespace {
+
+// A mapping whose name starts with prefix belongs to which_heap and sub_heap, and the longest
+// matching prefix wins.  Some prefixes take precedence over the suffixes that classify_vma_name
+// checks, such as ".so"; the others only apply to names without one of those suffixes.
+struct vma_name_rule {
+    const char* prefix;
+    int which_heap;
+    int sub_heap;
+    bool before_suffixes;
+};
+
+const vma_name_rule kVmaNameRules[] = {
+    { "[heap]", HEAP_NATIVE, HEAP_UNKNOWN, true },
+    { "[anon:libc_malloc]", HEAP_NATIVE, HEAP_UNKNOWN, true },
+    { "[stack", HEAP_STACK, HEAP_UNKNOWN, true },
+    { "/dev/", HEAP_UNKNOWN_DEV, HEAP_UNKNOWN, false },
+    { "/dev/kgsl-3d0", HEAP_GL_DEV, HEAP_UNKNOWN, false },
+    { "/dev/ashmem/CursorWindow", HEAP_CURSOR, HEAP_UNKNOWN, false },
+    { "/dev/ashmem", HEAP_ASHMEM, HEAP_UNKNOWN, false },
+    { "[anon:", HEAP_UNKNOWN, HEAP_UNKNOWN, false },
+    // Default to accounting.
+    { "[anon:dalvik-", HEAP_DALVIK_OTHER, HEAP_DALVIK_OTHER_ACCOUNTING, false },
+    { "[anon:dalvik-LinearAlloc", HEAP_DALVIK_OTHER, HEAP_DALVIK_OTHER_LINEARALLOC, false },
+    // This is the regular Dalvik heap.
+    { "[anon:dalvik-alloc space", HEAP_DALVIK, HEAP_DALVIK_NORMAL, false },
+    { "[anon:dalvik-main space", HEAP_DALVIK, HEAP_DALVIK_NORMAL, false },
+    { "[anon:dalvik-large object space", HEAP_DALVIK, HEAP_DALVIK_LARGE, false },
+    { "[anon:dalvik-free list large object space", HEAP_DALVIK, HEAP_DALVIK_LARGE, false },
+    { "[anon:dalvik-non moving space", HEAP_DALVIK, HEAP_DALVIK_NON_MOVING, false },
+    { "[anon:dalvik-zygote space", HEAP_DALVIK, HEAP_DALVIK_ZYGOTE, false },
+    { "[anon:dalvik-indirect ref", HEAP_DALVIK_OTHER,
+            HEAP_DALVIK_OTHER_INDIRECT_REFERENCE_TABLE, false },
+    { "[anon:dalvik-jit-code-cache", HEAP_DALVIK_OTHER, HEAP_DALVIK_OTHER_CODE_CACHE, false },
+    { "[anon:dalvik-data-code-cache", HEAP_DALVIK_OTHER, HEAP_DALVIK_OTHER_CODE_CACHE, false },
+    { "[anon:dalvik-CompilerMetadata", HEAP_DALVIK_OTHER,
+            HEAP_DALVIK_OTHER_COMPILER_METADATA, false },
+};
+
+// The prefixes of kVmaNameRules as a trie, so that a name is matched against all of them in one
+// pass over its first characters.  The children of a node are a linked list, since most nodes
+// have one.
+class vma_name_trie {
+public:
+    vma_name_trie() : mNodes(1) {
+        for (size_t i = 0; i < sizeof(kVmaNameRules) / sizeof(kVmaNameRules[0]); i++) {
+            size_t node = 0;
+            for (const char* c = kVmaNameRules[i].prefix; *c != '\0'; c++) {
+                node = getOrAddChild(node, *c);
+            }
+            mNodes[node].rule = i;
+        }
+    }
+
+    // Returns the rules with the longest prefixes of name, among the rules that apply before the
+    // suffixes and among the others, or nullptr.
+    void match(std::string_view name, const vma_name_rule** before_suffixes,
+            const vma_name_rule** after_suffixes) const {
+        *before_suffixes = nullptr;
+        *after_suffixes = nullptr;
+        size_t node = 0;
+        for (char c : name) {
+            node = findChild(node, c);
+            if (node == kNone) {
+                break;
+            }
+            if (mNodes[node].rule != kNone) {
+                const vma_name_rule* rule = &kVmaNameRules[mNodes[node].rule];
+                if (rule->before_suffixes) {
+                    *before_suffixes = rule;
+                } else {
+                    *after_suffixes = rule;
+                }
+            }
+        }
+    }
+
+private:
+    static constexpr size_t kNone = SIZE_MAX;
+
+    struct node {
+        char c = '\0';
+        size_t firstChild = kNone;
+        size_t nextSibling = kNone;
+        size_t rule = kNone;
+    };
+
+    size_t findChild(size_t parent, char c) const {
+        size_t child = mNodes[parent].firstChild;
+        while (child != kNone && mNodes[child].c != c) {
+            child = mNodes[child].nextSibling;
+        }
+        return child;
+    }
+
+    size_t getOrAddChild(size_t parent, char c) {
+        size_t child = findChild(parent, c);
+        if (child == kNone) {
+            child = mNodes.size();
+            mNodes.emplace_back();
+            mNodes[child].c = c;
+            mNodes[child].nextSibling = mNodes[parent].firstChild;
+            mNodes[parent].firstChild = child;
+        }
+        return child;
+    }
+
+    std::vector<node> mNodes;
+};
+
+bool ends_with(std::string_view s, std::string_view suffix)
+{
+    return s.size() >= suffix.size() && s.substr(s.size() - suffix.size()) == suffix;
+}
+
+bool contains(std::string_view s, std::string_view part)
+{
+    return s.find(part) != std::string_view::npos;
+}
+
+}  // namespace
+
+vma_class classify_vma_name(std::string_view name)
+{
+    static const vma_name_trie* trie = new vma_name_trie();
+
+    const vma_name_rule* before_suffixes;
+    const vma_name_rule* after_suffixes;
+    trie->match(name, &before_suffixes, &after_suffixes);
+    if (before_suffixes != nullptr) {
+        return { before_suffixes->which_heap, before_suffixes->sub_heap, false };
+    }
+
+    if (ends_with(name, ".so")) {
+        return { HEAP_SO, HEAP_UNKNOWN, true };
+    } else if (ends_with(name, ".jar")) {
+        return { HEAP_JAR, HEAP_UNKNOWN, true };
+    } else if (ends_with(name, ".apk")) {
+        return { HEAP_APK, HEAP_UNKNOWN, true };
+    } else if (ends_with(name, ".ttf")) {
+        return { HEAP_TTF, HEAP_UNKNOWN, true };
+    } else if (ends_with(name, ".odex") || (name.size() > 4 && contains(name, ".dex"))) {
+        return { HEAP_DEX, HEAP_DEX_APP_DEX, true };
+    } else if (ends_with(name, ".vdex")) {
+        // Handle system@framework@boot and system/framework/boot
+        if (contains(name, "@boot") || contains(name, "/boot")) {
+            return { HEAP_DEX, HEAP_DEX_BOOT_VDEX, true };
+        }
+        return { HEAP_DEX, HEAP_DEX_APP_VDEX, true };
+    } else if (ends_with(name, ".oat")) {
+        return { HEAP_OAT, HEAP_UNKNOWN, true };
+    } else if (ends_with(name, ".art") || ends_with(name, ".art]")) {
+        // Handle system@framework@boot* and system/framework/boot*
+        if (contains(name, "@boot") || contains(name, "/boot")) {
+            return { HEAP_ART, HEAP_ART_BOOT, true };
+        }
+        return { HEAP_ART, HEAP_ART_APP, true };
+    }
+
+    if (after_suffixes != nullptr) {
+        return { after_suffixes->which_heap, after_suffixes->sub_heap, false };
+    } else if (!name.empty()) {
+        return { HEAP_UNKNOWN_MAP, HEAP_UNKNOWN, false };
+    }
+    return { HEAP_UNKNOWN, HEAP_UNKNOWN, false };
+}
+
+void load_maps(const std::string& smaps_path, stats_t* stats, bool* foundSwapPss)
+{
+    *foundSwapPss = false;
+    uint64_t prev_end = 0;
+    int prev_heap = HEAP_UNKNOWN;
+
+    auto vma_scan = [&](const meminfo::Vma& vma) {
+        std::string_view name = vma.name;
+        if (ends_with(name, " (deleted)")) {
+            name.remove_suffix(strlen(" (deleted)"));
+        }
+
+        const vma_class classification = classify_vma_name(name);
+        int which_heap = classification.which_heap;
+        const int sub_heap = classification.sub_heap;
+        const bool is_swappable = classification.is_swappable;
+        if (name.empty() && vma.start == prev_end && prev_heap == HEAP_SO) {
+            // bss section of a shared library
+            which_heap = HEAP_SO;
+        }
+
+        prev_end = vma.end;
+        prev_heap = which_heap;
+
+        const meminfo::MemUsage& usage = vma.usage;
+        if (usage.swap_pss > 0 && *foundSwapPss != true) {
+            *foundSwapPss = true;
+        }
+
+        uint64_t swapable_pss = 0;
+        if (is_swappable && (usage.pss > 0)) {
+            float sharing_proportion = 0.0;
+            if ((usage.shared_clean > 0) || (usage.shared_dirty > 0)) {
+                sharing_proportion = (usage.pss - usage.uss) / (usage.shared_clean + usage.shared_dirty);
+            }
+            swapable_pss = (sharing_proportion * usage.shared_clean) + usage.private_clean;
+        }
+
+        stats[which_heap].pss += usage.pss;
+        stats[which_heap].swappablePss += swapable_pss;
+        stats[which_heap].rss += usage.rss;
+        stats[which_heap].privateDirty += usage.private_dirty;
+        stats[which_heap].sharedDirty += usage.shared_dirty;
+        stats[which_heap].privateClean += usage.private_clean;
+        stats[which_heap].sharedClean += usage.shared_clean;
+        stats[which_heap].swappedOut += usage.swap;
+        stats[which_heap].swappedOutPss += usage.swap_pss;
+        if (which_heap == HEAP_DALVIK || which_heap == HEAP_DALVIK_OTHER ||
+                which_heap == HEAP_DEX || which_heap == HEAP_ART) {
+            stats[sub_heap].pss += usage.pss;
+            stats[sub_heap].swappablePss += swapable_pss;
+            stats[sub_heap].rss += usage.rss;
+            stats[sub_heap].privateDirty += usage.private_dirty;
+            stats[sub_heap].sharedDirty += usage.shared_dirty;
+            stats[sub_heap].privateClean += usage.private_clean;
+            stats[sub_heap].sharedClean += usage.shared_clean;
+            stats[sub_heap].swappedOut += usage.swap;
+            stats[sub_heap].swappedOutPss += usage.swap_pss;
+        }
+    };
+
+    meminfo::ForEachVmaFromFile(smaps_path, vma_scan);
+}
+
+}  // namespace android
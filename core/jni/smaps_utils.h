@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SMAPS_UTILS_H_
+#define SMAPS_UTILS_H_
+
+#include <string>
+#include <string_view>
+
+namespace android {
+
+// The heaps that the memory of a process is broken down into, as in Debug.MemoryInfo.
+enum {
+    HEAP_UNKNOWN,
+    HEAP_DALVIK,
+    HEAP_NATIVE,
+
+    HEAP_DALVIK_OTHER,
+    HEAP_STACK,
+    HEAP_CURSOR,
+    HEAP_ASHMEM,
+    HEAP_GL_DEV,
+    HEAP_UNKNOWN_DEV,
+    HEAP_SO,
+    HEAP_JAR,
+    HEAP_APK,
+    HEAP_TTF,
+    HEAP_DEX,
+    HEAP_OAT,
+    HEAP_ART,
+    HEAP_UNKNOWN_MAP,
+    HEAP_GRAPHICS,
+    HEAP_GL,
+    HEAP_OTHER_MEMTRACK,
+
+    // Dalvik extra sections (heap).
+    HEAP_DALVIK_NORMAL,
+    HEAP_DALVIK_LARGE,
+    HEAP_DALVIK_ZYGOTE,
+    HEAP_DALVIK_NON_MOVING,
+
+    // Dalvik other extra sections.
+    HEAP_DALVIK_OTHER_LINEARALLOC,
+    HEAP_DALVIK_OTHER_ACCOUNTING,
+    HEAP_DALVIK_OTHER_CODE_CACHE,
+    HEAP_DALVIK_OTHER_COMPILER_METADATA,
+    HEAP_DALVIK_OTHER_INDIRECT_REFERENCE_TABLE,
+
+    // Boot vdex / app dex / app vdex
+    HEAP_DEX_BOOT_VDEX,
+    HEAP_DEX_APP_DEX,
+    HEAP_DEX_APP_VDEX,
+
+    // App art, boot art.
+    HEAP_ART_APP,
+    HEAP_ART_BOOT,
+
+    _NUM_HEAP,
+    _NUM_EXCLUSIVE_HEAP = HEAP_OTHER_MEMTRACK+1,
+    _NUM_CORE_HEAP = HEAP_NATIVE+1
+};
+
+
+struct stats_t {
+    int pss;
+    int swappablePss;
+    int rss;
+    int privateDirty;
+    int sharedDirty;
+    int privateClean;
+    int sharedClean;
+    int swappedOut;
+    int swappedOutPss;
+};
+
+struct vma_class {
+    int which_heap;
+    int sub_heap;
+    bool is_swappable;
+};
+
+// Works out which heap a mapping belongs to from its name, without " (deleted)".  Mappings
+// without a name are HEAP_UNKNOWN, though they can be the bss of the mapping before them; that is
+// left to the caller.
+vma_class classify_vma_name(std::string_view name);
+
+// Adds the memory of each mapping in the smaps file at smaps_path to the heap it belongs to.
+// stats must have _NUM_HEAP entries.
+void load_maps(const std::string& smaps_path, stats_t* stats, bool* foundSwapPss);
+
+}  // namespace android
+
+#endif  // SMAPS_UTILS_H_
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "YuvToJpegEncoder.h"
+
+#include <hardware/hardware.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+// A 12 MP camera frame.
+const int kWidth = 4000;
+const int kHeight = 3000;
+const int kQuality = 95;
+
+// A frame with some detail in it, so that encoding it takes about as long as a photo.
+std::vector<uint8_t> makeFrame(size_t size) {
+    std::vector<uint8_t> frame(size);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        frame[i] = (i % 251) + (seed >> 28);
+    }
+    return frame;
+}
+
+void encodeFrame(benchmark::State& state, int format, int maxThreads) {
+    const bool nv21 = format == HAL_PIXEL_FORMAT_YCrCb_420_SP;
+    std::vector<uint8_t> frame = makeFrame(nv21 ? kWidth * kHeight * 3 / 2 : kWidth * kHeight * 2);
+    int strides[] = { nv21 ? kWidth : kWidth * 2, kWidth };
+    int offsets[] = { 0, kWidth * kHeight };
+    std::unique_ptr<YuvToJpegEncoder> encoder(YuvToJpegEncoder::create(format, strides));
+    for (auto _ : state) {
+        SkDynamicMemoryWStream stream;
+        encoder->encode(&stream, frame.data(), kWidth, kHeight, offsets, kQuality, maxThreads);
+        benchmark::DoNotOptimize(stream.bytesWritten());
+    }
+    state.SetItemsProcessed(state.iterations() * kWidth * kHeight);
+}
+
+}  // namespace
+
+static void BM_EncodeNv21(benchmark::State& state) {
+    encodeFrame(state, HAL_PIXEL_FORMAT_YCrCb_420_SP, 1);
+}
+BENCHMARK(BM_EncodeNv21)->Unit(benchmark::kMillisecond);
+
+// In strips on every core, as YuvImage.compressToJpeg does when debug.yuvimage.jpeg_strips is
+// set.
+static void BM_EncodeNv21Strips(benchmark::State& state) {
+    encodeFrame(state, HAL_PIXEL_FORMAT_YCrCb_420_SP, std::thread::hardware_concurrency());
+}
+BENCHMARK(BM_EncodeNv21Strips)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_EncodeYuy2(benchmark::State& state) {
+    encodeFrame(state, HAL_PIXEL_FORMAT_YCbCr_422_I, 1);
+}
+BENCHMARK(BM_EncodeYuy2)->Unit(benchmark::kMillisecond);
+
+static void BM_EncodeYuy2Strips(benchmark::State& state) {
+    encodeFrame(state, HAL_PIXEL_FORMAT_YCbCr_422_I, std::thread::hardware_concurrency());
+}
+BENCHMARK(BM_EncodeYuy2Strips)->Unit(benchmark::kMillisecond)->UseRealTime();
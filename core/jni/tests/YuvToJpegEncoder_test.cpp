@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "YuvToJpegEncoder.h"
+
+#include <hardware/hardware.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+const int kQuality = 90;
+
+// Gives the tests the two ways of encoding a picture that encode() picks from.
+template <typename Encoder>
+class TestEncoder : public Encoder {
+public:
+    explicit TestEncoder(int* strides) : Encoder(strides) {}
+
+    using YuvToJpegEncoder::encodeRows;
+    using YuvToJpegEncoder::encodeStrips;
+};
+
+struct Picture {
+    int format;
+    int width;
+    int height;
+    std::vector<uint8_t> yuv;
+    int strides[2];
+    int offsets[2];
+
+    Picture(int format, int width, int height) : format(format), width(width), height(height) {
+        const bool nv21 = format == HAL_PIXEL_FORMAT_YCrCb_420_SP;
+        yuv.resize(nv21 ? width * height * 3 / 2 : width * height * 2);
+        uint32_t seed = 1;
+        for (size_t i = 0; i < yuv.size(); i++) {
+            seed = seed * 1103515245 + 12345;
+            yuv[i] = (i % 251) + (seed >> 28);
+        }
+        strides[0] = nv21 ? width : width * 2;
+        strides[1] = width;
+        offsets[0] = 0;
+        offsets[1] = width * height;
+    }
+
+    // The picture from one compressor with the given restart interval, or from encodeStrips.
+    std::string encode(int restartInterval, int numThreads) {
+        SkDynamicMemoryWStream stream;
+        bool encoded;
+        if (format == HAL_PIXEL_FORMAT_YCrCb_420_SP) {
+            encoded = encode(TestEncoder<Yuv420SpToJpegEncoder>(strides), &stream,
+                    restartInterval, numThreads);
+        } else {
+            encoded = encode(TestEncoder<Yuv422IToJpegEncoder>(strides), &stream,
+                    restartInterval, numThreads);
+        }
+        EXPECT_TRUE(encoded);
+        sk_sp<SkData> data = stream.detachAsData();
+        return std::string((const char*) data->data(), data->size());
+    }
+
+    template <typename Encoder>
+    bool encode(Encoder&& encoder, SkWStream* stream, int restartInterval, int numThreads) {
+        int encodeOffsets[2] = { offsets[0], offsets[1] };
+        if (numThreads > 0) {
+            return encoder.encodeStrips(stream, yuv.data(), width, height, encodeOffsets,
+                    kQuality, numThreads);
+        }
+        return encoder.encodeRows(stream, yuv.data(), width, height, encodeOffsets, kQuality,
+                restartInterval);
+    }
+};
+
+// The restart interval of the strips of encodeStrips: as many whole MCU rows as it takes to
+// split the picture into numThreads strips.
+int stripRestartInterval(int width, int height, int numThreads) {
+    const int mcusPerRow = (width + 15) / 16;
+    const int mcuRows = (height + 15) / 16;
+    return std::min((mcuRows + numThreads - 1) / numThreads, std::max(1, 65535 / mcusPerRow))
+            * mcusPerRow;
+}
+
+void expectStripsMatchOneCompressor(int format, int width, int height) {
+    Picture picture(format, width, height);
+    for (int numThreads : { 2, 3, 8 }) {
+        SCOPED_TRACE(numThreads);
+        const std::string strips = picture.encode(0, numThreads);
+        ASSERT_FALSE(strips.empty());
+        EXPECT_EQ(picture.encode(stripRestartInterval(width, height, numThreads), 0), strips);
+    }
+}
+
+}  // namespace
+
+TEST(YuvToJpegEncoderTest, Nv21StripsMatchOneCompressor) {
+    // MCU aligned.
+    expectStripsMatchOneCompressor(HAL_PIXEL_FORMAT_YCrCb_420_SP, 640, 480);
+    // Heights that are not MCU aligned, one with fewer MCU rows than some of the thread counts.
+    expectStripsMatchOneCompressor(HAL_PIXEL_FORMAT_YCrCb_420_SP, 640, 490);
+    expectStripsMatchOneCompressor(HAL_PIXEL_FORMAT_YCrCb_420_SP, 320, 34);
+}
+
+TEST(YuvToJpegEncoderTest, Yuy2StripsMatchOneCompressor) {
+    expectStripsMatchOneCompressor(HAL_PIXEL_FORMAT_YCbCr_422_I, 640, 480);
+    expectStripsMatchOneCompressor(HAL_PIXEL_FORMAT_YCbCr_422_I, 640, 490);
+    expectStripsMatchOneCompressor(HAL_PIXEL_FORMAT_YCbCr_422_I, 320, 34);
+}
+
+TEST(YuvToJpegEncoderTest, EncodesSmallPicturesSerially) {
+    Picture picture(HAL_PIXEL_FORMAT_YCrCb_420_SP, 640, 480);
+    int strides[2] = { picture.strides[0], picture.strides[1] };
+    int offsets[2] = { picture.offsets[0], picture.offsets[1] };
+    Yuv420SpToJpegEncoder encoder(strides);
+    SkDynamicMemoryWStream stream;
+    ASSERT_TRUE(encoder.encode(&stream, picture.yuv.data(), picture.width, picture.height,
+            offsets, kQuality, 8));
+    sk_sp<SkData> data = stream.detachAsData();
+    // Below a megapixel per strip, the picture has no restart markers.
+    EXPECT_EQ(picture.encode(0, 0), std::string((const char*) data->data(), data->size()));
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fd_utils.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+
+using android::base::StringPrintf;
+
+namespace {
+
+// About as many files as the zygote has open when it forks an app.
+const int kNumFds = 200;
+
+// How many of them are replaced by other files between two forks.
+const int kNumChangedFds = 5;
+
+void Fail(std::string message) {
+    LOG(FATAL) << message;
+    abort();
+}
+
+}  // namespace
+
+// A zygote with kNumFds whitelisted files open.  They are opened before each run and closed after
+// it, so that the other benchmarks don't find them in the fd table.
+class FakeZygote : public benchmark::Fixture {
+public:
+    void SetUp(const benchmark::State&) override {
+        // The benchmark itself may have other files open.
+        fds_to_ignore_.clear();
+        DIR* proc_fd_dir = opendir("/proc/self/fd");
+        dirent* entry;
+        while ((entry = readdir(proc_fd_dir)) != nullptr) {
+            char* end;
+            const int fd = strtol(entry->d_name, &end, 10);
+            if (*end == '\0') {
+                fds_to_ignore_.push_back(fd);
+            }
+        }
+        closedir(proc_fd_dir);
+
+        for (int i = 0; i < kNumFds + kNumChangedFds; i++) {
+            const std::string path = Path(i);
+            if (!FileDescriptorWhitelist::Get()->IsAllowed(path)) {
+                FileDescriptorWhitelist::Get()->Allow(path);
+            }
+            const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+            (i < kNumFds ? fds_ : other_fds_).push_back(fd);
+        }
+    }
+
+    void TearDown(const benchmark::State&) override {
+        for (int fd : fds_) {
+            close(fd);
+        }
+        for (int fd : other_fds_) {
+            close(fd);
+        }
+        fds_.clear();
+        other_fds_.clear();
+    }
+
+protected:
+    std::string Path(int i) const {
+        return StringPrintf("%s/framework%d.jar", dir_.path, i);
+    }
+
+    TemporaryDir dir_;
+    std::vector<int> fds_to_ignore_;
+    std::vector<int> fds_;
+    std::vector<int> other_fds_;
+};
+
+// Collecting every open file from scratch, as on the first fork.
+BENCHMARK_DEFINE_F(FakeZygote, CreateFdTable)(benchmark::State& state) {
+    for (auto _ : state) {
+        std::unique_ptr<FileDescriptorTable> table(
+                FileDescriptorTable::Create(fds_to_ignore_, Fail));
+        benchmark::DoNotOptimize(table.get());
+    }
+    state.SetItemsProcessed(state.iterations() * kNumFds);
+}
+BENCHMARK_REGISTER_F(FakeZygote, CreateFdTable)->Unit(benchmark::kMicrosecond);
+
+// Checking the table again when nothing changed since the previous fork.
+BENCHMARK_DEFINE_F(FakeZygote, RestatFdTable)(benchmark::State& state) {
+    std::unique_ptr<FileDescriptorTable> table(FileDescriptorTable::Create(fds_to_ignore_, Fail));
+    for (auto _ : state) {
+        table->Restat(fds_to_ignore_, Fail);
+    }
+    state.SetItemsProcessed(state.iterations() * kNumFds);
+}
+BENCHMARK_REGISTER_F(FakeZygote, RestatFdTable)->Unit(benchmark::kMicrosecond);
+
+// Checking the table again when a few files were replaced since the previous fork.
+BENCHMARK_DEFINE_F(FakeZygote, RestatFdTableChanged)(benchmark::State& state) {
+    std::unique_ptr<FileDescriptorTable> table(FileDescriptorTable::Create(fds_to_ignore_, Fail));
+    bool swapped = false;
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (int i = 0; i < kNumChangedFds; i++) {
+            const int fd = fds_[i * kNumFds / kNumChangedFds];
+            const std::string path = Path(swapped ? i * kNumFds / kNumChangedFds : kNumFds + i);
+            const int new_fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+            dup3(new_fd, fd, O_CLOEXEC);
+            close(new_fd);
+        }
+        swapped = !swapped;
+        state.ResumeTiming();
+
+        table->Restat(fds_to_ignore_, Fail);
+    }
+    state.SetItemsProcessed(state.iterations() * kNumFds);
+}
+BENCHMARK_REGISTER_F(FakeZygote, RestatFdTableChanged)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "parallel_utils.h"
+
+#include <atomic>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace android;
+
+TEST(ParallelUtilsTest, CallsEachIndexOnce) {
+    for (size_t max_threads : { 0, 1, 3, 64 }) {
+        SCOPED_TRACE(max_threads);
+        std::vector<std::atomic<int>> calls(20);
+        for_each_in_parallel(calls.size(), max_threads, [&](size_t i) {
+            calls[i]++;
+        });
+        for (const std::atomic<int>& count : calls) {
+            EXPECT_EQ(1, count);
+        }
+    }
+}
+
+TEST(ParallelUtilsTest, CallsNothingWithoutIndices) {
+    bool called = false;
+    for_each_in_parallel(0, 4, [&](size_t) {
+        called = true;
+    });
+    EXPECT_FALSE(called);
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "proc_format.h"
+
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+
+using namespace android;
+using android::base::StringPrintf;
+using android::base::WriteStringToFile;
+
+namespace {
+
+const int kNumProcesses = 500;
+
+// The format ProcessCpuTracker reads /proc/<pid>/stat with.
+const int32_t kProcessStatsFormat[] = {
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM|PROC_PARENS,
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM|PROC_OUT_LONG,                  // 10: minor faults
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM|PROC_OUT_LONG,                  // 12: major faults
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM|PROC_OUT_LONG,                  // 14: utime
+    PROC_SPACE_TERM|PROC_OUT_LONG,                  // 15: stime
+};
+const size_t kProcessStatsFormatCount =
+        sizeof(kProcessStatsFormat) / sizeof(kProcessStatsFormat[0]);
+
+// The stat file of a process, with different numbers for each pid.
+std::string statLine(int pid) {
+    return StringPrintf("%d (com.example.app%d) S 1 %d 0 0 -1 1077952832 %d 0 %d 0 %d %d 0 0 20 0 "
+            "24 0 %d 2186354688 23123 18446744073709551615 1 1 0 0 0 0 4612 1 1073775864 0 0 0 "
+            "17 3 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+            pid, pid, pid, pid * 31, pid * 7, pid * 101, pid * 53, pid * 1000);
+}
+
+}  // namespace
+
+// A fake /proc with a stat file for each of kNumProcesses processes.
+class FakeProcBench : public benchmark::Fixture {
+public:
+    virtual void SetUp(const benchmark::State&) override {
+        statPaths.clear();
+        for (int pid = 1; pid <= kNumProcesses; pid++) {
+            const std::string pidDir = StringPrintf("%s/%d", dir.path, pid);
+            mkdir(pidDir.c_str(), 0700);
+            statPaths.push_back(pidDir + "/stat");
+            WriteStringToFile(statLine(pid), statPaths.back());
+        }
+    }
+
+protected:
+    TemporaryDir dir;
+    std::vector<std::string> statPaths;
+};
+
+// Reading every stat file the way Process.readProcFile does, with the format checked again and
+// a new buffer for each file.
+BENCHMARK_DEFINE_F(FakeProcBench, ReadProcFileEach)(benchmark::State& state) {
+    std::vector<int64_t> longs(kProcessStatsFormatCount);
+    for (auto _ : state) {
+        for (const std::string& path : statPaths) {
+            std::vector<char> buffer;
+            size_t size;
+            if (read_proc_file(path.c_str(), &buffer, &size)) {
+                ProcFormat format(kProcessStatsFormat, kProcessStatsFormatCount);
+                format.parse(buffer.data(), 0, size, longs.data(), longs.size(), nullptr, 0,
+                        nullptr);
+            }
+        }
+        benchmark::DoNotOptimize(longs.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kNumProcesses);
+}
+BENCHMARK_REGISTER_F(FakeProcBench, ReadProcFileEach)->Unit(benchmark::kMicrosecond);
+
+// Reading every stat file the way Process.readProcFiles does, with a compiled format and one
+// buffer.
+BENCHMARK_DEFINE_F(FakeProcBench, ReadProcFilesBatch)(benchmark::State& state) {
+    const ProcFormat format(kProcessStatsFormat, kProcessStatsFormatCount);
+    std::vector<int32_t> ids;
+    for (int pid = 1; pid <= kNumProcesses; pid++) {
+        ids.push_back(pid);
+    }
+    std::vector<uint8_t> results(kNumProcesses);
+    std::vector<int64_t> longs(kNumProcesses * format.getOutputCount());
+    for (auto _ : state) {
+        read_proc_files(format, dir.path, "stat", ids.data(), ids.size(), results.data(),
+                longs.data(), nullptr);
+        benchmark::DoNotOptimize(longs.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kNumProcesses);
+}
+BENCHMARK_REGISTER_F(FakeProcBench, ReadProcFilesBatch)->Unit(benchmark::kMicrosecond);
+
+// Parsing from memory with a compiled format.
+static void BM_ParseProcStat(benchmark::State& state) {
+    const ProcFormat format(kProcessStatsFormat, kProcessStatsFormatCount);
+    std::string line = statLine(1);
+    std::vector<int64_t> longs(format.getOutputCount());
+    for (auto _ : state) {
+        format.parse(&line[0], 0, line.size(), longs.data(), longs.size(), nullptr, 0, nullptr);
+        benchmark::DoNotOptimize(longs.data());
+    }
+}
+BENCHMARK(BM_ParseProcStat);
+
+// Parsing from memory, with the format checked again for each line as parseProcLine did.
+static void BM_ParseProcStatCompileEach(benchmark::State& state) {
+    std::string line = statLine(1);
+    std::vector<int64_t> longs(kProcessStatsFormatCount);
+    for (auto _ : state) {
+        ProcFormat format(kProcessStatsFormat, kProcessStatsFormatCount);
+        format.parse(&line[0], 0, line.size(), longs.data(), longs.size(), nullptr, 0, nullptr);
+        benchmark::DoNotOptimize(longs.data());
+    }
+}
+BENCHMARK(BM_ParseProcStatCompileEach);
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "proc_format.h"
+
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <gtest/gtest.h>
+
+using namespace android;
+using android::base::StringPrintf;
+using android::base::WriteStringToFile;
+
+namespace {
+
+const char kStatLine[] = "1234 (com.example.app) S 1 1234 0 0 -1 1077952832 31 0 7 0 101 53 0 0 "
+        "20 0 24 0 1000 2186354688 23123\n";
+
+// The format ProcessCpuTracker reads /proc/<pid>/stat with.
+const int32_t kProcessStatsFormat[] = {
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM|PROC_PARENS,
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM|PROC_OUT_LONG,                  // 10: minor faults
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM|PROC_OUT_LONG,                  // 12: major faults
+    PROC_SPACE_TERM,
+    PROC_SPACE_TERM|PROC_OUT_LONG,                  // 14: utime
+    PROC_SPACE_TERM|PROC_OUT_LONG,                  // 15: stime
+};
+const size_t kProcessStatsFormatCount =
+        sizeof(kProcessStatsFormat) / sizeof(kProcessStatsFormat[0]);
+
+struct parsed_line {
+    bool result;
+    std::vector<int64_t> longs;
+    std::vector<float> floats;
+    std::vector<std::string> strings;
+};
+
+// Parses line with format, with an output of each kind for every field with an output.
+parsed_line parse(const std::vector<int32_t>& format, std::string line) {
+    const ProcFormat procFormat(format.data(), format.size());
+    const size_t count = procFormat.getOutputCount();
+    parsed_line parsed { false, std::vector<int64_t>(count, -1), std::vector<float>(count, -1),
+            std::vector<std::string>(count) };
+    const std::string original = line;
+    parsed.result = procFormat.parse(&line[0], 0, line.size(), parsed.longs.data(), count,
+            parsed.floats.data(), count, [&](size_t i, const char* value) {
+                parsed.strings[i] = value;
+            });
+    EXPECT_EQ(original, line);
+    return parsed;
+}
+
+}  // namespace
+
+TEST(ProcFormatTest, ParsesProcessStats) {
+    const ProcFormat format(kProcessStatsFormat, kProcessStatsFormatCount);
+    ASSERT_EQ(4u, format.getOutputCount());
+
+    std::string line = kStatLine;
+    std::vector<int64_t> longs(4);
+    ASSERT_TRUE(format.parse(&line[0], 0, line.size(), longs.data(), longs.size(), nullptr, 0,
+            nullptr));
+    EXPECT_EQ((std::vector<int64_t>{ 31, 7, 101, 53 }), longs);
+    EXPECT_EQ(kStatLine, line);
+}
+
+TEST(ProcFormatTest, ParsesParens) {
+    const parsed_line parsed = parse({
+        PROC_SPACE_TERM|PROC_OUT_LONG,
+        PROC_SPACE_TERM|PROC_PARENS|PROC_OUT_STRING,
+        PROC_SPACE_TERM|PROC_OUT_STRING,
+    }, "1234 (Binder: 1234_2) S 1\n");
+    ASSERT_TRUE(parsed.result);
+    EXPECT_EQ(1234, parsed.longs[0]);
+    EXPECT_EQ("Binder: 1234_2", parsed.strings[1]);
+    EXPECT_EQ("S", parsed.strings[2]);
+}
+
+TEST(ProcFormatTest, ParsesQuotes) {
+    const std::vector<int32_t> format = {
+        PROC_SPACE_TERM|PROC_QUOTES|PROC_OUT_STRING,
+        PROC_SPACE_TERM|PROC_QUOTES|PROC_OUT_STRING,
+    };
+    parsed_line parsed = parse(format, "\"two words\" next\n");
+    ASSERT_TRUE(parsed.result);
+    EXPECT_EQ("two words", parsed.strings[0]);
+    EXPECT_EQ("next\n", parsed.strings[1]);
+
+    // Without an opening quote, the field ends at the terminator.
+    parsed = parse(format, "two words\n");
+    ASSERT_TRUE(parsed.result);
+    EXPECT_EQ("two", parsed.strings[0]);
+    EXPECT_EQ("words\n", parsed.strings[1]);
+}
+
+TEST(ProcFormatTest, CombinesTerminators) {
+    parsed_line parsed = parse({
+        PROC_SPACE_TERM|PROC_COMBINE|PROC_OUT_LONG,
+        PROC_SPACE_TERM|PROC_COMBINE|PROC_OUT_LONG,
+        PROC_SPACE_TERM|PROC_COMBINE|PROC_OUT_LONG,
+    }, "1   22  333");
+    ASSERT_TRUE(parsed.result);
+    EXPECT_EQ((std::vector<int64_t>{ 1, 22, 333 }), parsed.longs);
+
+    // Each space ends a field otherwise.
+    parsed = parse({
+        PROC_SPACE_TERM|PROC_OUT_LONG,
+        PROC_SPACE_TERM|PROC_OUT_LONG,
+        PROC_SPACE_TERM|PROC_OUT_LONG,
+    }, "1  22");
+    ASSERT_TRUE(parsed.result);
+    EXPECT_EQ((std::vector<int64_t>{ 1, 0, 22 }), parsed.longs);
+}
+
+TEST(ProcFormatTest, ReturnsCharAsLong) {
+    const parsed_line parsed = parse({
+        PROC_SPACE_TERM,
+        PROC_SPACE_TERM|PROC_PARENS,
+        PROC_SPACE_TERM|PROC_CHAR|PROC_OUT_LONG,
+    }, kStatLine);
+    ASSERT_TRUE(parsed.result);
+    EXPECT_EQ('S', parsed.longs[0]);
+}
+
+TEST(ProcFormatTest, ParsesFloats) {
+    const parsed_line parsed = parse({
+        PROC_SPACE_TERM|PROC_OUT_FLOAT,
+        PROC_SPACE_TERM|PROC_OUT_FLOAT,
+        PROC_SPACE_TERM|PROC_OUT_FLOAT,
+    }, "0.50 1.25 2.00 1/123 4567\n");
+    ASSERT_TRUE(parsed.result);
+    EXPECT_EQ((std::vector<float>{ 0.5f, 1.25f, 2.0f }), parsed.floats);
+}
+
+TEST(ProcFormatTest, FailsWhenLineRunsOut) {
+    const parsed_line parsed = parse({
+        PROC_SPACE_TERM|PROC_OUT_LONG,
+        PROC_SPACE_TERM|PROC_OUT_LONG,
+        PROC_SPACE_TERM|PROC_OUT_LONG,
+    }, "1 2");
+    EXPECT_FALSE(parsed.result);
+    // The fields before the end are still parsed.
+    EXPECT_EQ((std::vector<int64_t>{ 1, 2, -1 }), parsed.longs);
+}
+
+TEST(ProcFormatTest, StopsAtEndIndex) {
+    const int32_t format[] = {
+        PROC_SPACE_TERM|PROC_OUT_LONG,
+        PROC_SPACE_TERM|PROC_OUT_LONG,
+    };
+    const ProcFormat procFormat(format, 2);
+    std::string line = "12 345 678";
+    int64_t longs[2] = { -1, -1 };
+
+    // The first field ends at the end index, and there is nothing left for the second.
+    EXPECT_FALSE(procFormat.parse(&line[0], 3, 5, longs, 2, nullptr, 0, nullptr));
+    EXPECT_EQ(34, longs[0]);
+    EXPECT_EQ(-1, longs[1]);
+    // The second field ends at the end index rather than at the next space.
+    ASSERT_TRUE(procFormat.parse(&line[0], 3, 8, longs, 2, nullptr, 0, nullptr));
+    EXPECT_EQ(345, longs[0]);
+    EXPECT_EQ(6, longs[1]);
+    EXPECT_EQ("12 345 678", line);
+}
+
+TEST(ProcFormatTest, SkipsOutputsPastArrays) {
+    const int32_t format[] = {
+        PROC_SPACE_TERM|PROC_OUT_LONG,
+        PROC_SPACE_TERM|PROC_OUT_LONG,
+        PROC_SPACE_TERM|PROC_OUT_LONG,
+    };
+    const ProcFormat procFormat(format, 3);
+    std::string line = "1 2 3";
+    int64_t longs[3] = { -1, -1, -1 };
+    ASSERT_TRUE(procFormat.parse(&line[0], 0, line.size(), longs, 2, nullptr, 0, nullptr));
+    EXPECT_EQ(1, longs[0]);
+    EXPECT_EQ(2, longs[1]);
+    EXPECT_EQ(-1, longs[2]);
+}
+
+class ReadProcFilesTest : public ::testing::Test {
+protected:
+    void writeStat(int pid, const std::string& contents) {
+        const std::string pidDir = StringPrintf("%s/%d", dir.path, pid);
+        mkdir(pidDir.c_str(), 0700);
+        ASSERT_TRUE(WriteStringToFile(contents, pidDir + "/stat"));
+    }
+
+    TemporaryDir dir;
+};
+
+TEST_F(ReadProcFilesTest, LaysOutFilesByOutputCount) {
+    writeStat(10, "10 (first) S 1 10 0 0 -1 0 11 0 12 0 13 14 0\n");
+    writeStat(20, "20 (second process) R 1 20 0 0 -1 0 21 0 22 0 23 24 0\n");
+    // Too short for the format.
+    writeStat(30, "30 (short) S 1\n");
+    writeStat(40, "40 (last) S 1 40 0 0 -1 0 41 0 42 0 43 44 0\n");
+
+    const ProcFormat format(kProcessStatsFormat, kProcessStatsFormatCount);
+    const size_t stride = format.getOutputCount();
+    // 50 doesn't exist.
+    const int32_t ids[] = { 10, 20, 30, 50, 40 };
+    const size_t count = sizeof(ids) / sizeof(ids[0]);
+    std::vector<uint8_t> results(count);
+    std::vector<int64_t> longs(count * stride, -1);
+    std::vector<float> floats(count * stride, -1);
+    read_proc_files(format, dir.path, "stat", ids, count, results.data(), longs.data(),
+            floats.data());
+
+    EXPECT_EQ((std::vector<uint8_t>{ 1, 1, 0, 0, 1 }), results);
+    EXPECT_EQ((std::vector<int64_t>{ 11, 12, 13, 14 }),
+            std::vector<int64_t>(longs.begin(), longs.begin() + stride));
+    EXPECT_EQ((std::vector<int64_t>{ 21, 22, 23, 24 }),
+            std::vector<int64_t>(longs.begin() + stride, longs.begin() + 2 * stride));
+    EXPECT_EQ((std::vector<int64_t>{ -1, -1, -1, -1 }),
+            std::vector<int64_t>(longs.begin() + 3 * stride, longs.begin() + 4 * stride));
+    EXPECT_EQ((std::vector<int64_t>{ 41, 42, 43, 44 }),
+            std::vector<int64_t>(longs.begin() + 4 * stride, longs.end()));
+    // Fields that are only PROC_OUT_LONG leave the floats alone.
+    EXPECT_EQ(std::vector<float>(count * stride, -1), floats);
+}
+
+TEST_F(ReadProcFilesTest, ReadsWithoutOutputs) {
+    writeStat(10, kStatLine);
+
+    const ProcFormat format(kProcessStatsFormat, kProcessStatsFormatCount);
+    const int32_t ids[] = { 10, 11 };
+    uint8_t results[2] = { 0, 1 };
+    read_proc_files(format, dir.path, "stat", ids, 2, results, nullptr, nullptr);
+    EXPECT_EQ(1, results[0]);
+    EXPECT_EQ(0, results[1]);
+}
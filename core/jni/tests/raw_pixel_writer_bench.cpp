@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "raw_pixel_writer.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+
+using namespace android;
+
+namespace {
+
+// A RAW16 frame of a 50 MP sensor, with padded rows as camera HALs often hand them out.
+const uint32_t kWidth = 8192;
+const uint32_t kHeight = 6144;
+const uint32_t kBytesPerPixel = 2;
+const uint32_t kRowStride = kWidth * kBytesPerPixel + 64;
+const size_t kChunkSize = 4 * 1024 * 1024;
+
+// A frame with a different byte at each offset, padding included.
+std::vector<uint8_t> makeFrame() {
+    std::vector<uint8_t> frame(kRowStride * kHeight);
+    for (size_t i = 0; i < frame.size(); i++) {
+        frame[i] = i * 7;
+    }
+    return frame;
+}
+
+// Stands in for the Java OutputStream that DngCreator writes to: the data is copied into a byte
+// array of arrayLength bytes at a time, and each array is written to a file.
+class StreamSink {
+public:
+    explicit StreamSink(size_t arrayLength) : mArray(arrayLength) {}
+
+    // Start over at the beginning of the file, so that every image overwrites the last one.
+    void rewind() { lseek(mFile.fd, 0, SEEK_SET); }
+
+    bool write(const uint8_t* buf, size_t count) {
+        while (count > 0) {
+            const size_t len = std::min(count, mArray.size());
+            memcpy(mArray.data(), buf, len);
+            if (::write(mFile.fd, mArray.data(), len) != static_cast<ssize_t>(len)) {
+                return false;
+            }
+            buf += len;
+            count -= len;
+        }
+        return true;
+    }
+
+private:
+    TemporaryFile mFile;
+    std::vector<uint8_t> mArray;
+};
+
+}  // namespace
+
+// One write per row through 4 KiB arrays, as DngCreator wrote padded frames before.
+static void BM_WriteRawRows(benchmark::State& state) {
+    const std::vector<uint8_t> frame = makeFrame();
+    StreamSink sink(4096);
+    for (auto _ : state) {
+        sink.rewind();
+        for (uint32_t row = 0; row < kHeight; row++) {
+            sink.write(frame.data() + row * kRowStride, kWidth * kBytesPerPixel);
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * kWidth * kHeight * kBytesPerPixel);
+}
+BENCHMARK(BM_WriteRawRows)->Unit(benchmark::kMillisecond);
+
+// Repacked bands written through 64 KiB arrays, as DngCreator writes padded frames now.
+static void BM_WriteRawPixels(benchmark::State& state) {
+    const std::vector<uint8_t> frame = makeFrame();
+    StreamSink sink(64 * 1024);
+    auto write = [&](const uint8_t* buf, size_t count) { return sink.write(buf, count); };
+    for (auto _ : state) {
+        sink.rewind();
+        write_raw_pixels(frame.data(), kWidth, kHeight, kBytesPerPixel, kRowStride,
+                kBytesPerPixel, kChunkSize, write);
+    }
+    state.SetBytesProcessed(state.iterations() * kWidth * kHeight * kBytesPerPixel);
+}
+BENCHMARK(BM_WriteRawPixels)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Repacking alone, in place, as for frames read from a stream.
+static void BM_RepackRawRowsInPlace(benchmark::State& state) {
+    const std::vector<uint8_t> frame = makeFrame();
+    const uint32_t rowsPerBand = kChunkSize / kRowStride;
+    std::vector<uint8_t> band(rowsPerBand * kRowStride);
+    for (auto _ : state) {
+        state.PauseTiming();
+        memcpy(band.data(), frame.data(), band.size());
+        state.ResumeTiming();
+        repack_raw_rows(band.data(), kWidth, kBytesPerPixel, kRowStride, kBytesPerPixel, 0,
+                rowsPerBand, band.data());
+        benchmark::DoNotOptimize(band.data());
+    }
+    state.SetBytesProcessed(state.iterations() * rowsPerBand * kWidth * kBytesPerPixel);
+}
+BENCHMARK(BM_RepackRawRowsInPlace);
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "raw_pixel_writer.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+#include <gtest/gtest.h>
+
+using namespace android;
+using android::base::StringPrintf;
+
+namespace {
+
+struct image_layout {
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerPixel;
+    uint32_t pixelStride;
+    uint32_t rowStride;
+};
+
+// Packed, padded pixels, padded rows, and both, for RAW16 and RGB888 pixels.
+std::vector<image_layout> makeLayouts() {
+    std::vector<image_layout> layouts;
+    for (uint32_t bytesPerPixel : { 2, 3 }) {
+        for (uint32_t width : { 1, 7, 64 }) {
+            for (uint32_t height : { 1, 5, 17 }) {
+                for (uint32_t pixelStride : { bytesPerPixel, bytesPerPixel + 1 }) {
+                    for (uint32_t rowPadding : { 0, 5, 64 }) {
+                        layouts.push_back({ width, height, bytesPerPixel, pixelStride,
+                                width * pixelStride + rowPadding });
+                    }
+                }
+            }
+        }
+    }
+    return layouts;
+}
+
+std::string describe(const image_layout& layout) {
+    return StringPrintf("%ux%u, %u bytes per pixel, pixel stride %u, row stride %u",
+            layout.width, layout.height, layout.bytesPerPixel, layout.pixelStride,
+            layout.rowStride);
+}
+
+// Pixels that differ in every byte, including the padding.
+std::vector<uint8_t> makePixels(const image_layout& layout) {
+    std::vector<uint8_t> pixels(layout.rowStride * layout.height);
+    for (size_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = i * 7 + 3;
+    }
+    return pixels;
+}
+
+// The pixels without padding, one byte at a time.
+std::vector<uint8_t> packPixels(const image_layout& layout, const std::vector<uint8_t>& pixels) {
+    std::vector<uint8_t> packed;
+    for (uint32_t y = 0; y < layout.height; y++) {
+        for (uint32_t x = 0; x < layout.width; x++) {
+            for (uint32_t b = 0; b < layout.bytesPerPixel; b++) {
+                packed.push_back(pixels[y * layout.rowStride + x * layout.pixelStride + b]);
+            }
+        }
+    }
+    return packed;
+}
+
+}  // namespace
+
+TEST(RawPixelWriterTest, RepacksRows) {
+    for (const image_layout& layout : makeLayouts()) {
+        SCOPED_TRACE(describe(layout));
+        const std::vector<uint8_t> pixels = makePixels(layout);
+        const std::vector<uint8_t> expected = packPixels(layout, pixels);
+        const size_t packedRowSize = layout.width * layout.bytesPerPixel;
+
+        std::vector<uint8_t> out(expected.size());
+        repack_raw_rows(pixels.data(), layout.width, layout.pixelStride, layout.rowStride,
+                layout.bytesPerPixel, 0, layout.height, out.data());
+        EXPECT_EQ(expected, out);
+
+        // Every row but the first, in place.
+        std::vector<uint8_t> inPlace = pixels;
+        uint8_t* firstRow = inPlace.data() + layout.rowStride;
+        repack_raw_rows(inPlace.data(), layout.width, layout.pixelStride, layout.rowStride,
+                layout.bytesPerPixel, 1, layout.height - 1, firstRow);
+        EXPECT_EQ(std::vector<uint8_t>(expected.begin() + packedRowSize, expected.end()),
+                std::vector<uint8_t>(firstRow, firstRow + (layout.height - 1) * packedRowSize));
+    }
+}
+
+TEST(RawPixelWriterTest, WritesPackedPixels) {
+    for (const image_layout& layout : makeLayouts()) {
+        const std::vector<uint8_t> pixels = makePixels(layout);
+        const std::vector<uint8_t> expected = packPixels(layout, pixels);
+        const size_t packedRowSize = layout.width * layout.bytesPerPixel;
+        const bool padded = layout.pixelStride != layout.bytesPerPixel
+                || layout.rowStride != packedRowSize;
+
+        // Less than a row, a few rows, and the whole image.
+        for (size_t chunkSize : { size_t(1), 3 * packedRowSize, expected.size() + 1 }) {
+            SCOPED_TRACE(describe(layout) + StringPrintf(", chunk size %zu", chunkSize));
+            std::vector<uint8_t> written;
+            size_t numWrites = 0;
+            ASSERT_TRUE(write_raw_pixels(pixels.data(), layout.width, layout.height,
+                    layout.pixelStride, layout.rowStride, layout.bytesPerPixel, chunkSize,
+                    [&](const uint8_t* buf, size_t count) {
+                        written.insert(written.end(), buf, buf + count);
+                        numWrites++;
+                        return true;
+                    }));
+            EXPECT_EQ(expected, written);
+
+            // A band is a whole number of rows, at least one.
+            const size_t rowsPerBand = std::max<size_t>(1, chunkSize / packedRowSize);
+            EXPECT_EQ(padded ? (layout.height + rowsPerBand - 1) / rowsPerBand : 1, numWrites);
+        }
+    }
+}
+
+TEST(RawPixelWriterTest, StopsWhenWriteFails) {
+    const image_layout layout = { 64, 17, 2, 2, 192 };
+    const std::vector<uint8_t> pixels = makePixels(layout);
+    const std::vector<uint8_t> expected = packPixels(layout, pixels);
+    const size_t packedRowSize = layout.width * layout.bytesPerPixel;
+
+    std::vector<uint8_t> written;
+    size_t numWrites = 0;
+    EXPECT_FALSE(write_raw_pixels(pixels.data(), layout.width, layout.height,
+            layout.pixelStride, layout.rowStride, layout.bytesPerPixel, 2 * packedRowSize,
+            [&](const uint8_t* buf, size_t count) {
+                written.insert(written.end(), buf, buf + count);
+                return ++numWrites < 3;
+            }));
+    EXPECT_EQ(3u, numWrites);
+    EXPECT_EQ(std::vector<uint8_t>(expected.begin(), expected.begin() + 6 * packedRowSize),
+            written);
+}
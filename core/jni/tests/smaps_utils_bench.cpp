@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "parallel_utils.h"
+#include "smaps_utils.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+#include <meminfo/procmeminfo.h>
+
+using namespace android;
+using android::base::StringPrintf;
+using android::base::WriteStringToFile;
+
+namespace {
+
+const size_t kNumProcesses = 64;
+const size_t kNumVmas = 2000;
+
+// Names like those in the smaps of an app process.
+const char* kVmaNames[] = {
+    "",
+    "[heap]",
+    "[anon:libc_malloc]",
+    "[stack]",
+    "[anon:stack_and_tls:1234]",
+    "/system/lib64/libandroid_runtime.so",
+    "/system/lib64/libhwui.so",
+    "/system/framework/framework.jar",
+    "/data/app/com.example-1/base.apk",
+    "/system/fonts/Roboto-Regular.ttf",
+    "/data/app/com.example-1/oat/arm64/base.odex",
+    "/system/framework/arm64/boot-framework.vdex",
+    "/data/app/com.example-1/oat/arm64/base.vdex",
+    "/system/framework/arm64/boot-framework.oat",
+    "[anon:dalvik-/system/framework/boot-framework.art]",
+    "/dev/kgsl-3d0",
+    "/dev/ashmem/CursorWindow: /data/data/com.example/databases/example.db",
+    "/dev/ashmem/dalvik-zygote space (deleted)",
+    "[anon:dalvik-LinearAlloc]",
+    "[anon:dalvik-main space (region space)]",
+    "[anon:dalvik-free list large object space]",
+    "[anon:dalvik-non moving space]",
+    "[anon:dalvik-zygote space]",
+    "[anon:dalvik-indirect ref table]",
+    "[anon:dalvik-jit-code-cache]",
+    "[anon:dalvik-CompilerMetadata]",
+    "[anon:dalvik-card table]",
+    "[anon:scudo:primary]",
+    "/memfd:jit-cache (deleted)",
+};
+const size_t kNumVmaNames = sizeof(kVmaNames) / sizeof(kVmaNames[0]);
+
+std::string vmaEntry(uint64_t start, const char* name, int kb) {
+    return StringPrintf("%" PRIx64 "-%" PRIx64 " rw-p 00000000 00:00 0                          %s\n"
+            "Size:           %8d kB\n"
+            "KernelPageSize:        4 kB\n"
+            "MMUPageSize:           4 kB\n"
+            "Rss:            %8d kB\n"
+            "Pss:            %8d kB\n"
+            "Shared_Clean:          0 kB\n"
+            "Shared_Dirty:          0 kB\n"
+            "Private_Clean:  %8d kB\n"
+            "Private_Dirty:  %8d kB\n"
+            "Referenced:     %8d kB\n"
+            "Anonymous:      %8d kB\n"
+            "LazyFree:              0 kB\n"
+            "AnonHugePages:         0 kB\n"
+            "ShmemPmdMapped:        0 kB\n"
+            "Shared_Hugetlb:        0 kB\n"
+            "Private_Hugetlb:       0 kB\n"
+            "Swap:                  0 kB\n"
+            "SwapPss:               0 kB\n"
+            "Locked:                0 kB\n"
+            "VmFlags: rd wr mr mw me ac \n",
+            start, start + kb * 1024, name, kb, kb, kb, kb / 2, kb / 2, kb, kb);
+}
+
+// Synthetic smaps and smaps_rollup files of count processes, in a directory that is removed with
+// them.  Each benchmark writes its own before timing starts.
+struct SmapsFiles {
+    TemporaryDir dir;
+    std::vector<std::string> smaps;
+    std::vector<std::string> rollups;
+
+    explicit SmapsFiles(size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            std::string contents;
+            for (size_t j = 0; j < kNumVmas; j++) {
+                contents += vmaEntry(0x10000000 + j * 0x100000, kVmaNames[(i + j) % kNumVmaNames],
+                        4 * (j % 64 + 1));
+            }
+            smaps.push_back(StringPrintf("%s/%zu_smaps", dir.path, i));
+            WriteStringToFile(contents, smaps.back());
+            rollups.push_back(StringPrintf("%s/%zu_smaps_rollup", dir.path, i));
+            WriteStringToFile(vmaEntry(0x10000000, "[rollup]", kNumVmas * 128), rollups.back());
+        }
+    }
+};
+
+}  // namespace
+
+static void BM_ClassifyVmaNames(benchmark::State& state) {
+    for (auto _ : state) {
+        for (size_t i = 0; i < kNumVmaNames; i++) {
+            benchmark::DoNotOptimize(classify_vma_name(kVmaNames[i]));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kNumVmaNames);
+}
+BENCHMARK(BM_ClassifyVmaNames);
+
+// The full breakdown of one process, as Debug.getMemoryInfo(pid) reads it.
+static void BM_LoadMaps(benchmark::State& state) {
+    const SmapsFiles files(1);
+    for (auto _ : state) {
+        stats_t stats[_NUM_HEAP];
+        memset(stats, 0, sizeof(stats));
+        bool foundSwapPss;
+        load_maps(files.smaps[0], stats, &foundSwapPss);
+        benchmark::DoNotOptimize(stats);
+    }
+    state.SetItemsProcessed(state.iterations() * kNumVmas);
+}
+BENCHMARK(BM_LoadMaps)->Unit(benchmark::kMicrosecond);
+
+// The full breakdown of many processes, one after another as with Debug.getMemoryInfo(pid).
+static void BM_LoadMapsSequential(benchmark::State& state) {
+    const size_t count = state.range(0);
+    const SmapsFiles files(count);
+    std::vector<stats_t> stats(count * _NUM_HEAP);
+    for (auto _ : state) {
+        memset(stats.data(), 0, stats.size() * sizeof(stats_t));
+        for (size_t i = 0; i < count; i++) {
+            bool foundSwapPss;
+            load_maps(files.smaps[i], &stats[i * _NUM_HEAP], &foundSwapPss);
+        }
+        benchmark::DoNotOptimize(stats.data());
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_LoadMapsSequential)->Arg(8)->Arg(kNumProcesses)->Unit(benchmark::kMillisecond);
+
+// The full breakdown of many processes in parallel, as a batch Debug.getMemoryInfo would read it.
+static void BM_LoadMapsParallel(benchmark::State& state) {
+    const size_t count = state.range(0);
+    const SmapsFiles files(count);
+    std::vector<stats_t> stats(count * _NUM_HEAP);
+    for (auto _ : state) {
+        memset(stats.data(), 0, stats.size() * sizeof(stats_t));
+        for_each_in_parallel(count, std::thread::hardware_concurrency(), [&](size_t i) {
+            bool foundSwapPss;
+            load_maps(files.smaps[i], &stats[i * _NUM_HEAP], &foundSwapPss);
+        });
+        benchmark::DoNotOptimize(stats.data());
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_LoadMapsParallel)
+        ->Arg(8)
+        ->Arg(kNumProcesses)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+// The totals of a process, from smaps and from smaps_rollup.
+static void BM_TotalsFromSmaps(benchmark::State& state) {
+    const SmapsFiles files(1);
+    for (auto _ : state) {
+        meminfo::MemUsage usage;
+        meminfo::SmapsOrRollupFromFile(files.smaps[0], &usage);
+        benchmark::DoNotOptimize(usage);
+    }
+}
+BENCHMARK(BM_TotalsFromSmaps)->Unit(benchmark::kMicrosecond);
+
+static void BM_TotalsFromSmapsRollup(benchmark::State& state) {
+    const SmapsFiles files(1);
+    for (auto _ : state) {
+        meminfo::MemUsage usage;
+        meminfo::SmapsOrRollupFromFile(files.rollups[0], &usage);
+        benchmark::DoNotOptimize(usage);
+    }
+}
+BENCHMARK(BM_TotalsFromSmapsRollup)->Unit(benchmark::kMicrosecond);
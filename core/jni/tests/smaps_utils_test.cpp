@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "smaps_utils.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <gtest/gtest.h>
+
+using namespace android;
+using android::base::StringPrintf;
+using android::base::WriteStringToFile;
+
+namespace {
+
+struct vma_name_case {
+    const char* name;
+    int which_heap;
+    int sub_heap;
+    bool is_swappable;
+};
+
+// How the chain of StartsWith and EndsWith checks that classify_vma_name replaced classified each
+// name.  The suffix checks came before the "/dev/" and "[anon:" prefixes, but after "[heap]",
+// "[anon:libc_malloc]" and "[stack".
+const vma_name_case kVmaNameCases[] = {
+    { "", HEAP_UNKNOWN, HEAP_UNKNOWN, false },
+    { "[heap]", HEAP_NATIVE, HEAP_UNKNOWN, false },
+    { "[anon:libc_malloc]", HEAP_NATIVE, HEAP_UNKNOWN, false },
+    { "[stack]", HEAP_STACK, HEAP_UNKNOWN, false },
+    { "[stack:1234]", HEAP_STACK, HEAP_UNKNOWN, false },
+    { "[anon:stack_and_tls:1234]", HEAP_UNKNOWN, HEAP_UNKNOWN, false },
+    { "[vdso]", HEAP_UNKNOWN_MAP, HEAP_UNKNOWN, false },
+    { "/memfd:jit-cache", HEAP_UNKNOWN_MAP, HEAP_UNKNOWN, false },
+
+    { "/system/lib64/libandroid_runtime.so", HEAP_SO, HEAP_UNKNOWN, true },
+    { "/system/framework/framework.jar", HEAP_JAR, HEAP_UNKNOWN, true },
+    { "/data/app/com.example-1/base.apk", HEAP_APK, HEAP_UNKNOWN, true },
+    { "/system/fonts/Roboto-Regular.ttf", HEAP_TTF, HEAP_UNKNOWN, true },
+    { "/data/app/com.example-1/oat/arm64/base.odex", HEAP_DEX, HEAP_DEX_APP_DEX, true },
+    { "/data/app/com.example-1/classes.dex", HEAP_DEX, HEAP_DEX_APP_DEX, true },
+    { ".dex", HEAP_UNKNOWN_MAP, HEAP_UNKNOWN, false },
+    { "/system/framework/arm64/boot-framework.vdex", HEAP_DEX, HEAP_DEX_BOOT_VDEX, true },
+    { "/data/dalvik-cache/arm64/system@framework@boot.vdex", HEAP_DEX, HEAP_DEX_BOOT_VDEX, true },
+    { "/data/app/com.example-1/oat/arm64/base.vdex", HEAP_DEX, HEAP_DEX_APP_VDEX, true },
+    { "/system/framework/arm64/boot-framework.oat", HEAP_OAT, HEAP_UNKNOWN, true },
+    { "/system/framework/arm64/boot-framework.art", HEAP_ART, HEAP_ART_BOOT, true },
+    { "/data/app/com.example-1/oat/arm64/base.art", HEAP_ART, HEAP_ART_APP, true },
+    { "[anon:dalvik-/system/framework/boot-framework.art]", HEAP_ART, HEAP_ART_BOOT, true },
+    { "[anon:dalvik-/data/app/com.example-1/oat/arm64/base.art]", HEAP_ART, HEAP_ART_APP, true },
+
+    // Suffixes win over the "/dev/" and "[anon:" prefixes.
+    { "[anon:dalvik-classes.dex extracted in memory from /data/app/com.example-1/base.apk]",
+            HEAP_DEX, HEAP_DEX_APP_DEX, true },
+    { "/dev/ashmem/libfoo.so", HEAP_SO, HEAP_UNKNOWN, true },
+
+    { "/dev/binder", HEAP_UNKNOWN_DEV, HEAP_UNKNOWN, false },
+    { "/dev/kgsl-3d0", HEAP_GL_DEV, HEAP_UNKNOWN, false },
+    { "/dev/ashmem/CursorWindow: /data/data/com.example/databases/example.db", HEAP_CURSOR,
+            HEAP_UNKNOWN, false },
+    { "/dev/ashmem/dalvik-zygote space", HEAP_ASHMEM, HEAP_UNKNOWN, false },
+    { "/dev/ashmem", HEAP_ASHMEM, HEAP_UNKNOWN, false },
+
+    { "[anon:scudo:primary]", HEAP_UNKNOWN, HEAP_UNKNOWN, false },
+    { "[anon:dalvik", HEAP_UNKNOWN, HEAP_UNKNOWN, false },
+    { "[anon:dalvik-card table]", HEAP_DALVIK_OTHER, HEAP_DALVIK_OTHER_ACCOUNTING, false },
+    { "[anon:dalvik-LinearAlloc]", HEAP_DALVIK_OTHER, HEAP_DALVIK_OTHER_LINEARALLOC, false },
+    { "[anon:dalvik-alloc space]", HEAP_DALVIK, HEAP_DALVIK_NORMAL, false },
+    { "[anon:dalvik-main space (region space)]", HEAP_DALVIK, HEAP_DALVIK_NORMAL, false },
+    { "[anon:dalvik-large object space allocation]", HEAP_DALVIK, HEAP_DALVIK_LARGE, false },
+    { "[anon:dalvik-free list large object space]", HEAP_DALVIK, HEAP_DALVIK_LARGE, false },
+    { "[anon:dalvik-non moving space]", HEAP_DALVIK, HEAP_DALVIK_NON_MOVING, false },
+    { "[anon:dalvik-zygote space]", HEAP_DALVIK, HEAP_DALVIK_ZYGOTE, false },
+    { "[anon:dalvik-indirect ref table]", HEAP_DALVIK_OTHER,
+            HEAP_DALVIK_OTHER_INDIRECT_REFERENCE_TABLE, false },
+    { "[anon:dalvik-jit-code-cache]", HEAP_DALVIK_OTHER, HEAP_DALVIK_OTHER_CODE_CACHE, false },
+    { "[anon:dalvik-data-code-cache]", HEAP_DALVIK_OTHER, HEAP_DALVIK_OTHER_CODE_CACHE, false },
+    { "[anon:dalvik-CompilerMetadata]", HEAP_DALVIK_OTHER, HEAP_DALVIK_OTHER_COMPILER_METADATA,
+            false },
+};
+
+std::string vmaEntry(uint64_t start, uint64_t end, const char* name, int pss) {
+    return StringPrintf("%" PRIx64 "-%" PRIx64 " rw-p 00000000 00:00 0          %s\n"
+            "Rss:            %8d kB\n"
+            "Pss:            %8d kB\n"
+            "VmFlags: rd wr mr mw me ac \n",
+            start, end, name, pss, pss);
+}
+
+}  // namespace
+
+TEST(SmapsUtilsTest, ClassifiesVmaNamesAsBefore) {
+    for (const vma_name_case& c : kVmaNameCases) {
+        SCOPED_TRACE(c.name);
+        const vma_class classification = classify_vma_name(c.name);
+        EXPECT_EQ(c.which_heap, classification.which_heap);
+        EXPECT_EQ(c.sub_heap, classification.sub_heap);
+        EXPECT_EQ(c.is_swappable, classification.is_swappable);
+    }
+}
+
+TEST(SmapsUtilsTest, LoadMapsStripsDeletedAndCountsBss) {
+    TemporaryFile smaps;
+    ASSERT_TRUE(WriteStringToFile(
+            vmaEntry(0x1000, 0x2000, "/system/lib64/libfoo.so", 1) +
+            // The bss of libfoo.so.
+            vmaEntry(0x2000, 0x3000, "", 2) +
+            vmaEntry(0x4000, 0x5000, "/dev/ashmem/CursorWindow: example.db (deleted)", 4) +
+            vmaEntry(0x5000, 0x6000, "/data/app/com.example-1/oat/arm64/base.odex (deleted)", 8) +
+            vmaEntry(0x6000, 0x7000, "[anon:dalvik-zygote space] (deleted)", 16) +
+            // Not right after a library, so not a bss.
+            vmaEntry(0x8000, 0x9000, "", 32),
+            smaps.path));
+
+    stats_t stats[_NUM_HEAP];
+    memset(stats, 0, sizeof(stats));
+    bool foundSwapPss;
+    load_maps(smaps.path, stats, &foundSwapPss);
+
+    EXPECT_EQ(3, stats[HEAP_SO].pss);
+    EXPECT_EQ(4, stats[HEAP_CURSOR].pss);
+    EXPECT_EQ(8, stats[HEAP_DEX].pss);
+    EXPECT_EQ(8, stats[HEAP_DEX_APP_DEX].pss);
+    EXPECT_EQ(16, stats[HEAP_DALVIK].pss);
+    EXPECT_EQ(16, stats[HEAP_DALVIK_ZYGOTE].pss);
+    EXPECT_EQ(32, stats[HEAP_UNKNOWN].pss);
+    EXPECT_EQ(0, stats[HEAP_UNKNOWN_MAP].pss);
+    EXPECT_FALSE(foundSwapPss);
+}
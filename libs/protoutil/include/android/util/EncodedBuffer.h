@@ -32,7 +32,9 @@ namespace util {
  * A stream of bytes containing a read pointer and a write pointer,
  * backed by a set of fixed-size buffers.  There are write functions for the
  * primitive types stored by protocol buffers, but none of the logic
- * for tags, inner objects, or any of that.
+ * for tags, inner objects, or any of that.  The fixed-size buffers are taken
+ * from and given back to a process-wide pool, so short-lived EncodedBuffers
+ * don't malloc every chunk.
  *
  * Terminology:
  *      *Pos:       Position in the whole data set (as if it were a single buffer).
@@ -184,6 +186,12 @@ public:
      */
     sp<ProtoReader> read();
 
+    /**
+     * Writes all the data to fd. Consecutive chunks are handed to the kernel
+     * together with writev, instead of one write per chunk.
+     */
+    status_t flush(int fd);
+
 private:
     class Reader;
     friend class Reader;
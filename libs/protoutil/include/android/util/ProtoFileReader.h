@@ -18,20 +18,33 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include <android/util/EncodedBuffer.h>
 
 namespace android {
 namespace util {
 
+/**
+ * Where a field of a message is in the data of a ProtoFileReader.
+ */
+struct ProtoFieldPosition {
+    uint64_t tag;       // Field id and wire type of the field.
+    size_t offset;      // Where the value starts, after the tag and the size, if there is one.
+    size_t size;        // How big the value is.
+};
+
 /**
  * A ProtoReader on top of a file descriptor.
+ *
+ * Regular files are mapped into memory and read in place, so that skipping over data with
+ * move() or seek() doesn't read it.  Other files, like pipes, are read through a buffer.
  */
 class ProtoFileReader : public ProtoReader
 {
 public:
     /**
-     * Read from this file descriptor.
+     * Read from this file descriptor, starting at its current offset.
      */
     ProtoFileReader(int fd);
 
@@ -51,16 +64,55 @@ public:
     virtual void move(size_t amt);
 
     status_t getError() const;
+
+    /**
+     * Whether the file is mapped into memory.  Then readBuffer() holds all of the rest of
+     * the data.
+     */
+    bool isMapped() const { return mData != NULL; }
+
+    /**
+     * Move the read position to pos, counted from where the reader started like
+     * bytesRead().  Only the mapped data or the current buffer can be read again, unless
+     * the file can be seeked.
+     */
+    status_t seek(size_t pos);
+
+    /**
+     * The positions of the fields of the message in the data, in order.  It is built the
+     * first time it is needed, without reading length delimited values, and the read
+     * position is kept.  Returns NULL if the data isn't a valid message or can't be read
+     * twice.
+     */
+    const std::vector<ProtoFieldPosition>* fieldIndex();
+
 private:
     int mFd;                // File descriptor for input.
     status_t mStatus;       // Any errors encountered during read.
+    off_t mStart;           // Offset of the data in the file, or -1 if it can't be seeked.
     ssize_t mSize;          // How much total data there is, or -1 if we can't tell.
-    size_t mPos;            // How much data has been read so far.
+    void* mMapping;         // Mapping of the file, if it is mapped.
+    size_t mMappingSize;    // Size of mMapping.
+    uint8_t const* mData;   // Where the data starts in mMapping.
+    size_t mBufferStart;    // Position of the start of the current buffer in the data.
     size_t mOffset;         // Offset in current buffer.
-    size_t mMaxOffset;      // How much data is left to read in mBuffer.
+    size_t mMaxOffset;      // How much data is left to read in the current buffer.
     const int mChunkSize;   // Size of mBuffer.
+    bool mIndexed;          // Whether mFieldIndex was built.
+    bool mIndexValid;       // Whether mFieldIndex covers all of the data.
+    std::vector<ProtoFieldPosition> mFieldIndex;
     uint8_t mBuffer[32*1024];
 
+    /**
+     * Map the data into memory if the file is a regular file.
+     */
+    void map_file();
+
+    /**
+     * The current buffer, the mapped data or mBuffer.
+     */
+    uint8_t const* buffer() const { return mData != NULL ? mData : mBuffer; }
+
     /**
      * If there is currently more data to read in the buffer, returns true.
      * If there is not more, then tries to read.  If more data can be read,
@@ -68,8 +120,12 @@ private:
      * Resets mOffset and mMaxOffset as necessary.  Does not advance mOffset.
      */
     bool ensure_data();
+
+    /**
+     * Fill mFieldIndex, returns whether all of the data was indexed.
+     */
+    bool build_index();
 };
 
 }
 }
-
@@ -18,10 +18,13 @@
 #define ANDROID_UTIL_PROTOOUTPUT_STREAM_H
 
 #include <cstdint>
+#include <cstring>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include <android/util/EncodedBuffer.h>
+#include <android/util/protobuf.h>
 
 namespace android {
 namespace util {
@@ -89,7 +92,24 @@ const uint64_t FIELD_COUNT_PACKED = 5ULL << FIELD_COUNT_SHIFT;
 class ProtoOutputStream
 {
 public:
+    /**
+     * How the sizes of nested messages are encoded. Both produce the same bytes.
+     */
+    enum class NestedEncoding {
+        /**
+         * start() reserves two 32-bit size slots in the buffer. The first read of the data walks
+         * the whole buffer twice, to compute the sizes and then to shrink the slots to varints.
+         */
+        COMPACT,
+        /**
+         * end() records the size of the message in a side table. The sizes are spliced into the
+         * data by a single copy on the first read, without walking the encoded fields again.
+         */
+        SINGLE_PASS,
+    };
+
     ProtoOutputStream();
+    explicit ProtoOutputStream(NestedEncoding encoding);
     ~ProtoOutputStream();
 
     /**
@@ -103,6 +123,17 @@ public:
     bool write(uint64_t fieldId, std::string val);
     bool write(uint64_t fieldId, const char* val, size_t size);
 
+    /**
+     * Write APIs for fieldIds known at compile time, e.g.
+     *     proto.write<FIELD_TYPE_INT32 | FooProto::kBarFieldNumber>(bar);
+     * The value type is checked against the field type and the tag is encoded by
+     * the compiler, so only the value is encoded at runtime, and the field is
+     * copied to the buffer at once. The bytes are the same as write(fieldId, val).
+     * Only scalar fields and std::string values of string and bytes fields.
+     */
+    template<uint64_t fieldId, typename T>
+    bool write(const T& val);
+
     /**
      * Starts a sub-message write session.
      * Returns a token of this write session.
@@ -136,8 +167,27 @@ public:
     void writeRawVarint(uint64_t varint);
     void writeLengthDelimitedHeader(uint32_t id, size_t size);
     void writeRawByte(uint8_t byte);
+    void writeRaw(const uint8_t* buf, size_t size);
 
 private:
+    /**
+     * The varint size of a nested message, to be inserted before position pos of mBuffer.
+     */
+    struct SizeSlot {
+        size_t pos;
+        uint32_t size;
+    };
+
+    /**
+     * A message started in SINGLE_PASS mode that has not ended yet.
+     */
+    struct OpenMessage {
+        uint64_t parentToken;
+        size_t sizeSlot;
+        // Bytes of size varints already inserted when the message started.
+        size_t insertedBefore;
+    };
+
     sp<EncodedBuffer> mBuffer;
     size_t mCopyBegin;
     bool mCompact;
@@ -145,6 +195,12 @@ private:
     uint32_t mObjectId;
     uint64_t mExpectedObjectToken;
 
+    NestedEncoding mEncoding;
+    std::vector<SizeSlot> mSizeSlots;
+    std::vector<OpenMessage> mOpenMessages;
+    // Total bytes of the size varints of all ended messages.
+    size_t mInsertedBytes;
+
     inline void writeDoubleImpl(uint32_t id, double val);
     inline void writeFloatImpl(uint32_t id, float val);
     inline void writeInt64Impl(uint32_t id, int64_t val);
@@ -165,11 +221,154 @@ private:
     bool compact();
     size_t editEncodedSize(size_t rawSize);
     bool compactSize(size_t rawSize);
+    bool spliceSizes();
+    void endSinglePass(uint64_t token);
 
     template<typename T>
     bool internalWrite(uint64_t fieldId, T val, const char* typeName);
+
+    /**
+     * A tag encoded at compile time, at most 5 bytes for a 32-bit varint.
+     */
+    struct EncodedTag {
+        uint8_t bytes[5];
+        size_t size;
+    };
+
+    static constexpr uint8_t wireTypeOf(uint64_t fieldType);
+    static constexpr EncodedTag encodeTag(uint32_t id, uint8_t wireType);
+    static inline uint8_t* encodeVarint(uint8_t* buf, uint64_t val);
+    static inline uint8_t* encodeFixed32(uint8_t* buf, uint32_t val);
+    static inline uint8_t* encodeFixed64(uint8_t* buf, uint64_t val);
 };
 
+constexpr uint8_t
+ProtoOutputStream::wireTypeOf(uint64_t fieldType)
+{
+    return (fieldType == FIELD_TYPE_DOUBLE || fieldType == FIELD_TYPE_FIXED64
+                    || fieldType == FIELD_TYPE_SFIXED64) ? WIRE_TYPE_FIXED64
+            : (fieldType == FIELD_TYPE_FLOAT || fieldType == FIELD_TYPE_FIXED32
+                    || fieldType == FIELD_TYPE_SFIXED32) ? WIRE_TYPE_FIXED32
+            : (fieldType == FIELD_TYPE_STRING || fieldType == FIELD_TYPE_BYTES
+                    || fieldType == FIELD_TYPE_MESSAGE) ? WIRE_TYPE_LENGTH_DELIMITED
+            : WIRE_TYPE_VARINT;
+}
+
+constexpr ProtoOutputStream::EncodedTag
+ProtoOutputStream::encodeTag(uint32_t id, uint8_t wireType)
+{
+    EncodedTag tag = {};
+    uint32_t varint = (id << FIELD_ID_SHIFT) | wireType;
+    while ((varint & ~0x7F) != 0) {
+        tag.bytes[tag.size++] = (uint8_t)((varint & 0x7F) | 0x80);
+        varint >>= 7;
+    }
+    tag.bytes[tag.size++] = (uint8_t)varint;
+    return tag;
+}
+
+inline uint8_t*
+ProtoOutputStream::encodeVarint(uint8_t* buf, uint64_t val)
+{
+    while ((val & ~0x7F) != 0) {
+        *buf++ = (uint8_t)((val & 0x7F) | 0x80);
+        val >>= 7;
+    }
+    *buf++ = (uint8_t)val;
+    return buf;
+}
+
+inline uint8_t*
+ProtoOutputStream::encodeFixed32(uint8_t* buf, uint32_t val)
+{
+    for (auto i=0; i<32; i+=8) {
+        *buf++ = (uint8_t)(val >> i);
+    }
+    return buf;
+}
+
+inline uint8_t*
+ProtoOutputStream::encodeFixed64(uint8_t* buf, uint64_t val)
+{
+    for (auto i=0; i<64; i+=8) {
+        *buf++ = (uint8_t)(val >> i);
+    }
+    return buf;
+}
+
+template<uint64_t fieldId, typename T>
+inline bool
+ProtoOutputStream::write(const T& val)
+{
+    constexpr uint64_t fieldType = fieldId & FIELD_TYPE_MASK;
+    constexpr uint32_t id = (uint32_t)fieldId;
+    static_assert(id > 0 && id < (1u << 29), "Invalid field number.");
+    static_assert(fieldType != FIELD_TYPE_MESSAGE,
+            "Use start and end, or write(fieldId, val, size), for message fields.");
+    constexpr EncodedTag tag = encodeTag(id, wireTypeOf(fieldType));
+
+    if (mCompact) return false;
+
+    if constexpr (fieldType == FIELD_TYPE_STRING || fieldType == FIELD_TYPE_BYTES) {
+        static_assert(std::is_same<T, std::string>::value,
+                "String and bytes fields take a std::string.");
+        // the size slots depend on the nested encoding, so the header isn't precomputed.
+        writeLengthDelimitedHeader(id, val.size());
+        return mBuffer->writeRaw((const uint8_t*)val.data(), val.size()) == NO_ERROR;
+    } else {
+        constexpr bool isFloat = fieldType == FIELD_TYPE_DOUBLE || fieldType == FIELD_TYPE_FLOAT;
+        static_assert(isFloat ? std::is_arithmetic<T>::value
+                : fieldType == FIELD_TYPE_ENUM ? std::is_integral<T>::value || std::is_enum<T>::value
+                : std::is_integral<T>::value,
+                "The value type doesn't match the field type.");
+
+        // tag and the longest value, a 10 bytes varint.
+        uint8_t buf[sizeof(tag.bytes) + 10];
+        uint8_t* p = buf;
+        for (size_t i = 0; i < tag.size; i++) {
+            *p++ = tag.bytes[i];
+        }
+
+        // same conversions as internalWrite, so both produce the same bytes.
+        if constexpr (fieldType == FIELD_TYPE_DOUBLE) {
+            double d = (double)val;
+            uint64_t bits;
+            memcpy(&bits, &d, sizeof(bits));
+            p = encodeFixed64(p, bits);
+        } else if constexpr (fieldType == FIELD_TYPE_FLOAT) {
+            float f = (float)val;
+            uint32_t bits;
+            memcpy(&bits, &f, sizeof(bits));
+            p = encodeFixed32(p, bits);
+        } else if constexpr (fieldType == FIELD_TYPE_INT64 || fieldType == FIELD_TYPE_UINT64) {
+            p = encodeVarint(p, (uint64_t)val);
+        } else if constexpr (fieldType == FIELD_TYPE_INT32) {
+            p = encodeVarint(p, (uint32_t)(int32_t)val);
+        } else if constexpr (fieldType == FIELD_TYPE_UINT32) {
+            p = encodeVarint(p, (uint32_t)val);
+        } else if constexpr (fieldType == FIELD_TYPE_FIXED64
+                || fieldType == FIELD_TYPE_SFIXED64) {
+            p = encodeFixed64(p, (uint64_t)val);
+        } else if constexpr (fieldType == FIELD_TYPE_FIXED32
+                || fieldType == FIELD_TYPE_SFIXED32) {
+            p = encodeFixed32(p, (uint32_t)val);
+        } else if constexpr (fieldType == FIELD_TYPE_SINT32) {
+            int32_t v = (int32_t)val;
+            p = encodeVarint(p, (uint32_t)((v << 1) ^ (v >> 31)));
+        } else if constexpr (fieldType == FIELD_TYPE_SINT64) {
+            int64_t v = (int64_t)val;
+            p = encodeVarint(p, (uint64_t)((v << 1) ^ (v >> 63)));
+        } else if constexpr (fieldType == FIELD_TYPE_ENUM) {
+            p = encodeVarint(p, (uint32_t)(int)val);
+        } else if constexpr (fieldType == FIELD_TYPE_BOOL) {
+            *p++ = val != 0 ? 1 : 0;
+        } else {
+            static_assert(sizeof(T) == 0, "Unsupported field type.");
+        }
+        return mBuffer->writeRaw(buf, p - buf) == NO_ERROR;
+    }
+}
+
 }
 }
 
@@ -15,7 +15,13 @@
  */
 #define LOG_TAG "libprotoutil"
 
+#include <errno.h>
 #include <stdlib.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <mutex>
+#include <unordered_map>
 
 #include <android/util/EncodedBuffer.h>
 #include <android/util/protobuf.h>
@@ -25,6 +31,50 @@ namespace android {
 namespace util {
 
 const size_t BUFFER_SIZE = 8 * 1024; // 8 KB
+const size_t MAX_POOLED_BYTES = 1024 * 1024; // 1 MB
+const int MAX_IOVECS = 64;
+
+/**
+ * Process-wide free lists of chunks, by chunk size. Buffers are created and
+ * destroyed for every section and every report, so their chunks are kept for
+ * the next buffer instead of going back to malloc, up to MAX_POOLED_BYTES.
+ */
+class ChunkPool {
+public:
+    uint8_t* acquire(size_t chunkSize) {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            std::vector<uint8_t*>& chunks = mChunks[chunkSize];
+            if (!chunks.empty()) {
+                uint8_t* chunk = chunks.back();
+                chunks.pop_back();
+                mPooledBytes -= chunkSize;
+                return chunk;
+            }
+        }
+        return (uint8_t*)malloc(chunkSize);
+    }
+
+    void release(uint8_t* chunk, size_t chunkSize) {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            if (mPooledBytes + chunkSize <= MAX_POOLED_BYTES) {
+                mChunks[chunkSize].push_back(chunk);
+                mPooledBytes += chunkSize;
+                return;
+            }
+        }
+        free(chunk);
+    }
+
+private:
+    std::mutex mLock;
+    std::unordered_map<size_t, std::vector<uint8_t*>> mChunks;
+    size_t mPooledBytes = 0;
+};
+
+// Never destroyed, buffers may outlive static destructors.
+static ChunkPool* gChunkPool = new ChunkPool();
 
 EncodedBuffer::Pointer::Pointer() : Pointer(BUFFER_SIZE)
 {
@@ -97,8 +147,7 @@ EncodedBuffer::EncodedBuffer(size_t chunkSize)
 EncodedBuffer::~EncodedBuffer()
 {
     for (size_t i=0; i<mBuffers.size(); i++) {
-        uint8_t* buf = mBuffers[i];
-        free(buf);
+        gChunkPool->release(mBuffers[i], mChunkSize);
     }
 }
 
@@ -135,7 +184,7 @@ EncodedBuffer::writeBuffer()
     if (mWp.index() > mBuffers.size()) return NULL;
     uint8_t* buf = NULL;
     if (mWp.index() == mBuffers.size()) {
-        buf = (uint8_t*)malloc(mChunkSize);
+        buf = gChunkPool->acquire(mChunkSize);
 
         if (buf == NULL) return NULL; // This indicates NO_MEMORY
 
@@ -414,5 +463,28 @@ EncodedBuffer::Reader::move(size_t amt)
     mRp.move(amt);
 }
 
+status_t
+EncodedBuffer::flush(int fd)
+{
+    struct iovec iov[MAX_IOVECS];
+    Pointer rp(mChunkSize);
+    while (rp.pos() < mWp.pos()) {
+        int count = 0;
+        for (Pointer p = rp.copy(); p.pos() < mWp.pos() && count < MAX_IOVECS; count++) {
+            size_t amt = (mWp.index() > p.index()) ? mChunkSize - p.offset()
+                                                   : mWp.offset() - p.offset();
+            iov[count].iov_base = at(p);
+            iov[count].iov_len = amt;
+            p.move(amt);
+        }
+        ssize_t amt = TEMP_FAILURE_RETRY(writev(fd, iov, count));
+        if (amt < 0) {
+            return -errno;
+        }
+        rp.move(amt);
+    }
+    return NO_ERROR;
+}
+
 } // util
 } // android
@@ -16,11 +16,14 @@
 #define LOG_TAG "libprotoutil"
 
 #include <android/util/ProtoFileReader.h>
+#include <android/util/protobuf.h>
 #include <cutils/log.h>
 
 #include <cinttypes>
 #include <type_traits>
 
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 namespace android {
@@ -52,14 +55,25 @@ ssize_t get_file_size(int fd) {
 ProtoFileReader::ProtoFileReader(int fd)
         :mFd(fd),
          mStatus(NO_ERROR),
+         mStart(lseek(fd, 0, SEEK_CUR)),
          mSize(get_file_size(fd)),
-         mPos(0),
+         mMapping(NULL),
+         mMappingSize(0),
+         mData(NULL),
+         mBufferStart(0),
          mOffset(0),
          mMaxOffset(0),
-         mChunkSize(sizeof(mBuffer)) {
+         mChunkSize(sizeof(mBuffer)),
+         mIndexed(false),
+         mIndexValid(false),
+         mFieldIndex() {
+    map_file();
 }
 
 ProtoFileReader::~ProtoFileReader() {
+    if (mMapping != NULL) {
+        munmap(mMapping, mMappingSize);
+    }
 }
 
 ssize_t
@@ -71,13 +85,13 @@ ProtoFileReader::size() const
 size_t
 ProtoFileReader::bytesRead() const
 {
-    return mPos;
+    return mBufferStart + mOffset;
 }
 
 uint8_t const*
 ProtoFileReader::readBuffer()
 {
-    return hasNext() ? mBuffer + mOffset : NULL;
+    return hasNext() ? buffer() + mOffset : NULL;
 }
 
 size_t
@@ -99,7 +113,7 @@ ProtoFileReader::next()
         // Shouldn't get to here.  Always call hasNext() before calling next().
         return 0;
     }
-    return mBuffer[mOffset++];
+    return buffer()[mOffset++];
 }
 
 uint64_t
@@ -123,6 +137,16 @@ ProtoFileReader::readRawVarint()
 void
 ProtoFileReader::move(size_t amt)
 {
+    if (mStatus == NO_ERROR && amt > mMaxOffset - mOffset && mData == NULL && mStart >= 0) {
+        // Seek over what isn't buffered instead of reading it, but not past the end.
+        size_t pos = bytesRead() + amt;
+        if (mSize >= 0 && pos > (size_t)mSize) {
+            pos = mSize;
+        }
+        if (seek(pos) == NO_ERROR) {
+            return;
+        }
+    }
     while (mStatus == NO_ERROR && amt > 0) {
         if (!ensure_data()) {
             return;
@@ -139,6 +163,68 @@ ProtoFileReader::getError() const {
     return mStatus;
 }
 
+status_t
+ProtoFileReader::seek(size_t pos)
+{
+    if (mStatus != NO_ERROR) {
+        return mStatus;
+    }
+    if (pos >= mBufferStart && pos <= mBufferStart + mMaxOffset) {
+        mOffset = pos - mBufferStart;
+        return NO_ERROR;
+    }
+    if (mData != NULL || (mSize >= 0 && pos > (size_t)mSize)) {
+        return BAD_VALUE;
+    }
+    if (mStart < 0) {
+        return INVALID_OPERATION;
+    }
+    if (lseek(mFd, mStart + pos, SEEK_SET) < 0) {
+        return -errno;
+    }
+    mBufferStart = pos;
+    mOffset = 0;
+    mMaxOffset = 0;
+    return NO_ERROR;
+}
+
+const std::vector<ProtoFieldPosition>*
+ProtoFileReader::fieldIndex()
+{
+    if (!mIndexed) {
+        mIndexed = true;
+        mIndexValid = build_index();
+        if (!mIndexValid) {
+            mFieldIndex.clear();
+        }
+    }
+    return mIndexValid ? &mFieldIndex : NULL;
+}
+
+void
+ProtoFileReader::map_file()
+{
+    struct stat st;
+    if (mStart < 0 || mSize <= 0 || fstat(mFd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return;
+    }
+
+    // The mapping has to start on a page boundary.
+    const off_t pageStart = mStart & ~((off_t)sysconf(_SC_PAGE_SIZE) - 1);
+    const size_t length = (size_t)(mStart - pageStart) + mSize;
+    void* mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, mFd, pageStart);
+    if (mapping == MAP_FAILED) {
+        // It is read with read() instead.
+        return;
+    }
+    madvise(mapping, length, MADV_SEQUENTIAL);
+
+    mMapping = mapping;
+    mMappingSize = length;
+    mData = (uint8_t const*)mapping + (mStart - pageStart);
+    mMaxOffset = mSize;
+}
+
 bool
 ProtoFileReader::ensure_data() {
     if (mStatus != NO_ERROR) {
@@ -147,6 +233,9 @@ ProtoFileReader::ensure_data() {
     if (mOffset < mMaxOffset) {
         return true;
     }
+    if (mData != NULL) {
+        return false;
+    }
     ssize_t amt = TEMP_FAILURE_RETRY(read(mFd, mBuffer, mChunkSize));
     if (amt == 0) {
         return false;
@@ -154,13 +243,67 @@ ProtoFileReader::ensure_data() {
         mStatus = -errno;
         return false;
     } else {
+        mBufferStart += mMaxOffset;
         mOffset = 0;
         mMaxOffset = amt;
         return true;
     }
 }
 
+bool
+ProtoFileReader::build_index()
+{
+    // Data that can't be read again would be lost to the caller.
+    if (mData == NULL && mStart < 0) {
+        return false;
+    }
+    const size_t pos = bytesRead();
+    if (seek(0) != NO_ERROR) {
+        return false;
+    }
+
+    bool valid = true;
+    while (valid && hasNext()) {
+        ProtoFieldPosition field;
+        field.tag = readRawVarint();
+        switch (read_wire_type(field.tag)) {
+            case WIRE_TYPE_VARINT:
+                field.offset = bytesRead();
+                readRawVarint();
+                field.size = bytesRead() - field.offset;
+                break;
+            case WIRE_TYPE_FIXED64:
+                field.offset = bytesRead();
+                field.size = sizeof(int64_t);
+                break;
+            case WIRE_TYPE_LENGTH_DELIMITED:
+                field.size = readRawVarint();
+                field.offset = bytesRead();
+                break;
+            case WIRE_TYPE_FIXED32:
+                field.offset = bytesRead();
+                field.size = sizeof(int32_t);
+                break;
+            default:
+                valid = false;
+                continue;
+        }
+        if (read_wire_type(field.tag) != WIRE_TYPE_VARINT) {
+            move(field.size);
+        }
+        // A value that runs past the end of the data means the message is cut short.
+        valid = mStatus == NO_ERROR && bytesRead() == field.offset + field.size;
+        if (valid) {
+            mFieldIndex.push_back(field);
+        }
+    }
+
+    // Reading past the end while indexing isn't an error of the reader.
+    if (mStatus == NOT_ENOUGH_DATA) {
+        mStatus = NO_ERROR;
+    }
+    return seek(pos) == NO_ERROR && valid;
+}
 
 } // util
 } // android
-
@@ -18,7 +18,6 @@
 #include <cinttypes>
 #include <type_traits>
 
-#include <android-base/file.h>
 #include <android/util/protobuf.h>
 #include <android/util/ProtoOutputStream.h>
 #include <cutils/log.h>
@@ -26,13 +25,21 @@
 namespace android {
 namespace util {
 
-ProtoOutputStream::ProtoOutputStream()
+ProtoOutputStream::ProtoOutputStream() : ProtoOutputStream(NestedEncoding::COMPACT)
+{
+}
+
+ProtoOutputStream::ProtoOutputStream(NestedEncoding encoding)
         :mBuffer(new EncodedBuffer()),
          mCopyBegin(0),
          mCompact(false),
          mDepth(0),
          mObjectId(0),
-         mExpectedObjectToken(UINT64_C(-1))
+         mExpectedObjectToken(UINT64_C(-1)),
+         mEncoding(encoding),
+         mSizeSlots(),
+         mOpenMessages(),
+         mInsertedBytes(0)
 {
 }
 
@@ -50,6 +57,9 @@ ProtoOutputStream::clear()
     mDepth = 0;
     mObjectId = 0;
     mExpectedObjectToken = UINT64_C(-1);
+    mSizeSlots.clear();
+    mOpenMessages.clear();
+    mInsertedBytes = 0;
 }
 
 template<typename T>
@@ -232,7 +242,13 @@ ProtoOutputStream::start(uint64_t fieldId)
 
     mDepth++;
     mObjectId++;
-    mBuffer->writeRawFixed64(mExpectedObjectToken); // push previous token into stack.
+    if (mEncoding == NestedEncoding::SINGLE_PASS) {
+        // Nothing is reserved in the buffer, the size goes into a slot of the side table.
+        mOpenMessages.push_back({mExpectedObjectToken, mSizeSlots.size(), mInsertedBytes});
+        mSizeSlots.push_back({sizePos, 0});
+    } else {
+        mBuffer->writeRawFixed64(mExpectedObjectToken); // push previous token into stack.
+    }
 
     mExpectedObjectToken = makeToken(sizePos - prevPos,
         (bool)(fieldId & FIELD_COUNT_REPEATED), mDepth, mObjectId, sizePos);
@@ -256,6 +272,11 @@ ProtoOutputStream::end(uint64_t token)
     }
     mDepth--;
 
+    if (mEncoding == NestedEncoding::SINGLE_PASS) {
+        endSinglePass(token);
+        return;
+    }
+
     uint32_t sizePos = getSizePosFromToken(token);
     // number of bytes written in this start-end session.
     int childRawSize = mBuffer->wp()->pos() - sizePos - 8;
@@ -274,6 +295,29 @@ ProtoOutputStream::end(uint64_t token)
     }
 }
 
+void
+ProtoOutputStream::endSinglePass(uint64_t token)
+{
+    OpenMessage message = mOpenMessages.back();
+    mOpenMessages.pop_back();
+    mExpectedObjectToken = message.parentToken;
+
+    // The encoded size covers the bytes written since start() plus the size varints of the
+    // messages nested in this one, which all ended already.
+    uint32_t dataPos = getSizePosFromToken(token);
+    size_t encodedSize = mBuffer->wp()->pos() - dataPos + mInsertedBytes - message.insertedBefore;
+
+    if (encodedSize > 0) {
+        mSizeSlots[message.sizeSlot].size = encodedSize;
+        mInsertedBytes += get_varint_size(encodedSize);
+    } else {
+        // An empty message has no nested messages either, so its slot is the last one. Erase the
+        // slot and the header tag, like the compact encoding does.
+        mSizeSlots.pop_back();
+        mBuffer->wp()->rewind()->move(dataPos - getTagSizeFromToken(token));
+    }
+}
+
 size_t
 ProtoOutputStream::bytesWritten()
 {
@@ -287,6 +331,15 @@ ProtoOutputStream::compact() {
         ALOGE("Can't compact when depth(%" PRIu32 ") is not zero. Missing or extra calls to end.", mDepth);
         return false;
     }
+    if (mEncoding == NestedEncoding::SINGLE_PASS) {
+        if (!spliceSizes()) {
+            ALOGE("Failed to spliceSizes.");
+            return false;
+        }
+        mCompact = true;
+        return true;
+    }
+
     // record the size of the original buffer.
     size_t rawBufferSize = mBuffer->size();
     if (rawBufferSize == 0) return true; // nothing to do if the buffer is empty;
@@ -422,6 +475,30 @@ ProtoOutputStream::compactSize(size_t rawSize)
     return true;
 }
 
+/**
+ * Single pass encoding.  Copy the data to a new buffer, inserting the varint
+ * size of each nested object recorded by end() in front of its data.
+ */
+bool
+ProtoOutputStream::spliceSizes()
+{
+    if (mSizeSlots.empty()) return true; // the data is already final.
+
+    sp<EncodedBuffer> spliced = new EncodedBuffer();
+    sp<ProtoReader> reader = mBuffer->read();
+    size_t copied = 0;
+    for (const SizeSlot& slot : mSizeSlots) {
+        if (spliced->writeRaw(reader, slot.pos - copied) != NO_ERROR) return false;
+        spliced->writeRawVarint32(slot.size);
+        copied = slot.pos;
+    }
+    if (spliced->writeRaw(reader) != NO_ERROR) return false;
+
+    mBuffer = spliced;
+    mSizeSlots.clear();
+    return true;
+}
+
 size_t
 ProtoOutputStream::size()
 {
@@ -438,14 +515,7 @@ ProtoOutputStream::flush(int fd)
     if (fd < 0) return false;
     if (!compact()) return false;
 
-    sp<ProtoReader> reader = mBuffer->read();
-    while (reader->readBuffer() != NULL) {
-        if (!android::base::WriteFully(fd, reader->readBuffer(), reader->currentToRead())) {
-            return false;
-        }
-        reader->move(reader->currentToRead());
-    }
-    return true;
+    return mBuffer->flush(fd) == NO_ERROR;
 }
 
 bool
@@ -501,6 +571,11 @@ void
 ProtoOutputStream::writeLengthDelimitedHeader(uint32_t id, size_t size)
 {
     mBuffer->writeHeader(id, WIRE_TYPE_LENGTH_DELIMITED);
+    if (mEncoding == NestedEncoding::SINGLE_PASS) {
+        // nothing to fix up later, the size is written in its final form.
+        mBuffer->writeRawVarint32(size);
+        return;
+    }
     // reserves 64 bits for length delimited fields, if first field is negative, compact it.
     mBuffer->writeRawFixed32(size);
     mBuffer->writeRawFixed32(size);
@@ -512,6 +587,12 @@ ProtoOutputStream::writeRawByte(uint8_t byte)
     mBuffer->writeRawByte(byte);
 }
 
+void
+ProtoOutputStream::writeRaw(const uint8_t* buf, size_t size)
+{
+    mBuffer->writeRaw(buf, size);
+}
+
 
 // =========================================================================
 // Private functions
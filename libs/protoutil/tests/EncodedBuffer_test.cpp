@@ -11,10 +11,13 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
 #include <android/util/EncodedBuffer.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+using namespace android::base;
 using namespace android::util;
 using android::sp;
 
@@ -150,3 +153,32 @@ TEST(EncodedBufferTest, ReadVarint) {
     EXPECT_EQ(reader->size(), len);
     EXPECT_EQ(reader->readRawVarint(), val);
 }
+
+TEST(EncodedBufferTest, ReusesChunks) {
+    // A chunk size no other test uses, so the pool only holds this test's chunk.
+    constexpr size_t chunkSize = 24UL;
+    sp<EncodedBuffer> buffer = new EncodedBuffer(chunkSize);
+    uint8_t* chunk = buffer->writeBuffer();
+    ASSERT_NE(chunk, nullptr);
+    buffer = nullptr;
+
+    sp<EncodedBuffer> reused = new EncodedBuffer(chunkSize);
+    EXPECT_EQ(reused->writeBuffer(), chunk);
+}
+
+TEST(EncodedBufferTest, Flush) {
+    sp<EncodedBuffer> buffer = new EncodedBuffer(TEST_CHUNK_SIZE);
+    // more chunks than a single writev call takes.
+    std::string expected;
+    for (size_t i = 0; i < 100 * TEST_CHUNK_SIZE + TEST_CHUNK_HALF_SIZE; i++) {
+        buffer->writeRawByte(i);
+        expected.push_back(i);
+    }
+
+    TemporaryFile tf;
+    ASSERT_NE(tf.fd, -1);
+    EXPECT_EQ(buffer->flush(tf.fd), android::NO_ERROR);
+    std::string content;
+    ASSERT_TRUE(ReadFileToString(tf.path, &content));
+    EXPECT_EQ(content, expected);
+}
@@ -0,0 +1,125 @@
+// Copyright (C) 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <android/util/protobuf.h>
+#include <android/util/ProtoOutputStream.h>
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+#include "frameworks/base/libs/protoutil/tests/test.pb.h"
+
+using android::sp;
+using namespace android::util;
+
+// An incident-like report: many logs, each holding a chain of nested messages.
+static void writeReport(ProtoOutputStream* proto, int logs, int depth) {
+    const std::string name(200, 'n');
+    std::vector<uint64_t> tokens;
+    for (int i = 0; i < logs; i++) {
+        proto->write(FIELD_TYPE_INT32 | ComplexProto::kIntsFieldNumber, i);
+        uint64_t log = proto->start(FIELD_TYPE_MESSAGE | ComplexProto::kLogsFieldNumber);
+        proto->write(FIELD_TYPE_INT32 | ComplexProto::Log::kIdFieldNumber, i);
+        proto->write(FIELD_TYPE_STRING | ComplexProto::Log::kNameFieldNumber, name);
+        for (int d = 0; d < depth; d++) {
+            tokens.push_back(proto->start(FIELD_TYPE_MESSAGE | ComplexProto::Log::kDataFieldNumber));
+            proto->write(FIELD_TYPE_INT32 | ComplexProto::Log::kIdFieldNumber, d);
+        }
+        while (!tokens.empty()) {
+            proto->end(tokens.back());
+            tokens.pop_back();
+        }
+        proto->end(log);
+    }
+}
+
+static std::string readAll(ProtoOutputStream* proto) {
+    std::string content;
+    content.reserve(proto->size());
+    sp<ProtoReader> reader = proto->data();
+    while (reader->hasNext()) {
+        content.push_back(reader->next());
+    }
+    return content;
+}
+
+static void BM_Serialize(benchmark::State& state, ProtoOutputStream::NestedEncoding encoding) {
+    const int logs = state.range(0);
+    const int depth = state.range(1);
+
+    // Both encodings must produce the same bytes, or the timings are meaningless.
+    ProtoOutputStream reference;
+    writeReport(&reference, logs, depth);
+    ProtoOutputStream checked(encoding);
+    writeReport(&checked, logs, depth);
+    if (readAll(&checked) != readAll(&reference)) {
+        state.SkipWithError("encoded bytes differ from the compact encoding");
+        return;
+    }
+
+    size_t bytes = 0;
+    for (auto _ : state) {
+        ProtoOutputStream proto(encoding);
+        writeReport(&proto, logs, depth);
+        bytes = proto.size();
+        benchmark::DoNotOptimize(bytes);
+    }
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+static void BM_SerializeCompact(benchmark::State& state) {
+    BM_Serialize(state, ProtoOutputStream::NestedEncoding::COMPACT);
+}
+BENCHMARK(BM_SerializeCompact)->Args({1000, 1})->Args({1000, 8})->Args({10000, 8});
+
+static void BM_SerializeSinglePass(benchmark::State& state) {
+    BM_Serialize(state, ProtoOutputStream::NestedEncoding::SINGLE_PASS);
+}
+BENCHMARK(BM_SerializeSinglePass)->Args({1000, 1})->Args({1000, 8})->Args({10000, 8});
+
+// A statsd-like event: a few scalar fields written in a tight loop.
+static void BM_WriteFieldsDynamic(benchmark::State& state) {
+    ProtoOutputStream proto;
+    for (auto _ : state) {
+        proto.clear();
+        for (int i = 0; i < 1000; i++) {
+            proto.write(FIELD_TYPE_INT32 | PrimitiveProto::kValInt32FieldNumber, i);
+            proto.write(FIELD_TYPE_INT64 | PrimitiveProto::kValInt64FieldNumber, (long long)i << 20);
+            proto.write(FIELD_TYPE_BOOL | PrimitiveProto::kValBoolFieldNumber, i % 2 == 0);
+            proto.write(FIELD_TYPE_FIXED64 | PrimitiveProto::kValFixed64FieldNumber, (long long)i);
+            proto.write(FIELD_TYPE_SINT32 | PrimitiveProto::kValSint32FieldNumber, -i);
+        }
+        benchmark::DoNotOptimize(proto.bytesWritten());
+    }
+}
+BENCHMARK(BM_WriteFieldsDynamic);
+
+static void BM_WriteFieldsCompileTime(benchmark::State& state) {
+    ProtoOutputStream proto;
+    for (auto _ : state) {
+        proto.clear();
+        for (int i = 0; i < 1000; i++) {
+            proto.write<FIELD_TYPE_INT32 | PrimitiveProto::kValInt32FieldNumber>(i);
+            proto.write<FIELD_TYPE_INT64 | PrimitiveProto::kValInt64FieldNumber>((long long)i << 20);
+            proto.write<FIELD_TYPE_BOOL | PrimitiveProto::kValBoolFieldNumber>(i % 2 == 0);
+            proto.write<FIELD_TYPE_FIXED64 | PrimitiveProto::kValFixed64FieldNumber>((long long)i);
+            proto.write<FIELD_TYPE_SINT32 | PrimitiveProto::kValSint32FieldNumber>(-i);
+        }
+        benchmark::DoNotOptimize(proto.bytesWritten());
+    }
+}
+BENCHMARK(BM_WriteFieldsCompileTime);
+
+BENCHMARK_MAIN();
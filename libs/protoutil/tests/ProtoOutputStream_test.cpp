@@ -88,6 +88,72 @@ TEST(ProtoOutputStreamTest, Primitives) {
     EXPECT_EQ(primitives.val_enum(), PrimitiveProto_Count_TWO);
 }
 
+TEST(ProtoOutputStreamTest, CompileTimeFieldIds) {
+    std::string s = "hello";
+    const char b[5] = { 'a', 'p', 'p', 'l', 'e' };
+
+    ProtoOutputStream dynamic;
+    EXPECT_TRUE(dynamic.write(FIELD_TYPE_INT32 | PrimitiveProto::kValInt32FieldNumber, -5));
+    EXPECT_TRUE(dynamic.write(FIELD_TYPE_INT64 | PrimitiveProto::kValInt64FieldNumber, -1234567890123LL));
+    EXPECT_TRUE(dynamic.write(FIELD_TYPE_FLOAT | PrimitiveProto::kValFloatFieldNumber, -23.5f));
+    EXPECT_TRUE(dynamic.write(FIELD_TYPE_DOUBLE | PrimitiveProto::kValDoubleFieldNumber, 4.5e100));
+    EXPECT_TRUE(dynamic.write(FIELD_TYPE_UINT32 | PrimitiveProto::kValUint32FieldNumber, 300));
+    EXPECT_TRUE(dynamic.write(FIELD_TYPE_UINT64 | PrimitiveProto::kValUint64FieldNumber, 5000000000LL));
+    EXPECT_TRUE(dynamic.write(FIELD_TYPE_FIXED32 | PrimitiveProto::kValFixed32FieldNumber, 77));
+    EXPECT_TRUE(dynamic.write(FIELD_TYPE_FIXED64 | PrimitiveProto::kValFixed64FieldNumber, 88LL));
+    EXPECT_TRUE(dynamic.write(FIELD_TYPE_BOOL | PrimitiveProto::kValBoolFieldNumber, true));
+    EXPECT_TRUE(dynamic.write(FIELD_TYPE_STRING | PrimitiveProto::kValStringFieldNumber, s));
+    EXPECT_TRUE(dynamic.write(FIELD_TYPE_BYTES | PrimitiveProto::kValBytesFieldNumber, b, 5));
+    EXPECT_TRUE(dynamic.write(FIELD_TYPE_SFIXED32 | PrimitiveProto::kValSfixed32FieldNumber, -42));
+    EXPECT_TRUE(dynamic.write(FIELD_TYPE_SFIXED64 | PrimitiveProto::kValSfixed64FieldNumber, -42LL));
+    EXPECT_TRUE(dynamic.write(FIELD_TYPE_SINT32 | PrimitiveProto::kValSint32FieldNumber, -99));
+    EXPECT_TRUE(dynamic.write(FIELD_TYPE_SINT64 | PrimitiveProto::kValSint64FieldNumber, -99999999999LL));
+    EXPECT_TRUE(dynamic.write(FIELD_TYPE_ENUM | PrimitiveProto::kValEnumFieldNumber, PrimitiveProto_Count_TWO));
+
+    ProtoOutputStream proto;
+    EXPECT_TRUE(proto.write<FIELD_TYPE_INT32 | PrimitiveProto::kValInt32FieldNumber>(-5));
+    EXPECT_TRUE(proto.write<FIELD_TYPE_INT64 | PrimitiveProto::kValInt64FieldNumber>(-1234567890123LL));
+    EXPECT_TRUE(proto.write<FIELD_TYPE_FLOAT | PrimitiveProto::kValFloatFieldNumber>(-23.5f));
+    EXPECT_TRUE(proto.write<FIELD_TYPE_DOUBLE | PrimitiveProto::kValDoubleFieldNumber>(4.5e100));
+    EXPECT_TRUE(proto.write<FIELD_TYPE_UINT32 | PrimitiveProto::kValUint32FieldNumber>(300));
+    EXPECT_TRUE(proto.write<FIELD_TYPE_UINT64 | PrimitiveProto::kValUint64FieldNumber>(5000000000LL));
+    EXPECT_TRUE(proto.write<FIELD_TYPE_FIXED32 | PrimitiveProto::kValFixed32FieldNumber>(77));
+    EXPECT_TRUE(proto.write<FIELD_TYPE_FIXED64 | PrimitiveProto::kValFixed64FieldNumber>(88LL));
+    EXPECT_TRUE(proto.write<FIELD_TYPE_BOOL | PrimitiveProto::kValBoolFieldNumber>(true));
+    EXPECT_TRUE(proto.write<FIELD_TYPE_STRING | PrimitiveProto::kValStringFieldNumber>(s));
+    EXPECT_TRUE(proto.write<FIELD_TYPE_BYTES | PrimitiveProto::kValBytesFieldNumber>(std::string(b, 5)));
+    EXPECT_TRUE(proto.write<FIELD_TYPE_SFIXED32 | PrimitiveProto::kValSfixed32FieldNumber>(-42));
+    EXPECT_TRUE(proto.write<FIELD_TYPE_SFIXED64 | PrimitiveProto::kValSfixed64FieldNumber>(-42LL));
+    EXPECT_TRUE(proto.write<FIELD_TYPE_SINT32 | PrimitiveProto::kValSint32FieldNumber>(-99));
+    EXPECT_TRUE(proto.write<FIELD_TYPE_SINT64 | PrimitiveProto::kValSint64FieldNumber>(-99999999999LL));
+    EXPECT_TRUE(proto.write<FIELD_TYPE_ENUM | PrimitiveProto::kValEnumFieldNumber>(PrimitiveProto_Count_TWO));
+
+    std::string content = iterateToString(&proto);
+    EXPECT_EQ(content, iterateToString(&dynamic));
+
+    PrimitiveProto primitives;
+    ASSERT_TRUE(primitives.ParseFromString(content));
+    EXPECT_EQ(primitives.val_int32(), -5);
+    EXPECT_EQ(primitives.val_double(), 4.5e100);
+    EXPECT_THAT(primitives.val_string(), StrEq(s.c_str()));
+    EXPECT_THAT(primitives.val_bytes(), StrEq("apple"));
+    EXPECT_EQ(primitives.val_sint64(), -99999999999LL);
+    EXPECT_EQ(primitives.val_enum(), PrimitiveProto_Count_TWO);
+
+    // Can't write to proto after compact
+    EXPECT_FALSE(proto.write<FIELD_TYPE_INT32 | PrimitiveProto::kValInt32FieldNumber>(1));
+}
+
+TEST(ProtoOutputStreamTest, CompileTimeFieldIdsWithLongTags) {
+    ProtoOutputStream dynamic;
+    ProtoOutputStream proto;
+    dynamic.write(FIELD_TYPE_INT32 | 2000, 1);
+    proto.write<FIELD_TYPE_INT32 | 2000>(1);
+    dynamic.write(FIELD_TYPE_UINT64 | 0x1fffffff, 2LL);
+    proto.write<FIELD_TYPE_UINT64 | 0x1fffffff>(2LL);
+    EXPECT_EQ(iterateToString(&proto), iterateToString(&dynamic));
+}
+
 TEST(ProtoOutputStreamTest, SerializeToStringPrimitives) {
     std::string s = "hello";
     const char b[5] = { 'a', 'p', 'p', 'l', 'e' };
@@ -316,6 +382,73 @@ TEST(ProtoOutputStreamTest, AdvancedEncoding) {
     EXPECT_FALSE(log2.has_data());
 }
 
+// Writes logs whose data field holds messages nested depth levels deep, with empty messages,
+// sizes that need more than one varint byte and raw length delimited fields in between.
+static void writeNestedReport(ProtoOutputStream* proto, int logs, int depth) {
+    const std::string longName(300, 'x');
+    for (int i = 0; i < logs; i++) {
+        proto->write(FIELD_TYPE_INT32 | ComplexProto::kIntsFieldNumber, i);
+        uint64_t log = proto->start(FIELD_TYPE_MESSAGE | ComplexProto::kLogsFieldNumber);
+        proto->write(FIELD_TYPE_INT32 | ComplexProto::Log::kIdFieldNumber, i);
+        proto->write(FIELD_TYPE_STRING | ComplexProto::Log::kNameFieldNumber,
+                     i % 2 == 0 ? longName : std::string("short"));
+
+        std::vector<uint64_t> tokens;
+        for (int d = 0; d < depth; d++) {
+            tokens.push_back(proto->start(FIELD_TYPE_MESSAGE | ComplexProto::Log::kDataFieldNumber));
+            proto->end(proto->start(FIELD_TYPE_MESSAGE | ComplexProto::Log::kDataFieldNumber));
+            proto->write(FIELD_TYPE_INT32 | ComplexProto::Log::kIdFieldNumber, d);
+        }
+        proto->writeLengthDelimitedHeader(ComplexProto::Log::kNameFieldNumber, 3);
+        proto->writeRawByte('a');
+        proto->writeRawByte('b');
+        proto->writeRawByte('c');
+        while (!tokens.empty()) {
+            proto->end(tokens.back());
+            tokens.pop_back();
+        }
+        proto->end(log);
+    }
+    proto->end(proto->start(FIELD_TYPE_MESSAGE | ComplexProto::kLogsFieldNumber));
+}
+
+TEST(ProtoOutputStreamTest, SinglePassEncodingMatchesCompact) {
+    ProtoOutputStream compact;
+    ProtoOutputStream singlePass(ProtoOutputStream::NestedEncoding::SINGLE_PASS);
+    writeNestedReport(&compact, 20, 10);
+    writeNestedReport(&singlePass, 20, 10);
+
+    std::string expected = iterateToString(&compact);
+    EXPECT_EQ(singlePass.size(), expected.size());
+    EXPECT_EQ(iterateToString(&singlePass), expected);
+
+    ComplexProto complex;
+    ASSERT_TRUE(complex.ParseFromString(flushToString(&singlePass)));
+    EXPECT_EQ(complex.ints_size(), 20);
+    EXPECT_EQ(complex.logs_size(), 20);
+    EXPECT_EQ(complex.logs(0).name(), std::string(300, 'x'));
+    EXPECT_THAT(complex.logs(1).name(), StrEq("short"));
+}
+
+TEST(ProtoOutputStreamTest, SinglePassEncodingReusability) {
+    ProtoOutputStream proto(ProtoOutputStream::NestedEncoding::SINGLE_PASS);
+    uint64_t token = proto.start(FIELD_TYPE_MESSAGE | ComplexProto::kLogsFieldNumber);
+    proto.write(FIELD_TYPE_INT32 | ComplexProto::Log::kIdFieldNumber, 53);
+    proto.end(token);
+    EXPECT_EQ(proto.size(), 4);
+
+    proto.clear();
+    token = proto.start(FIELD_TYPE_MESSAGE | ComplexProto::kLogsFieldNumber);
+    proto.write(FIELD_TYPE_STRING | ComplexProto::Log::kNameFieldNumber, std::string("dog"));
+    proto.end(token);
+
+    ComplexProto complex;
+    ASSERT_TRUE(complex.ParseFromString(flushToString(&proto)));
+    EXPECT_EQ(complex.logs_size(), 1);
+    EXPECT_FALSE(complex.logs(0).has_id());
+    EXPECT_THAT(complex.logs(0).name(), StrEq("dog"));
+}
+
 TEST(ProtoOutputStreamTest, InvalidTypes) {
     ProtoOutputStream proto;
     EXPECT_FALSE(proto.write(FIELD_TYPE_UNKNOWN | PrimitiveProto::kValInt32FieldNumber, 790));
@@ -334,6 +467,15 @@ TEST(ProtoOutputStreamTest, NoEndCalled) {
     EXPECT_FALSE(proto.flush(STDOUT_FILENO));
 }
 
+TEST(ProtoOutputStreamTest, SinglePassEncodingNoEndCalled) {
+    ProtoOutputStream proto(ProtoOutputStream::NestedEncoding::SINGLE_PASS);
+    proto.start(FIELD_TYPE_MESSAGE | ComplexProto::kLogsFieldNumber);
+    proto.write(FIELD_TYPE_INT32 | ComplexProto::Log::kIdFieldNumber, 53);
+    // no proto.end called
+    EXPECT_NE(proto.bytesWritten(), 0);
+    EXPECT_EQ(proto.size(), 0);
+    EXPECT_FALSE(proto.flush(STDOUT_FILENO));
+}
 
 TEST(ProtoOutputStreamTest, TwoEndCalled) {
     ProtoOutputStream proto;
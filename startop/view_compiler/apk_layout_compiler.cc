@@ -24,8 +24,14 @@
 #include "androidfw/AssetManager2.h"
 #include "androidfw/ResourceTypes.h"
 
+#include <algorithm>
 #include <iostream>
 #include <locale>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 #include "android-base/stringprintf.h"
 
@@ -80,11 +86,58 @@ bool CanCompileLayout(ResXMLParser* parser) {
 }
 
 namespace {
-void CompileApkAssetsLayouts(const std::unique_ptr<const android::ApkAssets>& assets,
-                             CompilationTarget target, std::ostream& target_out) {
-  android::AssetManager2 resources;
-  resources.SetApkAssets({assets.get()});
+size_t DefaultNumThreads() { return std::max(1u, std::thread::hardware_concurrency()); }
+
+// Parses the layout at layout_path into the calls that compile it, or returns nullopt if the
+// layout can't be compiled.
+std::optional<LayoutProgram> ParseLayout(android::AssetManager2* resources,
+                                         const std::string& layout_path) {
+  android::ApkAssetsCookie cookie = android::kInvalidCookie;
+  auto asset = resources->OpenNonAsset(layout_path, android::Asset::ACCESS_RANDOM, &cookie);
+  CHECK(asset);
+  CHECK(android::kInvalidCookie != cookie);
+  const auto dynamic_ref_table = resources->GetDynamicRefTableForCookie(cookie);
+  CHECK(nullptr != dynamic_ref_table);
+  android::ResXMLTree xml_tree{dynamic_ref_table};
+  xml_tree.setTo(asset->getBuffer(/*wordAligned=*/true),
+                 asset->getLength(),
+                 /*copy_data=*/true);
+  android::ResXMLParser parser{xml_tree};
+  parser.restart();
+  if (!CanCompileLayout(&parser)) {
+    return std::nullopt;
+  }
+  parser.restart();
+  LayoutProgram program;
+  program.Start();
+  LayoutCompilerVisitor visitor{&program};
+  ResXmlVisitorAdapter adapter{&parser};
+  adapter.Accept(&visitor);
+  program.Finish();
+  return program;
+}
+
+// Parses every layout on its own thread pool, since that is most of the work for an APK with
+// many layouts. The results are in the order of layout_paths.
+std::vector<std::optional<LayoutProgram>> ParseLayouts(
+    const std::unique_ptr<const android::ApkAssets>& assets,
+    const std::vector<std::string>& layout_paths, size_t num_threads) {
+  std::vector<std::optional<LayoutProgram>> layouts(layout_paths.size());
+  // AssetManager2 isn't thread safe, but the ApkAssets it reads from are immutable.
+  std::vector<std::unique_ptr<android::AssetManager2>> resources(num_threads);
+  util::ForEachInParallel(layout_paths.size(), num_threads, [&](size_t worker, size_t i) {
+    if (!resources[worker]) {
+      resources[worker] = std::make_unique<android::AssetManager2>();
+      resources[worker]->SetApkAssets({assets.get()});
+    }
+    layouts[i] = ParseLayout(resources[worker].get(), layout_paths[i]);
+  });
+  return layouts;
+}
 
+void CompileApkAssetsLayouts(const std::unique_ptr<const android::ApkAssets>& assets,
+                             CompilationTarget target, std::ostream& target_out,
+                             size_t num_threads) {
   std::string package_name;
 
   // TODO: handle multiple packages better
@@ -95,72 +148,39 @@ void CompileApkAssetsLayouts(const std::unique_ptr<const android::ApkAssets>& as
     first = false;
   }
 
-  dex::DexBuilder dex_file;
-  dex::ClassBuilder compiled_view{
-      dex_file.MakeClass(StringPrintf("%s.CompiledView", package_name.c_str()))};
-  std::vector<dex::MethodBuilder> methods;
-
+  std::vector<std::string> layout_paths;
   assets->ForEachFile("res/", [&](const android::StringPiece& s, android::FileType) {
     if (s == "layout") {
       auto path = StringPrintf("res/%s/", s.to_string().c_str());
       assets->ForEachFile(path, [&](const android::StringPiece& layout_file, android::FileType) {
-        auto layout_path = StringPrintf("%s%s", path.c_str(), layout_file.to_string().c_str());
-        android::ApkAssetsCookie cookie = android::kInvalidCookie;
-        auto asset = resources.OpenNonAsset(layout_path, android::Asset::ACCESS_RANDOM, &cookie);
-        CHECK(asset);
-        CHECK(android::kInvalidCookie != cookie);
-        const auto dynamic_ref_table = resources.GetDynamicRefTableForCookie(cookie);
-        CHECK(nullptr != dynamic_ref_table);
-        android::ResXMLTree xml_tree{dynamic_ref_table};
-        xml_tree.setTo(asset->getBuffer(/*wordAligned=*/true),
-                       asset->getLength(),
-                       /*copy_data=*/true);
-        android::ResXMLParser parser{xml_tree};
-        parser.restart();
-        if (CanCompileLayout(&parser)) {
-          parser.restart();
-          const std::string layout_name = startop::util::FindLayoutNameFromFilename(layout_path);
-          ResXmlVisitorAdapter adapter{&parser};
-          switch (target) {
-            case CompilationTarget::kDex: {
-              methods.push_back(compiled_view.CreateMethod(
-                  layout_name,
-                  dex::Prototype{dex::TypeDescriptor::FromClassname("android.view.View"),
-                                 dex::TypeDescriptor::FromClassname("android.content.Context"),
-                                 dex::TypeDescriptor::Int()}));
-              DexViewBuilder builder(&methods.back());
-              builder.Start();
-              LayoutCompilerVisitor visitor{&builder};
-              adapter.Accept(&visitor);
-              builder.Finish();
-              methods.back().Encode();
-              break;
-            }
-            case CompilationTarget::kJavaLanguage: {
-              JavaLangViewBuilder builder{package_name, layout_name, target_out};
-              builder.Start();
-              LayoutCompilerVisitor visitor{&builder};
-              adapter.Accept(&visitor);
-              builder.Finish();
-              break;
-            }
-          }
-        }
+        layout_paths.push_back(
+            StringPrintf("%s%s", path.c_str(), layout_file.to_string().c_str()));
       });
     }
   });
 
-  if (target == CompilationTarget::kDex) {
-    slicer::MemView image{dex_file.CreateImage()};
-    target_out.write(image.ptr<const char>(), image.size());
+  std::vector<std::optional<LayoutProgram>> programs =
+      ParseLayouts(assets, layout_paths, num_threads);
+  std::vector<NamedLayoutProgram> layouts;
+  for (size_t i = 0; i < layout_paths.size(); i++) {
+    if (programs[i]) {
+      layouts.push_back(NamedLayoutProgram{
+          startop::util::FindLayoutNameFromFilename(layout_paths[i]), std::move(*programs[i])});
+    }
   }
+  CompileLayoutPrograms(package_name, layouts, target, target_out, num_threads);
 }
 }  // namespace
 
 void CompileApkLayouts(const std::string& filename, CompilationTarget target,
                        std::ostream& target_out) {
+  CompileApkLayouts(filename, target, target_out, DefaultNumThreads());
+}
+
+void CompileApkLayouts(const std::string& filename, CompilationTarget target,
+                       std::ostream& target_out, size_t num_threads) {
   auto assets = android::ApkAssets::Load(filename);
-  CompileApkAssetsLayouts(assets, target, target_out);
+  CompileApkAssetsLayouts(assets, target, target_out, num_threads);
 }
 
 void CompileApkLayoutsFd(android::base::unique_fd fd, CompilationTarget target,
@@ -168,7 +188,48 @@ void CompileApkLayoutsFd(android::base::unique_fd fd, CompilationTarget target,
   constexpr const char* friendly_name{"viewcompiler assets"};
   auto assets = android::ApkAssets::LoadFromFd(
       std::move(fd), friendly_name, /*system=*/false, /*force_shared_lib=*/false);
-  CompileApkAssetsLayouts(assets, target, target_out);
+  CompileApkAssetsLayouts(assets, target, target_out, DefaultNumThreads());
+}
+
+void CompileLayoutPrograms(const std::string& package_name,
+                           const std::vector<NamedLayoutProgram>& layouts,
+                           CompilationTarget target, std::ostream& target_out, size_t num_threads) {
+  switch (target) {
+    case CompilationTarget::kDex: {
+      dex::DexBuilder dex_file;
+      dex::ClassBuilder compiled_view{
+          dex_file.MakeClass(StringPrintf("%s.CompiledView", package_name.c_str()))};
+      // The encoded methods refer to the code in their MethodBuilder until the image is created.
+      std::vector<dex::MethodBuilder> methods;
+      for (const auto& layout : layouts) {
+        methods.push_back(compiled_view.CreateMethod(
+            layout.layout_name,
+            dex::Prototype{dex::TypeDescriptor::FromClassname("android.view.View"),
+                           dex::TypeDescriptor::FromClassname("android.content.Context"),
+                           dex::TypeDescriptor::Int()}));
+        DexViewBuilder builder{&methods.back()};
+        layout.program.Replay(&builder);
+        methods.back().Encode();
+      }
+      slicer::MemView image{dex_file.CreateImage()};
+      target_out.write(image.ptr<const char>(), image.size());
+      break;
+    }
+    case CompilationTarget::kJavaLanguage: {
+      // Each class is generated on its own, then they are all written in order.
+      std::vector<std::string> classes(layouts.size());
+      util::ForEachInParallel(layouts.size(), num_threads, [&](size_t /*worker*/, size_t i) {
+        std::ostringstream out;
+        JavaLangViewBuilder builder{package_name, layouts[i].layout_name, out};
+        layouts[i].program.Replay(&builder);
+        classes[i] = out.str();
+      });
+      for (const auto& java_class : classes) {
+        target_out << java_class;
+      }
+      break;
+    }
+  }
 }
 
 }  // namespace startop
@@ -17,7 +17,9 @@
 #ifndef APK_LAYOUT_COMPILER_H_
 #define APK_LAYOUT_COMPILER_H_
 
+#include <ostream>
 #include <string>
+#include <vector>
 
 #include "android-base/unique_fd.h"
 
@@ -25,11 +27,72 @@ namespace startop {
 
 enum class CompilationTarget { kJavaLanguage, kDex };
 
+// The calls that a LayoutCompilerVisitor makes to its builder for one layout. It is built for each
+// layout on its own thread, and replayed into the real builder afterwards.
+class LayoutProgram {
+ public:
+  void Start() { calls_.push_back(Call{Call::kStart, {}, false}); }
+  void Finish() { calls_.push_back(Call{Call::kFinish, {}, false}); }
+  void StartView(const std::string& name, bool is_viewgroup) {
+    calls_.push_back(Call{Call::kStartView, name, is_viewgroup});
+  }
+  void FinishView() { calls_.push_back(Call{Call::kFinishView, {}, false}); }
+
+  // Makes the recorded calls to builder, in order.
+  template <typename Builder>
+  void Replay(Builder* builder) const {
+    for (const auto& call : calls_) {
+      switch (call.kind) {
+        case Call::kStart:
+          builder->Start();
+          break;
+        case Call::kFinish:
+          builder->Finish();
+          break;
+        case Call::kStartView:
+          builder->StartView(call.name, call.is_viewgroup);
+          break;
+        case Call::kFinishView:
+          builder->FinishView();
+          break;
+      }
+    }
+  }
+
+ private:
+  struct Call {
+    enum Kind { kStart, kFinish, kStartView, kFinishView } kind;
+    std::string name;
+    bool is_viewgroup;
+  };
+
+  std::vector<Call> calls_;
+};
+
+struct NamedLayoutProgram {
+  // Names the generated method or class.
+  std::string layout_name;
+  LayoutProgram program;
+};
+
+// Compiles every layout of the APK that can be compiled. The layouts are parsed into
+// LayoutPrograms on one thread per core, or on up to num_threads threads, which doesn't change the
+// output. DEX method generation stays serial: see CompileLayoutPrograms.
 void CompileApkLayouts(const std::string& filename, CompilationTarget target,
                        std::ostream& target_out);
+void CompileApkLayouts(const std::string& filename, CompilationTarget target,
+                       std::ostream& target_out, size_t num_threads);
 void CompileApkLayoutsFd(android::base::unique_fd fd, CompilationTarget target,
                          std::ostream& target_out);
 
+// Generates the code for layouts, in their order. Java code is generated on up to num_threads
+// threads, which doesn't change the output. DEX code is generated on the calling thread: the
+// MethodBuilder of each layout is built and encoded one after another, since the DexBuilder assigns
+// its string, type and method ids in the order that code is generated.
+void CompileLayoutPrograms(const std::string& package_name,
+                           const std::vector<NamedLayoutProgram>& layouts,
+                           CompilationTarget target, std::ostream& target_out, size_t num_threads);
+
 }  // namespace startop
 
 #endif  // APK_LAYOUT_COMPILER_H_
\ No newline at end of file
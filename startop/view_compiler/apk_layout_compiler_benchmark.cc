@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "apk_layout_compiler.h"
+#include "dex_layout_compiler.h"
+#include "util.h"
+
+#include "benchmark/benchmark.h"
+
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using startop::CompilationTarget;
+using startop::CompileLayoutPrograms;
+using startop::LayoutCompilerVisitor;
+using startop::NamedLayoutProgram;
+
+namespace {
+constexpr size_t kNumLayouts = 500;
+
+// Visits a layout about the size of an activity: a few nested groups of views.
+template <typename Visitor>
+void VisitLayout(Visitor* visitor) {
+  visitor->VisitStartDocument();
+  visitor->VisitStartTag(u"LinearLayout");
+  for (size_t i = 0; i < 8; i++) {
+    visitor->VisitStartTag(u"FrameLayout");
+    for (size_t j = 0; j < 4; j++) {
+      visitor->VisitStartTag(u"TextView");
+      visitor->VisitEndTag();
+    }
+    visitor->VisitEndTag();
+  }
+  visitor->VisitEndTag();
+  visitor->VisitEndDocument();
+}
+
+std::vector<NamedLayoutProgram> MakeLayouts() {
+  std::vector<NamedLayoutProgram> layouts(kNumLayouts);
+  for (size_t i = 0; i < layouts.size(); i++) {
+    layouts[i].layout_name = "layout_" + std::to_string(i);
+    LayoutCompilerVisitor visitor{&layouts[i].program};
+    VisitLayout(&visitor);
+  }
+  return layouts;
+}
+
+void ThreadArgs(benchmark::internal::Benchmark* b) {
+  b->Arg(1);
+  if (std::thread::hardware_concurrency() > 1) {
+    b->Arg(std::thread::hardware_concurrency());
+  }
+}
+}  // namespace
+
+// Building the program of every layout, which ParseLayouts does on its threads after parsing.
+static void BM_RecordLayoutPrograms(benchmark::State& state) {
+  std::vector<NamedLayoutProgram> layouts(kNumLayouts);
+  for (auto _ : state) {
+    startop::util::ForEachInParallel(layouts.size(), state.range(0), [&](size_t, size_t i) {
+      layouts[i].program = {};
+      LayoutCompilerVisitor visitor{&layouts[i].program};
+      VisitLayout(&visitor);
+    });
+  }
+  state.SetItemsProcessed(state.iterations() * kNumLayouts);
+}
+BENCHMARK(BM_RecordLayoutPrograms)->Apply(ThreadArgs)->UseRealTime();
+
+static void BM_CompileJava(benchmark::State& state) {
+  const std::vector<NamedLayoutProgram> layouts = MakeLayouts();
+  for (auto _ : state) {
+    std::ostringstream out;
+    CompileLayoutPrograms("com.example", layouts, CompilationTarget::kJavaLanguage, out,
+                          state.range(0));
+    benchmark::DoNotOptimize(out.tellp());
+  }
+  state.SetItemsProcessed(state.iterations() * kNumLayouts);
+}
+BENCHMARK(BM_CompileJava)->Apply(ThreadArgs)->UseRealTime();
+
+// DEX code is always generated on one thread.
+static void BM_CompileDex(benchmark::State& state) {
+  const std::vector<NamedLayoutProgram> layouts = MakeLayouts();
+  for (auto _ : state) {
+    std::ostringstream out;
+    CompileLayoutPrograms("com.example", layouts, CompilationTarget::kDex, out, 1);
+    benchmark::DoNotOptimize(out.tellp());
+  }
+  state.SetItemsProcessed(state.iterations() * kNumLayouts);
+}
+BENCHMARK(BM_CompileDex);
+
+BENCHMARK_MAIN();
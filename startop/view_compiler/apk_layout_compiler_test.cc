@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "apk_layout_compiler.h"
+#include "dex_layout_compiler.h"
+#include "java_lang_builder.h"
+
+#include "android-base/file.h"
+#include "gtest/gtest.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using startop::CompilationTarget;
+using startop::CompileApkLayouts;
+using startop::CompileLayoutPrograms;
+using startop::LayoutCompilerVisitor;
+using startop::LayoutProgram;
+using startop::NamedLayoutProgram;
+using std::string;
+
+namespace {
+constexpr const char* kPackageName = "com.example";
+
+// Visits a LinearLayout holding a different number of views for each layout number.
+template <typename Visitor>
+void VisitLayout(size_t layout, Visitor* visitor) {
+  visitor->VisitStartDocument();
+  visitor->VisitStartTag(u"LinearLayout");
+  for (size_t i = 0; i < layout % 5; i++) {
+    visitor->VisitStartTag(i % 2 == 0 ? u"TextView" : u"FrameLayout");
+    if (i % 2 != 0) {
+      visitor->VisitStartTag(u"Button");
+      visitor->VisitEndTag();
+    }
+    visitor->VisitEndTag();
+  }
+  visitor->VisitEndTag();
+  visitor->VisitEndDocument();
+}
+
+std::vector<NamedLayoutProgram> MakeLayouts(size_t count) {
+  std::vector<NamedLayoutProgram> layouts;
+  for (size_t i = 0; i < count; i++) {
+    NamedLayoutProgram layout{"layout_" + std::to_string(i), {}};
+    LayoutCompilerVisitor visitor{&layout.program};
+    VisitLayout(i, &visitor);
+    layouts.push_back(std::move(layout));
+  }
+  return layouts;
+}
+
+string Compile(const std::vector<NamedLayoutProgram>& layouts, CompilationTarget target,
+               size_t num_threads) {
+  std::ostringstream out;
+  CompileLayoutPrograms(kPackageName, layouts, target, out, num_threads);
+  return out.str();
+}
+
+// An APK with a few layouts, one of which can't be compiled. testdata/build builds it.
+string CompileTestApk(CompilationTarget target, size_t num_threads) {
+  std::ostringstream out;
+  CompileApkLayouts(android::base::GetExecutableDirectory() + "/testdata/view_compiler_test.apk",
+                    target, out, num_threads);
+  return out.str();
+}
+}  // namespace
+
+TEST(ApkLayoutCompilerTest, ReplaysLayoutsAsTheyWereVisited) {
+  const std::vector<NamedLayoutProgram> layouts = MakeLayouts(10);
+
+  // Each layout compiled straight from the visitor, one after the other.
+  std::ostringstream expected;
+  for (size_t i = 0; i < layouts.size(); i++) {
+    JavaLangViewBuilder builder{kPackageName, layouts[i].layout_name, expected};
+    LayoutCompilerVisitor visitor{&builder};
+    VisitLayout(i, &visitor);
+  }
+
+  EXPECT_EQ(expected.str(), Compile(layouts, CompilationTarget::kJavaLanguage, 1));
+}
+
+TEST(ApkLayoutCompilerTest, JavaOutputDoesNotDependOnThreads) {
+  const std::vector<NamedLayoutProgram> layouts = MakeLayouts(100);
+  const string serial = Compile(layouts, CompilationTarget::kJavaLanguage, 1);
+  EXPECT_EQ(serial, Compile(layouts, CompilationTarget::kJavaLanguage, 4));
+  EXPECT_EQ(serial, Compile(layouts, CompilationTarget::kJavaLanguage, 200));
+}
+
+TEST(ApkLayoutCompilerTest, CompilesApkLayoutsOnAnyNumberOfThreads) {
+  const string serial = CompileTestApk(CompilationTarget::kJavaLanguage, 1);
+  for (const char* layout :
+       {"activity_main", "list_item", "nested_groups", "single_view", "toolbar_row"}) {
+    EXPECT_NE(string::npos, serial.find(string{"R.layout."} + layout + ")")) << layout;
+  }
+  EXPECT_EQ(string::npos, serial.find("with_include"));
+
+  // Each worker parses its layouts with its own AssetManager2 over the shared ApkAssets.
+  EXPECT_EQ(serial, CompileTestApk(CompilationTarget::kJavaLanguage, 2));
+  EXPECT_EQ(serial, CompileTestApk(CompilationTarget::kJavaLanguage, 8));
+}
+
+TEST(ApkLayoutCompilerTest, ApkDexOutputDoesNotDependOnThreads) {
+  const string serial = CompileTestApk(CompilationTarget::kDex, 1);
+  EXPECT_FALSE(serial.empty());
+  EXPECT_EQ(serial, CompileTestApk(CompilationTarget::kDex, 2));
+  EXPECT_EQ(serial, CompileTestApk(CompilationTarget::kDex, 8));
+}
+
+TEST(ApkLayoutCompilerTest, CompilesNoLayouts) {
+  EXPECT_EQ("", Compile({}, CompilationTarget::kJavaLanguage, 4));
+}
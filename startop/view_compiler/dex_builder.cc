@@ -18,8 +18,12 @@
 
 #include "dex/descriptors_names.h"
 
+#include <algorithm>
 #include <fstream>
+#include <limits>
 #include <memory>
+#include <queue>
+#include <set>
 
 namespace startop {
 namespace dex {
@@ -285,7 +289,9 @@ ir::EncodedMethod* MethodBuilder::Encode() {
   CHECK(decl_->prototype != nullptr);
   size_t const num_args =
       decl_->prototype->param_types != nullptr ? decl_->prototype->param_types->types.size() : 0;
-  code->registers = num_registers_ + num_args + kMaxScratchRegisters;
+  AllocateRegisters();
+  RemoveRedundantConstants();
+  code->registers = num_dex_registers_ + num_args + kMaxScratchRegisters;
   code->ins_count = num_args;
   EncodeInstructions();
   code->instructions = slicer::ArrayView<const ::dex::u2>(buffer_.data(), buffer_.size());
@@ -333,6 +339,166 @@ void MethodBuilder::EncodeInstructions() {
   }
 }
 
+std::vector<bool> MethodBuilder::FindLoopHeaders() const {
+  std::vector<bool> is_bound(labels_.size(), false);
+  std::vector<bool> loop_headers(labels_.size(), false);
+  for (const auto& instruction : instructions_) {
+    if (instruction.opcode() == Op::kBindLabel) {
+      is_bound[instruction.args()[0].value()] = true;
+    } else if (instruction.opcode() == Op::kBranchEqz || instruction.opcode() == Op::kBranchNEqz) {
+      const size_t label = instruction.args()[1].value();
+      if (is_bound[label]) {
+        loop_headers[label] = true;
+      }
+    }
+  }
+  return loop_headers;
+}
+
+void MethodBuilder::AllocateRegisters() {
+  // The live range of each register, from the first to the last instruction that refers to it.
+  // Without loops, code only moves forward through the instructions, so a register is dead
+  // outside of its range.
+  constexpr size_t kUnused = std::numeric_limits<size_t>::max();
+  std::vector<std::pair<size_t, size_t>> live_ranges(num_registers_, {kUnused, 0});
+  auto add_reference = [&](size_t index, const Value& value) {
+    if (value.is_register()) {
+      auto& range = live_ranges[value.value()];
+      range.first = std::min(range.first, index);
+      range.second = std::max(range.second, index);
+    }
+  };
+  for (size_t i = 0; i < instructions_.size(); ++i) {
+    if (instructions_[i].dest().has_value()) {
+      add_reference(i, *instructions_[i].dest());
+    }
+    for (const auto& arg : instructions_[i].args()) {
+      add_reference(i, arg);
+    }
+  }
+
+  register_map_.assign(num_registers_ + kMaxScratchRegisters, 0);
+  num_dex_registers_ = 0;
+  const std::vector<bool> loop_headers = FindLoopHeaders();
+  if (std::find(loop_headers.begin(), loop_headers.end(), true) != loop_headers.end()) {
+    // A register can be live around a loop, outside of its range, so don't share any of them.
+    for (size_t i = 0; i < num_registers_; ++i) {
+      register_map_[i] = num_dex_registers_++;
+    }
+  } else {
+    std::vector<size_t> registers;
+    for (size_t i = 0; i < num_registers_; ++i) {
+      if (live_ranges[i].first != kUnused) {
+        registers.push_back(i);
+      }
+    }
+    std::stable_sort(registers.begin(), registers.end(), [&](size_t lhs, size_t rhs) {
+      return live_ranges[lhs].first < live_ranges[rhs].first;
+    });
+
+    // Hand out the lowest free DEX register, so that as many registers as possible fit in the
+    // short instruction formats.
+    std::set<size_t> free_registers;
+    // The end of the live range and the DEX register of the registers that are live, ending
+    // soonest first.
+    std::priority_queue<std::pair<size_t, size_t>,
+                        std::vector<std::pair<size_t, size_t>>,
+                        std::greater<std::pair<size_t, size_t>>>
+        live_registers;
+    for (size_t reg : registers) {
+      while (!live_registers.empty() && live_registers.top().first < live_ranges[reg].first) {
+        free_registers.insert(live_registers.top().second);
+        live_registers.pop();
+      }
+      size_t dex_register;
+      if (free_registers.empty()) {
+        dex_register = num_dex_registers_++;
+      } else {
+        dex_register = *free_registers.begin();
+        free_registers.erase(free_registers.begin());
+      }
+      register_map_[reg] = dex_register;
+      live_registers.push({live_ranges[reg].second, dex_register});
+    }
+  }
+
+  for (size_t i = 0; i < kMaxScratchRegisters; ++i) {
+    register_map_[num_registers_ + i] = num_dex_registers_ + i;
+  }
+}
+
+void MethodBuilder::RemoveRedundantConstants() {
+  // The constants that DEX registers are known to hold, as whether the constant is a string and
+  // its value.
+  using Constants = std::map<size_t, std::pair<bool, size_t>>;
+  auto intersect = [](const Constants& lhs, const Constants& rhs) {
+    Constants result;
+    for (const auto& entry : lhs) {
+      auto it = rhs.find(entry.first);
+      if (it != rhs.end() && it->second == entry.second) {
+        result.insert(entry);
+      }
+    }
+    return result;
+  };
+
+  const std::vector<bool> loop_headers = FindLoopHeaders();
+  // What the branches to each label seen so far agree on.
+  std::vector<std::optional<Constants>> label_constants(labels_.size());
+  Constants constants;
+  bool reachable = true;
+
+  std::vector<Instruction> instructions;
+  for (const auto& instruction : instructions_) {
+    switch (instruction.opcode()) {
+      case Op::kBindLabel: {
+        const size_t label = instruction.args()[0].value();
+        if (loop_headers[label]) {
+          constants.clear();
+        } else if (!reachable) {
+          constants = label_constants[label].value_or(Constants{});
+        } else if (label_constants[label].has_value()) {
+          constants = intersect(constants, *label_constants[label]);
+        }
+        reachable = true;
+        break;
+      }
+      case Op::kBranchEqz:
+      case Op::kBranchNEqz: {
+        auto& known = label_constants[instruction.args()[1].value()];
+        known = known.has_value() ? intersect(*known, constants) : constants;
+        break;
+      }
+      case Op::kReturn:
+      case Op::kReturnObject:
+        reachable = false;
+        constants.clear();
+        break;
+      default:
+        break;
+    }
+
+    if (instruction.dest().has_value() && instruction.dest()->is_variable()) {
+      const size_t dest = RegisterValue(*instruction.dest());
+      const bool is_move = instruction.opcode() == Op::kMove ||
+                           instruction.opcode() == Op::kMoveObject;
+      if (is_move && (instruction.args()[0].is_immediate() || instruction.args()[0].is_string())) {
+        const std::pair<bool, size_t> value{instruction.args()[0].is_string(),
+                                            instruction.args()[0].value()};
+        auto it = constants.find(dest);
+        if (it != constants.end() && it->second == value) {
+          continue;
+        }
+        constants[dest] = value;
+      } else {
+        constants.erase(dest);
+      }
+    }
+    instructions.push_back(instruction);
+  }
+  instructions_.swap(instructions);
+}
+
 void MethodBuilder::EncodeInstruction(const Instruction& instruction) {
   switch (instruction.opcode()) {
     case Instruction::Op::kReturn:
@@ -516,9 +682,9 @@ void MethodBuilder::EncodeCast(const Instruction& instruction) {
 
 size_t MethodBuilder::RegisterValue(const Value& value) const {
   if (value.is_register()) {
-    return value.value();
+    return register_map_[value.value()];
   } else if (value.is_parameter()) {
-    return value.value() + num_registers_ + kMaxScratchRegisters;
+    return value.value() + num_dex_registers_ + kMaxScratchRegisters;
   }
   CHECK(false && "Must be either a parameter or a register");
   return 0;
@@ -280,8 +280,9 @@ class MethodBuilder {
   ir::EncodedMethod* Encode();
 
   // Create a new register to be used to storing values. Note that these are not SSA registers, like
-  // might be expected in similar code generators. This does no liveness tracking or anything, so
-  // it's up to the caller to reuse registers as appropriate.
+  // might be expected in similar code generators. Encode assigns registers whose live ranges don't
+  // overlap to the same DEX register, so callers don't need to reuse registers to keep the frame
+  // small.
   Value MakeRegister();
 
   Value MakeLabel();
@@ -309,6 +310,13 @@ class MethodBuilder {
   void EncodeInstructions();
   void EncodeInstruction(const Instruction& instruction);
 
+  // Maps the registers made by MakeRegister to DEX registers, sharing DEX registers between
+  // registers that are never live at the same time.
+  void AllocateRegisters();
+  // Removes instructions that load a constant into a register that already holds it on every path
+  // to the instruction.
+  void RemoveRedundantConstants();
+
   // Encodes a return instruction. For instructions with no return value, the opcode field is
   // ignored. Otherwise, this specifies which return instruction will be used (return,
   // return-object, etc.)
@@ -393,6 +401,9 @@ class MethodBuilder {
     return regs;
   }
 
+  // Returns, for each label, whether some branch after the label is bound jumps back to it.
+  std::vector<bool> FindLoopHeaders() const;
+
   // Converts a register or parameter to its DEX register number.
   size_t RegisterValue(const Value& value) const;
 
@@ -421,6 +432,11 @@ class MethodBuilder {
   // How many registers we've allocated
   size_t num_registers_{0};
 
+  // The DEX register for each register, including the scratch registers, and how many DEX registers
+  // they take up, not counting the scratch registers. Filled in by AllocateRegisters.
+  std::vector<size_t> register_map_;
+  size_t num_dex_registers_{0};
+
   // Stores information needed to back-patch a label once it is bound. We need to know the start of
   // the instruction that refers to the label, and the offset to where the actual label value should
   // go.
@@ -15,6 +15,7 @@
  */
 
 #include "dex_builder.h"
+#include "dex_layout_compiler.h"
 
 #include "dex/art_dex_file_loader.h"
 #include "dex/dex_file.h"
@@ -178,3 +179,174 @@ TEST(DexBuilderTest, VerifyDexCallManyRegisters) {
 
   EXPECT_TRUE(EncodeAndVerify(&dex_file));
 }
+
+// Write out and verify a DEX file that corresponds to:
+//
+// package dextest;
+// public class DexTest {
+//     public static int foo() {
+//       String s0 = "foo0"; ... String s19 = "foo19";
+//       s0.length(); ... s18.length();
+//       return s19.length();
+//     }
+// }
+TEST(DexBuilderTest, VerifyDexCallManyLiveRegisters) {
+  DexBuilder dex_file;
+
+  auto cbuilder{dex_file.MakeClass("dextest.DexTest")};
+
+  MethodBuilder method{cbuilder.CreateMethod("foo", Prototype{TypeDescriptor::Int()})};
+
+  MethodDeclData string_length =
+      dex_file.GetOrDeclareMethod(TypeDescriptor::FromClassname("java.lang.String"),
+                                  "length",
+                                  Prototype{TypeDescriptor::Int()});
+
+  // All of the strings are live at the same time, so the later ones need registers that are too
+  // big for the short invoke instruction.
+  std::vector<Value> strings;
+  for (size_t i = 0; i < 20; ++i) {
+    strings.push_back(method.MakeRegister());
+    method.BuildConstString(strings.back(), "foo" + std::to_string(i));
+  }
+  Value result = method.MakeRegister();
+  for (const Value& string_val : strings) {
+    method.AddInstruction(Instruction::InvokeVirtual(string_length.id, result, string_val));
+  }
+  method.BuildReturn(result);
+
+  ir::EncodedMethod* encoded = method.Encode();
+  EXPECT_LE(21u, encoded->code->registers);
+
+  EXPECT_TRUE(EncodeAndVerify(&dex_file));
+}
+
+// Registers that are never live at the same time share a DEX register.
+TEST(DexBuilderTest, ReuseRegisters) {
+  DexBuilder dex_file;
+
+  auto cbuilder{dex_file.MakeClass("dextest.DexTest")};
+
+  MethodBuilder method{cbuilder.CreateMethod("foo", Prototype{TypeDescriptor::Int()})};
+
+  MethodDeclData string_length =
+      dex_file.GetOrDeclareMethod(TypeDescriptor::FromClassname("java.lang.String"),
+                                  "length",
+                                  Prototype{TypeDescriptor::Int()});
+
+  Value result = method.MakeRegister();
+  for (size_t i = 0; i < 20; ++i) {
+    Value string_val = method.MakeRegister();
+    method.BuildConstString(string_val, "foo" + std::to_string(i));
+    method.AddInstruction(Instruction::InvokeVirtual(string_length.id, result, string_val));
+  }
+  method.BuildReturn(result);
+
+  ir::EncodedMethod* encoded = method.Encode();
+  // result, one string and the scratch registers.
+  EXPECT_EQ(7u, encoded->code->registers);
+
+  EXPECT_TRUE(EncodeAndVerify(&dex_file));
+}
+
+// Loading a constant into a register that already holds it on every path is left out.
+TEST(DexBuilderTest, RemoveRedundantConstants) {
+  DexBuilder dex_file;
+
+  auto cbuilder{dex_file.MakeClass("dextest.DexTest")};
+
+  MethodBuilder method{cbuilder.CreateMethod(
+      "foo", Prototype{TypeDescriptor::Int(), TypeDescriptor::Int()})};
+
+  Value five = method.MakeRegister();
+  Value label = method.MakeLabel();
+  method.BuildConst4(five, 5);
+  method.AddInstruction(Instruction::OpWithArgs(
+      Instruction::Op::kBranchEqz, /*dest=*/{}, Value::Parameter(0), label));
+  // Redundant, the register holds 5 already.
+  method.BuildConst4(five, 5);
+  method.AddInstruction(Instruction::OpWithArgs(Instruction::Op::kBindLabel, /*dest=*/{}, label));
+  // Redundant, the register holds 5 on both paths.
+  method.BuildConst4(five, 5);
+  method.BuildReturn(five);
+
+  ir::EncodedMethod* encoded = method.Encode();
+  // const/4, if-eqz and return.
+  EXPECT_EQ(4u, encoded->code->instructions.size());
+
+  EXPECT_TRUE(EncodeAndVerify(&dex_file));
+}
+
+// A register that holds different constants on the paths to a label is loaded again after it.
+TEST(DexBuilderTest, KeepConstantsThatDifferByPath) {
+  DexBuilder dex_file;
+
+  auto cbuilder{dex_file.MakeClass("dextest.DexTest")};
+
+  MethodBuilder method{cbuilder.CreateMethod(
+      "foo", Prototype{TypeDescriptor::Int(), TypeDescriptor::Int()})};
+
+  Value result = method.MakeRegister();
+  Value label = method.MakeLabel();
+  method.BuildConst4(result, 5);
+  method.AddInstruction(Instruction::OpWithArgs(
+      Instruction::Op::kBranchEqz, /*dest=*/{}, Value::Parameter(0), label));
+  method.BuildConst4(result, 6);
+  method.AddInstruction(Instruction::OpWithArgs(Instruction::Op::kBindLabel, /*dest=*/{}, label));
+  method.BuildConst4(result, 6);
+  method.BuildReturn(result);
+
+  ir::EncodedMethod* encoded = method.Encode();
+  // const/4, if-eqz, const/4, const/4 and return.
+  EXPECT_EQ(6u, encoded->code->instructions.size());
+
+  EXPECT_TRUE(EncodeAndVerify(&dex_file));
+}
+
+// Compiles a LinearLayout with many TextViews, and makes sure the view class names are only loaded
+// once and the views share registers.
+TEST(DexBuilderTest, CompileLayoutWithManyViews) {
+  DexBuilder dex_file;
+
+  auto cbuilder{dex_file.MakeClass("dextest.DexTest")};
+
+  MethodBuilder method{cbuilder.CreateMethod(
+      "foo",
+      Prototype{TypeDescriptor::FromClassname("android.view.View"),
+                TypeDescriptor::FromClassname("android.content.Context"),
+                TypeDescriptor::Int()})};
+  startop::DexViewBuilder builder{&method};
+  startop::LayoutCompilerVisitor visitor{&builder};
+  visitor.VisitStartDocument();
+  visitor.VisitStartTag(u"LinearLayout");
+  for (size_t i = 0; i < 20; ++i) {
+    visitor.VisitStartTag(u"TextView");
+    visitor.VisitEndTag();
+  }
+  visitor.VisitEndTag();
+  visitor.VisitEndDocument();
+
+  ir::EncodedMethod* encoded = method.Encode();
+  const ::dex::u2* code = encoded->code->instructions.begin();
+  const ::dex::u2* code_end = encoded->code->instructions.end();
+  size_t num_instructions = 0;
+  size_t num_const_strings = 0;
+  for (const ::dex::u2* pc = code; pc < code_end;
+       pc += art::Instruction::At(pc)->SizeInCodeUnits()) {
+    num_instructions++;
+    if (art::Instruction::At(pc)->Opcode() == art::Instruction::CONST_STRING) {
+      num_const_strings++;
+    }
+  }
+  RecordProperty("code_units", encoded->code->instructions.size());
+  RecordProperty("instructions", num_instructions);
+  RecordProperty("registers", encoded->code->registers);
+
+  // One for LinearLayout, and one for all of the TextViews.
+  EXPECT_EQ(2u, num_const_strings);
+  // The registers for the LayoutInflater, the XmlResourceParser, the AttributeSet, the class name,
+  // the root view, one child view and its LayoutParams, the scratch registers and the parameters.
+  EXPECT_EQ(7u + 5u + 2u, encoded->code->registers);
+
+  EXPECT_TRUE(EncodeAndVerify(&dex_file));
+}
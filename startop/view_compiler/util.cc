@@ -16,6 +16,11 @@
 
 #include "util.h"
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
 using std::string;
 
 namespace startop {
@@ -34,5 +39,25 @@ string FindLayoutNameFromFilename(const string& filename) {
   return filename.substr(start, end - start);
 }
 
+void ForEachInParallel(size_t count, size_t num_workers,
+                       const std::function<void(size_t worker, size_t i)>& fn) {
+  num_workers = std::max<size_t>(1, std::min(num_workers, count));
+  std::atomic<size_t> next{0};
+  auto work = [&](size_t worker) {
+    for (size_t i = next++; i < count; i = next++) {
+      fn(worker, i);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t worker = 1; worker < num_workers; worker++) {
+    threads.emplace_back(work, worker);
+  }
+  work(0);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
 }  // namespace util
 }  // namespace startop
@@ -16,6 +16,7 @@
 #ifndef VIEW_COMPILER_UTIL_H_
 #define VIEW_COMPILER_UTIL_H_
 
+#include <functional>
 #include <string>
 
 namespace startop {
@@ -23,6 +24,12 @@ namespace util {
 
 std::string FindLayoutNameFromFilename(const std::string& filename);
 
+// Calls fn(worker, i) for each i in [0, count), on up to num_workers threads including the calling
+// one, and returns once every call has returned. worker is below num_workers and identifies the
+// thread that makes the call, so that fn can keep state for each thread.
+void ForEachInParallel(size_t count, size_t num_workers,
+                       const std::function<void(size_t worker, size_t i)>& fn);
+
 }  // namespace util
 }  // namespace startop
 
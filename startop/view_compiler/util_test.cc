@@ -16,6 +16,9 @@
 
 #include "util.h"
 
+#include <atomic>
+#include <vector>
+
 #include "gtest/gtest.h"
 
 using std::string;
@@ -30,5 +33,23 @@ TEST(UtilTest, FindLayoutNameFromFilename) {
   EXPECT_EQ("bar", startop::util::FindLayoutNameFromFilename("/foo/bar.xml"));
 }
 
+TEST(UtilTest, ForEachInParallelCallsEachIndexOnce) {
+  for (size_t num_workers : {1, 3, 64}) {
+    std::vector<std::atomic<int>> calls(50);
+    std::atomic<bool> bad_worker{false};
+    ForEachInParallel(calls.size(), num_workers, [&](size_t worker, size_t i) {
+      if (worker >= num_workers) {
+        bad_worker = true;
+      }
+      calls[i]++;
+    });
+    EXPECT_FALSE(bad_worker);
+    for (const auto& count : calls) {
+      EXPECT_EQ(1, count);
+    }
+  }
+  ForEachInParallel(0, 4, [](size_t, size_t) { FAIL(); });
+}
+
 }  // namespace util
 }  // namespace startop
@@ -20,6 +20,8 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "android-base/macros.h"
 #include "androidfw/StringPiece.h"
@@ -150,6 +152,29 @@ class SourcePathDiagnostics : public IDiagnostics {
   DISALLOW_COPY_AND_ASSIGN(SourcePathDiagnostics);
 };
 
+// Holds on to every message logged to it, so that work running on another thread can report its
+// messages later without interleaving them with the output of other threads.
+class BufferedDiagnostics : public IDiagnostics {
+ public:
+  BufferedDiagnostics() = default;
+
+  void Log(Level level, DiagMessageActual& actual_msg) override {
+    messages_.emplace_back(level, actual_msg);
+  }
+
+  // Logs all the buffered messages to `diag`, in the order they were logged.
+  void Replay(IDiagnostics* diag) {
+    for (std::pair<Level, DiagMessageActual>& message : messages_) {
+      diag->Log(message.first, message.second);
+    }
+  }
+
+ private:
+  std::vector<std::pair<Level, DiagMessageActual>> messages_;
+
+  DISALLOW_COPY_AND_ASSIGN(BufferedDiagnostics);
+};
+
 }  // namespace aapt
 
 #endif /* AAPT_DIAGNOSTICS_H */
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Diagnostics.h"
+
+#include <string>
+#include <vector>
+
+#include "test/Test.h"
+
+namespace aapt {
+
+namespace {
+
+class RecordingDiagnostics : public IDiagnostics {
+ public:
+  void Log(Level level, DiagMessageActual& actual_msg) override {
+    levels.push_back(level);
+    messages.push_back(actual_msg.message);
+    paths.push_back(actual_msg.source.path);
+  }
+
+  std::vector<Level> levels;
+  std::vector<std::string> messages;
+  std::vector<std::string> paths;
+};
+
+}  // namespace
+
+TEST(BufferedDiagnosticsTest, ReplaysMessagesInOrder) {
+  BufferedDiagnostics buffered;
+  buffered.Note(DiagMessage("a.apk") << "loading");
+  buffered.Error(DiagMessage("a.apk") << "bad table");
+  buffered.Warn(DiagMessage() << "done");
+
+  RecordingDiagnostics recorded;
+  buffered.Replay(&recorded);
+
+  using Level = IDiagnostics::Level;
+  EXPECT_EQ((std::vector<Level>{Level::Note, Level::Error, Level::Warn}), recorded.levels);
+  EXPECT_EQ((std::vector<std::string>{"loading", "bad table", "done"}), recorded.messages);
+  EXPECT_EQ((std::vector<std::string>{"a.apk", "a.apk", ""}), recorded.paths);
+}
+
+TEST(BufferedDiagnosticsTest, LogsNothingUntilReplayed) {
+  RecordingDiagnostics recorded;
+  {
+    BufferedDiagnostics buffered;
+    buffered.Error(DiagMessage() << "dropped");
+  }
+  EXPECT_TRUE(recorded.messages.empty());
+}
+
+}  // namespace aapt
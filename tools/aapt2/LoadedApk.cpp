@@ -72,7 +72,31 @@ static ApkFormat DetermineApkFormat(io::IFileCollection* apk) {
   }
 }
 
-std::unique_ptr<LoadedApk> LoadedApk::LoadApkFromPath(const StringPiece& path, IDiagnostics* diag) {
+// Parses the binary resources.arsc of the collection, if it has one, into `out_table`.
+static bool ParseBinaryTable(const Source& source, io::IFileCollection* collection,
+                             IDiagnostics* diag, std::unique_ptr<ResourceTable>* out_table) {
+  io::IFile* table_file = collection->FindFile(kApkResourceTablePath);
+  if (table_file == nullptr) {
+    return true;
+  }
+
+  std::unique_ptr<ResourceTable> table =
+      util::make_unique<ResourceTable>(/** validate_resources **/ false);
+  std::unique_ptr<io::IData> data = table_file->OpenAsData();
+  if (data == nullptr) {
+    diag->Error(DiagMessage(source) << "failed to open " << kApkResourceTablePath);
+    return false;
+  }
+  BinaryResourceParser parser(diag, table.get(), source, data->data(), data->size(), collection);
+  if (!parser.Parse()) {
+    return false;
+  }
+  *out_table = std::move(table);
+  return true;
+}
+
+std::unique_ptr<LoadedApk> LoadedApk::LoadApkFromPath(const StringPiece& path, IDiagnostics* diag,
+                                                      bool defer_binary_table) {
   Source source(path);
   std::string error;
   std::unique_ptr<io::ZipFileCollection> apk = io::ZipFileCollection::Create(path, &error);
@@ -84,7 +108,7 @@ std::unique_ptr<LoadedApk> LoadedApk::LoadApkFromPath(const StringPiece& path, I
   ApkFormat apkFormat = DetermineApkFormat(apk.get());
   switch (apkFormat) {
     case ApkFormat::kBinary:
-      return LoadBinaryApkFromFileCollection(source, std::move(apk), diag);
+      return LoadBinaryApkFromFileCollection(source, std::move(apk), diag, defer_binary_table);
     case ApkFormat::kProto:
       return LoadProtoApkFromFileCollection(source, std::move(apk), diag);
     default:
@@ -152,22 +176,11 @@ std::unique_ptr<LoadedApk> LoadedApk::LoadProtoApkFromFileCollection(
 }
 
 std::unique_ptr<LoadedApk> LoadedApk::LoadBinaryApkFromFileCollection(
-    const Source& source, unique_ptr<io::IFileCollection> collection, IDiagnostics* diag) {
+    const Source& source, unique_ptr<io::IFileCollection> collection, IDiagnostics* diag,
+    bool defer_table) {
   std::unique_ptr<ResourceTable> table;
-
-  io::IFile* table_file = collection->FindFile(kApkResourceTablePath);
-  if (table_file != nullptr) {
-    table = util::make_unique<ResourceTable>(/** validate_resources **/ false);
-    std::unique_ptr<io::IData> data = table_file->OpenAsData();
-    if (data == nullptr) {
-      diag->Error(DiagMessage(source) << "failed to open " << kApkResourceTablePath);
-      return {};
-    }
-    BinaryResourceParser parser(diag, table.get(), source, data->data(), data->size(),
-                                collection.get());
-    if (!parser.Parse()) {
-      return {};
-    }
+  if (!defer_table && !ParseBinaryTable(source, collection.get(), diag, &table)) {
+    return {};
   }
 
   io::IFile* manifest_file = collection->FindFile(kAndroidManifestPath);
@@ -190,8 +203,45 @@ std::unique_ptr<LoadedApk> LoadedApk::LoadBinaryApkFromFileCollection(
                 << "failed to parse binary " << kAndroidManifestPath << ": " << error);
     return {};
   }
-  return util::make_unique<LoadedApk>(source, std::move(collection), std::move(table),
-                                      std::move(manifest), ApkFormat::kBinary);
+  auto apk = util::make_unique<LoadedApk>(source, std::move(collection), std::move(table),
+                                          std::move(manifest), ApkFormat::kBinary);
+  if (defer_table) {
+    apk->deferred_table_diag_ = diag;
+  }
+  return apk;
+}
+
+void LoadedApk::LoadDeferredTable() const {
+  if (deferred_table_diag_ == nullptr) {
+    return;
+  }
+
+  IDiagnostics* diag = deferred_table_diag_;
+  deferred_table_diag_ = nullptr;
+  ParseBinaryTable(source_, apk_.get(), diag, &table_);
+}
+
+std::unique_ptr<BinaryResourceTableView> LoadedApk::OpenBinaryTableView(IDiagnostics* diag) const {
+  if (format_ != ApkFormat::kBinary) {
+    return {};
+  }
+
+  io::IFile* table_file = apk_->FindFile(kApkResourceTablePath);
+  if (table_file == nullptr) {
+    return {};
+  }
+
+  std::unique_ptr<io::IData> data = table_file->OpenAsData();
+  if (data == nullptr) {
+    diag->Error(DiagMessage(source_) << "failed to open " << kApkResourceTablePath);
+    return {};
+  }
+
+  auto view = util::make_unique<BinaryResourceTableView>(diag, source_, std::move(data));
+  if (!view->Load()) {
+    return {};
+  }
+  return view;
 }
 
 bool LoadedApk::WriteToArchive(IAaptContext* context, const TableFlattenerOptions& options,
@@ -23,6 +23,7 @@
 #include "filter/Filter.h"
 #include "format/Archive.h"
 #include "format/binary/BinaryResourceParser.h"
+#include "format/binary/BinaryResourceTableView.h"
 #include "format/binary/TableFlattener.h"
 #include "io/ZipArchive.h"
 #include "xml/XmlDom.h"
@@ -44,9 +45,11 @@ class LoadedApk {
  public:
   virtual ~LoadedApk() = default;
 
-  // Loads both binary and proto APKs from disk.
+  // Loads both binary and proto APKs from disk. If `defer_binary_table` is true, the
+  // resources.arsc of a binary APK is not parsed until GetResourceTable() is first called.
   static std::unique_ptr<LoadedApk> LoadApkFromPath(const ::android::StringPiece& path,
-                                                    IDiagnostics* diag);
+                                                    IDiagnostics* diag,
+                                                    bool defer_binary_table = false);
 
   // Loads a proto APK from the given file collection.
   static std::unique_ptr<LoadedApk> LoadProtoApkFromFileCollection(
@@ -54,7 +57,8 @@ class LoadedApk {
 
   // Loads a binary APK from the given file collection.
   static std::unique_ptr<LoadedApk> LoadBinaryApkFromFileCollection(
-      const Source& source, std::unique_ptr<io::IFileCollection> collection, IDiagnostics* diag);
+      const Source& source, std::unique_ptr<io::IFileCollection> collection, IDiagnostics* diag,
+      bool defer_table = false);
 
   LoadedApk(const Source& source, std::unique_ptr<io::IFileCollection> apk,
             std::unique_ptr<ResourceTable> table, std::unique_ptr<xml::XmlResource> manifest,
@@ -75,13 +79,20 @@ class LoadedApk {
   }
 
   const ResourceTable* GetResourceTable() const {
+    LoadDeferredTable();
     return table_.get();
   }
 
   ResourceTable* GetResourceTable() {
+    LoadDeferredTable();
     return table_.get();
   }
 
+  // Opens a read-only view of the resources.arsc of a binary APK without building a
+  // ResourceTable. Stored tables are mmapped rather than copied. Returns nullptr for proto APKs,
+  // APKs without a resource table, or if the table is corrupt.
+  std::unique_ptr<BinaryResourceTableView> OpenBinaryTableView(IDiagnostics* diag) const;
+
   const Source& GetSource() {
     return source_;
   }
@@ -116,9 +127,16 @@ class LoadedApk {
  private:
   DISALLOW_COPY_AND_ASSIGN(LoadedApk);
 
+  // Parses the resource table if its loading was deferred.
+  void LoadDeferredTable() const;
+
   Source source_;
   std::unique_ptr<io::IFileCollection> apk_;
-  std::unique_ptr<ResourceTable> table_;
+  mutable std::unique_ptr<ResourceTable> table_;
+
+  // Set while the parsing of a binary resource table is deferred; the diagnostics errors are
+  // reported to once it is parsed.
+  mutable IDiagnostics* deferred_table_diag_ = nullptr;
   std::unique_ptr<xml::XmlResource> manifest_;
   ApkFormat format_;
 };
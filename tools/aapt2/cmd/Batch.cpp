@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Batch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "android-base/file.h"
+#include "android-base/parseint.h"
+#include "androidfw/StringPiece.h"
+
+#include "Diagnostics.h"
+#include "cmd/Compile.h"
+#include "cmd/Link.h"
+#include "process/SymbolTable.h"
+#include "trace/TraceBuffer.h"
+#include "util/TaskGraph.h"
+#include "util/Util.h"
+
+using ::android::StringPiece;
+
+namespace aapt {
+
+namespace {
+
+constexpr const char* kIdDirective = "@id ";
+constexpr const char* kDependsDirective = "@depends ";
+constexpr const char* kProfileFlag = "--profile";
+
+bool IsSupportedSubcommand(const std::string& name) {
+  return name == "compile" || name == "c" || name == "link" || name == "l";
+}
+
+std::unique_ptr<Command> CreateJobCommand(const std::string& name, IDiagnostics* diag) {
+  if (name == "compile" || name == "c") {
+    return util::make_unique<CompileCommand>(diag);
+  }
+  return util::make_unique<LinkCommand>(diag);
+}
+
+}  // namespace
+
+bool ParseBatchManifest(const std::string& contents, std::vector<BatchJob>* out_jobs,
+                        std::string* out_error) {
+  std::vector<BatchJob> jobs;
+  BatchJob job;
+  size_t line_number = 0;
+
+  auto finish_job = [&]() -> bool {
+    if (job.args.empty()) {
+      if (!job.id.empty() || !job.dependencies.empty()) {
+        *out_error = "line " + std::to_string(job.line) + ": job has no subcommand";
+        return false;
+      }
+      return true;
+    }
+
+    if (!IsSupportedSubcommand(job.args[0])) {
+      *out_error = "line " + std::to_string(job.line) + ": unsupported subcommand '" +
+                   job.args[0] + "'";
+      return false;
+    }
+
+    // The profiler is process wide, so jobs running at once would mix their phases and reset
+    // each other's stats.
+    if (std::find(job.args.begin(), job.args.end(), kProfileFlag) != job.args.end()) {
+      *out_error = "line " + std::to_string(job.line) + ": " + kProfileFlag +
+                   " is not supported in batch jobs";
+      return false;
+    }
+
+    if (job.id.empty()) {
+      job.id = "#" + std::to_string(jobs.size() + 1);
+    }
+    jobs.push_back(std::move(job));
+    job = BatchJob();
+    return true;
+  };
+
+  for (StringPiece line : util::Tokenize(contents, '\n')) {
+    line_number++;
+
+    // Arguments are used as they are, apart from the line ending.
+    if (!line.empty() && line.data()[line.size() - 1] == '\r') {
+      line = line.substr(0, line.size() - 1);
+    }
+
+    if (line.empty()) {
+      if (!finish_job()) {
+        return false;
+      }
+      continue;
+    }
+
+    if (job.line == 0) {
+      job.line = line_number;
+    }
+
+    if (!job.args.empty()) {
+      job.args.push_back(line.to_string());
+    } else if (util::StartsWith(line, "#")) {
+      // Comments are only recognized before the subcommand, where no argument can start.
+      continue;
+    } else if (util::StartsWith(line, kIdDirective)) {
+      if (!job.id.empty()) {
+        *out_error = "line " + std::to_string(line_number) + ": job already has an id";
+        return false;
+      }
+      job.id = util::TrimWhitespace(line.substr(strlen(kIdDirective))).to_string();
+    } else if (util::StartsWith(line, kDependsDirective)) {
+      for (StringPiece dependency : util::Tokenize(line.substr(strlen(kDependsDirective)), ' ')) {
+        dependency = util::TrimWhitespace(dependency);
+        if (!dependency.empty()) {
+          job.dependencies.push_back(dependency.to_string());
+        }
+      }
+    } else if (util::StartsWith(line, "@")) {
+      *out_error = "line " + std::to_string(line_number) + ": unknown directive '" +
+                   line.to_string() + "'";
+      return false;
+    } else {
+      job.args.push_back(line.to_string());
+    }
+  }
+
+  if (!finish_job()) {
+    return false;
+  }
+
+  std::map<std::string, size_t> ids;
+  for (const BatchJob& parsed_job : jobs) {
+    if (!ids.insert(std::make_pair(parsed_job.id, parsed_job.line)).second) {
+      *out_error = "line " + std::to_string(parsed_job.line) + ": duplicate job id '" +
+                   parsed_job.id + "'";
+      return false;
+    }
+  }
+
+  for (const BatchJob& parsed_job : jobs) {
+    for (const std::string& dependency : parsed_job.dependencies) {
+      if (ids.find(dependency) == ids.end()) {
+        *out_error = "line " + std::to_string(parsed_job.line) + ": job '" + parsed_job.id +
+                     "' depends on unknown job '" + dependency + "'";
+        return false;
+      }
+    }
+  }
+
+  *out_jobs = std::move(jobs);
+  return true;
+}
+
+int BatchCommand::Action(const std::vector<std::string>& args) {
+  TRACE_CALL();
+  if (args.size() != 1) {
+    diag_->Error(DiagMessage() << "must specify a single batch manifest");
+    Usage(&std::cerr);
+    return 1;
+  }
+
+  size_t num_threads = std::thread::hardware_concurrency();
+  if (jobs_) {
+    if (!android::base::ParseUint(jobs_.value(), &num_threads) || num_threads == 0) {
+      diag_->Error(DiagMessage() << "invalid number of jobs '" << jobs_.value() << "'");
+      return 1;
+    }
+  }
+  num_threads = std::max<size_t>(num_threads, 1u);
+
+  std::string contents;
+  if (!android::base::ReadFileToString(args[0], &contents)) {
+    diag_->Error(DiagMessage(args[0]) << "failed to read batch manifest");
+    return 1;
+  }
+
+  std::vector<BatchJob> jobs;
+  std::string error;
+  if (!ParseBatchManifest(contents, &jobs, &error)) {
+    diag_->Error(DiagMessage(args[0]) << error);
+    return 1;
+  }
+
+  // Jobs buffer their diagnostics and print them all at once when they finish.
+  std::mutex output_mutex;
+  auto run_job = [&](const BatchJob& job) -> bool {
+    TRACE_NAME("batch job " + job.id);
+    BufferedDiagnostics job_diag;
+    std::unique_ptr<Command> command = CreateJobCommand(job.args[0], &job_diag);
+    std::vector<StringPiece> job_args(job.args.begin() + 1, job.args.end());
+    std::stringstream usage;
+    const bool succeeded = command->Execute(job_args, &usage) == 0;
+
+    std::lock_guard<std::mutex> lock(output_mutex);
+    StdErrDiagnostics job_output;
+    job_diag.Replay(&job_output);
+    std::cerr << usage.str();
+    if (!succeeded) {
+      std::cerr << args[0] << ":" << job.line << ": error: job '" << job.id << "' failed."
+                << std::endl;
+    } else if (verbose_) {
+      std::cerr << "note: job '" << job.id << "' finished." << std::endl;
+    }
+    return succeeded;
+  };
+
+  TaskGraph graph;
+  std::map<std::string, size_t> tasks;
+  for (const BatchJob& job : jobs) {
+    tasks[job.id] = graph.AddTask([&run_job, &job]() { return run_job(job); });
+  }
+  for (const BatchJob& job : jobs) {
+    for (const std::string& dependency : job.dependencies) {
+      graph.AddDependency(tasks[job.id], tasks[dependency]);
+    }
+  }
+
+  if (graph.HasCycle()) {
+    diag_->Error(DiagMessage(args[0]) << "jobs have circular dependencies");
+    return 1;
+  }
+
+  // Every link of the batch sees the same include APKs, so load each of them once.
+  apk_assets_cache::SetEnabled(true);
+  std::vector<TaskGraph::Result> results = graph.Run(num_threads);
+  apk_assets_cache::SetEnabled(false);
+
+  size_t failed = 0;
+  for (size_t i = 0; i < jobs.size(); i++) {
+    if (results[i] == TaskGraph::Result::kSkipped) {
+      diag_->Error(DiagMessage(Source(args[0], jobs[i].line))
+                   << "job '" << jobs[i].id << "' skipped because a dependency failed");
+    }
+    if (results[i] != TaskGraph::Result::kSucceeded) {
+      failed++;
+    }
+  }
+
+  if (verbose_) {
+    diag_->Note(DiagMessage() << "ran " << jobs.size() << " jobs on " << num_threads
+                              << " threads, " << graph.GetStealCount() << " stolen");
+  }
+  return failed == 0 ? 0 : 1;
+}
+
+}  // namespace aapt
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AAPT2_BATCH_H
+#define AAPT2_BATCH_H
+
+#include <string>
+#include <vector>
+
+#include "Command.h"
+#include "Diagnostics.h"
+
+namespace aapt {
+
+// A single compile or link invocation of a batch manifest.
+struct BatchJob {
+  // Name used by other jobs to depend on this one. Defaults to "#<n>" for the n-th job.
+  std::string id;
+  std::vector<std::string> dependencies;
+
+  // The subcommand followed by its arguments, exactly as they would be passed to aapt2.
+  std::vector<std::string> args;
+
+  // Line of the manifest the job starts on.
+  size_t line = 0;
+};
+
+// Parses a batch manifest. Like the input of the daemon command, each job is a list of lines, one
+// per argument, starting with the subcommand and ended by an empty line. Before the subcommand, a
+// job may name itself with an '@id <name>' line and list the jobs it needs the outputs of with
+// '@depends <name>...' lines. Lines starting with '#' before the subcommand are comments. Jobs
+// can't use --profile, since every job of the batch shares the profiler.
+bool ParseBatchManifest(const std::string& contents, std::vector<BatchJob>* out_jobs,
+                        std::string* out_error);
+
+class BatchCommand : public Command {
+ public:
+  explicit BatchCommand(IDiagnostics* diag) : Command("batch"), diag_(diag) {
+    SetDescription("Runs the compile and link jobs of a batch manifest in a single process.\n"
+        "Jobs run in parallel once their dependencies have finished, and include APKs are\n"
+        "loaded once and shared by every link. The outputs are the same as when running\n"
+        "each job as its own aapt2 invocation.");
+    AddOptionalFlag("-j", "Number of jobs to run at once. Defaults to the number of CPU cores.",
+                    &jobs_);
+    AddOptionalSwitch("-v", "Enables verbose logging", &verbose_);
+  }
+
+  int Action(const std::vector<std::string>& args) override;
+
+ private:
+  IDiagnostics* diag_;
+  Maybe<std::string> jobs_;
+  bool verbose_ = false;
+};
+
+}  // namespace aapt
+
+#endif  // AAPT2_BATCH_H
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Batch.h"
+
+#include "android-base/file.h"
+
+#include "LoadedApk.h"
+#include "test/Fixture.h"
+#include "test/Test.h"
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::HasSubstr;
+using ::testing::IsEmpty;
+using ::testing::Ne;
+
+namespace aapt {
+
+using BatchTest = CommandTestFixture;
+
+std::string JoinLines(const std::vector<std::string>& lines) {
+  std::string out;
+  for (const std::string& line : lines) {
+    out += line + "\n";
+  }
+  return out;
+}
+
+TEST(BatchManifestTest, ParsesJobs) {
+  std::vector<BatchJob> jobs;
+  std::string error;
+  ASSERT_TRUE(ParseBatchManifest(R"(# Compiles the library.
+@id lib
+compile
+--dir
+lib/res
+-o
+lib.flata
+
+@depends lib
+link
+-o
+app.apk
+lib.flata
+)", &jobs, &error)) << error;
+
+  ASSERT_THAT(jobs.size(), Eq(2u));
+  EXPECT_THAT(jobs[0].id, Eq("lib"));
+  EXPECT_THAT(jobs[0].dependencies, IsEmpty());
+  EXPECT_THAT(jobs[0].args, ElementsAre("compile", "--dir", "lib/res", "-o", "lib.flata"));
+  EXPECT_THAT(jobs[0].line, Eq(1u));
+
+  EXPECT_THAT(jobs[1].id, Eq("#2"));
+  EXPECT_THAT(jobs[1].dependencies, ElementsAre("lib"));
+  EXPECT_THAT(jobs[1].args, ElementsAre("link", "-o", "app.apk", "lib.flata"));
+  EXPECT_THAT(jobs[1].line, Eq(9u));
+}
+
+TEST(BatchManifestTest, RejectsUnknownDependency) {
+  std::vector<BatchJob> jobs;
+  std::string error;
+  EXPECT_FALSE(ParseBatchManifest("@depends missing\nlink\n-o\napp.apk\n", &jobs, &error));
+  EXPECT_THAT(error, HasSubstr("unknown job 'missing'"));
+}
+
+TEST(BatchManifestTest, RejectsUnsupportedSubcommand) {
+  std::vector<BatchJob> jobs;
+  std::string error;
+  EXPECT_FALSE(ParseBatchManifest("dump\nstrings\napp.apk\n", &jobs, &error));
+  EXPECT_THAT(error, HasSubstr("unsupported subcommand 'dump'"));
+}
+
+TEST(BatchManifestTest, RejectsDuplicateIds) {
+  std::vector<BatchJob> jobs;
+  std::string error;
+  EXPECT_FALSE(ParseBatchManifest("@id a\ncompile\n\n@id a\ncompile\n", &jobs, &error));
+  EXPECT_THAT(error, HasSubstr("duplicate job id 'a'"));
+}
+
+TEST(BatchManifestTest, RejectsProfiledJobs) {
+  std::vector<BatchJob> jobs;
+  std::string error;
+  EXPECT_FALSE(ParseBatchManifest("compile\n--profile\nprofile.txt\n", &jobs, &error));
+  EXPECT_THAT(error, HasSubstr("line 1: --profile is not supported in batch jobs"));
+}
+
+TEST_F(BatchTest, CompilesAndLinksInDependencyOrder) {
+  const std::string values = GetTestPath("res/values/values.xml");
+  ASSERT_TRUE(WriteFile(values, R"(
+      <resources>
+        <string name="hello">Hello</string>
+      </resources>)"));
+
+  const std::string flat_dir = GetTestPath("flat");
+  ASSERT_TRUE(file::mkdirs(flat_dir));
+  const std::string flat_file = file::BuildPath({flat_dir, "values_values.arsc.flat"});
+  const std::string out_apk = GetTestPath("out.apk");
+  const std::string android_sdk = file::BuildPath({android::base::GetExecutableDirectory(),
+                                                   "integration-tests", "CommandTests",
+                                                   "android-28.jar"});
+
+  const std::string manifest = GetTestPath("batch.txt");
+  ASSERT_TRUE(WriteFile(manifest, JoinLines({
+      "@id compile", "compile", values, "-o", flat_dir, "",
+      "@depends compile", "link", "-o", out_apk, "--manifest", GetDefaultManifest(),
+      "-I", android_sdk, flat_file})));
+
+  StdErrDiagnostics diag;
+  ASSERT_THAT(BatchCommand(&diag).Execute({"-j", "2", manifest}, &std::cerr), Eq(0));
+
+  std::unique_ptr<LoadedApk> apk = LoadedApk::LoadApkFromPath(out_apk, &diag);
+  ASSERT_THAT(apk, Ne(nullptr));
+  EXPECT_THAT(test::GetValue<String>(apk->GetResourceTable(),
+                                     "com.aapt.command.test:string/hello"),
+              Ne(nullptr));
+}
+
+TEST_F(BatchTest, SkipsJobsWhoseDependencyFailed) {
+  const std::string out_apk = GetTestPath("out.apk");
+  const std::string manifest = GetTestPath("batch.txt");
+  ASSERT_TRUE(WriteFile(manifest, JoinLines({
+      "@id compile", "compile", GetTestPath("missing.xml"), "-o", GetTestPath("flat"), "",
+      "@depends compile", "link", "-o", out_apk, "--manifest", GetDefaultManifest()})));
+
+  StdErrDiagnostics diag;
+  EXPECT_THAT(BatchCommand(&diag).Execute({manifest}, &std::cerr), Ne(0));
+  EXPECT_FALSE(file::GetFileType(out_apk) == file::FileType::kRegular);
+}
+
+}  // namespace aapt
@@ -45,6 +45,7 @@
 #include "io/StringStream.h"
 #include "io/Util.h"
 #include "io/ZipArchive.h"
+#include "trace/Profiler.h"
 #include "trace/TraceBuffer.h"
 #include "util/Files.h"
 #include "util/Maybe.h"
@@ -139,6 +140,15 @@ static std::string BuildIntermediateContainerFilename(const ResourcePathData& da
   return name.str();
 }
 
+// Opens a resource file for parsing. Files are mapped when possible so that the XML parser reads
+// them in place instead of through the small copy buffer of a FileInputStream.
+static std::unique_ptr<io::InputStream> OpenForParsing(io::IFile* file) {
+  if (std::unique_ptr<io::IData> data = file->OpenAsData()) {
+    return std::move(data);
+  }
+  return file->OpenInputStream();
+}
+
 static bool CompileTable(IAaptContext* context, const CompileOptions& options,
                          const ResourcePathData& path_data, io::IFile* file, IArchiveWriter* writer,
                          const std::string& output_path) {
@@ -147,7 +157,7 @@ static bool CompileTable(IAaptContext* context, const CompileOptions& options,
   bool translatable_file = path_data.name.find("donottranslate") != 0;
   ResourceTable table;
   {
-    auto fin = file->OpenInputStream();
+    auto fin = OpenForParsing(file);
     if (fin->HadError()) {
       context->GetDiagnostics()->Error(DiagMessage(path_data.source)
           << "failed to open file: " << fin->GetError());
@@ -194,29 +204,34 @@ static bool CompileTable(IAaptContext* context, const CompileOptions& options,
     }
   }
 
-  // Create the file/zip entry.
-  if (!writer->StartEntry(output_path, 0)) {
-    context->GetDiagnostics()->Error(DiagMessage(output_path) << "failed to open");
-    return false;
-  }
-
-  // Make sure CopyingOutputStreamAdaptor is deleted before we call writer->FinishEntry().
   {
-    // Wrap our IArchiveWriter with an adaptor that implements the ZeroCopyOutputStream interface.
-    CopyingOutputStreamAdaptor copying_adaptor(writer);
-    ContainerWriter container_writer(&copying_adaptor, 1u);
+    PROFILE_PHASE(ProfilePhase::kFlatten);
 
-    pb::ResourceTable pb_table;
-    SerializeTableToPb(table, &pb_table, context->GetDiagnostics());
-    if (!container_writer.AddResTableEntry(pb_table)) {
-      context->GetDiagnostics()->Error(DiagMessage(output_path) << "failed to write");
+    // Create the file/zip entry.
+    if (!writer->StartEntry(output_path, 0)) {
+      context->GetDiagnostics()->Error(DiagMessage(output_path) << "failed to open");
       return false;
     }
-  }
 
-  if (!writer->FinishEntry()) {
-    context->GetDiagnostics()->Error(DiagMessage(output_path) << "failed to finish entry");
-    return false;
+    // Make sure CopyingOutputStreamAdaptor is deleted before we call writer->FinishEntry().
+    {
+      // Wrap our IArchiveWriter with an adaptor that implements the ZeroCopyOutputStream
+      // interface.
+      CopyingOutputStreamAdaptor copying_adaptor(writer);
+      ContainerWriter container_writer(&copying_adaptor, 1u);
+
+      pb::ResourceTable pb_table;
+      SerializeTableToPb(table, &pb_table, context->GetDiagnostics());
+      if (!container_writer.AddResTableEntry(pb_table)) {
+        context->GetDiagnostics()->Error(DiagMessage(output_path) << "failed to write");
+        return false;
+      }
+    }
+
+    if (!writer->FinishEntry()) {
+      context->GetDiagnostics()->Error(DiagMessage(output_path) << "failed to finish entry");
+      return false;
+    }
   }
 
   if (options.generate_text_symbols_path) {
@@ -289,6 +304,7 @@ static bool WriteHeaderAndDataToWriter(const StringPiece& output_path, const Res
                                        io::KnownSizeInputStream* in, IArchiveWriter* writer,
                                        IDiagnostics* diag) {
   TRACE_CALL();
+  PROFILE_PHASE(ProfilePhase::kWrite);
   // Start the entry so we can write the header.
   if (!writer->StartEntry(output_path, 0)) {
     diag->Error(DiagMessage(output_path) << "failed to open file");
@@ -319,6 +335,7 @@ static bool WriteHeaderAndDataToWriter(const StringPiece& output_path, const Res
 
 static bool FlattenXmlToOutStream(const StringPiece& output_path, const xml::XmlResource& xmlres,
                                   ContainerWriter* container_writer, IDiagnostics* diag) {
+  PROFILE_PHASE(ProfilePhase::kFlatten);
   pb::internal::CompiledFile pb_compiled_file;
   SerializeCompiledFileToPb(xmlres.file, &pb_compiled_file);
 
@@ -362,7 +379,7 @@ static bool CompileXml(IAaptContext* context, const CompileOptions& options,
 
   std::unique_ptr<xml::XmlResource> xmlres;
   {
-    auto fin = file->OpenInputStream();
+    auto fin = OpenForParsing(file);
     if (fin->HadError()) {
       context->GetDiagnostics()->Error(DiagMessage(path_data.source)
                                        << "failed to open file: " << fin->GetError());
@@ -514,8 +531,11 @@ static bool CompilePng(IAaptContext* context, const CompileOptions& options,
     }
 
     // Write the crunched PNG.
-    if (!WritePng(context, image.get(), nine_patch.get(), &crunched_png_buffer_out, {})) {
-      return false;
+    {
+      PROFILE_PHASE(ProfilePhase::kCompress);
+      if (!WritePng(context, image.get(), nine_patch.get(), &crunched_png_buffer_out, {})) {
+        return false;
+      }
     }
 
     if (nine_patch != nullptr ||
@@ -703,6 +723,8 @@ int Compile(IAaptContext* context, io::IFileCollection* inputs, IArchiveWriter*
       continue;
     }
 
+    // Everything not attributed to a more specific phase is parsing of this input file.
+    PROFILE_PHASE_FILE(ProfilePhase::kParse, path);
     const std::string out_path = BuildIntermediateContainerFilename(path_data);
     if (!compile_func(context, options, path_data, file, output_writer, out_path)) {
       context->GetDiagnostics()->Error(DiagMessage(file->GetSource()) << "file failed to compile");
@@ -715,6 +737,7 @@ int Compile(IAaptContext* context, io::IFileCollection* inputs, IArchiveWriter*
 
 int CompileCommand::Action(const std::vector<std::string>& args) {
   TRACE_FLUSH(trace_folder_? trace_folder_.value() : "", "CompileCommand::Action");
+  PROFILE_FLUSH(profile_path_ ? profile_path_.value() : "");
   CompileContext context(diagnostic_);
   context.SetVerbose(options_.verbose);
 
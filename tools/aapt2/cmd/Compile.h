@@ -62,6 +62,10 @@ class CompileCommand : public Command {
     AddOptionalSwitch("-v", "Enables verbose logging", &options_.verbose);
     AddOptionalFlag("--trace-folder", "Generate systrace json trace fragment to specified folder.",
                     &trace_folder_);
+    AddOptionalFlag("--profile",
+        "Prints a per-phase time, allocation and output size breakdown and writes\n"
+            "a Chrome trace json of every phase and input file to the specified path.",
+        &profile_path_, Command::kPath);
   }
 
   int Action(const std::vector<std::string>& args) override;
@@ -71,6 +75,7 @@ class CompileCommand : public Command {
   CompileOptions options_;
   Maybe<std::string> visibility_;
   Maybe<std::string> trace_folder_;
+  Maybe<std::string> profile_path_;
 };
 
 int Compile(IAaptContext* context, io::IFileCollection* inputs, IArchiveWriter* output_writer,
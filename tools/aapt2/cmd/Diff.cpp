@@ -16,20 +16,30 @@
 
 #include "Diff.h"
 
+#include <algorithm>
+#include <map>
+#include <set>
+#include <thread>
+#include <utility>
+
 #include "android-base/macros.h"
 
 #include "LoadedApk.h"
 #include "ValueVisitor.h"
+#include "format/binary/BinaryResourceTableView.h"
 #include "process/IResourceTableConsumer.h"
 #include "process/SymbolTable.h"
+#include "util/Util.h"
 
+using ::android::ConfigDescription;
+using ::android::ResTable_type;
 using ::android::StringPiece;
 
 namespace aapt {
 
 class DiffContext : public IAaptContext {
  public:
-  DiffContext() : name_mangler_({}), symbol_table_(&name_mangler_) {
+  explicit DiffContext(bool json) : json_(json), name_mangler_({}), symbol_table_(&name_mangler_) {
   }
 
   PackageType GetPackageType() override {
@@ -65,15 +75,83 @@ class DiffContext : public IAaptContext {
     return 0;
   }
 
+  // Reports a single difference. `kind` and `resource` identify the difference for machine
+  // readable output; `message` is what is printed in the human readable form.
+  void EmitDiff(const Source& source, const StringPiece& kind, const std::string& resource,
+                const std::string& config, const std::string& message) {
+    if (!json_) {
+      std::cerr << source << ": " << message << "\n";
+      return;
+    }
+
+    std::stringstream source_stream;
+    source_stream << source;
+    std::cout << "{\"source\": \"" << util::EscapeJson(source_stream.str())
+              << "\", \"kind\": \"" << util::EscapeJson(kind)
+              << "\", \"resource\": \"" << util::EscapeJson(resource)
+              << "\", \"config\": \"" << util::EscapeJson(config)
+              << "\", \"message\": \"" << util::EscapeJson(message) << "\"}\n";
+  }
+
+  // Records that every chunk of the type `type_id` is the same in both tables.
+  void AddIdenticalType(const ResourceId& type_id) {
+    identical_types_.insert(type_id);
+  }
+
+  // Records that the chunks of the type `type_id` in `config` are the same in both tables.
+  void AddIdenticalConfig(const ResourceId& type_id, const ConfigDescription& config) {
+    identical_configs_.emplace(type_id, config);
+  }
+
+  // Whether none of the entries of the two types can differ, because they are stored the same.
+  bool IsTypeIdentical(const ResourceTablePackage* pkg_a, const ResourceTableType* type_a,
+                       const ResourceTablePackage* pkg_b, const ResourceTableType* type_b) const {
+    Maybe<ResourceId> type_id = GetSharedTypeId(pkg_a, type_a, pkg_b, type_b);
+    return type_id && identical_types_.count(type_id.value()) != 0;
+  }
+
+  // Whether none of the values of the two types in `config` can differ.
+  bool IsConfigIdentical(const ResourceTablePackage* pkg_a, const ResourceTableType* type_a,
+                         const ResourceTablePackage* pkg_b, const ResourceTableType* type_b,
+                         const ConfigDescription& config) const {
+    Maybe<ResourceId> type_id = GetSharedTypeId(pkg_a, type_a, pkg_b, type_b);
+    return type_id && identical_configs_.count(std::make_pair(type_id.value(), config)) != 0;
+  }
+
  private:
+  // The chunks are keyed by id, so only types with the same package and type id in both tables
+  // can be looked up.
+  static Maybe<ResourceId> GetSharedTypeId(const ResourceTablePackage* pkg_a,
+                                           const ResourceTableType* type_a,
+                                           const ResourceTablePackage* pkg_b,
+                                           const ResourceTableType* type_b) {
+    if (!pkg_a->id || pkg_a->id != pkg_b->id || !type_a->id || type_a->id != type_b->id) {
+      return {};
+    }
+    return ResourceId(pkg_a->id.value(), type_a->id.value(), 0);
+  }
+
+  bool json_;
   std::string empty_;
   StdErrDiagnostics diagnostics_;
   NameMangler name_mangler_;
   SymbolTable symbol_table_;
+  std::set<ResourceId> identical_types_;
+  std::set<std::pair<ResourceId, ConfigDescription>> identical_configs_;
 };
 
-static void EmitDiffLine(const Source& source, const StringPiece& message) {
-  std::cerr << source << ": " << message << "\n";
+static std::string FormatName(const ResourceTablePackage* pkg,
+                              const ResourceTableType* type = nullptr,
+                              const ResourceEntry* entry = nullptr) {
+  std::stringstream str_stream;
+  str_stream << pkg->name;
+  if (type) {
+    str_stream << ":" << type->type;
+  }
+  if (entry) {
+    str_stream << "/" << entry->name;
+  }
+  return str_stream.str();
 }
 
 static bool IsSymbolVisibilityDifferent(const Visibility& vis_a, const Visibility& vis_b) {
@@ -89,12 +167,16 @@ static bool IsIdDiff(const Visibility::Level& level_a, const Maybe<Id>& id_a,
   return false;
 }
 
-static bool EmitResourceConfigValueDiff(IAaptContext* context, LoadedApk* apk_a,
+static bool EmitResourceConfigValueDiff(DiffContext* context, LoadedApk* apk_a,
                                         ResourceTablePackage* pkg_a, ResourceTableType* type_a,
                                         ResourceEntry* entry_a, ResourceConfigValue* config_value_a,
                                         LoadedApk* apk_b, ResourceTablePackage* pkg_b,
                                         ResourceTableType* type_b, ResourceEntry* entry_b,
                                         ResourceConfigValue* config_value_b) {
+  if (context->IsConfigIdentical(pkg_a, type_a, pkg_b, type_b, config_value_a->config)) {
+    return false;
+  }
+
   Value* value_a = config_value_a->value.get();
   Value* value_b = config_value_b->value.get();
   if (!value_a->Equals(value_b)) {
@@ -104,13 +186,14 @@ static bool EmitResourceConfigValueDiff(IAaptContext* context, LoadedApk* apk_a,
     value_a->Print(&str_stream);
     str_stream << "\n vs \n";
     value_b->Print(&str_stream);
-    EmitDiffLine(apk_b->GetSource(), str_stream.str());
+    context->EmitDiff(apk_b->GetSource(), "value", FormatName(pkg_a, type_a, entry_a),
+                      config_value_a->config.to_string(), str_stream.str());
     return true;
   }
   return false;
 }
 
-static bool EmitResourceEntryDiff(IAaptContext* context, LoadedApk* apk_a,
+static bool EmitResourceEntryDiff(DiffContext* context, LoadedApk* apk_a,
                                   ResourceTablePackage* pkg_a, ResourceTableType* type_a,
                                   ResourceEntry* entry_a, LoadedApk* apk_b,
                                   ResourceTablePackage* pkg_b, ResourceTableType* type_b,
@@ -122,7 +205,8 @@ static bool EmitResourceEntryDiff(IAaptContext* context, LoadedApk* apk_a,
       std::stringstream str_stream;
       str_stream << "missing " << pkg_a->name << ":" << type_a->type << "/" << entry_a->name
                  << " config=" << config_value_a->config;
-      EmitDiffLine(apk_b->GetSource(), str_stream.str());
+      context->EmitDiff(apk_b->GetSource(), "missing-config", FormatName(pkg_a, type_a, entry_a),
+                        config_value_a->config.to_string(), str_stream.str());
       diff = true;
     } else {
       diff |=
@@ -138,14 +222,15 @@ static bool EmitResourceEntryDiff(IAaptContext* context, LoadedApk* apk_a,
       std::stringstream str_stream;
       str_stream << "new config " << pkg_b->name << ":" << type_b->type << "/" << entry_b->name
                  << " config=" << config_value_b->config;
-      EmitDiffLine(apk_b->GetSource(), str_stream.str());
+      context->EmitDiff(apk_b->GetSource(), "new-config", FormatName(pkg_b, type_b, entry_b),
+                        config_value_b->config.to_string(), str_stream.str());
       diff = true;
     }
   }
   return false;
 }
 
-static bool EmitResourceTypeDiff(IAaptContext* context, LoadedApk* apk_a,
+static bool EmitResourceTypeDiff(DiffContext* context, LoadedApk* apk_a,
                                  ResourceTablePackage* pkg_a, ResourceTableType* type_a,
                                  LoadedApk* apk_b, ResourceTablePackage* pkg_b,
                                  ResourceTableType* type_b) {
@@ -155,7 +240,8 @@ static bool EmitResourceTypeDiff(IAaptContext* context, LoadedApk* apk_a,
     if (!entry_b) {
       std::stringstream str_stream;
       str_stream << "missing " << pkg_a->name << ":" << type_a->type << "/" << entry_a->name;
-      EmitDiffLine(apk_b->GetSource(), str_stream.str());
+      context->EmitDiff(apk_b->GetSource(), "missing", FormatName(pkg_a, type_a, entry_a.get()), {},
+                        str_stream.str());
       diff = true;
     } else {
       if (IsSymbolVisibilityDifferent(entry_a->visibility, entry_b->visibility)) {
@@ -174,7 +260,8 @@ static bool EmitResourceTypeDiff(IAaptContext* context, LoadedApk* apk_a,
           str_stream << "PRIVATE";
         }
         str_stream << ")";
-        EmitDiffLine(apk_b->GetSource(), str_stream.str());
+        context->EmitDiff(apk_b->GetSource(), "visibility",
+                          FormatName(pkg_a, type_a, entry_a.get()), {}, str_stream.str());
         diff = true;
       } else if (IsIdDiff(entry_a->visibility.level, entry_a->id, entry_b->visibility.level,
                           entry_b->id)) {
@@ -193,7 +280,8 @@ static bool EmitResourceTypeDiff(IAaptContext* context, LoadedApk* apk_a,
           str_stream << "none";
         }
         str_stream << ")";
-        EmitDiffLine(apk_b->GetSource(), str_stream.str());
+        context->EmitDiff(apk_b->GetSource(), "id", FormatName(pkg_a, type_a, entry_a.get()), {},
+                          str_stream.str());
         diff = true;
       }
       diff |= EmitResourceEntryDiff(context, apk_a, pkg_a, type_a, entry_a.get(), apk_b, pkg_b,
@@ -207,14 +295,15 @@ static bool EmitResourceTypeDiff(IAaptContext* context, LoadedApk* apk_a,
     if (!entry_a) {
       std::stringstream str_stream;
       str_stream << "new entry " << pkg_b->name << ":" << type_b->type << "/" << entry_b->name;
-      EmitDiffLine(apk_b->GetSource(), str_stream.str());
+      context->EmitDiff(apk_b->GetSource(), "new", FormatName(pkg_b, type_b, entry_b.get()), {},
+                        str_stream.str());
       diff = true;
     }
   }
   return diff;
 }
 
-static bool EmitResourcePackageDiff(IAaptContext* context, LoadedApk* apk_a,
+static bool EmitResourcePackageDiff(DiffContext* context, LoadedApk* apk_a,
                                     ResourceTablePackage* pkg_a, LoadedApk* apk_b,
                                     ResourceTablePackage* pkg_b) {
   bool diff = false;
@@ -223,7 +312,8 @@ static bool EmitResourcePackageDiff(IAaptContext* context, LoadedApk* apk_a,
     if (!type_b) {
       std::stringstream str_stream;
       str_stream << "missing " << pkg_a->name << ":" << type_a->type;
-      EmitDiffLine(apk_a->GetSource(), str_stream.str());
+      context->EmitDiff(apk_a->GetSource(), "missing", FormatName(pkg_a, type_a.get()), {},
+                        str_stream.str());
       diff = true;
     } else {
       if (type_a->visibility_level != type_b->visibility_level) {
@@ -241,7 +331,8 @@ static bool EmitResourcePackageDiff(IAaptContext* context, LoadedApk* apk_a,
           str_stream << "PRIVATE";
         }
         str_stream << ")";
-        EmitDiffLine(apk_b->GetSource(), str_stream.str());
+        context->EmitDiff(apk_b->GetSource(), "visibility", FormatName(pkg_a, type_a.get()), {},
+                          str_stream.str());
         diff = true;
       } else if (IsIdDiff(type_a->visibility_level, type_a->id, type_b->visibility_level,
                           type_b->id)) {
@@ -259,10 +350,13 @@ static bool EmitResourcePackageDiff(IAaptContext* context, LoadedApk* apk_a,
           str_stream << "none";
         }
         str_stream << ")";
-        EmitDiffLine(apk_b->GetSource(), str_stream.str());
+        context->EmitDiff(apk_b->GetSource(), "id", FormatName(pkg_a, type_a.get()), {},
+                          str_stream.str());
         diff = true;
       }
-      diff |= EmitResourceTypeDiff(context, apk_a, pkg_a, type_a.get(), apk_b, pkg_b, type_b);
+      if (!context->IsTypeIdentical(pkg_a, type_a.get(), pkg_b, type_b)) {
+        diff |= EmitResourceTypeDiff(context, apk_a, pkg_a, type_a.get(), apk_b, pkg_b, type_b);
+      }
     }
   }
 
@@ -272,14 +366,15 @@ static bool EmitResourcePackageDiff(IAaptContext* context, LoadedApk* apk_a,
     if (!type_a) {
       std::stringstream str_stream;
       str_stream << "new type " << pkg_b->name << ":" << type_b->type;
-      EmitDiffLine(apk_b->GetSource(), str_stream.str());
+      context->EmitDiff(apk_b->GetSource(), "new", FormatName(pkg_b, type_b.get()), {},
+                        str_stream.str());
       diff = true;
     }
   }
   return diff;
 }
 
-static bool EmitResourceTableDiff(IAaptContext* context, LoadedApk* apk_a, LoadedApk* apk_b) {
+static bool EmitResourceTableDiff(DiffContext* context, LoadedApk* apk_a, LoadedApk* apk_b) {
   ResourceTable* table_a = apk_a->GetResourceTable();
   ResourceTable* table_b = apk_b->GetResourceTable();
 
@@ -289,7 +384,8 @@ static bool EmitResourceTableDiff(IAaptContext* context, LoadedApk* apk_a, Loade
     if (!pkg_b) {
       std::stringstream str_stream;
       str_stream << "missing package " << pkg_a->name;
-      EmitDiffLine(apk_b->GetSource(), str_stream.str());
+      context->EmitDiff(apk_b->GetSource(), "missing", FormatName(pkg_a.get()), {},
+                        str_stream.str());
       diff = true;
     } else {
       if (pkg_a->id != pkg_b->id) {
@@ -307,7 +403,7 @@ static bool EmitResourceTableDiff(IAaptContext* context, LoadedApk* apk_a, Loade
           str_stream << "none";
         }
         str_stream << ")";
-        EmitDiffLine(apk_b->GetSource(), str_stream.str());
+        context->EmitDiff(apk_b->GetSource(), "id", FormatName(pkg_a.get()), {}, str_stream.str());
         diff = true;
       }
       diff |= EmitResourcePackageDiff(context, apk_a, pkg_a.get(), apk_b, pkg_b);
@@ -320,7 +416,7 @@ static bool EmitResourceTableDiff(IAaptContext* context, LoadedApk* apk_a, Loade
     if (!pkg_a) {
       std::stringstream str_stream;
       str_stream << "new package " << pkg_b->name;
-      EmitDiffLine(apk_b->GetSource(), str_stream.str());
+      context->EmitDiff(apk_b->GetSource(), "new", FormatName(pkg_b.get()), {}, str_stream.str());
       diff = true;
     }
   }
@@ -345,8 +441,92 @@ static void ZeroOutAppReferences(ResourceTable* table) {
   VisitAllValuesInTable(table, &visitor);
 }
 
+// An APK loaded for diffing, along with the diagnostics logged while loading it.
+struct DiffInput {
+  std::unique_ptr<LoadedApk> apk;
+  // The resources.arsc of a binary APK, which is stored uncompressed and so is mapped rather
+  // than read again.
+  std::unique_ptr<BinaryResourceTableView> table_view;
+  BufferedDiagnostics diag;
+};
+
+// Loads the APK. Safe to run concurrently for different inputs.
+static void LoadDiffInput(const std::string& path, DiffInput* out_input) {
+  out_input->apk = LoadedApk::LoadApkFromPath(path, &out_input->diag);
+  if (out_input->apk) {
+    // Zero out Application IDs in references.
+    ZeroOutAppReferences(out_input->apk->GetResourceTable());
+    out_input->table_view = out_input->apk->OpenBinaryTableView(&out_input->diag);
+  }
+}
+
+// Groups the ResTable_type chunks of a type by their configuration.
+static std::map<ConfigDescription, std::vector<const ResTable_type*>> GroupByConfig(
+    const std::vector<const ResTable_type*>& types) {
+  std::map<ConfigDescription, std::vector<const ResTable_type*>> configs;
+  for (const ResTable_type* type : types) {
+    ConfigDescription config;
+    config.copyFromDtoH(type->config);
+    configs[config].push_back(type);
+  }
+  return configs;
+}
+
+// Records in the context which types, and which configurations of types, are stored byte for byte
+// the same in both tables, along with the string pools they refer to. Comparing the chunks costs
+// far less than comparing their values one by one with Value::Equals.
+//
+// A reference is compared by the name of the resource it points to. That name can change without
+// changing the chunk that holds the reference, but then the chunks of the renamed resource differ
+// and the rename is reported there.
+static void FindIdenticalChunks(const BinaryResourceTableView& view_a,
+                                const BinaryResourceTableView& view_b, DiffContext* context) {
+  const std::map<ResourceId, BinaryResourceTableView::TypeChunks> types_b = view_b.GetTypeChunks();
+  std::map<uint8_t, bool> same_string_pools;
+  for (const auto& entry : view_a.GetTypeChunks()) {
+    const ResourceId& type_id = entry.first;
+    const BinaryResourceTableView::TypeChunks& chunks_a = entry.second;
+    auto iter_b = types_b.find(type_id);
+    if (iter_b == types_b.end()) {
+      continue;
+    }
+    const BinaryResourceTableView::TypeChunks& chunks_b = iter_b->second;
+
+    auto pools_iter = same_string_pools.find(type_id.package_id());
+    if (pools_iter == same_string_pools.end()) {
+      pools_iter = same_string_pools
+                       .emplace(type_id.package_id(),
+                                view_a.HasSameStringPools(view_b, type_id.package_id()))
+                       .first;
+    }
+    if (!pools_iter->second) {
+      continue;
+    }
+
+    const auto configs_a = GroupByConfig(chunks_a.types);
+    const auto configs_b = GroupByConfig(chunks_b.types);
+    bool type_identical = BinaryResourceTableView::ChunksEqual(chunks_a.spec, chunks_b.spec) &&
+                          configs_a.size() == configs_b.size();
+    for (const auto& config_a : configs_a) {
+      auto config_b = configs_b.find(config_a.first);
+      if (config_b != configs_b.end() &&
+          std::equal(config_a.second.begin(), config_a.second.end(), config_b->second.begin(),
+                     config_b->second.end(), [](const ResTable_type* a, const ResTable_type* b) {
+                       return BinaryResourceTableView::ChunksEqual(&a->header, &b->header);
+                     })) {
+        context->AddIdenticalConfig(type_id, config_a.first);
+      } else {
+        type_identical = false;
+      }
+    }
+    if (type_identical) {
+      context->AddIdenticalType(type_id);
+    }
+  }
+}
+
 int DiffCommand::Action(const std::vector<std::string>& args) {
-  DiffContext context;
+  DiffContext context(json_);
 
   if (args.size() != 2u) {
     std::cerr << "must have two apks as arguments.\n\n";
@@ -354,18 +534,25 @@ int DiffCommand::Action(const std::vector<std::string>& args) {
     return 1;
   }
 
-  IDiagnostics* diag = context.GetDiagnostics();
-  std::unique_ptr<LoadedApk> apk_a = LoadedApk::LoadApkFromPath(args[0], diag);
-  std::unique_ptr<LoadedApk> apk_b = LoadedApk::LoadApkFromPath(args[1], diag);
-  if (!apk_a || !apk_b) {
+  // Both APKs are loaded in parallel. Their diagnostics are buffered and logged afterwards, in
+  // the order of the arguments.
+  DiffInput input_a;
+  DiffInput input_b;
+  std::thread loader_b(LoadDiffInput, args[1], &input_b);
+  LoadDiffInput(args[0], &input_a);
+  loader_b.join();
+
+  input_a.diag.Replay(context.GetDiagnostics());
+  input_b.diag.Replay(context.GetDiagnostics());
+  if (!input_a.apk || !input_b.apk) {
     return 1;
   }
 
-  // Zero out Application IDs in references.
-  ZeroOutAppReferences(apk_a->GetResourceTable());
-  ZeroOutAppReferences(apk_b->GetResourceTable());
+  if (input_a.table_view && input_b.table_view) {
+    FindIdenticalChunks(*input_a.table_view, *input_b.table_view, &context);
+  }
 
-  if (EmitResourceTableDiff(&context, apk_a.get(), apk_b.get())) {
+  if (EmitResourceTableDiff(&context, input_a.apk.get(), input_b.apk.get())) {
     // We emitted a diff, so return 1 (failure).
     return 1;
   }
@@ -25,9 +25,16 @@ class DiffCommand : public Command {
  public:
   explicit DiffCommand() : Command("diff") {
     SetDescription("Prints the differences in resources of two apks.");
+    AddOptionalSwitch("--json",
+        "Prints each difference as a single line JSON object to stdout instead of\n"
+            "human readable text to stderr.",
+        &json_);
   }
 
   int Action(const std::vector<std::string>& args) override;
+
+ private:
+  bool json_ = false;
 };
 
 }// namespace aapt
@@ -220,6 +220,14 @@ int DumpBadgerCommand::Action(const std::vector<std::string>& args) {
 }
 
 int DumpConfigsCommand::Dump(LoadedApk* apk) {
+  // Binary tables can answer this from the type chunk headers alone.
+  if (std::unique_ptr<BinaryResourceTableView> view = apk->OpenBinaryTableView(GetDiagnostics())) {
+    for (const android::ConfigDescription& config : view->GetConfigurations()) {
+      GetPrinter()->Print(StringPrintf("%s\n", config.to_string().data()));
+    }
+    return 0;
+  }
+
   ResourceTable* table = apk->GetResourceTable();
   if (!table) {
     GetDiagnostics()->Error(DiagMessage() << "Failed to retrieve resource table");
@@ -261,6 +269,12 @@ int DumpPackageNameCommand::Dump(LoadedApk* apk) {
 }
 
 int DumpStringsCommand::Dump(LoadedApk* apk) {
+  // Print the string pool of a binary table directly from the (usually mmapped) APK entry.
+  if (std::unique_ptr<BinaryResourceTableView> view = apk->OpenBinaryTableView(GetDiagnostics())) {
+    Debug::DumpResStringPool(&view->GetValueStringPool(), GetPrinter());
+    return 0;
+  }
+
   ResourceTable* table = apk->GetResourceTable();
   if (!table) {
     GetDiagnostics()->Error(DiagMessage() << "Failed to retrieve resource table");
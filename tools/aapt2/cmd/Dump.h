@@ -69,7 +69,9 @@ class DumpApkCommand : public Command {
 
     bool error = false;
     for (auto apk : args) {
-      auto loaded_apk = LoadedApk::LoadApkFromPath(apk, diag_);
+      // Dump commands are read-only and many never look at the resource table, so only parse it
+      // when a command asks for it.
+      auto loaded_apk = LoadedApk::LoadApkFromPath(apk, diag_, /* defer_binary_table */ true);
       if (!loaded_apk) {
         error = true;
         continue;
@@ -67,6 +67,7 @@
 #include "process/IResourceTableConsumer.h"
 #include "process/SymbolTable.h"
 #include "split/TableSplitter.h"
+#include "trace/Profiler.h"
 #include "trace/TraceBuffer.h"
 #include "util/Files.h"
 #include "xml/XmlDom.h"
@@ -797,6 +798,7 @@ class Linker {
   // Pre-condition: context_->GetCompilationPackage() needs to be set.
   bool LoadSymbolsFromIncludePaths() {
     TRACE_NAME("LoadSymbolsFromIncludePaths: #" + std::to_string(options_.include_paths.size()));
+    PROFILE_PHASE(ProfilePhase::kParse);
     auto asset_source = util::make_unique<AssetManagerSymbolSource>();
     for (const std::string& path : options_.include_paths) {
       if (context_->IsVerbose()) {
@@ -1420,6 +1422,7 @@ class Linker {
   bool MergeFile(io::IFile* file, bool override) {
     TRACE_CALL();
     const Source& src = file->GetSource();
+    PROFILE_PHASE_FILE(ProfilePhase::kParse, src.path);
 
     if (util::EndsWith(src.path, ".xml") || util::EndsWith(src.path, ".png")) {
       // Since AAPT compiles these file types and appends .flat to them, seeing
@@ -2034,6 +2037,7 @@ class Linker {
 
 int LinkCommand::Action(const std::vector<std::string>& args) {
   TRACE_FLUSH(trace_folder_ ? trace_folder_.value() : "", "LinkCommand::Action");
+  PROFILE_FLUSH(profile_path_ ? profile_path_.value() : "");
   LinkContext context(diag_);
 
   // Expand all argument-files passed into the command line. These start with '@'.
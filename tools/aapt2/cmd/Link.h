@@ -280,6 +280,10 @@ class LinkCommand : public Command {
     AddOptionalSwitch("-v", "Enables verbose logging.", &verbose_);
     AddOptionalFlag("--trace-folder", "Generate systrace json trace fragment to specified folder.",
                     &trace_folder_);
+    AddOptionalFlag("--profile",
+        "Prints a per-phase time, allocation and output size breakdown and writes\n"
+            "a Chrome trace json of every phase and input file to the specified path.",
+        &profile_path_, Command::kPath);
   }
 
   int Action(const std::vector<std::string>& args) override;
@@ -304,6 +308,7 @@ class LinkCommand : public Command {
   Maybe<std::string> stable_id_file_path_;
   std::vector<std::string> split_args_;
   Maybe<std::string> trace_folder_;
+  Maybe<std::string> profile_path_;
 };
 
 }// namespace aapt
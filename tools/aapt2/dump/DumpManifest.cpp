@@ -21,6 +21,7 @@
 #include "LoadedApk.h"
 #include "SdkConstants.h"
 #include "ValueVisitor.h"
+#include "format/binary/BinaryResourceTableView.h"
 #include "io/File.h"
 #include "io/FileStream.h"
 #include "process/IResourceTableConsumer.h"
@@ -110,6 +111,41 @@ static xml::Attribute* FindAttribute(xml::Element *el, const std::string &packag
   return el->FindAttribute(package, name);
 }
 
+/*
+ * Retrieves a configuration value of the resource entry that best matches the specified
+ * configuration.
+ */
+static Value* BestConfigValue(ResourceEntry* entry, const ConfigDescription& match) {
+  if (!entry) {
+    return nullptr;
+  }
+
+  // Determine the config that best matches the desired config
+  ResourceConfigValue* best_value = nullptr;
+  for (auto& value : entry->values) {
+    if (!value->config.match(match)) {
+      continue;
+    }
+
+    if (best_value != nullptr) {
+      if (!value->config.isBetterThan(best_value->config, &match)) {
+        if (value->config.compare(best_value->config) != 0) {
+          continue;
+        }
+      }
+    }
+
+    best_value = value.get();
+  }
+
+  // The entry has no values
+  if (!best_value) {
+    return nullptr;
+  }
+
+  return best_value->value.get();
+}
+
 class CommonFeatureGroup;
 
 class ManifestExtractor {
@@ -149,77 +185,20 @@ class ManifestExtractor {
     /** Retrieves and stores the information extracted from the xml element. */
     virtual void Extract(xml::Element* el) { }
 
-    /*
-     * Retrieves a configuration value of the resource entry that best matches the specified
-     * configuration.
-     */
-    static Value* BestConfigValue(ResourceEntry* entry,
-                                  const ConfigDescription& match) {
-      if (!entry) {
-        return nullptr;
-      }
-
-      // Determine the config that best matches the desired config
-      ResourceConfigValue* best_value = nullptr;
-      for (auto& value : entry->values) {
-        if (!value->config.match(match)) {
-          continue;
-        }
-
-        if (best_value != nullptr) {
-          if (!value->config.isBetterThan(best_value->config, &match)) {
-            if (value->config.compare(best_value->config) != 0) {
-              continue;
-            }
-          }
-        }
-
-        best_value = value.get();
-      }
-
-      // The entry has no values
-      if (!best_value) {
-        return nullptr;
-      }
-
-      return best_value->value.get();
-    }
-
-    /** Retrieves the resource assigned to the specified resource id if one exists. */
-    Value* FindValueById(const ResourceTable* table, const ResourceId& res_id,
-                         const ConfigDescription& config = DummyConfig()) {
-      if (table) {
-        for (auto& package : table->packages) {
-          if (package->id && package->id.value() == res_id.package_id()) {
-            for (auto& type : package->types) {
-              if (type->id && type->id.value() == res_id.type_id()) {
-                for (auto& entry : type->entries) {
-                  if (entry->id && entry->id.value() == res_id.entry_id()) {
-                    if (auto value = BestConfigValue(entry.get(), config)) {
-                      return value;
-                    }
-                  }
-                }
-              }
-            }
-          }
-        }
-      }
-      return nullptr;
-    }
-
     /** Attempts to resolve the reference to a non-reference value. */
     Value* ResolveReference(Reference* ref, const ConfigDescription& config = DummyConfig()) {
       const int kMaxIterations = 40;
       int i = 0;
       while (ref && ref->id && i++ < kMaxIterations) {
-        auto table = extractor_->apk_->GetResourceTable();
-        if (auto value = FindValueById(table, ref->id.value(), config)) {
+        if (auto value = extractor_->FindValueById(ref->id.value(), config)) {
           if (ValueCast<Reference>(value)) {
             ref = ValueCast<Reference>(value);
           } else {
             return value;
           }
+        } else {
+          // Looking the same id up again would not find it either.
+          break;
         }
       }
       return nullptr;
@@ -332,6 +311,9 @@ class ManifestExtractor {
 
   bool Dump(text::Printer* printer, IDiagnostics* diag);
 
+  /** Retrieves the resource assigned to the specified resource id if one exists. */
+  Value* FindValueById(const ResourceId& res_id, const ConfigDescription& config = DummyConfig());
+
   /** Recursively visit the xml element tree and return a processed badging element tree. */
   std::unique_ptr<Element> Visit(xml::Element* element);
 
@@ -384,6 +366,13 @@ class ManifestExtractor {
   std::map<uint16_t, ConfigDescription> densities_;
   std::vector<Element*> parent_stack_;
   int32_t target_sdk_ = 0;
+
+  // The resources of binary APKs are looked up in the resource table without parsing it. The
+  // values found are kept alive for as long as the extractor.
+  bool use_table_view_ = false;
+  std::unique_ptr<BinaryResourceTableView> table_view_;
+  StringPool table_view_strings_;
+  std::vector<std::unique_ptr<Item>> table_view_values_;
 };
 
 template<typename T> T* ElementCast(ManifestExtractor::Element* element);
@@ -1782,6 +1771,40 @@ static void Print(ManifestExtractor::Element* el, text::Printer* printer) {
   }
 }
 
+Value* ManifestExtractor::FindValueById(const ResourceId& res_id,
+                                        const ConfigDescription& config) {
+  if (use_table_view_) {
+    if (!table_view_) {
+      return nullptr;
+    }
+    std::unique_ptr<Item> item = table_view_->FindItemById(res_id, config, &table_view_strings_);
+    if (!item) {
+      return nullptr;
+    }
+    table_view_values_.push_back(std::move(item));
+    return table_view_values_.back().get();
+  }
+
+  if (const ResourceTable* table = apk_->GetResourceTable()) {
+    for (auto& package : table->packages) {
+      if (package->id && package->id.value() == res_id.package_id()) {
+        for (auto& type : package->types) {
+          if (type->id && type->id.value() == res_id.type_id()) {
+            for (auto& entry : type->entries) {
+              if (entry->id && entry->id.value() == res_id.entry_id()) {
+                if (auto value = BestConfigValue(entry.get(), config)) {
+                  return value;
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  return nullptr;
+}
+
 bool ManifestExtractor::Dump(text::Printer* printer, IDiagnostics* diag) {
   // Load the manifest
   std::unique_ptr<xml::XmlResource> doc = apk_->LoadXml("AndroidManifest.xml", diag);
@@ -1796,6 +1819,11 @@ bool ManifestExtractor::Dump(text::Printer* printer, IDiagnostics* diag) {
     return false;
   }
 
+  if (apk_->GetApkFormat() == ApkFormat::kBinary) {
+    use_table_view_ = true;
+    table_view_ = apk_->OpenBinaryTableView(diag);
+  }
+
   // Print only the <uses-permission>, <uses-permission-sdk23>, and <permission> elements if
   // printing only permission elements is requested
   if (options_.only_permissions) {
@@ -1823,34 +1851,42 @@ bool ManifestExtractor::Dump(text::Printer* printer, IDiagnostics* diag) {
   }
 
   // Collect information about the resource configurations
-  if (apk_->GetResourceTable()) {
+  std::vector<ConfigDescription> configs;
+  if (use_table_view_) {
+    if (table_view_) {
+      configs = table_view_->GetConfigurations();
+    }
+  } else if (apk_->GetResourceTable()) {
     for (auto &package : apk_->GetResourceTable()->packages) {
       for (auto &type : package->types) {
         for (auto &entry : type->entries) {
           for (auto &value : entry->values) {
-            std::string locale_str = value->config.GetBcp47LanguageTag();
-
-            // Collect all the unique locales of the apk
-            if (locales_.find(locale_str) == locales_.end()) {
-              ConfigDescription config = ManifestExtractor::DummyConfig();
-              config.setBcp47Locale(locale_str.data());
-              locales_.insert(std::make_pair(locale_str, config));
-            }
-
-            // Collect all the unique density of the apk
-            uint16_t density = (value->config.density == 0) ? (uint16_t) 160
-                                                            : value->config.density;
-            if (densities_.find(density) == densities_.end()) {
-              ConfigDescription config = ManifestExtractor::DummyConfig();
-              config.density = density;
-              densities_.insert(std::make_pair(density, config));
-            }
+            configs.push_back(value->config);
           }
         }
       }
     }
   }
 
+  for (const ConfigDescription& value_config : configs) {
+    std::string locale_str = value_config.GetBcp47LanguageTag();
+
+    // Collect all the unique locales of the apk
+    if (locales_.find(locale_str) == locales_.end()) {
+      ConfigDescription config = ManifestExtractor::DummyConfig();
+      config.setBcp47Locale(locale_str.data());
+      locales_.insert(std::make_pair(locale_str, config));
+    }
+
+    // Collect all the unique density of the apk
+    uint16_t density = (value_config.density == 0) ? (uint16_t) 160 : value_config.density;
+    if (densities_.find(density) == densities_.end()) {
+      ConfigDescription config = ManifestExtractor::DummyConfig();
+      config.density = density;
+      densities_.insert(std::make_pair(density, config));
+    }
+  }
+
   // Extract badging information
   auto root = Visit(element);
 
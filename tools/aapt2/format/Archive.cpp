@@ -27,6 +27,7 @@
 #include "androidfw/StringPiece.h"
 #include "ziparchive/zip_writer.h"
 
+#include "trace/Profiler.h"
 #include "util/Files.h"
 
 using ::android::StringPiece;
@@ -80,6 +81,7 @@ class DirectoryWriter : public IArchiveWriter {
       file_.reset(nullptr);
       return false;
     }
+    profiler::RecordBytesWritten(static_cast<size_t>(len));
     return true;
   }
 
@@ -173,6 +175,14 @@ class ZipFileWriter : public IArchiveWriter {
       error_ = ZipWriter::ErrorCodeString(result);
       return false;
     }
+
+    if (profiler::IsEnabled()) {
+      // Account for what actually landed in the zip rather than the uncompressed input.
+      ZipWriter::FileEntry last_entry;
+      if (writer_->GetLastEntry(&last_entry) == 0) {
+        profiler::RecordBytesWritten(last_entry.compressed_size);
+      }
+    }
     return true;
   }
 
@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "format/binary/BinaryResourceTableView.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "android-base/stringprintf.h"
+#include "androidfw/TypeWrappers.h"
+
+#include "ResourceUtils.h"
+#include "format/binary/ResChunkPullParser.h"
+#include "util/Util.h"
+
+using ::android::ConfigDescription;
+using ::android::Res_value;
+using ::android::ResChunk_header;
+using ::android::ResTable_entry;
+using ::android::ResTable_header;
+using ::android::ResTable_package;
+using ::android::ResTable_type;
+using ::android::ResTable_typeSpec;
+using ::android::TypeVariant;
+using ::android::base::StringPrintf;
+
+namespace aapt {
+
+BinaryResourceTableView::BinaryResourceTableView(IDiagnostics* diag, const Source& source,
+                                                 std::unique_ptr<io::IData> data)
+    : diag_(diag), source_(source), data_(std::move(data)) {
+}
+
+bool BinaryResourceTableView::Load() {
+  ResChunkPullParser parser(data_->data(), data_->size());
+  if (!ResChunkPullParser::IsGoodEvent(parser.Next())) {
+    diag_->Error(DiagMessage(source_) << "corrupt resources.arsc: " << parser.error());
+    return false;
+  }
+
+  if (util::DeviceToHost16(parser.chunk()->type) != android::RES_TABLE_TYPE) {
+    diag_->Error(DiagMessage(source_) << StringPrintf("unknown chunk of type 0x%02x",
+                                                      static_cast<int>(parser.chunk()->type)));
+    return false;
+  }
+
+  const ResTable_header* table_header = ConvertTo<ResTable_header>(parser.chunk());
+  if (!table_header) {
+    diag_->Error(DiagMessage(source_) << "corrupt ResTable_header chunk");
+    return false;
+  }
+
+  ResChunkPullParser table_parser(GetChunkData(&table_header->header),
+                                  GetChunkDataLen(&table_header->header));
+  while (ResChunkPullParser::IsGoodEvent(table_parser.Next())) {
+    switch (util::DeviceToHost16(table_parser.chunk()->type)) {
+      case android::RES_STRING_POOL_TYPE:
+        if (value_pool_.getError() == android::NO_INIT) {
+          android::status_t err = value_pool_.setTo(
+              table_parser.chunk(), util::DeviceToHost32(table_parser.chunk()->size));
+          if (err != android::NO_ERROR) {
+            diag_->Error(DiagMessage(source_)
+                         << "corrupt string pool in ResTable: " << value_pool_.getError());
+            return false;
+          }
+          value_pool_chunk_ = table_parser.chunk();
+        }
+        break;
+
+      case android::RES_TABLE_PACKAGE_TYPE:
+        if (!LoadPackage(table_parser.chunk())) {
+          return false;
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  if (table_parser.event() == ResChunkPullParser::Event::kBadDocument) {
+    diag_->Error(DiagMessage(source_) << "corrupt resource table: " << table_parser.error());
+    return false;
+  }
+  return true;
+}
+
+bool BinaryResourceTableView::LoadPackage(const ResChunk_header* chunk) {
+  constexpr size_t kMinPackageSize =
+      sizeof(ResTable_package) - sizeof(ResTable_package::typeIdOffset);
+  const ResTable_package* package_header = ConvertTo<ResTable_package, kMinPackageSize>(chunk);
+  if (!package_header) {
+    diag_->Error(DiagMessage(source_) << "corrupt ResTable_package chunk");
+    return false;
+  }
+
+  std::u16string package_name;
+  for (size_t i = 0; i < arraysize(package_header->name) && package_header->name[i] != 0; i++) {
+    package_name += static_cast<char16_t>(util::DeviceToHost16(package_header->name[i]));
+  }
+
+  packages_.push_back(package_header);
+  package_infos_.push_back(
+      PackageInfo{util::Utf16ToUtf8(package_name), util::DeviceToHost32(package_header->id)});
+  return true;
+}
+
+const ResTable_package* BinaryResourceTableView::FindPackage(uint32_t package_id) const {
+  for (const ResTable_package* package_header : packages_) {
+    if (util::DeviceToHost32(package_header->id) == package_id) {
+      return package_header;
+    }
+  }
+  return nullptr;
+}
+
+// Returns the string pool chunk at `offset` from the start of the package, or nullptr if the
+// package has none there.
+static const ResChunk_header* GetPackageStringPool(const ResTable_package* package_header,
+                                                   uint32_t offset) {
+  const size_t package_size = util::DeviceToHost32(package_header->header.size);
+  if (offset == 0 || offset > package_size || package_size - offset < sizeof(ResChunk_header)) {
+    return nullptr;
+  }
+  const ResChunk_header* chunk = reinterpret_cast<const ResChunk_header*>(
+      reinterpret_cast<const uint8_t*>(package_header) + offset);
+  if (util::DeviceToHost32(chunk->size) > package_size - offset) {
+    return nullptr;
+  }
+  return chunk;
+}
+
+bool BinaryResourceTableView::ChunksEqual(const ResChunk_header* a, const ResChunk_header* b) {
+  if (a == nullptr || b == nullptr) {
+    return a == b;
+  }
+  return a->size == b->size && memcmp(a, b, util::DeviceToHost32(a->size)) == 0;
+}
+
+bool BinaryResourceTableView::HasSameStringPools(const BinaryResourceTableView& other,
+                                                 uint32_t package_id) const {
+  const ResTable_package* package_a = FindPackage(package_id);
+  const ResTable_package* package_b = other.FindPackage(package_id);
+  if (package_a == nullptr || package_b == nullptr) {
+    return false;
+  }
+  return ChunksEqual(value_pool_chunk_, other.value_pool_chunk_) &&
+         ChunksEqual(
+             GetPackageStringPool(package_a, util::DeviceToHost32(package_a->typeStrings)),
+             GetPackageStringPool(package_b, util::DeviceToHost32(package_b->typeStrings))) &&
+         ChunksEqual(GetPackageStringPool(package_a, util::DeviceToHost32(package_a->keyStrings)),
+                     GetPackageStringPool(package_b, util::DeviceToHost32(package_b->keyStrings)));
+}
+
+std::map<ResourceId, BinaryResourceTableView::TypeChunks> BinaryResourceTableView::GetTypeChunks()
+    const {
+  std::map<ResourceId, TypeChunks> chunks;
+  for (const ResTable_package* package_header : packages_) {
+    const uint8_t package_id = util::DeviceToHost32(package_header->id);
+    ResChunkPullParser parser(GetChunkData(&package_header->header),
+                              GetChunkDataLen(&package_header->header));
+    while (ResChunkPullParser::IsGoodEvent(parser.Next())) {
+      switch (util::DeviceToHost16(parser.chunk()->type)) {
+        case android::RES_TABLE_TYPE_SPEC_TYPE: {
+          const ResTable_typeSpec* spec = ConvertTo<ResTable_typeSpec>(parser.chunk());
+          if (!spec) {
+            diag_->Warn(DiagMessage(source_) << "corrupt ResTable_typeSpec chunk");
+            break;
+          }
+          chunks[ResourceId(package_id, spec->id, 0)].spec = parser.chunk();
+          break;
+        }
+
+        case android::RES_TABLE_TYPE_TYPE: {
+          const ResTable_type* type =
+              ConvertTo<ResTable_type, android::kResTableTypeMinSize>(parser.chunk());
+          if (!type) {
+            diag_->Warn(DiagMessage(source_) << "corrupt ResTable_type chunk");
+            break;
+          }
+          chunks[ResourceId(package_id, type->id, 0)].types.push_back(type);
+          break;
+        }
+
+        default:
+          break;
+      }
+    }
+  }
+  return chunks;
+}
+
+std::vector<ConfigDescription> BinaryResourceTableView::GetConfigurations() const {
+  std::vector<ConfigDescription> configs;
+  for (const ResTable_package* package_header : packages_) {
+    ResChunkPullParser parser(GetChunkData(&package_header->header),
+                              GetChunkDataLen(&package_header->header));
+    while (ResChunkPullParser::IsGoodEvent(parser.Next())) {
+      if (util::DeviceToHost16(parser.chunk()->type) != android::RES_TABLE_TYPE_TYPE) {
+        continue;
+      }
+
+      // Only the header of the type is read, none of its entries.
+      const ResTable_type* type =
+          ConvertTo<ResTable_type, android::kResTableTypeMinSize>(parser.chunk());
+      if (!type) {
+        diag_->Warn(DiagMessage(source_) << "corrupt ResTable_type chunk");
+        continue;
+      }
+
+      ConfigDescription config;
+      config.copyFromDtoH(type->config);
+      configs.push_back(config);
+    }
+  }
+
+  std::sort(configs.begin(), configs.end(),
+            [](const ConfigDescription& a, const ConfigDescription& b) {
+              return a.compare(b) < 0;
+            });
+  configs.erase(std::unique(configs.begin(), configs.end(),
+                            [](const ConfigDescription& a, const ConfigDescription& b) {
+                              return a.compare(b) == 0;
+                            }),
+                configs.end());
+  return configs;
+}
+
+std::unique_ptr<Item> BinaryResourceTableView::FindItemById(const ResourceId& id,
+                                                            const ConfigDescription& config,
+                                                            StringPool* out_pool) const {
+  struct Candidate {
+    ConfigDescription config;
+    // nullptr if the entry is a bag.
+    const Res_value* value;
+  };
+
+  std::vector<Candidate> candidates;
+  ResourceType type_name = ResourceType::kUnknown;
+  for (const ResTable_package* package_header : packages_) {
+    if (util::DeviceToHost32(package_header->id) != id.package_id()) {
+      continue;
+    }
+
+    android::ResStringPool type_pool;
+    ResChunkPullParser parser(GetChunkData(&package_header->header),
+                              GetChunkDataLen(&package_header->header));
+    while (ResChunkPullParser::IsGoodEvent(parser.Next())) {
+      const ResChunk_header* chunk = parser.chunk();
+      const uint16_t chunk_type = util::DeviceToHost16(chunk->type);
+      if (chunk_type == android::RES_STRING_POOL_TYPE) {
+        // The first string pool of a package holds the names of its types.
+        if (type_pool.getError() == android::NO_INIT) {
+          type_pool.setTo(chunk, util::DeviceToHost32(chunk->size));
+          if (const ResourceType* parsed =
+                  ParseResourceType(util::GetString(type_pool, id.type_id() - 1))) {
+            type_name = *parsed;
+          }
+        }
+        continue;
+      }
+      if (chunk_type != android::RES_TABLE_TYPE_TYPE) {
+        continue;
+      }
+
+      const ResTable_type* type = ConvertTo<ResTable_type, android::kResTableTypeMinSize>(chunk);
+      if (!type || type->id != id.type_id()) {
+        continue;
+      }
+
+      // Only the entry offsets up to the one of the resource are read.
+      TypeVariant tv(type);
+      TypeVariant::iterator iter = tv.beginEntries();
+      while (iter != tv.endEntries() && iter.index() < id.entry_id()) {
+        ++iter;
+      }
+      const ResTable_entry* entry = iter != tv.endEntries() ? *iter : nullptr;
+      if (!entry) {
+        continue;
+      }
+
+      Candidate candidate;
+      candidate.config.copyFromDtoH(type->config);
+      candidate.value = nullptr;
+      if (!(util::DeviceToHost16(entry->flags) & ResTable_entry::FLAG_COMPLEX)) {
+        const uint8_t* value_start =
+            reinterpret_cast<const uint8_t*>(entry) + util::DeviceToHost16(entry->size);
+        if (value_start + sizeof(Res_value) >
+            reinterpret_cast<const uint8_t*>(type) + util::DeviceToHost32(type->header.size)) {
+          diag_->Warn(DiagMessage(source_) << "corrupt value for resource " << id);
+          continue;
+        }
+        candidate.value = reinterpret_cast<const Res_value*>(value_start);
+      }
+      candidates.push_back(candidate);
+    }
+  }
+
+  // The values of a ResourceEntry are sorted by configuration, and the first of two equally good
+  // matches wins there, so keep the same order here.
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [](const Candidate& a, const Candidate& b) {
+                     return a.config.compare(b.config) < 0;
+                   });
+  const Candidate* best = nullptr;
+  for (const Candidate& candidate : candidates) {
+    if (!candidate.config.match(config)) {
+      continue;
+    }
+    if (best != nullptr && !candidate.config.isBetterThan(best->config, &config) &&
+        candidate.config.compare(best->config) != 0) {
+      continue;
+    }
+    best = &candidate;
+  }
+
+  if (best == nullptr || best->value == nullptr) {
+    return {};
+  }
+  return ResourceUtils::ParseBinaryResValue(type_name, best->config, value_pool_, *best->value,
+                                            out_pool);
+}
+
+}  // namespace aapt
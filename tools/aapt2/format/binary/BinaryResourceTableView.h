@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AAPT_FORMAT_BINARY_BINARYRESOURCETABLEVIEW_H
+#define AAPT_FORMAT_BINARY_BINARYRESOURCETABLEVIEW_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "android-base/macros.h"
+#include "androidfw/ConfigDescription.h"
+#include "androidfw/ResourceTypes.h"
+
+#include "Diagnostics.h"
+#include "Resource.h"
+#include "ResourceValues.h"
+#include "Source.h"
+#include "StringPool.h"
+#include "io/Data.h"
+
+namespace aapt {
+
+// A read-only view of a binary resource table (resources.arsc).
+// Unlike BinaryResourceParser, this does not build a ResourceTable. Queries are answered directly
+// from the chunks in the data, which is typically mmapped straight out of the APK. This makes it
+// suitable for dump commands that only need a small part of the table.
+class BinaryResourceTableView {
+ public:
+  struct PackageInfo {
+    std::string name;
+    uint32_t id;
+  };
+
+  // Creates a view over `data`. The view takes ownership of the data.
+  BinaryResourceTableView(IDiagnostics* diag, const Source& source,
+                          std::unique_ptr<io::IData> data);
+
+  // Locates the value string pool and the packages in the table. The chunks of each package are
+  // only walked by the queries that need them. Returns false if the table is corrupt.
+  bool Load();
+
+  // The global string pool that holds the string values of the table.
+  const android::ResStringPool& GetValueStringPool() const {
+    return value_pool_;
+  }
+
+  const std::vector<PackageInfo>& GetPackages() const {
+    return package_infos_;
+  }
+
+  // The chunks that hold one type of a package.
+  struct TypeChunks {
+    // The ResTable_typeSpec chunk, or nullptr if the package has none for the type.
+    const android::ResChunk_header* spec = nullptr;
+    // The ResTable_type chunk of each configuration, in table order.
+    std::vector<const android::ResTable_type*> types;
+  };
+
+  // Returns the chunks of every type of every package, keyed by ResourceId(package_id, type_id, 0).
+  // Only the chunk headers are read.
+  std::map<ResourceId, TypeChunks> GetTypeChunks() const;
+
+  // Returns whether the string pools that the entries of the package `package_id` refer to are the
+  // same byte for byte in this table and in `other`: the value string pool, and the type and key
+  // string pools of the package. If they are, a ResTable_type chunk that is the same in both tables
+  // holds entries with the same names, flags and values.
+  bool HasSameStringPools(const BinaryResourceTableView& other, uint32_t package_id) const;
+
+  // Returns whether the two chunks are the same byte for byte. Either may be nullptr.
+  static bool ChunksEqual(const android::ResChunk_header* a, const android::ResChunk_header* b);
+
+  // Returns every configuration that at least one type of any package defines values for, in
+  // sorted order and without duplicates.
+  std::vector<android::ConfigDescription> GetConfigurations() const;
+
+  // Returns the value of the resource `id` in the configuration that best matches `config`, picked
+  // the same way as from the values of a ResourceEntry. Returns nullptr if no configuration matches
+  // or if the best match is a bag. Strings of the value are added to `out_pool`.
+  std::unique_ptr<Item> FindItemById(const ResourceId& id, const android::ConfigDescription& config,
+                                     StringPool* out_pool) const;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BinaryResourceTableView);
+
+  bool LoadPackage(const android::ResChunk_header* chunk);
+  const android::ResTable_package* FindPackage(uint32_t package_id) const;
+
+  IDiagnostics* diag_;
+  const Source source_;
+  std::unique_ptr<io::IData> data_;
+
+  android::ResStringPool value_pool_;
+  const android::ResChunk_header* value_pool_chunk_ = nullptr;
+  std::vector<const android::ResTable_package*> packages_;
+  std::vector<PackageInfo> package_infos_;
+};
+
+}  // namespace aapt
+
+#endif  // AAPT_FORMAT_BINARY_BINARYRESOURCETABLEVIEW_H
@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "format/binary/BinaryResourceTableView.h"
+
+#include <cstring>
+
+#include "ResourceUtils.h"
+#include "format/binary/TableFlattener.h"
+#include "test/Test.h"
+
+using ::android::ConfigDescription;
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::UnorderedElementsAre;
+
+namespace aapt {
+
+class BinaryResourceTableViewTest : public ::testing::Test {
+ public:
+  void SetUp() override {
+    context_ =
+        test::ContextBuilder().SetCompilationPackage("com.app.test").SetPackageId(0x7f).Build();
+  }
+
+  std::unique_ptr<BinaryResourceTableView> FlattenAndView(ResourceTable* table) {
+    BigBuffer buffer(1024);
+    TableFlattener flattener({}, &buffer);
+    if (!flattener.Consume(context_.get(), table)) {
+      return {};
+    }
+
+    std::string content = buffer.to_string();
+    std::unique_ptr<uint8_t[]> data(new uint8_t[content.size()]);
+    memcpy(data.get(), content.data(), content.size());
+
+    auto view = util::make_unique<BinaryResourceTableView>(
+        context_->GetDiagnostics(), Source("resources.arsc"),
+        util::make_unique<io::MallocData>(std::move(data), content.size()));
+    if (!view->Load()) {
+      return {};
+    }
+    return view;
+  }
+
+ protected:
+  std::unique_ptr<IAaptContext> context_;
+};
+
+TEST_F(BinaryResourceTableViewTest, ReadsPackagesAndValueStringPool) {
+  std::unique_ptr<ResourceTable> table =
+      test::ResourceTableBuilder()
+          .SetPackageId("com.app.test", 0x7f)
+          .AddString("com.app.test:string/one", ResourceId(0x7f020000), "hello")
+          .AddString("com.app.test:string/two", ResourceId(0x7f020001), "world")
+          .Build();
+
+  std::unique_ptr<BinaryResourceTableView> view = FlattenAndView(table.get());
+  ASSERT_THAT(view, ::testing::NotNull());
+
+  ASSERT_THAT(view->GetPackages().size(), Eq(1u));
+  EXPECT_THAT(view->GetPackages()[0].name, Eq("com.app.test"));
+  EXPECT_THAT(view->GetPackages()[0].id, Eq(0x7fu));
+
+  const android::ResStringPool& pool = view->GetValueStringPool();
+  std::vector<std::string> strings;
+  for (size_t i = 0; i < pool.size(); i++) {
+    strings.push_back(util::GetString(pool, i));
+  }
+  EXPECT_THAT(strings, UnorderedElementsAre("hello", "world"));
+}
+
+TEST_F(BinaryResourceTableViewTest, CollectsSortedUniqueConfigurations) {
+  const ConfigDescription land = test::ParseConfigOrDie("land");
+  const ConfigDescription fr = test::ParseConfigOrDie("fr");
+  std::unique_ptr<ResourceTable> table =
+      test::ResourceTableBuilder()
+          .SetPackageId("com.app.test", 0x7f)
+          .AddSimple("com.app.test:id/one", ResourceId(0x7f010000))
+          .AddString("com.app.test:string/one", ResourceId(0x7f020000), "default")
+          .AddString("com.app.test:string/one", ResourceId(0x7f020000), fr, "defaut")
+          .AddString("com.app.test:string/two", ResourceId(0x7f020001), land, "land")
+          .AddString("com.app.test:string/two", ResourceId(0x7f020001), fr, "deux")
+          .Build();
+
+  std::unique_ptr<BinaryResourceTableView> view = FlattenAndView(table.get());
+  ASSERT_THAT(view, ::testing::NotNull());
+
+  EXPECT_THAT(view->GetConfigurations(),
+              ElementsAre(ConfigDescription::DefaultConfig(), land, fr));
+}
+
+TEST_F(BinaryResourceTableViewTest, FindsBestMatchingItemById) {
+  const ConfigDescription fr = test::ParseConfigOrDie("fr");
+  const ConfigDescription fr_land = test::ParseConfigOrDie("fr-land");
+  std::unique_ptr<ResourceTable> table =
+      test::ResourceTableBuilder()
+          .SetPackageId("com.app.test", 0x7f)
+          .AddString("com.app.test:string/one", ResourceId(0x7f020000), "default")
+          .AddString("com.app.test:string/one", ResourceId(0x7f020000), fr, "defaut")
+          .AddString("com.app.test:string/one", ResourceId(0x7f020000), fr_land, "paysage")
+          .AddValue("com.app.test:string/two", ResourceId(0x7f020001),
+                    test::BuildReference("com.app.test:string/one", ResourceId(0x7f020000)))
+          .Build();
+
+  std::unique_ptr<BinaryResourceTableView> view = FlattenAndView(table.get());
+  ASSERT_THAT(view, ::testing::NotNull());
+
+  StringPool pool;
+  std::unique_ptr<Item> item = view->FindItemById(ResourceId(0x7f020000), {}, &pool);
+  ASSERT_THAT(ValueCast<String>(item.get()), ::testing::NotNull());
+  EXPECT_THAT(*ValueCast<String>(item.get())->value, Eq("default"));
+
+  item = view->FindItemById(ResourceId(0x7f020000), fr, &pool);
+  ASSERT_THAT(ValueCast<String>(item.get()), ::testing::NotNull());
+  EXPECT_THAT(*ValueCast<String>(item.get())->value, Eq("defaut"));
+
+  item = view->FindItemById(ResourceId(0x7f020000), test::ParseConfigOrDie("fr-land-hdpi"), &pool);
+  ASSERT_THAT(ValueCast<String>(item.get()), ::testing::NotNull());
+  EXPECT_THAT(*ValueCast<String>(item.get())->value, Eq("paysage"));
+
+  item = view->FindItemById(ResourceId(0x7f020001), fr, &pool);
+  ASSERT_THAT(ValueCast<Reference>(item.get()), ::testing::NotNull());
+  EXPECT_THAT(ValueCast<Reference>(item.get())->id, Eq(make_value(ResourceId(0x7f020000))));
+}
+
+TEST_F(BinaryResourceTableViewTest, FindsNoItemForMissingEntriesOrBags) {
+  std::unique_ptr<ResourceTable> table =
+      test::ResourceTableBuilder()
+          .SetPackageId("com.app.test", 0x7f)
+          .AddString("com.app.test:string/one", ResourceId(0x7f020000),
+                     test::ParseConfigOrDie("fr"), "defaut")
+          .AddValue("com.app.test:style/Theme", ResourceId(0x7f030000),
+                    test::StyleBuilder()
+                        .AddItem("android:attr/foo", ResourceId(0x01010000),
+                                 ResourceUtils::TryParseBool("true"))
+                        .Build())
+          .Build();
+
+  std::unique_ptr<BinaryResourceTableView> view = FlattenAndView(table.get());
+  ASSERT_THAT(view, ::testing::NotNull());
+
+  StringPool pool;
+  EXPECT_THAT(view->FindItemById(ResourceId(0x7f020000), {}, &pool), ::testing::IsNull());
+  EXPECT_THAT(view->FindItemById(ResourceId(0x7f020001), {}, &pool), ::testing::IsNull());
+  EXPECT_THAT(view->FindItemById(ResourceId(0x7f030000), {}, &pool), ::testing::IsNull());
+  EXPECT_THAT(view->FindItemById(ResourceId(0x7e020000), {}, &pool), ::testing::IsNull());
+}
+
+// Returns the chunk of `chunks` that holds `config`, or nullptr if there is none.
+static const android::ResChunk_header* FindTypeChunk(
+    const BinaryResourceTableView::TypeChunks& chunks, const ConfigDescription& config) {
+  for (const android::ResTable_type* type : chunks.types) {
+    ConfigDescription type_config;
+    type_config.copyFromDtoH(type->config);
+    if (type_config == config) {
+      return &type->header;
+    }
+  }
+  return nullptr;
+}
+
+TEST_F(BinaryResourceTableViewTest, ComparesTypeChunksOfTwoTables) {
+  const ConfigDescription fr = test::ParseConfigOrDie("fr");
+  // The same strings in both tables, so that their string pools are the same, but swapped between
+  // the default values of the two strings.
+  std::unique_ptr<ResourceTable> table_a =
+      test::ResourceTableBuilder()
+          .SetPackageId("com.app.test", 0x7f)
+          .AddSimple("com.app.test:id/one", ResourceId(0x7f010000))
+          .AddString("com.app.test:string/one", ResourceId(0x7f020000), "hello")
+          .AddString("com.app.test:string/one", ResourceId(0x7f020000), fr, "salut")
+          .AddString("com.app.test:string/two", ResourceId(0x7f020001), "world")
+          .Build();
+  std::unique_ptr<ResourceTable> table_b =
+      test::ResourceTableBuilder()
+          .SetPackageId("com.app.test", 0x7f)
+          .AddSimple("com.app.test:id/one", ResourceId(0x7f010000))
+          .AddString("com.app.test:string/one", ResourceId(0x7f020000), "world")
+          .AddString("com.app.test:string/one", ResourceId(0x7f020000), fr, "salut")
+          .AddString("com.app.test:string/two", ResourceId(0x7f020001), "hello")
+          .Build();
+
+  std::unique_ptr<BinaryResourceTableView> view_a = FlattenAndView(table_a.get());
+  std::unique_ptr<BinaryResourceTableView> view_b = FlattenAndView(table_b.get());
+  ASSERT_THAT(view_a, ::testing::NotNull());
+  ASSERT_THAT(view_b, ::testing::NotNull());
+  EXPECT_TRUE(view_a->HasSameStringPools(*view_b, 0x7f));
+  EXPECT_FALSE(view_a->HasSameStringPools(*view_b, 0x7e));
+
+  std::map<ResourceId, BinaryResourceTableView::TypeChunks> chunks_a = view_a->GetTypeChunks();
+  std::map<ResourceId, BinaryResourceTableView::TypeChunks> chunks_b = view_b->GetTypeChunks();
+  ASSERT_THAT(chunks_a.size(), Eq(2u));
+  ASSERT_THAT(chunks_b.size(), Eq(2u));
+
+  const BinaryResourceTableView::TypeChunks& ids_a = chunks_a[ResourceId(0x7f, 0x01, 0)];
+  const BinaryResourceTableView::TypeChunks& ids_b = chunks_b[ResourceId(0x7f, 0x01, 0)];
+  ASSERT_THAT(ids_a.types.size(), Eq(1u));
+  EXPECT_TRUE(BinaryResourceTableView::ChunksEqual(ids_a.spec, ids_b.spec));
+  EXPECT_TRUE(BinaryResourceTableView::ChunksEqual(FindTypeChunk(ids_a, {}),
+                                                   FindTypeChunk(ids_b, {})));
+
+  const BinaryResourceTableView::TypeChunks& strings_a = chunks_a[ResourceId(0x7f, 0x02, 0)];
+  const BinaryResourceTableView::TypeChunks& strings_b = chunks_b[ResourceId(0x7f, 0x02, 0)];
+  ASSERT_THAT(strings_a.types.size(), Eq(2u));
+  ASSERT_THAT(FindTypeChunk(strings_a, {}), ::testing::NotNull());
+  EXPECT_TRUE(BinaryResourceTableView::ChunksEqual(strings_a.spec, strings_b.spec));
+  EXPECT_FALSE(BinaryResourceTableView::ChunksEqual(FindTypeChunk(strings_a, {}),
+                                                    FindTypeChunk(strings_b, {})));
+  EXPECT_TRUE(BinaryResourceTableView::ChunksEqual(FindTypeChunk(strings_a, fr),
+                                                   FindTypeChunk(strings_b, fr)));
+  EXPECT_FALSE(BinaryResourceTableView::ChunksEqual(FindTypeChunk(strings_a, fr), nullptr));
+}
+
+TEST_F(BinaryResourceTableViewTest, DifferentValueStringsMakeDifferentStringPools) {
+  std::unique_ptr<ResourceTable> table_a =
+      test::ResourceTableBuilder()
+          .SetPackageId("com.app.test", 0x7f)
+          .AddString("com.app.test:string/one", ResourceId(0x7f020000), "hello")
+          .Build();
+  std::unique_ptr<ResourceTable> table_b =
+      test::ResourceTableBuilder()
+          .SetPackageId("com.app.test", 0x7f)
+          .AddString("com.app.test:string/one", ResourceId(0x7f020000), "goodbye")
+          .Build();
+
+  std::unique_ptr<BinaryResourceTableView> view_a = FlattenAndView(table_a.get());
+  std::unique_ptr<BinaryResourceTableView> view_b = FlattenAndView(table_b.get());
+  ASSERT_THAT(view_a, ::testing::NotNull());
+  ASSERT_THAT(view_b, ::testing::NotNull());
+  EXPECT_TRUE(view_a->HasSameStringPools(*view_a, 0x7f));
+  EXPECT_FALSE(view_a->HasSameStringPools(*view_b, 0x7f));
+}
+
+TEST_F(BinaryResourceTableViewTest, RejectsCorruptTable) {
+  std::unique_ptr<uint8_t[]> data(new uint8_t[4]);
+  memset(data.get(), 0xff, 4);
+  BinaryResourceTableView view(context_->GetDiagnostics(), Source("resources.arsc"),
+                               util::make_unique<io::MallocData>(std::move(data), 4u));
+  EXPECT_FALSE(view.Load());
+}
+
+}  // namespace aapt
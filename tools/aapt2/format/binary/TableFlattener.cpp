@@ -32,6 +32,7 @@
 #include "ValueVisitor.h"
 #include "format/binary/ChunkWriter.h"
 #include "format/binary/ResourceTypeExtensions.h"
+#include "trace/Profiler.h"
 #include "trace/TraceBuffer.h"
 #include "util/BigBuffer.h"
 
@@ -719,6 +720,7 @@ class PackageFlattener {
 
 bool TableFlattener::Consume(IAaptContext* context, ResourceTable* table) {
   TRACE_CALL();
+  PROFILE_PHASE(ProfilePhase::kFlatten);
   // We must do this before writing the resources, since the string pool IDs may change.
   table->string_pool.Prune();
   table->string_pool.Sort([](const StringPool::Context& a, const StringPool::Context& b) -> int {
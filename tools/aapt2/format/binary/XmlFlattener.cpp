@@ -30,6 +30,7 @@
 #include "ValueVisitor.h"
 #include "format/binary/ChunkWriter.h"
 #include "format/binary/ResourceTypeExtensions.h"
+#include "trace/Profiler.h"
 #include "xml/XmlDom.h"
 
 using namespace android;
@@ -367,6 +368,7 @@ bool XmlFlattener::Flatten(IAaptContext* context, const xml::Node* node) {
 }
 
 bool XmlFlattener::Consume(IAaptContext* context, const xml::XmlResource* resource) {
+  PROFILE_PHASE_FILE(ProfilePhase::kFlatten, resource->file.source.path);
   if (!resource->root) {
     return false;
   }
@@ -18,6 +18,7 @@
 
 #include "google/protobuf/io/zero_copy_stream_impl_lite.h"
 
+#include "trace/Profiler.h"
 #include "trace/TraceBuffer.h"
 
 using ::android::StringPiece;
@@ -26,9 +27,15 @@ using ::google::protobuf::io::ZeroCopyOutputStream;
 namespace aapt {
 namespace io {
 
+static ProfilePhase GetArchivePhase(uint32_t compression_flags) {
+  return (compression_flags & ArchiveEntry::kCompress) ? ProfilePhase::kCompress
+                                                       : ProfilePhase::kWrite;
+}
+
 bool CopyInputStreamToArchive(IAaptContext* context, InputStream* in, const std::string& out_path,
                               uint32_t compression_flags, IArchiveWriter* writer) {
   TRACE_CALL();
+  PROFILE_PHASE_FILE(GetArchivePhase(compression_flags), out_path);
   if (context->IsVerbose()) {
     context->GetDiagnostics()->Note(DiagMessage() << "writing " << out_path << " to archive");
   }
@@ -62,6 +69,7 @@ bool CopyProtoToArchive(IAaptContext* context, ::google::protobuf::MessageLite*
                         const std::string& out_path, uint32_t compression_flags,
                         IArchiveWriter* writer) {
   TRACE_CALL();
+  PROFILE_PHASE_FILE(GetArchivePhase(compression_flags), out_path);
   if (context->IsVerbose()) {
     context->GetDiagnostics()->Note(DiagMessage() << "writing " << out_path << " to archive");
   }
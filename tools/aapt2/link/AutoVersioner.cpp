@@ -23,6 +23,7 @@
 #include "ResourceTable.h"
 #include "SdkConstants.h"
 #include "ValueVisitor.h"
+#include "trace/Profiler.h"
 #include "trace/TraceBuffer.h"
 
 using android::ConfigDescription;
@@ -72,6 +73,7 @@ ApiVersion FindNextApiVersionForConfig(const ResourceEntry* entry,
 
 bool AutoVersioner::Consume(IAaptContext* context, ResourceTable* table) {
   TRACE_NAME("AutoVersioner::Consume");
+  PROFILE_PHASE(ProfilePhase::kVersion);
   for (auto& package : table->packages) {
     for (auto& type : package->types) {
       if (type->type != ResourceType::kStyle) {
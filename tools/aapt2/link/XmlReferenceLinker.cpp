@@ -25,6 +25,7 @@
 #include "link/ReferenceLinker.h"
 #include "process/IResourceTableConsumer.h"
 #include "process/SymbolTable.h"
+#include "trace/Profiler.h"
 #include "trace/TraceBuffer.h"
 #include "util/Util.h"
 #include "xml/XmlDom.h"
@@ -153,6 +154,7 @@ class XmlVisitor : public xml::PackageAwareVisitor {
 
 bool XmlReferenceLinker::Consume(IAaptContext* context, xml::XmlResource* resource) {
   TRACE_NAME("XmlReferenceLinker::Consume");
+  PROFILE_PHASE(ProfilePhase::kLink);
   CallSite callsite{resource->file.name.package};
 
   std::string out_name = resource->file.name.entry;
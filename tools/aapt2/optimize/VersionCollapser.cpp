@@ -20,6 +20,7 @@
 #include <vector>
 
 #include "ResourceTable.h"
+#include "trace/Profiler.h"
 #include "trace/TraceBuffer.h"
 
 using android::ConfigDescription;
@@ -146,6 +147,7 @@ static void CollapseVersions(int min_sdk, ResourceEntry* entry) {
 
 bool VersionCollapser::Consume(IAaptContext* context, ResourceTable* table) {
   TRACE_NAME("VersionCollapser::Consume");
+  PROFILE_PHASE(ProfilePhase::kVersion);
   const int min_sdk = context->GetMinSdkVersion();
   for (auto& package : table->packages) {
     for (auto& type : package->types) {
@@ -16,7 +16,12 @@
 
 #include "process/SymbolTable.h"
 
+#include <sys/stat.h>
+
+#include <functional>
 #include <iostream>
+#include <map>
+#include <mutex>
 
 #include "android-base/logging.h"
 #include "android-base/stringprintf.h"
@@ -217,18 +222,151 @@ std::unique_ptr<SymbolTable::Symbol> ResourceTableSymbolSource::FindByName(
   return symbol;
 }
 
+namespace apk_assets_cache {
+
+namespace {
+
+struct CacheEntry {
+  // Held while loading so that concurrent users of the same path wait for a single load.
+  std::mutex mutex;
+  std::shared_ptr<const ApkAssets> assets;
+  off_t size = 0;
+  time_t mtime = 0;
+};
+
+std::mutex cache_mutex;
+bool cache_enabled = false;
+std::map<std::string, std::shared_ptr<CacheEntry>> cache;
+std::map<std::vector<const ApkAssets*>, std::shared_ptr<SharedSymbols>> symbols_cache;
+
+}  // namespace
+
+class SharedSymbols {
+ public:
+  explicit SharedSymbols(const std::vector<std::shared_ptr<const ApkAssets>>& assets)
+      : assets_(assets) {
+  }
+
+  // Returns a copy of the symbol named `name`, calling `lookup` to find it the first time.
+  std::unique_ptr<SymbolTable::Symbol> FindByName(
+      const ResourceName& name, const std::function<std::unique_ptr<SymbolTable::Symbol>()>& lookup) {
+    return FindOrLookup(&by_name_, name, lookup);
+  }
+
+  // Returns a copy of the symbol with `id`, calling `lookup` to find it the first time.
+  std::unique_ptr<SymbolTable::Symbol> FindById(
+      ResourceId id, const std::function<std::unique_ptr<SymbolTable::Symbol>()>& lookup) {
+    return FindOrLookup(&by_id_, id, lookup);
+  }
+
+ private:
+  // Symbols that were not found are kept as nullptr.
+  template <typename Key>
+  using SymbolMap = std::map<Key, std::shared_ptr<const SymbolTable::Symbol>>;
+
+  template <typename Key>
+  std::unique_ptr<SymbolTable::Symbol> FindOrLookup(
+      SymbolMap<Key>* symbols, const Key& key,
+      const std::function<std::unique_ptr<SymbolTable::Symbol>()>& lookup) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto iter = symbols->find(key);
+      if (iter != symbols->end()) {
+        if (iter->second == nullptr) {
+          return {};
+        }
+        return util::make_unique<SymbolTable::Symbol>(*iter->second);
+      }
+    }
+
+    // The lookup runs in the AssetManager2 of the calling source, so it needs no lock. Two sources
+    // looking up the same symbol at once both find the same thing.
+    std::unique_ptr<SymbolTable::Symbol> symbol = lookup();
+    std::lock_guard<std::mutex> lock(mutex_);
+    symbols->emplace(key, symbol ? std::make_shared<const SymbolTable::Symbol>(*symbol) : nullptr);
+    return symbol;
+  }
+
+  // Keeps the ApkAssets alive, so that their addresses are not reused by other ApkAssets while
+  // they key this entry.
+  const std::vector<std::shared_ptr<const ApkAssets>> assets_;
+
+  std::mutex mutex_;
+  SymbolMap<ResourceName> by_name_;
+  SymbolMap<ResourceId> by_id_;
+};
+
+void SetEnabled(bool enabled) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  cache_enabled = enabled;
+  if (!enabled) {
+    cache.clear();
+    symbols_cache.clear();
+  }
+}
+
+std::shared_ptr<SharedSymbols> GetSharedSymbols(
+    const std::vector<std::shared_ptr<const ApkAssets>>& assets) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  if (!cache_enabled) {
+    return {};
+  }
+
+  std::vector<const ApkAssets*> key;
+  for (const std::shared_ptr<const ApkAssets>& apk_assets : assets) {
+    key.push_back(apk_assets.get());
+  }
+  std::shared_ptr<SharedSymbols>& symbols = symbols_cache[key];
+  if (symbols == nullptr) {
+    symbols = std::make_shared<SharedSymbols>(assets);
+  }
+  return symbols;
+}
+
+std::shared_ptr<const ApkAssets> Load(const std::string& path) {
+  std::shared_ptr<CacheEntry> entry;
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (!cache_enabled) {
+      return ApkAssets::Load(path);
+    }
+
+    std::shared_ptr<CacheEntry>& slot = cache[path];
+    if (slot == nullptr) {
+      slot = std::make_shared<CacheEntry>();
+    }
+    entry = slot;
+  }
+
+  struct stat sb;
+  if (stat(path.c_str(), &sb) != 0) {
+    return {};
+  }
+
+  std::lock_guard<std::mutex> lock(entry->mutex);
+  if (entry->assets == nullptr || entry->size != sb.st_size || entry->mtime != sb.st_mtime) {
+    entry->assets = ApkAssets::Load(path);
+    entry->size = sb.st_size;
+    entry->mtime = sb.st_mtime;
+  }
+  return entry->assets;
+}
+
+}  // namespace apk_assets_cache
+
 bool AssetManagerSymbolSource::AddAssetPath(const StringPiece& path) {
   TRACE_CALL();
-  if (std::unique_ptr<const ApkAssets> apk = ApkAssets::Load(path.data())) {
+  if (std::shared_ptr<const ApkAssets> apk = apk_assets_cache::Load(path.to_string())) {
     apk_assets_.push_back(std::move(apk));
 
     std::vector<const ApkAssets*> apk_assets;
-    for (const std::unique_ptr<const ApkAssets>& apk_asset : apk_assets_) {
+    for (const std::shared_ptr<const ApkAssets>& apk_asset : apk_assets_) {
       apk_assets.push_back(apk_asset.get());
     }
 
     asset_manager_.SetApkAssets(apk_assets, true /* invalidate_caches */,
                                 false /* filter_incompatible_configs */);
+    shared_symbols_ = apk_assets_cache::GetSharedSymbols(apk_assets_);
     return true;
   }
   return false;
@@ -250,7 +388,7 @@ bool AssetManagerSymbolSource::IsPackageDynamic(uint32_t packageId) const {
     return true;
   }
 
-  for (const std::unique_ptr<const ApkAssets>& assets : apk_assets_) {
+  for (const std::shared_ptr<const ApkAssets>& assets : apk_assets_) {
     for (const std::unique_ptr<const android::LoadedPackage>& loaded_package
          : assets->GetLoadedArsc()->GetPackages()) {
       if (packageId == loaded_package->GetPackageId() && loaded_package->IsDynamic()) {
@@ -322,6 +460,14 @@ static std::unique_ptr<SymbolTable::Symbol> LookupAttributeInTable(
 
 std::unique_ptr<SymbolTable::Symbol> AssetManagerSymbolSource::FindByName(
     const ResourceName& name) {
+  if (shared_symbols_ != nullptr) {
+    return shared_symbols_->FindByName(name, [&]() { return LookupByName(name); });
+  }
+  return LookupByName(name);
+}
+
+std::unique_ptr<SymbolTable::Symbol> AssetManagerSymbolSource::LookupByName(
+    const ResourceName& name) {
   const std::string mangled_entry = NameMangler::MangleEntry(name.package, name.entry);
 
   bool found = false;
@@ -378,6 +524,14 @@ static Maybe<ResourceName> GetResourceName(android::AssetManager2& am,
 
 std::unique_ptr<SymbolTable::Symbol> AssetManagerSymbolSource::FindById(
     ResourceId id) {
+  if (shared_symbols_ != nullptr) {
+    return shared_symbols_->FindById(id, [&]() { return LookupById(id); });
+  }
+  return LookupById(id);
+}
+
+std::unique_ptr<SymbolTable::Symbol> AssetManagerSymbolSource::LookupById(
+    ResourceId id) {
   if (!id.is_valid()) {
     // Exit early and avoid the error logs from AssetManager.
     return {};
@@ -19,6 +19,7 @@
 
 #include <algorithm>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "android-base/macros.h"
@@ -188,6 +189,28 @@ class ResourceTableSymbolSource : public ISymbolSource {
   DISALLOW_COPY_AND_ASSIGN(ResourceTableSymbolSource);
 };
 
+// Shares loaded include APKs between the AssetManagerSymbolSources of the process. The cache is
+// disabled by default. `aapt2 batch` enables it so that an include used by many links, such as the
+// framework, is only loaded once. An entry is reloaded when the size or modification time of the
+// file changes. ApkAssets are immutable once loaded, so they can be used from several threads.
+namespace apk_assets_cache {
+
+// Disabling the cache drops every entry.
+void SetEnabled(bool enabled);
+
+std::shared_ptr<const android::ApkAssets> Load(const std::string& path);
+
+// The symbols found so far in one list of cached ApkAssets.
+class SharedSymbols;
+
+// Returns the symbols shared by every AssetManagerSymbolSource that loaded `assets`, in that order,
+// so that a symbol of an include such as the framework is only looked up once. Returns nullptr if
+// the cache is disabled.
+std::shared_ptr<SharedSymbols> GetSharedSymbols(
+    const std::vector<std::shared_ptr<const android::ApkAssets>>& assets);
+
+}  // namespace apk_assets_cache
+
 class AssetManagerSymbolSource : public ISymbolSource {
  public:
   AssetManagerSymbolSource() = default;
@@ -207,8 +230,12 @@ class AssetManagerSymbolSource : public ISymbolSource {
   }
 
  private:
+  std::unique_ptr<SymbolTable::Symbol> LookupByName(const ResourceName& name);
+  std::unique_ptr<SymbolTable::Symbol> LookupById(ResourceId id);
+
   android::AssetManager2 asset_manager_;
-  std::vector<std::unique_ptr<const android::ApkAssets>> apk_assets_;
+  std::vector<std::shared_ptr<const android::ApkAssets>> apk_assets_;
+  std::shared_ptr<apk_assets_cache::SharedSymbols> shared_symbols_;
 
   DISALLOW_COPY_AND_ASSIGN(AssetManagerSymbolSource);
 };
@@ -134,4 +134,54 @@ TEST_F(SymbolTableTestFixture, FindByNameWhenSymbolIsMangledInResTable) {
   EXPECT_THAT(symbol_table.FindByName(test::ParseNameOrDie("com.android.other:id/foo")), IsNull());
 }
 
+TEST_F(SymbolTableTestFixture, CachedSourcesShareSymbols) {
+  StdErrDiagnostics diag;
+  const std::string compiled_files_dir = GetTestPath("compiled");
+  ASSERT_TRUE(CompileFile(GetTestPath("res/values/values.xml"),
+      R"(<?xml version="1.0" encoding="utf-8"?>
+         <resources>
+             <item type="id" name="foo"/>
+        </resources>)",
+        compiled_files_dir, &diag));
+
+  const std::string out_apk = GetTestPath("out.apk");
+  std::vector<std::string> link_args = {
+      "--manifest", GetDefaultManifest("com.android.app"),
+      "--min-sdk-version", "22",
+      "-o", out_apk,
+  };
+  ASSERT_TRUE(Link(link_args, compiled_files_dir, &diag));
+
+  apk_assets_cache::SetEnabled(true);
+  AssetManagerSymbolSource source_a;
+  ASSERT_TRUE(source_a.AddAssetPath(out_apk));
+  AssetManagerSymbolSource source_b;
+  ASSERT_TRUE(source_b.AddAssetPath(out_apk));
+
+  std::shared_ptr<const android::ApkAssets> apk_assets = apk_assets_cache::Load(out_apk);
+  ASSERT_THAT(apk_assets, NotNull());
+  EXPECT_THAT(apk_assets_cache::GetSharedSymbols({apk_assets}), NotNull());
+  EXPECT_THAT(apk_assets_cache::GetSharedSymbols({apk_assets}),
+              Eq(apk_assets_cache::GetSharedSymbols({apk_assets})));
+
+  const ResourceName foo = test::ParseNameOrDie("com.android.app:id/foo");
+  std::unique_ptr<SymbolTable::Symbol> symbol_a = source_a.FindByName(foo);
+  std::unique_ptr<SymbolTable::Symbol> symbol_b = source_b.FindByName(foo);
+  ASSERT_THAT(symbol_a, NotNull());
+  ASSERT_THAT(symbol_b, NotNull());
+  EXPECT_THAT(symbol_b->id, Eq(symbol_a->id));
+  ASSERT_TRUE(symbol_a->id);
+
+  symbol_b = source_b.FindById(symbol_a->id.value());
+  ASSERT_THAT(symbol_b, NotNull());
+  EXPECT_THAT(symbol_b->id, Eq(symbol_a->id));
+
+  const ResourceName bar = test::ParseNameOrDie("com.android.app:id/bar");
+  EXPECT_THAT(source_a.FindByName(bar), IsNull());
+  EXPECT_THAT(source_b.FindByName(bar), IsNull());
+
+  apk_assets_cache::SetEnabled(false);
+  EXPECT_THAT(apk_assets_cache::GetSharedSymbols({apk_assets}), IsNull());
+}
+
 }  // namespace aapt
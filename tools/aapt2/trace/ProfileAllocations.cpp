@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replacements for the global allocation functions that feed the allocation columns of
+// `--profile`. This file is only linked into the aapt2 executable so that the library, the JNI
+// wrapper and the tests keep the default allocator.
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include "android-base/logging.h"
+
+#include "trace/Profiler.h"
+
+namespace {
+
+void* AllocateOrDie(size_t size) {
+  if (aapt::profiler::IsEnabled()) {
+    aapt::profiler::RecordAllocation(size);
+  }
+
+  void* ptr = malloc(size == 0 ? 1 : size);
+  CHECK(ptr != nullptr) << "out of memory allocating " << size << " bytes";
+  return ptr;
+}
+
+// Memory from posix_memalign is released with free, like the rest.
+void* AllocateAligned(size_t size, std::align_val_t alignment) {
+  if (aapt::profiler::IsEnabled()) {
+    aapt::profiler::RecordAllocation(size);
+  }
+
+  size_t align = std::max(static_cast<size_t>(alignment), sizeof(void*));
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, align, size == 0 ? 1 : size) != 0) {
+    return nullptr;
+  }
+  return ptr;
+}
+
+void* AllocateAlignedOrDie(size_t size, std::align_val_t alignment) {
+  void* ptr = AllocateAligned(size, alignment);
+  CHECK(ptr != nullptr) << "out of memory allocating " << size << " bytes aligned to "
+                        << static_cast<size_t>(alignment);
+  return ptr;
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+  return AllocateOrDie(size);
+}
+
+void* operator new[](size_t size) {
+  return AllocateOrDie(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  if (aapt::profiler::IsEnabled()) {
+    aapt::profiler::RecordAllocation(size);
+  }
+  return malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  if (aapt::profiler::IsEnabled()) {
+    aapt::profiler::RecordAllocation(size);
+  }
+  return malloc(size == 0 ? 1 : size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+  return AllocateAlignedOrDie(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return AllocateAlignedOrDie(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+  return AllocateAligned(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+  return AllocateAligned(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+  free(ptr);
+}
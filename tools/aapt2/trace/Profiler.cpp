@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "trace/Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "android-base/errors.h"
+#include "android-base/stringprintf.h"
+#include "android-base/utf8.h"
+
+#include "util/Util.h"
+
+using ::android::base::StringPrintf;
+using ::android::base::SystemErrorCodeToString;
+
+namespace aapt {
+
+const char* ProfilePhaseToString(ProfilePhase phase) {
+  switch (phase) {
+    case ProfilePhase::kParse:
+      return "parse";
+    case ProfilePhase::kLink:
+      return "link";
+    case ProfilePhase::kVersion:
+      return "version";
+    case ProfilePhase::kFlatten:
+      return "flatten";
+    case ProfilePhase::kCompress:
+      return "compress";
+    case ProfilePhase::kWrite:
+      return "write";
+    default:
+      break;
+  }
+  return "unknown";
+}
+
+namespace profiler {
+
+namespace {
+
+// How many of the slowest files are listed in the summary.
+constexpr size_t kMaxFilesInSummary = 10;
+
+struct Span {
+  ProfilePhase phase;
+  std::string file;
+  int tid;
+  int64_t start_us;
+  int64_t duration_us;
+  size_t allocations;
+  size_t allocated_bytes;
+  size_t bytes_written;
+};
+
+// An open ProfileScope. The child totals are subtracted on close so that every span only reports
+// its exclusive cost.
+struct Frame {
+  ProfilePhase phase;
+  std::string file;
+  int64_t start_us;
+  size_t start_allocations;
+  size_t start_allocated_bytes;
+  size_t start_bytes_written;
+  int64_t child_duration_us = 0;
+  size_t child_allocations = 0;
+  size_t child_allocated_bytes = 0;
+  size_t child_bytes_written = 0;
+};
+
+std::atomic<bool> enabled(false);
+std::atomic<int> next_tid(0);
+
+std::mutex spans_lock;
+std::vector<Span> spans;
+
+// The counters are kept per thread so that concurrently running scopes do not steal each other's
+// allocations. They are plain integers so touching them from operator new never allocates.
+thread_local size_t thread_allocations = 0;
+thread_local size_t thread_allocated_bytes = 0;
+thread_local size_t thread_bytes_written = 0;
+thread_local int thread_id = -1;
+thread_local std::vector<Frame>* thread_frames = nullptr;
+
+int64_t GetTime() noexcept {
+  auto now = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+}
+
+int GetThreadId() {
+  if (thread_id < 0) {
+    thread_id = next_tid++;
+  }
+  return thread_id;
+}
+
+std::vector<Frame>* GetFrames() {
+  if (thread_frames == nullptr) {
+    // Intentionally leaked; destroying it at thread exit could race with late allocations.
+    thread_frames = new std::vector<Frame>();
+  }
+  return thread_frames;
+}
+
+void PushFrame(ProfilePhase phase, const std::string& file) {
+  Frame frame;
+  frame.phase = phase;
+  frame.file = file;
+  frame.start_allocations = thread_allocations;
+  frame.start_allocated_bytes = thread_allocated_bytes;
+  frame.start_bytes_written = thread_bytes_written;
+  frame.start_us = GetTime();
+  GetFrames()->push_back(std::move(frame));
+}
+
+void PopFrame() {
+  const int64_t end_us = GetTime();
+  std::vector<Frame>* frames = GetFrames();
+  if (frames->empty()) {
+    return;
+  }
+
+  Frame frame = std::move(frames->back());
+  frames->pop_back();
+
+  const int64_t duration_us = end_us - frame.start_us;
+  const size_t allocations = thread_allocations - frame.start_allocations;
+  const size_t allocated_bytes = thread_allocated_bytes - frame.start_allocated_bytes;
+  const size_t bytes_written = thread_bytes_written - frame.start_bytes_written;
+
+  if (!frames->empty()) {
+    Frame& parent = frames->back();
+    parent.child_duration_us += duration_us;
+    parent.child_allocations += allocations;
+    parent.child_allocated_bytes += allocated_bytes;
+    parent.child_bytes_written += bytes_written;
+  }
+
+  Span span;
+  span.phase = frame.phase;
+  span.file = std::move(frame.file);
+  span.tid = GetThreadId();
+  span.start_us = frame.start_us;
+  span.duration_us = duration_us - frame.child_duration_us;
+  span.allocations = allocations - frame.child_allocations;
+  span.allocated_bytes = allocated_bytes - frame.child_allocated_bytes;
+  span.bytes_written = bytes_written - frame.child_bytes_written;
+
+  std::lock_guard<std::mutex> lock(spans_lock);
+  spans.push_back(std::move(span));
+}
+
+}  // namespace
+
+void Enable() {
+  enabled = true;
+}
+
+void Disable() {
+  enabled = false;
+}
+
+bool IsEnabled() {
+  return enabled.load(std::memory_order_relaxed);
+}
+
+void Reset() {
+  std::lock_guard<std::mutex> lock(spans_lock);
+  spans.clear();
+}
+
+void RecordBytesWritten(size_t bytes) {
+  thread_bytes_written += bytes;
+}
+
+void RecordAllocation(size_t bytes) {
+  thread_allocations++;
+  thread_allocated_bytes += bytes;
+}
+
+PhaseStats GetPhaseStats(ProfilePhase phase) {
+  PhaseStats stats;
+  std::lock_guard<std::mutex> lock(spans_lock);
+  for (const Span& span : spans) {
+    if (span.phase == phase) {
+      stats.duration_us += span.duration_us;
+      stats.spans++;
+      stats.allocations += span.allocations;
+      stats.allocated_bytes += span.allocated_bytes;
+      stats.bytes_written += span.bytes_written;
+    }
+  }
+  return stats;
+}
+
+void PrintSummary(std::ostream* out) {
+  *out << StringPrintf("%-10s %8s %12s %12s %14s %14s\n", "phase", "spans", "time (ms)",
+                       "allocs", "alloc bytes", "bytes written");
+
+  PhaseStats total;
+  for (int i = 0; i < static_cast<int>(ProfilePhase::kCount); i++) {
+    const ProfilePhase phase = static_cast<ProfilePhase>(i);
+    const PhaseStats stats = GetPhaseStats(phase);
+    *out << StringPrintf("%-10s %8zu %12.2f %12zu %14zu %14zu\n", ProfilePhaseToString(phase),
+                         stats.spans, stats.duration_us / 1000.0, stats.allocations,
+                         stats.allocated_bytes, stats.bytes_written);
+    total.duration_us += stats.duration_us;
+    total.spans += stats.spans;
+    total.allocations += stats.allocations;
+    total.allocated_bytes += stats.allocated_bytes;
+    total.bytes_written += stats.bytes_written;
+  }
+  *out << StringPrintf("%-10s %8zu %12.2f %12zu %14zu %14zu\n", "total", total.spans,
+                       total.duration_us / 1000.0, total.allocations, total.allocated_bytes,
+                       total.bytes_written);
+
+  // Sum up the exclusive time of every span attributed to the same input file.
+  std::map<std::string, int64_t> file_durations;
+  {
+    std::lock_guard<std::mutex> lock(spans_lock);
+    for (const Span& span : spans) {
+      if (!span.file.empty()) {
+        file_durations[span.file] += span.duration_us;
+      }
+    }
+  }
+
+  if (file_durations.empty()) {
+    return;
+  }
+
+  std::vector<std::pair<std::string, int64_t>> files(file_durations.begin(),
+                                                     file_durations.end());
+  std::stable_sort(files.begin(), files.end(),
+                   [](const std::pair<std::string, int64_t>& a,
+                      const std::pair<std::string, int64_t>& b) { return a.second > b.second; });
+  if (files.size() > kMaxFilesInSummary) {
+    files.resize(kMaxFilesInSummary);
+  }
+
+  *out << "\nslowest files:\n";
+  for (const auto& file : files) {
+    *out << StringPrintf("%12.2f ms  %s\n", file.second / 1000.0, file.first.c_str());
+  }
+}
+
+bool WriteChromeTrace(const std::string& path, std::string* out_error) {
+  FILE* f = android::base::utf8::fopen(path.c_str(), "w");
+  if (f == nullptr) {
+    *out_error = SystemErrorCodeToString(errno);
+    return false;
+  }
+
+  const pid_t pid = getpid();
+  fprintf(f, "{\"traceEvents\": [\n");
+
+  std::lock_guard<std::mutex> lock(spans_lock);
+  for (size_t i = 0; i < spans.size(); i++) {
+    const Span& span = spans[i];
+    fprintf(f,
+            "  {\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %" PRId64
+            ", \"dur\": %" PRId64 ", \"pid\": %d, \"tid\": %d, \"args\": {\"file\": \"%s\", "
+            "\"allocations\": %zu, \"allocated_bytes\": %zu, \"bytes_written\": %zu}}%s\n",
+            span.file.empty() ? ProfilePhaseToString(span.phase) : util::EscapeJson(span.file).c_str(),
+            ProfilePhaseToString(span.phase), span.start_us, span.duration_us, pid, span.tid,
+            util::EscapeJson(span.file).c_str(), span.allocations, span.allocated_bytes,
+            span.bytes_written, i + 1 < spans.size() ? "," : "");
+  }
+
+  fprintf(f, "]}\n");
+  if (fclose(f) != 0) {
+    *out_error = SystemErrorCodeToString(errno);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace profiler
+
+ProfileScope::ProfileScope(ProfilePhase phase) : active_(profiler::IsEnabled()) {
+  if (active_) {
+    profiler::PushFrame(phase, {});
+  }
+}
+
+ProfileScope::ProfileScope(ProfilePhase phase, const std::string& file)
+    : active_(profiler::IsEnabled()) {
+  if (active_) {
+    profiler::PushFrame(phase, file);
+  }
+}
+
+ProfileScope::~ProfileScope() {
+  if (active_) {
+    profiler::PopFrame();
+  }
+}
+
+FlushProfile::FlushProfile(const std::string& path) : path_(path) {
+  if (!path_.empty()) {
+    profiler::Reset();
+    profiler::Enable();
+  }
+}
+
+FlushProfile::~FlushProfile() {
+  if (path_.empty()) {
+    return;
+  }
+
+  profiler::Disable();
+  profiler::PrintSummary(&std::cerr);
+  std::string error;
+  if (!profiler::WriteChromeTrace(path_, &error)) {
+    std::cerr << path_ << ": failed to write profile: " << error << std::endl;
+  }
+}
+
+}  // namespace aapt
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AAPT_PROFILER_H
+#define AAPT_PROFILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace aapt {
+
+// The coarse phases that compile and link time is attributed to. Each recorded span belongs to
+// exactly one phase; time spent in a nested span is not counted toward the enclosing span's phase.
+enum class ProfilePhase {
+  kParse = 0,
+  kLink,
+  kVersion,
+  kFlatten,
+  kCompress,
+  kWrite,
+
+  kCount,
+};
+
+const char* ProfilePhaseToString(ProfilePhase phase);
+
+// Aggregated per-phase and per-file profiling for `--profile`. Unlike the TraceBuffer, which
+// emits raw begin/end markers for systrace, the profiler keeps exclusive durations, allocation
+// counts and bytes written so that a summary table can be printed at the end of the command.
+// Recording is a no-op until Enable() is called.
+namespace profiler {
+
+void Enable();
+void Disable();
+bool IsEnabled();
+
+// Discards everything recorded so far. Mainly for tests.
+void Reset();
+
+// Called by the archive writers for every chunk of bytes that reaches the output.
+void RecordBytesWritten(size_t bytes);
+
+// Called by the allocation hooks linked into the aapt2 binary.
+void RecordAllocation(size_t bytes);
+
+// Totals for one phase, excluding time spent in nested spans.
+struct PhaseStats {
+  int64_t duration_us = 0;
+  size_t spans = 0;
+  size_t allocations = 0;
+  size_t allocated_bytes = 0;
+  size_t bytes_written = 0;
+};
+
+PhaseStats GetPhaseStats(ProfilePhase phase);
+
+// Prints a table of the phase totals and the slowest input files.
+void PrintSummary(std::ostream* out);
+
+// Writes every recorded span as a complete ('X') event in the Chrome trace JSON format, loadable
+// in chrome://tracing or Perfetto.
+bool WriteChromeTrace(const std::string& path, std::string* out_error);
+
+}  // namespace profiler
+
+// RAII object recording a span of the given phase, optionally attributed to an input file.
+class ProfileScope {
+ public:
+  explicit ProfileScope(ProfilePhase phase);
+  ProfileScope(ProfilePhase phase, const std::string& file);
+  ~ProfileScope();
+
+ private:
+  bool active_;
+};
+
+// Enables the profiler for the lifetime of the object. When it goes out of scope, the summary is
+// printed to stderr and the Chrome trace is written to `path`. An empty path disables profiling.
+class FlushProfile {
+ public:
+  explicit FlushProfile(const std::string& path);
+  ~FlushProfile();
+
+ private:
+  std::string path_;
+};
+
+#define PROFILE_PHASE(phase) ProfileScope __p(phase)
+#define PROFILE_PHASE_FILE(phase, file) ProfileScope __p(phase, file)
+
+#define PROFILE_FLUSH(path) FlushProfile __fp(path)
+
+}  // namespace aapt
+
+#endif  // AAPT_PROFILER_H
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "trace/Profiler.h"
+
+#include <sstream>
+
+#include "android-base/file.h"
+
+#include "test/Fixture.h"
+#include "test/Test.h"
+
+using ::testing::HasSubstr;
+
+namespace aapt {
+
+class ProfilerTest : public TestDirectoryFixture {
+ public:
+  void SetUp() override {
+    TestDirectoryFixture::SetUp();
+    profiler::Reset();
+    profiler::Enable();
+  }
+
+  void TearDown() override {
+    profiler::Disable();
+    profiler::Reset();
+    TestDirectoryFixture::TearDown();
+  }
+};
+
+TEST_F(ProfilerTest, NothingRecordedWhenDisabled) {
+  profiler::Disable();
+  {
+    PROFILE_PHASE(ProfilePhase::kParse);
+    profiler::RecordBytesWritten(10u);
+  }
+  EXPECT_EQ(0u, profiler::GetPhaseStats(ProfilePhase::kParse).spans);
+}
+
+TEST_F(ProfilerTest, NestedPhasesAreExclusive) {
+  {
+    PROFILE_PHASE_FILE(ProfilePhase::kParse, "res/values/strings.xml");
+    profiler::RecordAllocation(8u);
+    {
+      PROFILE_PHASE(ProfilePhase::kWrite);
+      profiler::RecordAllocation(16u);
+      profiler::RecordBytesWritten(100u);
+    }
+  }
+
+  profiler::PhaseStats parse = profiler::GetPhaseStats(ProfilePhase::kParse);
+  EXPECT_EQ(1u, parse.spans);
+  EXPECT_EQ(1u, parse.allocations);
+  EXPECT_EQ(8u, parse.allocated_bytes);
+  EXPECT_EQ(0u, parse.bytes_written);
+
+  profiler::PhaseStats write = profiler::GetPhaseStats(ProfilePhase::kWrite);
+  EXPECT_EQ(1u, write.spans);
+  EXPECT_EQ(1u, write.allocations);
+  EXPECT_EQ(16u, write.allocated_bytes);
+  EXPECT_EQ(100u, write.bytes_written);
+}
+
+TEST_F(ProfilerTest, SummaryListsPhasesAndFiles) {
+  {
+    PROFILE_PHASE_FILE(ProfilePhase::kFlatten, "res/layout/main.xml");
+  }
+
+  std::stringstream summary;
+  profiler::PrintSummary(&summary);
+  EXPECT_THAT(summary.str(), HasSubstr("flatten"));
+  EXPECT_THAT(summary.str(), HasSubstr("compress"));
+  EXPECT_THAT(summary.str(), HasSubstr("res/layout/main.xml"));
+}
+
+TEST_F(ProfilerTest, WriteChromeTrace) {
+  {
+    PROFILE_PHASE_FILE(ProfilePhase::kParse, "res/values/\"quoted\".xml");
+  }
+
+  const std::string path = GetTestPath("profile.json");
+  std::string error;
+  ASSERT_TRUE(profiler::WriteChromeTrace(path, &error)) << error;
+
+  std::string contents;
+  ASSERT_TRUE(android::base::ReadFileToString(path, &contents));
+  EXPECT_THAT(contents, HasSubstr("\"traceEvents\""));
+  EXPECT_THAT(contents, HasSubstr("\"ph\": \"X\""));
+  EXPECT_THAT(contents, HasSubstr("\"cat\": \"parse\""));
+  EXPECT_THAT(contents, HasSubstr("res/values/\\\"quoted\\\".xml"));
+}
+
+}  // namespace aapt
@@ -17,6 +17,7 @@
 #include "TraceBuffer.h"
 
 #include <chrono>
+#include <mutex>
 #include <sstream>
 #include <unistd.h>
 #include <vector>
@@ -42,6 +43,7 @@ struct TracePoint {
   char type;
 };
 
+std::mutex traces_lock;
 std::vector<TracePoint> traces;
 
 int64_t GetTime() noexcept {
@@ -53,6 +55,7 @@ int64_t GetTime() noexcept {
 
 void AddWithTime(const std::string& tag, char type, int64_t time) noexcept {
   TracePoint t = {getpid(), time, tag, type};
+  std::lock_guard<std::mutex> lock(traces_lock);
   traces.emplace_back(t);
 }
 
@@ -76,6 +79,7 @@ void Flush(const std::string& basePath) {
     return;
   }
 
+  std::lock_guard<std::mutex> lock(traces_lock);
   for(const TracePoint& trace : traces) {
     fprintf(f, "{\"ts\" : \"%" PRIu64 "\", \"ph\" : \"%c\", \"tid\" : \"%d\" , \"pid\" : \"%d\", "
             "\"name\" : \"%s\" },\n", trace.time, trace.type, 0, trace.tid, trace.tag.c_str());
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util/TaskGraph.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "android-base/logging.h"
+
+#include "util/Util.h"
+
+namespace aapt {
+
+size_t TaskGraph::AddTask(std::function<bool()> task) {
+  tasks_.push_back(Task{std::move(task), {}, 0});
+  return tasks_.size() - 1;
+}
+
+void TaskGraph::AddDependency(size_t task, size_t dependency) {
+  CHECK(task < tasks_.size() && dependency < tasks_.size()) << "invalid task index";
+  tasks_[dependency].dependents.push_back(task);
+  tasks_[task].dependency_count++;
+}
+
+bool TaskGraph::HasCycle() const {
+  std::vector<size_t> pending(tasks_.size());
+  std::vector<size_t> ready;
+  for (size_t i = 0; i < tasks_.size(); i++) {
+    pending[i] = tasks_[i].dependency_count;
+    if (pending[i] == 0) {
+      ready.push_back(i);
+    }
+  }
+
+  // Every task that can be ordered after its dependencies is visited exactly once. Tasks on or
+  // behind a cycle are never visited.
+  size_t visited = 0;
+  while (!ready.empty()) {
+    const size_t task = ready.back();
+    ready.pop_back();
+    visited++;
+    for (size_t dependent : tasks_[task].dependents) {
+      if (--pending[dependent] == 0) {
+        ready.push_back(dependent);
+      }
+    }
+  }
+  return visited != tasks_.size();
+}
+
+std::vector<TaskGraph::Result> TaskGraph::Run(size_t num_threads) {
+  CHECK(!HasCycle()) << "task graph has a cycle";
+
+  results_.assign(tasks_.size(), Result::kSkipped);
+  if (tasks_.empty()) {
+    return results_;
+  }
+
+  num_threads = std::max<size_t>(1u, std::min(num_threads, tasks_.size()));
+  queues_.clear();
+  for (size_t i = 0; i < num_threads; i++) {
+    queues_.push_back(util::make_unique<WorkQueue>());
+  }
+
+  pending_dependencies_.clear();
+  for (const Task& task : tasks_) {
+    pending_dependencies_.push_back(task.dependency_count);
+  }
+  done_.assign(tasks_.size(), false);
+  remaining_ = tasks_.size();
+  ready_ = 0;
+  steal_count_ = 0;
+
+  // Spread the tasks without dependencies over the workers up front. Everything else is queued by
+  // the worker that finishes its last dependency.
+  size_t next_queue = 0;
+  for (size_t i = 0; i < tasks_.size(); i++) {
+    if (tasks_[i].dependency_count == 0) {
+      queues_[next_queue++ % num_threads]->tasks.push_back(i);
+      ready_++;
+    }
+  }
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; i++) {
+    threads.emplace_back(&TaskGraph::WorkerLoop, this, i);
+  }
+  WorkerLoop(0);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  queues_.clear();
+  return results_;
+}
+
+void TaskGraph::WorkerLoop(size_t worker) {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return ready_ > 0 || remaining_ == 0; });
+      if (remaining_ == 0) {
+        return;
+      }
+
+      // Claim one of the queued tasks. Which queue it is taken from is decided without holding the
+      // graph lock.
+      ready_--;
+    }
+
+    const size_t task = TakeTask(worker);
+    FinishTask(worker, task, tasks_[task].run());
+  }
+}
+
+size_t TaskGraph::TakeTask(size_t worker) {
+  // A task was claimed before calling this, so there is always at least one task queued for this
+  // worker somewhere. A sweep can still come up empty while other workers move tasks around.
+  while (true) {
+    {
+      WorkQueue* queue = queues_[worker].get();
+      std::lock_guard<std::mutex> lock(queue->mutex);
+      if (!queue->tasks.empty()) {
+        const size_t task = queue->tasks.back();
+        queue->tasks.pop_back();
+        return task;
+      }
+    }
+
+    for (size_t i = 1; i < queues_.size(); i++) {
+      WorkQueue* victim = queues_[(worker + i) % queues_.size()].get();
+      std::lock_guard<std::mutex> lock(victim->mutex);
+      if (!victim->tasks.empty()) {
+        const size_t task = victim->tasks.front();
+        victim->tasks.pop_front();
+        steal_count_++;
+        return task;
+      }
+    }
+    std::this_thread::yield();
+  }
+}
+
+void TaskGraph::FinishTask(size_t worker, size_t task, bool succeeded) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  results_[task] = succeeded ? Result::kSucceeded : Result::kFailed;
+  done_[task] = true;
+  remaining_--;
+
+  if (!succeeded) {
+    SkipDependents(task);
+  } else {
+    WorkQueue* queue = queues_[worker].get();
+    for (size_t dependent : tasks_[task].dependents) {
+      if (--pending_dependencies_[dependent] == 0 && !done_[dependent]) {
+        {
+          std::lock_guard<std::mutex> queue_lock(queue->mutex);
+          queue->tasks.push_back(dependent);
+        }
+        ready_++;
+        cv_.notify_one();
+      }
+    }
+  }
+
+  if (remaining_ == 0) {
+    cv_.notify_all();
+  }
+}
+
+void TaskGraph::SkipDependents(size_t task) {
+  std::vector<size_t> to_skip = tasks_[task].dependents;
+  while (!to_skip.empty()) {
+    const size_t dependent = to_skip.back();
+    to_skip.pop_back();
+    if (done_[dependent]) {
+      continue;
+    }
+
+    done_[dependent] = true;
+    results_[dependent] = Result::kSkipped;
+    remaining_--;
+    to_skip.insert(to_skip.end(), tasks_[dependent].dependents.begin(),
+                   tasks_[dependent].dependents.end());
+  }
+}
+
+}  // namespace aapt
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AAPT_UTIL_TASKGRAPH_H
+#define AAPT_UTIL_TASKGRAPH_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "android-base/macros.h"
+
+namespace aapt {
+
+// A set of tasks with dependencies between them, run on a fixed number of worker threads.
+//
+// Each worker owns a queue of ready tasks. A worker runs the newest task of its own queue first, so
+// a task that becomes ready when its last dependency finishes runs on the same thread, right after
+// it. Workers whose queue is empty steal the oldest task from the queue of another worker.
+class TaskGraph {
+ public:
+  enum class Result {
+    kSucceeded,
+    kFailed,
+    // The task was not run because one of its dependencies failed or was skipped.
+    kSkipped,
+  };
+
+  TaskGraph() = default;
+
+  // Adds a task and returns its index. The task returns false when it fails.
+  size_t AddTask(std::function<bool()> task);
+
+  // Makes `task` wait for `dependency` to succeed before running.
+  void AddDependency(size_t task, size_t dependency);
+
+  // Returns true if the dependencies form a cycle, in which case the graph cannot be run.
+  bool HasCycle() const;
+
+  // Runs every task on `num_threads` workers (one of which is the calling thread) and returns the
+  // result of each task, by index. The graph must not have a cycle.
+  std::vector<Result> Run(size_t num_threads);
+
+  // The number of tasks that were taken from the queue of another worker during the last run.
+  size_t GetStealCount() const {
+    return steal_count_.load();
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(TaskGraph);
+
+  struct Task {
+    std::function<bool()> run;
+    std::vector<size_t> dependents;
+    size_t dependency_count = 0;
+  };
+
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<size_t> tasks;
+  };
+
+  void WorkerLoop(size_t worker);
+  size_t TakeTask(size_t worker);
+  void FinishTask(size_t worker, size_t task, bool succeeded);
+  void SkipDependents(size_t task);
+
+  std::vector<Task> tasks_;
+
+  // State of the current run. Everything below is guarded by mutex_, except the queues, which have
+  // their own locks so that taking a task does not contend with the bookkeeping.
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+  std::vector<size_t> pending_dependencies_;
+  std::vector<bool> done_;
+  std::vector<Result> results_;
+  size_t remaining_ = 0;
+  // The number of tasks sitting in the queues that no worker has claimed yet.
+  size_t ready_ = 0;
+  std::atomic<size_t> steal_count_{0};
+};
+
+}  // namespace aapt
+
+#endif  // AAPT_UTIL_TASKGRAPH_H
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "util/TaskGraph.h"
+
+#include <atomic>
+#include <mutex>
+
+#include "test/Test.h"
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+
+namespace aapt {
+
+using Result = TaskGraph::Result;
+
+TEST(TaskGraphTest, RunsEveryTask) {
+  TaskGraph graph;
+  std::atomic<int> count{0};
+  for (int i = 0; i < 100; i++) {
+    graph.AddTask([&count]() {
+      count++;
+      return true;
+    });
+  }
+
+  std::vector<Result> results = graph.Run(4u);
+  EXPECT_THAT(count.load(), Eq(100));
+  EXPECT_THAT(results.size(), Eq(100u));
+  for (Result result : results) {
+    EXPECT_THAT(result, Eq(Result::kSucceeded));
+  }
+}
+
+TEST(TaskGraphTest, RunsDependenciesFirst) {
+  TaskGraph graph;
+  std::mutex mutex;
+  std::vector<int> order;
+  auto record = [&](int id) {
+    return [&, id]() {
+      std::lock_guard<std::mutex> lock(mutex);
+      order.push_back(id);
+      return true;
+    };
+  };
+
+  // 0 <- 1 <- 2, and 3 needs both 0 and 2.
+  size_t t0 = graph.AddTask(record(0));
+  size_t t1 = graph.AddTask(record(1));
+  size_t t2 = graph.AddTask(record(2));
+  size_t t3 = graph.AddTask(record(3));
+  graph.AddDependency(t1, t0);
+  graph.AddDependency(t2, t1);
+  graph.AddDependency(t3, t0);
+  graph.AddDependency(t3, t2);
+
+  graph.Run(4u);
+  EXPECT_THAT(order, ElementsAre(0, 1, 2, 3));
+}
+
+TEST(TaskGraphTest, FailureSkipsDependents) {
+  TaskGraph graph;
+  size_t failing = graph.AddTask([]() { return false; });
+  size_t dependent = graph.AddTask([]() { return true; });
+  size_t transitive = graph.AddTask([]() { return true; });
+  graph.AddTask([]() { return true; });
+  graph.AddDependency(dependent, failing);
+  graph.AddDependency(transitive, dependent);
+
+  EXPECT_THAT(graph.Run(2u),
+              ElementsAre(Result::kFailed, Result::kSkipped, Result::kSkipped,
+                          Result::kSucceeded));
+}
+
+TEST(TaskGraphTest, DetectsCycle) {
+  TaskGraph graph;
+  size_t a = graph.AddTask([]() { return true; });
+  size_t b = graph.AddTask([]() { return true; });
+  graph.AddDependency(a, b);
+  EXPECT_FALSE(graph.HasCycle());
+
+  graph.AddDependency(b, a);
+  EXPECT_TRUE(graph.HasCycle());
+}
+
+TEST(TaskGraphTest, EmptyGraph) {
+  TaskGraph graph;
+  EXPECT_TRUE(graph.Run(4u).empty());
+}
+
+}  // namespace aapt
@@ -71,6 +71,9 @@ android::StringPiece TrimTrailingWhitespace(const android::StringPiece& str);
 // trailing whitespace.
 android::StringPiece TrimWhitespace(const android::StringPiece& str);
 
+// Escapes the string so that it can be placed between double quotes in a JSON document.
+std::string EscapeJson(const android::StringPiece& str);
+
 // Tests that the string is a valid Java class name.
 bool IsJavaClassName(const android::StringPiece& str);
 
@@ -33,6 +33,12 @@ TEST(UtilTest, TrimOnlyWhitespace) {
   EXPECT_THAT(trimmed, SizeIs(0u));
 }
 
+TEST(UtilTest, EscapeJson) {
+  EXPECT_EQ("plain", util::EscapeJson("plain"));
+  EXPECT_EQ("\\\"quoted\\\" back\\\\slash", util::EscapeJson("\"quoted\" back\\slash"));
+  EXPECT_EQ("line\\nbreak\\u0001", util::EscapeJson("line\nbreak\x01"));
+}
+
 TEST(UtilTest, StringEndsWith) {
   EXPECT_TRUE(util::EndsWith("hello.xml", ".xml"));
 }
@@ -30,6 +30,11 @@ namespace xml {
 
 constexpr char kXmlNamespaceSep = 1;
 
+// The most input handed to expat at once. Streams over mapped files return the whole file from a
+// single Next() call, and every event of the data passed to expat is queued before the first one
+// is consumed.
+constexpr size_t kMaxParseChunkSize = 16u * 1024u;
+
 XmlPullParser::XmlPullParser(InputStream* in) : in_(in), empty_(), depth_(0) {
   parser_ = XML_ParserCreateNS(nullptr, kXmlNamespaceSep);
   XML_SetUserData(parser_, this);
@@ -52,6 +57,7 @@ XmlPullParser::Event XmlPullParser::Next() {
     return currentEvent;
   }
 
+  free_events_.push_back(std::move(event_queue_.front()));
   event_queue_.pop();
   while (event_queue_.empty()) {
     const char* buffer = nullptr;
@@ -60,21 +66,24 @@ XmlPullParser::Event XmlPullParser::Next() {
     if (!in_->Next(reinterpret_cast<const void**>(&buffer), &buffer_size)) {
       if (in_->HadError()) {
         error_ = in_->GetError();
-        event_queue_.push(EventData{Event::kBadDocument});
+        PushEvent(Event::kBadDocument, 0).line_number = 0;
         break;
       }
 
       done = true;
+    } else if (buffer_size > kMaxParseChunkSize) {
+      in_->BackUp(buffer_size - kMaxParseChunkSize);
+      buffer_size = kMaxParseChunkSize;
     }
 
     if (XML_Parse(parser_, buffer, buffer_size, done) == XML_STATUS_ERROR) {
       error_ = XML_ErrorString(XML_GetErrorCode(parser_));
-      event_queue_.push(EventData{Event::kBadDocument});
+      PushEvent(Event::kBadDocument, 0).line_number = 0;
       break;
     }
 
     if (done) {
-      event_queue_.push(EventData{Event::kEndDocument, 0, 0});
+      PushEvent(Event::kEndDocument, 0).line_number = 0;
     }
   }
 
@@ -182,14 +191,34 @@ XmlPullParser::const_iterator XmlPullParser::begin_attributes() const {
 }
 
 XmlPullParser::const_iterator XmlPullParser::end_attributes() const {
-  return event_queue_.front().attributes.end();
+  return event_queue_.front().attributes.begin() + event_queue_.front().attribute_count;
 }
 
 size_t XmlPullParser::attribute_count() const {
   if (event() != Event::kStartElement) {
     return 0;
   }
-  return event_queue_.front().attributes.size();
+  return event_queue_.front().attribute_count;
+}
+
+XmlPullParser::EventData& XmlPullParser::PushEvent(Event event, size_t depth) {
+  if (free_events_.empty()) {
+    event_queue_.emplace();
+  } else {
+    // Moving keeps the heap storage of the strings, so assigning similar values to them later does
+    // not allocate.
+    event_queue_.push(std::move(free_events_.back()));
+    free_events_.pop_back();
+  }
+
+  EventData& data = event_queue_.back();
+  data.event = event;
+  data.line_number = XML_GetCurrentLineNumber(parser_);
+  data.depth = depth;
+  data.data1.clear();
+  data.data2.clear();
+  data.attribute_count = 0;
+  return data;
 }
 
 /**
@@ -216,10 +245,11 @@ void XMLCALL XmlPullParser::StartNamespaceHandler(void* user_data,
   XmlPullParser* parser = reinterpret_cast<XmlPullParser*>(user_data);
   std::string namespace_uri = uri != nullptr ? uri : std::string();
   parser->namespace_uris_.push(namespace_uri);
-  parser->event_queue_.push(
-      EventData{Event::kStartNamespace,
-                XML_GetCurrentLineNumber(parser->parser_), parser->depth_++,
-                prefix != nullptr ? prefix : std::string(), namespace_uri});
+  EventData& data = parser->PushEvent(Event::kStartNamespace, parser->depth_++);
+  if (prefix != nullptr) {
+    data.data1.assign(prefix);
+  }
+  data.data2.assign(namespace_uri);
 }
 
 void XMLCALL XmlPullParser::StartElementHandler(void* user_data,
@@ -227,55 +257,48 @@ void XMLCALL XmlPullParser::StartElementHandler(void* user_data,
                                                 const char** attrs) {
   XmlPullParser* parser = reinterpret_cast<XmlPullParser*>(user_data);
 
-  EventData data = {Event::kStartElement,
-                    XML_GetCurrentLineNumber(parser->parser_),
-                    parser->depth_++};
+  EventData& data = parser->PushEvent(Event::kStartElement, parser->depth_++);
   SplitName(name, &data.data1, &data.data2);
 
+  size_t count = 0;
   while (*attrs) {
-    Attribute attribute;
+    if (count == data.attributes.size()) {
+      data.attributes.emplace_back();
+    }
+    Attribute& attribute = data.attributes[count++];
     SplitName(*attrs++, &attribute.namespace_uri, &attribute.name);
-    attribute.value = *attrs++;
-
-    // Insert in sorted order.
-    auto iter = std::lower_bound(data.attributes.begin(), data.attributes.end(),
-                                 attribute);
-    data.attributes.insert(iter, std::move(attribute));
+    attribute.value.assign(*attrs++);
   }
+  data.attribute_count = count;
 
-  // Move the structure into the queue (no copy).
-  parser->event_queue_.push(std::move(data));
+  // Expat rejects duplicate attributes, so the order is strict.
+  std::sort(data.attributes.begin(), data.attributes.begin() + count);
 }
 
 void XMLCALL XmlPullParser::CharacterDataHandler(void* user_data, const char* s,
                                                  int len) {
   XmlPullParser* parser = reinterpret_cast<XmlPullParser*>(user_data);
 
-  parser->event_queue_.push(EventData{Event::kText, XML_GetCurrentLineNumber(parser->parser_),
-                                      parser->depth_, std::string(s, len)});
+  parser->PushEvent(Event::kText, parser->depth_).data1.assign(s, len);
 }
 
 void XMLCALL XmlPullParser::EndElementHandler(void* user_data,
                                               const char* name) {
   XmlPullParser* parser = reinterpret_cast<XmlPullParser*>(user_data);
 
-  EventData data = {Event::kEndElement,
-                    XML_GetCurrentLineNumber(parser->parser_),
-                    --(parser->depth_)};
+  EventData& data = parser->PushEvent(Event::kEndElement, --(parser->depth_));
   SplitName(name, &data.data1, &data.data2);
-
-  // Move the data into the queue (no copy).
-  parser->event_queue_.push(std::move(data));
 }
 
 void XMLCALL XmlPullParser::EndNamespaceHandler(void* user_data,
                                                 const char* prefix) {
   XmlPullParser* parser = reinterpret_cast<XmlPullParser*>(user_data);
 
-  parser->event_queue_.push(
-      EventData{Event::kEndNamespace, XML_GetCurrentLineNumber(parser->parser_),
-                --(parser->depth_), prefix != nullptr ? prefix : std::string(),
-                parser->namespace_uris_.top()});
+  EventData& data = parser->PushEvent(Event::kEndNamespace, --(parser->depth_));
+  if (prefix != nullptr) {
+    data.data1.assign(prefix);
+  }
+  data.data2.assign(parser->namespace_uris_.top());
   parser->namespace_uris_.pop();
 }
 
@@ -283,25 +306,19 @@ void XMLCALL XmlPullParser::CommentDataHandler(void* user_data,
                                                const char* comment) {
   XmlPullParser* parser = reinterpret_cast<XmlPullParser*>(user_data);
 
-  parser->event_queue_.push(EventData{Event::kComment,
-                                      XML_GetCurrentLineNumber(parser->parser_),
-                                      parser->depth_, comment});
+  parser->PushEvent(Event::kComment, parser->depth_).data1.assign(comment);
 }
 
 void XMLCALL XmlPullParser::StartCdataSectionHandler(void* user_data) {
   XmlPullParser* parser = reinterpret_cast<XmlPullParser*>(user_data);
 
-  parser->event_queue_.push(EventData{Event::kCdataStart,
-                                      XML_GetCurrentLineNumber(parser->parser_),
-                                      parser->depth_ });
+  parser->PushEvent(Event::kCdataStart, parser->depth_);
 }
 
 void XMLCALL XmlPullParser::EndCdataSectionHandler(void* user_data) {
   XmlPullParser* parser = reinterpret_cast<XmlPullParser*>(user_data);
 
-  parser->event_queue_.push(EventData{Event::kCdataEnd,
-                                      XML_GetCurrentLineNumber(parser->parser_),
-                                      parser->depth_ });
+  parser->PushEvent(Event::kCdataEnd, parser->depth_);
 }
 
 Maybe<StringPiece> FindAttribute(const XmlPullParser* parser,
@@ -170,12 +170,20 @@ class XmlPullParser : public IPackageDeclStack {
     size_t depth;
     std::string data1;
     std::string data2;
+
+    // Only the first `attribute_count` attributes belong to the event. The rest are left over from
+    // an earlier event and keep their storage for the next one.
     std::vector<Attribute> attributes;
+    size_t attribute_count = 0;
   };
 
+  // Queues an event, reusing the storage of an event that was already consumed.
+  EventData& PushEvent(Event event, size_t depth);
+
   io::InputStream* in_;
   XML_Parser parser_;
   std::queue<EventData> event_queue_;
+  std::vector<EventData> free_events_;
   std::string error_;
   const std::string empty_;
   size_t depth_;
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+
+#include "android-base/file.h"
+#include "android-base/logging.h"
+#include "androidfw/ConfigDescription.h"
+#include "benchmark/benchmark.h"
+
+#include "Diagnostics.h"
+#include "ResourceParser.h"
+#include "ResourceTable.h"
+#include "io/Data.h"
+#include "io/FileStream.h"
+#include "util/Files.h"
+#include "xml/XmlPullParser.h"
+
+namespace aapt {
+
+// A values file the size of a large translated strings.xml.
+static std::string MakeStringsFile(int count) {
+  std::string contents = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+      "<resources xmlns:xliff=\"urn:oasis:names:tc:xliff:document:1.2\">\n";
+  for (int i = 0; i < count; i++) {
+    const std::string index = std::to_string(i);
+    contents += "  <!-- Description of string " + index + " -->\n";
+    contents += "  <string name=\"string_" + index + "\" translatable=\"true\">Value of the " +
+                "string number <xliff:g id=\"n\">" + index + "</xliff:g>, <b>bold</b></string>\n";
+  }
+  contents += "</resources>\n";
+  return contents;
+}
+
+class StringsFileBenchmark : public benchmark::Fixture {
+ public:
+  void SetUp(const benchmark::State&) override {
+    const std::string contents = MakeStringsFile(50000);
+    CHECK(android::base::WriteStringToFile(contents, file_.path));
+    size_ = contents.size();
+  }
+
+ protected:
+  void ParseValues(io::InputStream* in, benchmark::State& state) {
+    StdErrDiagnostics diag;
+    ResourceTable table;
+    xml::XmlPullParser xml_parser(in);
+    ResourceParser parser(&diag, &table, Source(file_.path), {});
+    if (!parser.Parse(&xml_parser)) {
+      state.SkipWithError("failed to parse values file");
+    }
+  }
+
+  TemporaryFile file_;
+  size_t size_ = 0;
+};
+
+// Small buffered reads through a FileInputStream, as compile read values files before.
+BENCHMARK_DEFINE_F(StringsFileBenchmark, ParseValuesFileStream)(benchmark::State& state) {
+  for (auto _ : state) {
+    io::FileInputStream in(file_.path);
+    ParseValues(&in, state);
+  }
+  state.SetBytesProcessed(state.iterations() * size_);
+}
+BENCHMARK_REGISTER_F(StringsFileBenchmark, ParseValuesFileStream)->Unit(benchmark::kMillisecond);
+
+// The whole file mapped and handed to the parser in chunks, as compile reads values files now.
+BENCHMARK_DEFINE_F(StringsFileBenchmark, ParseValuesMmap)(benchmark::State& state) {
+  for (auto _ : state) {
+    Maybe<android::FileMap> map = file::MmapPath(file_.path, nullptr);
+    io::MmappedData in(std::move(map.value()));
+    ParseValues(&in, state);
+  }
+  state.SetBytesProcessed(state.iterations() * size_);
+}
+BENCHMARK_REGISTER_F(StringsFileBenchmark, ParseValuesMmap)->Unit(benchmark::kMillisecond);
+
+// Only the pull parser, without building the resource table.
+BENCHMARK_DEFINE_F(StringsFileBenchmark, PullParserEventsMmap)(benchmark::State& state) {
+  for (auto _ : state) {
+    Maybe<android::FileMap> map = file::MmapPath(file_.path, nullptr);
+    io::MmappedData in(std::move(map.value()));
+    xml::XmlPullParser parser(&in);
+    size_t events = 0;
+    while (xml::XmlPullParser::IsGoodEvent(parser.Next())) {
+      events++;
+    }
+    benchmark::DoNotOptimize(events);
+  }
+  state.SetBytesProcessed(state.iterations() * size_);
+}
+BENCHMARK_REGISTER_F(StringsFileBenchmark, PullParserEventsMmap)->Unit(benchmark::kMillisecond);
+
+}  // namespace aapt
+
+BENCHMARK_MAIN();
@@ -62,5 +62,46 @@ TEST(XmlPullParserTest, NextChildNodeTraversesCorrectly) {
   EXPECT_THAT(parser.event(), Eq(XmlPullParser::Event::kEndDocument));
 }
 
+TEST(XmlPullParserTest, ParsesInputLargerThanOneChunk) {
+  // Elements alternate between two and no attributes so that the storage reused from an earlier
+  // event never leaks into the next one.
+  std::string str = "<resources>";
+  constexpr int kCount = 5000;
+  for (int i = 0; i < kCount; i++) {
+    if (i % 2 == 0) {
+      str += "<string translatable=\"false\" name=\"s" + std::to_string(i) + "\">v</string>";
+    } else {
+      str += "<string>v</string>";
+    }
+  }
+  str += "</resources>";
+  StringInputStream input(str);
+  XmlPullParser parser(&input);
+
+  int count = 0;
+  while (XmlPullParser::IsGoodEvent(parser.Next())) {
+    if (parser.event() != Event::kStartElement || parser.element_name() != "string") {
+      continue;
+    }
+
+    if (count % 2 == 0) {
+      ASSERT_THAT(parser.attribute_count(), Eq(2u));
+      auto iter = parser.begin_attributes();
+      EXPECT_THAT(iter->name, StrEq("name"));
+      EXPECT_THAT(iter->value, StrEq("s" + std::to_string(count)));
+      ++iter;
+      EXPECT_THAT(iter->name, StrEq("translatable"));
+      EXPECT_THAT(++iter, Eq(parser.end_attributes()));
+    } else {
+      EXPECT_THAT(parser.attribute_count(), Eq(0u));
+      EXPECT_THAT(parser.begin_attributes(), Eq(parser.end_attributes()));
+    }
+    count++;
+  }
+
+  EXPECT_THAT(parser.event(), Eq(Event::kEndDocument));
+  EXPECT_THAT(count, Eq(kCount));
+}
+
 }  // namespace xml
 }  // namespace aapt